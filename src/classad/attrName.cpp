@@ -0,0 +1,116 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#include "classad/common.h"
+#include "classad/classad_containers.h"
+#include "classad/attrName.h"
+#include <mutex>
+#include <tuple>
+
+using namespace std;
+
+namespace classad {
+
+// An interned name's entry in the table, keyed by exact spelling.
+struct AttrNameEntry {
+	explicit AttrNameEntry( size_t h ) : hash( h ), refs( 0 ) {}
+
+		// The case-insensitive hash of the name
+	size_t hash;
+		// The number of AttrNames holding the name.  It only goes from 0
+		// to 1 or from 1 to 0 with the table locked, so an entry found
+		// in the table under the lock is never one being removed.
+	std::atomic<size_t> refs;
+};
+
+typedef classad_unordered<string, AttrNameEntry> AttrNameTable;
+
+// The table and its lock are never destroyed, since AttrNames in other
+// static objects may be released after them at exit.
+static AttrNameTable &getAttrNameTable()
+{
+	static AttrNameTable *table = new AttrNameTable;
+	return *table;
+}
+
+static std::mutex &getAttrNameTableLock()
+{
+	static std::mutex *lock = new std::mutex;
+	return *lock;
+}
+
+void AttrName::
+Intern( const string &str )
+{
+	std::lock_guard<std::mutex> guard( getAttrNameTableLock() );
+	AttrNameTable &table = getAttrNameTable();
+	AttrNameTable::iterator itr = table.find( str );
+	if( itr == table.end() ) {
+		itr = table.emplace( std::piecewise_construct,
+			std::forward_as_tuple( str ),
+			std::forward_as_tuple( ClassadAttrNameHash()( str ) ) ).first;
+	}
+	itr->second.refs.fetch_add( 1, std::memory_order_relaxed );
+	name = &itr->first;
+	hash = itr->second.hash;
+	refs = &itr->second.refs;
+}
+
+void AttrName::
+Release( const string *name, std::atomic<size_t> *refs )
+{
+		// Dropping a reference that isn't the last needs no lock.
+	size_t count = refs->load( std::memory_order_relaxed );
+	while( count > 1 ) {
+		if( refs->compare_exchange_weak( count, count - 1, std::memory_order_acq_rel ) ) {
+			return;
+		}
+	}
+
+	std::lock_guard<std::mutex> guard( getAttrNameTableLock() );
+	if( refs->fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+		AttrNameTable &table = getAttrNameTable();
+		table.erase( table.find( *name ) );
+	}
+}
+
+AttrName::
+AttrName()
+{
+	static const AttrName *empty = new AttrName( string() );
+	name = empty->name;
+	hash = empty->hash;
+	refs = empty->refs;
+	refs->fetch_add( 1, std::memory_order_relaxed );
+}
+
+AttrName::
+AttrName( const string &str )
+{
+	Intern( str );
+}
+
+AttrName::
+AttrName( const char *str )
+{
+	Intern( str ? str : "" );
+}
+
+} // classad
@@ -20,6 +20,7 @@
 
 #include "classad/common.h"
 #include "classad/classad.h"
+#include "classad/evalProfile.h"
 
 using namespace std;
 
@@ -39,7 +40,7 @@ AttributeReference::
 AttributeReference( ExprTree *tree, const string &attrname, bool absolut )
 {
 	parentScope = NULL;
-	attributeStr = attrname;
+	attributeStr = AttrName( attrname );
 	expr = tree;
 	absolute = absolut;
 }
@@ -109,7 +110,7 @@ bool AttributeReference::SetComponents( ExprTree *tree, const std::string &attr,
 		if (expr) delete expr;
 		expr = tree;
 	}
-	attributeStr = attr;
+	attributeStr = AttrName( attr );
 	absolute = abs;
 	return true;
 }
@@ -201,7 +202,10 @@ _Evaluate (EvalState &state, Value &val) const
 			}
 			state.depth_remaining--;
 
-			rval = tree->Evaluate( state, val );
+			{
+				EvalProfileScope profile( EvalProfile::ATTRIBUTE, attributeStr );
+				rval = tree->Evaluate( state, val );
+			}
 
 			state.depth_remaining++;
 
@@ -249,7 +253,10 @@ _Evaluate (EvalState &state, Value &val, ExprTree *&sig ) const
 			}
 			state.depth_remaining--;
 
-			rval = tree->Evaluate( state, val );
+			{
+				EvalProfileScope profile( EvalProfile::ATTRIBUTE, attributeStr );
+				rval = tree->Evaluate( state, val );
+			}
 
 			state.depth_remaining++;
 
@@ -0,0 +1,518 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#include "classad/common.h"
+#include "classad/batchConstraint.h"
+#include "classad/literals.h"
+#include "classad/attrrefs.h"
+#include <functional>
+
+using namespace std;
+
+namespace classad {
+
+// Integers up to this magnitude convert to double exactly, so they can be
+// compared in the floating point column.
+static const long long MAX_EXACT_INT = 1LL << 53;
+
+// Tables for && and ||, indexed by left * 4 + right, and for !.  These
+// follow Operation::doLogical().
+static const unsigned char andTable[16] = {
+	0, 0, 0, 0,		// false && x
+	0, 1, 2, 3,		// true && x
+	0, 2, 2, 3,		// undefined && x
+	3, 3, 3, 3		// error && x
+};
+static const unsigned char orTable[16] = {
+	0, 1, 2, 3,		// false || x
+	1, 1, 1, 1,		// true || x
+	2, 1, 2, 3,		// undefined || x
+	3, 3, 3, 3		// error || x
+};
+static const unsigned char notTable[4] = { 1, 0, 2, 3 };
+
+// Names that LookupInScope() treats specially when they aren't attributes
+// of the ad; references to these are always evaluated ad by ad.
+static bool
+isSpecialName( const string &name )
+{
+	return strcasecmp( name.c_str(), "toplevel" ) == 0 ||
+		strcasecmp( name.c_str(), "root" ) == 0 ||
+		strcasecmp( name.c_str(), "self" ) == 0 ||
+		strcasecmp( name.c_str(), "parent" ) == 0 ||
+		strcasecmp( name.c_str(), "my" ) == 0 ||
+		strcasecmp( name.c_str(), "CurrentTime" ) == 0;
+}
+
+static bool
+isMetaOp( Operation::OpKind op )
+{
+	return op == Operation::META_EQUAL_OP || op == Operation::META_NOT_EQUAL_OP;
+}
+
+// The result of comparing two strings, given the sign of their difference,
+// as in Operation::compareStrings()
+static unsigned char
+stringCompareResult( Operation::OpKind op, int cmp )
+{
+	switch( op ) {
+	case Operation::LESS_THAN_OP:			return cmp < 0;
+	case Operation::LESS_OR_EQUAL_OP:		return cmp <= 0;
+	case Operation::EQUAL_OP:				return cmp == 0;
+	case Operation::META_EQUAL_OP:			return cmp == 0;
+	case Operation::NOT_EQUAL_OP:			return cmp != 0;
+	case Operation::META_NOT_EQUAL_OP:		return cmp != 0;
+	case Operation::GREATER_OR_EQUAL_OP:	return cmp >= 0;
+	case Operation::GREATER_THAN_OP:		return cmp > 0;
+	default:
+		CLASSAD_EXCEPT( "Unexpected comparison operator %d", op );
+		return 0;
+	}
+}
+
+// Compare a column of numbers with a constant.  Rows that aren't numbers
+// keep the result already stored for them.  The loop has no branches or
+// calls, so that the compiler can vectorize it.
+template <class Compare>
+static void
+compareColumn( const double *numbers, const unsigned char *isNumber,
+			   int count, double constant, unsigned char *out )
+{
+	Compare compare;
+	for( int i = 0; i < count; i++ ) {
+		unsigned char r = compare( numbers[i], constant );
+		out[i] = isNumber[i] ? r : out[i];
+	}
+}
+
+BatchConstraint::
+BatchConstraint()
+{
+	numColumnLeaves = 0;
+}
+
+BatchConstraint::
+~BatchConstraint()
+{
+	for( vector<Node>::iterator itr = nodes.begin(); itr != nodes.end(); itr++ ) {
+		delete itr->compiled;
+	}
+}
+
+bool BatchConstraint::
+Initialize( const ExprTree *constraint )
+{
+	for( vector<Node>::iterator itr = nodes.begin(); itr != nodes.end(); itr++ ) {
+		delete itr->compiled;
+	}
+	nodes.clear();
+	numColumnLeaves = 0;
+
+	if( !constraint ) {
+		return false;
+	}
+	compileNode( constraint );
+	return true;
+}
+
+int BatchConstraint::
+compileNode( const ExprTree *tree )
+{
+	const ExprTree *expr = tree->self();
+	if( expr->GetKind() != ExprTree::OP_NODE ) {
+		return addScalarLeaf( tree );
+	}
+
+	Operation::OpKind op = Operation::__NO_OP__;
+	ExprTree *child1 = NULL, *child2 = NULL, *child3 = NULL;
+	((const Operation*)expr)->GetComponents( op, child1, child2, child3 );
+
+	if( op == Operation::PARENTHESES_OP && child1 ) {
+		return compileNode( child1 );
+	}
+
+	if( ( op == Operation::LOGICAL_AND_OP || op == Operation::LOGICAL_OR_OP ) &&
+		child1 && child2 ) {
+		Node node;
+		node.left = compileNode( child1 );
+		node.right = compileNode( child2 );
+		node.kind = op == Operation::LOGICAL_AND_OP ? AND_NODE : OR_NODE;
+		node.tree = expr;
+		node.compiled = NULL;
+		nodes.push_back( node );
+		return (int)nodes.size() - 1;
+	}
+
+	if( op == Operation::LOGICAL_NOT_OP && child1 ) {
+		Node node;
+		node.left = compileNode( child1 );
+		node.right = -1;
+		node.kind = NOT_NODE;
+		node.tree = expr;
+		node.compiled = NULL;
+		nodes.push_back( node );
+		return (int)nodes.size() - 1;
+	}
+
+	Node node;
+	if( makeColumnLeaf( expr, node ) ) {
+		numColumnLeaves++;
+		nodes.push_back( node );
+		return (int)nodes.size() - 1;
+	}
+	return addScalarLeaf( tree );
+}
+
+int BatchConstraint::
+addScalarLeaf( const ExprTree *tree )
+{
+	Node node;
+	node.kind = SCALAR_LEAF;
+	node.left = node.right = -1;
+	node.tree = tree;
+	node.compiled = ClassAdGetExpressionCompiling() ? CompiledExpr::Compile( tree ) : NULL;
+	nodes.push_back( node );
+	return (int)nodes.size() - 1;
+}
+
+// Makes a column leaf out of a comparison between an unscoped attribute
+// reference and a literal.
+bool BatchConstraint::
+makeColumnLeaf( const ExprTree *tree, Node &node )
+{
+	Operation::OpKind op = Operation::__NO_OP__;
+	ExprTree *child1 = NULL, *child2 = NULL, *child3 = NULL;
+	((const Operation*)tree)->GetComponents( op, child1, child2, child3 );
+
+	if( op < Operation::__COMPARISON_START__ || op > Operation::__COMPARISON_END__ ||
+		!child1 || !child2 ) {
+		return false;
+	}
+
+	const ExprTree *ref = child1->self();
+	const ExprTree *lit = child2->self();
+	if( ref->GetKind() == ExprTree::LITERAL_NODE &&
+		lit->GetKind() == ExprTree::ATTRREF_NODE ) {
+			// literal op attr; swap the operands and the operator
+		std::swap( ref, lit );
+		switch( op ) {
+		case Operation::LESS_THAN_OP:			op = Operation::GREATER_THAN_OP; break;
+		case Operation::LESS_OR_EQUAL_OP:		op = Operation::GREATER_OR_EQUAL_OP; break;
+		case Operation::GREATER_OR_EQUAL_OP:	op = Operation::LESS_OR_EQUAL_OP; break;
+		case Operation::GREATER_THAN_OP:		op = Operation::LESS_THAN_OP; break;
+		default: break;
+		}
+	}
+	if( ref->GetKind() != ExprTree::ATTRREF_NODE ||
+		lit->GetKind() != ExprTree::LITERAL_NODE ) {
+		return false;
+	}
+
+	ExprTree *scope = NULL;
+	string attr;
+	bool absolute = false;
+	((const AttributeReference*)ref)->GetComponents( scope, attr, absolute );
+	if( scope || absolute || isSpecialName( attr ) ) {
+		return false;
+	}
+
+	Value val;
+	long long i;
+	bool b;
+	((const Literal*)lit)->GetValue( val );
+	switch( val.GetType() ) {
+	case Value::INTEGER_VALUE:
+		val.IsIntegerValue( i );
+		if( i > MAX_EXACT_INT || i < -MAX_EXACT_INT ) {
+			return false;
+		}
+		node.litNumber = (double)i;
+		break;
+	case Value::REAL_VALUE:
+		val.IsRealValue( node.litNumber );
+		break;
+	case Value::BOOLEAN_VALUE:
+		val.IsBooleanValue( b );
+		node.litNumber = b ? 1 : 0;
+		break;
+	case Value::STRING_VALUE:
+		val.IsStringValue( node.litString );
+		node.litNumber = 0;
+		break;
+	case Value::UNDEFINED_VALUE:
+			// x == undefined is always undefined, but x =?= undefined is
+			// a common test.
+		if( !isMetaOp( op ) ) {
+			return false;
+		}
+		node.litNumber = 0;
+		break;
+	default:
+		return false;
+	}
+
+	node.kind = COLUMN_LEAF;
+	node.left = node.right = -1;
+	node.tree = tree;
+	node.compiled = NULL;
+	node.attr = AttrName( attr );
+	node.op = op;
+	node.litType = val.GetType();
+	return true;
+}
+
+void BatchConstraint::
+Evaluate( const vector<const ClassAd*> &ads, vector<bool> &matches ) const
+{
+	int count = (int)ads.size();
+	matches.assign( count, false );
+	if( nodes.empty() || count == 0 ) {
+		return;
+	}
+
+	vector<unsigned char> results( nodes.size() * CHUNK_SIZE );
+	const unsigned char *root = &results[( nodes.size() - 1 ) * CHUNK_SIZE];
+	for( int start = 0; start < count; start += CHUNK_SIZE ) {
+		int n = count - start < CHUNK_SIZE ? count - start : CHUNK_SIZE;
+		evalChunk( &ads[start], n, &results[0] );
+		for( int i = 0; i < n; i++ ) {
+			if( root[i] == RESULT_TRUE ) {
+				matches[start + i] = true;
+			}
+		}
+	}
+}
+
+void BatchConstraint::
+evalChunk( const ClassAd * const *ads, int count, unsigned char *results ) const
+{
+	double numbers[CHUNK_SIZE];
+	unsigned char isNumber[CHUNK_SIZE];
+
+	for( size_t n = 0; n < nodes.size(); n++ ) {
+		const Node &node = nodes[n];
+		unsigned char *out = results + n * CHUNK_SIZE;
+		const unsigned char *left = node.left >= 0 ? results + node.left * CHUNK_SIZE : NULL;
+		const unsigned char *right = node.right >= 0 ? results + node.right * CHUNK_SIZE : NULL;
+
+		switch( node.kind ) {
+		case COLUMN_LEAF:
+			gatherColumn( node, ads, count, numbers, isNumber, out );
+			switch( node.op ) {
+			case Operation::LESS_THAN_OP:
+				compareColumn< std::less<double> >( numbers, isNumber, count, node.litNumber, out );
+				break;
+			case Operation::LESS_OR_EQUAL_OP:
+				compareColumn< std::less_equal<double> >( numbers, isNumber, count, node.litNumber, out );
+				break;
+			case Operation::EQUAL_OP:
+			case Operation::META_EQUAL_OP:
+				compareColumn< std::equal_to<double> >( numbers, isNumber, count, node.litNumber, out );
+				break;
+			case Operation::NOT_EQUAL_OP:
+			case Operation::META_NOT_EQUAL_OP:
+				compareColumn< std::not_equal_to<double> >( numbers, isNumber, count, node.litNumber, out );
+				break;
+			case Operation::GREATER_OR_EQUAL_OP:
+				compareColumn< std::greater_equal<double> >( numbers, isNumber, count, node.litNumber, out );
+				break;
+			case Operation::GREATER_THAN_OP:
+				compareColumn< std::greater<double> >( numbers, isNumber, count, node.litNumber, out );
+				break;
+			default:
+				CLASSAD_EXCEPT( "Unexpected comparison operator %d", node.op );
+			}
+			break;
+
+		case SCALAR_LEAF:
+			for( int i = 0; i < count; i++ ) {
+				evalScalar( node, ads[i], out[i] );
+			}
+			break;
+
+		case AND_NODE:
+			for( int i = 0; i < count; i++ ) {
+				out[i] = andTable[left[i] * 4 + right[i]];
+			}
+			break;
+
+		case OR_NODE:
+			for( int i = 0; i < count; i++ ) {
+				out[i] = orTable[left[i] * 4 + right[i]];
+			}
+			break;
+
+		case NOT_NODE:
+			for( int i = 0; i < count; i++ ) {
+				out[i] = notTable[left[i]];
+			}
+			break;
+		}
+	}
+}
+
+// Gathers the attribute of a column leaf from each ad.  Rows whose value
+// is a number (for the comparison to be made as a number) go into the
+// numbers column for the comparison kernel; the result of every other row
+// is worked out here and stored in out.
+void BatchConstraint::
+gatherColumn( const Node &node, const ClassAd * const *ads, int count,
+			  double *numbers, unsigned char *isNumber, unsigned char *out ) const
+{
+	bool meta = isMetaOp( node.op );
+	bool litIsNumber = node.litType == Value::INTEGER_VALUE ||
+		node.litType == Value::REAL_VALUE || node.litType == Value::BOOLEAN_VALUE;
+		// the result of =?= or =!= for operands of different types
+	unsigned char differ = node.op == Operation::META_EQUAL_OP ? RESULT_FALSE : RESULT_TRUE;
+		// the result when the attribute is undefined
+	unsigned char undef = RESULT_UNDEF;
+	if( meta ) {
+		undef = node.litType == Value::UNDEFINED_VALUE ? (unsigned char)!differ : differ;
+	}
+
+	for( int i = 0; i < count; i++ ) {
+		numbers[i] = 0;
+		isNumber[i] = 0;
+
+		const ExprTree *tree = ads[i]->Lookup( node.attr );
+		if( !tree ) {
+				// The attribute may still be found in another scope.
+			if( ads[i]->alternateScope || ads[i]->GetParentScope() ) {
+				evalScalar( node, ads[i], out[i] );
+			} else {
+				out[i] = undef;
+			}
+			continue;
+		}
+		tree = tree->self();
+		if( tree->GetKind() != ExprTree::LITERAL_NODE ) {
+			evalScalar( node, ads[i], out[i] );
+			continue;
+		}
+
+		Value::NumberFactor factor;
+		const Value &val = ((const Literal*)tree)->getValue( factor );
+		if( factor != Value::NO_FACTOR ) {
+			evalScalar( node, ads[i], out[i] );
+			continue;
+		}
+
+		Value::ValueType type = val.GetType();
+		if( meta && type != node.litType ) {
+			out[i] = differ;
+			continue;
+		}
+
+		long long ival;
+		bool bval;
+		const char *sval;
+		switch( type ) {
+		case Value::INTEGER_VALUE:
+			val.IsIntegerValue( ival );
+			if( !litIsNumber ) {
+				out[i] = RESULT_ERROR;
+			} else if( ival > MAX_EXACT_INT || ival < -MAX_EXACT_INT ) {
+				evalScalar( node, ads[i], out[i] );
+			} else {
+				numbers[i] = (double)ival;
+				isNumber[i] = 1;
+			}
+			break;
+
+		case Value::REAL_VALUE:
+			if( !litIsNumber ) {
+				out[i] = RESULT_ERROR;
+			} else {
+				val.IsRealValue( numbers[i] );
+				isNumber[i] = 1;
+			}
+			break;
+
+		case Value::BOOLEAN_VALUE:
+			if( !litIsNumber ) {
+				out[i] = RESULT_ERROR;
+			} else {
+				val.IsBooleanValue( bval );
+				numbers[i] = bval ? 1 : 0;
+				isNumber[i] = 1;
+			}
+			break;
+
+		case Value::STRING_VALUE:
+			if( node.litType != Value::STRING_VALUE ) {
+				out[i] = RESULT_ERROR;
+			} else {
+				val.IsStringValue( sval );
+				int cmp = meta ? strcmp( sval, node.litString.c_str() ) :
+					strcasecmp( sval, node.litString.c_str() );
+				out[i] = stringCompareResult( node.op, cmp );
+			}
+			break;
+
+		case Value::UNDEFINED_VALUE:
+			out[i] = undef;
+			break;
+
+		case Value::ERROR_VALUE:
+			out[i] = RESULT_ERROR;
+			break;
+
+		default:
+			evalScalar( node, ads[i], out[i] );
+			break;
+		}
+	}
+}
+
+void BatchConstraint::
+evalScalar( const Node &node, const ClassAd *ad, unsigned char &out ) const
+{
+	EvalState state;
+	Value val;
+	bool rval;
+
+	state.SetScopes( ad );
+	if( node.compiled ) {
+		rval = node.compiled->Evaluate( state, val );
+	} else {
+		rval = node.tree->Evaluate( state, val );
+	}
+	if( rval ) {
+		out = resultOf( val );
+	} else {
+		out = RESULT_ERROR;
+	}
+}
+
+// The value of a leaf as an operand of the logical operators
+unsigned char BatchConstraint::
+resultOf( const Value &val )
+{
+	bool b;
+	if( val.IsBooleanValueEquiv( b ) ) {
+		return b ? RESULT_TRUE : RESULT_FALSE;
+	}
+	if( val.IsUndefinedValue() ) {
+		return RESULT_UNDEF;
+	}
+	return RESULT_ERROR;
+}
+
+} // classad
@@ -0,0 +1,715 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#include "classad/common.h"
+#include "classad/binaryCodec.h"
+#include "classad/classadCache.h"
+#include "classad/literals.h"
+#include "classad/attrrefs.h"
+#include "classad/operators.h"
+#include "classad/fnCall.h"
+#include "classad/exprList.h"
+#include "classad/exprArena.h"
+#include "classad/util.h"
+
+using namespace std;
+
+namespace classad {
+
+// The encoding of an expression is a tag byte followed by the contents of
+// the node.  Integers are sent as variable length (7 bits per byte,
+// low bits first) and signed ones zig-zag encoded, so small values of
+// either sign take a single byte.  Reals are the 8 bytes of the IEEE
+// double, low byte first.  Strings are the length followed by the bytes.
+enum {
+	TAG_UNDEFINED = 0,
+	TAG_ERROR,
+	TAG_TRUE,
+	TAG_FALSE,
+	TAG_INTEGER,	// signed value
+	TAG_REAL,		// double
+	TAG_STRING,		// string
+	TAG_ABSTIME,	// signed seconds, signed offset
+	TAG_RELTIME,	// double
+	TAG_FACTOR,		// factor byte, then an INTEGER or REAL node
+	TAG_ATTRREF,	// flags byte, [scope expression], name
+	TAG_OPERATION,	// operator byte, byte with a bit per child, children
+	TAG_FNCALL,		// name, count, arguments
+	TAG_CLASSAD,	// count, (name, expression) pairs
+	TAG_LIST,		// count, expressions
+	TAG_TEXT		// string in old ClassAd syntax
+};
+
+// Flags of TAG_ATTRREF
+enum {
+	ATTRREF_ABSOLUTE = 0x01,
+	ATTRREF_SCOPED = 0x02
+};
+
+// A name is sent as a number N followed, for the first two forms, by a
+// string:
+//   N == 0:         the name, not put in the dictionary
+//   N odd:          the name, put in the dictionary as entry N/2
+//   N even, N > 0:  dictionary entry N/2 - 1
+static const unsigned int MAX_DICTIONARY_SIZE = 1 << 16;
+
+// Nesting deeper than this is taken to be a malformed buffer, rather
+// than risk running out of stack decoding it.
+static const int MAX_DEPTH = 1000;
+
+// The operands an operation node has, as a bit per child
+static unsigned char
+operandMask( Operation::OpKind op )
+{
+	switch( op ) {
+	case Operation::PARENTHESES_OP:
+	case Operation::UNARY_PLUS_OP:
+	case Operation::UNARY_MINUS_OP:
+	case Operation::LOGICAL_NOT_OP:
+	case Operation::BITWISE_NOT_OP:
+		return 1;
+	case Operation::TERNARY_OP:
+		return 7;
+	default:
+		return 3;
+	}
+}
+
+static void
+putNumber( string &buffer, unsigned long long val )
+{
+	while( val >= 0x80 ) {
+		buffer += (char)( ( val & 0x7f ) | 0x80 );
+		val >>= 7;
+	}
+	buffer += (char)val;
+}
+
+static bool
+getNumber( const char *&buf, const char *end, unsigned long long &val )
+{
+	val = 0;
+	for( int shift = 0; shift < 64; shift += 7 ) {
+		if( buf >= end ) {
+			return false;
+		}
+		unsigned char ch = (unsigned char)*buf++;
+		val |= (unsigned long long)( ch & 0x7f ) << shift;
+		if( !( ch & 0x80 ) ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+putSigned( string &buffer, long long val )
+{
+	putNumber( buffer, ( (unsigned long long)val << 1 ) ^ (unsigned long long)( val >> 63 ) );
+}
+
+static bool
+getSigned( const char *&buf, const char *end, long long &val )
+{
+	unsigned long long u;
+	if( !getNumber( buf, end, u ) ) {
+		return false;
+	}
+	val = (long long)( ( u >> 1 ) ^ ( ~( u & 1 ) + 1 ) );
+	return true;
+}
+
+static void
+putReal( string &buffer, double val )
+{
+	unsigned long long bits;
+	memcpy( &bits, &val, sizeof( bits ) );
+	for( int i = 0; i < 8; i++ ) {
+		buffer += (char)( bits & 0xff );
+		bits >>= 8;
+	}
+}
+
+static bool
+getReal( const char *&buf, const char *end, double &val )
+{
+	if( end - buf < 8 ) {
+		return false;
+	}
+	unsigned long long bits = 0;
+	for( int i = 7; i >= 0; i-- ) {
+		bits = ( bits << 8 ) | (unsigned char)buf[i];
+	}
+	buf += 8;
+	memcpy( &val, &bits, sizeof( val ) );
+	return true;
+}
+
+static void
+putString( string &buffer, const char *str, size_t len )
+{
+	putNumber( buffer, len );
+	buffer.append( str, len );
+}
+
+static bool
+getString( const char *&buf, const char *end, const char *&str, size_t &len )
+{
+	unsigned long long n;
+	if( !getNumber( buf, end, n ) || n > (unsigned long long)( end - buf ) ) {
+		return false;
+	}
+	str = buf;
+	len = (size_t)n;
+	buf += len;
+	return true;
+}
+
+
+ClassAdBinaryUnParser::
+ClassAdBinaryUnParser()
+{
+	useDictionary = false;
+	textUnparser.SetOldClassAd( true, true );
+}
+
+ClassAdBinaryUnParser::
+~ClassAdBinaryUnParser()
+{
+}
+
+void ClassAdBinaryUnParser::
+UnparseAttr( string &buffer, const string &name, const ExprTree *expr )
+{
+	unparseName( buffer, name );
+	Unparse( buffer, expr );
+}
+
+void ClassAdBinaryUnParser::
+Unparse( string &buffer, const ExprTree *expr )
+{
+	if( !expr ) {
+		buffer += (char)TAG_ERROR;
+		return;
+	}
+
+	switch( expr->GetKind() ) {
+	case ExprTree::EXPR_ENVELOPE: {
+			// The text the expression was cached under is old ClassAd
+			// syntax (see ClassAd::InsertViaCache()), and the receiver
+			// can use it to look the expression up in its own cache.
+		const string &str = ((const CachedExprEnvelope*)expr)->get_unparsed_str();
+		buffer += (char)TAG_TEXT;
+		putString( buffer, str.data(), str.size() );
+		break;
+	}
+
+	case ExprTree::LITERAL_NODE:
+		if( !unparseLiteral( buffer, (const Literal*)expr ) ) {
+			unparseText( buffer, expr );
+		}
+		break;
+
+	case ExprTree::ATTRREF_NODE: {
+		ExprTree *scope = NULL;
+		string attr;
+		bool absolute = false;
+		((const AttributeReference*)expr)->GetComponents( scope, attr, absolute );
+		buffer += (char)TAG_ATTRREF;
+		buffer += (char)( ( absolute ? ATTRREF_ABSOLUTE : 0 ) | ( scope ? ATTRREF_SCOPED : 0 ) );
+		if( scope ) {
+			Unparse( buffer, scope );
+		}
+		unparseName( buffer, attr );
+		break;
+	}
+
+	case ExprTree::OP_NODE: {
+		Operation::OpKind op = Operation::__NO_OP__;
+		ExprTree *child1 = NULL, *child2 = NULL, *child3 = NULL;
+		((const Operation*)expr)->GetComponents( op, child1, child2, child3 );
+		buffer += (char)TAG_OPERATION;
+		buffer += (char)op;
+		buffer += (char)( ( child1 ? 1 : 0 ) | ( child2 ? 2 : 0 ) | ( child3 ? 4 : 0 ) );
+		if( child1 ) Unparse( buffer, child1 );
+		if( child2 ) Unparse( buffer, child2 );
+		if( child3 ) Unparse( buffer, child3 );
+		break;
+	}
+
+	case ExprTree::FN_CALL_NODE: {
+		string fnName;
+		vector<ExprTree*> args;
+		((const FunctionCall*)expr)->GetComponents( fnName, args );
+		buffer += (char)TAG_FNCALL;
+		unparseName( buffer, fnName );
+		putNumber( buffer, args.size() );
+		for( vector<ExprTree*>::const_iterator itr = args.begin(); itr != args.end(); itr++ ) {
+			Unparse( buffer, *itr );
+		}
+		break;
+	}
+
+	case ExprTree::CLASSAD_NODE: {
+		const ClassAd *ad = (const ClassAd*)expr;
+		buffer += (char)TAG_CLASSAD;
+		putNumber( buffer, ad->size() );
+		for( ClassAd::const_iterator itr = ad->begin(); itr != ad->end(); itr++ ) {
+			UnparseAttr( buffer, itr->first, itr->second );
+		}
+		break;
+	}
+
+	case ExprTree::EXPR_LIST_NODE: {
+		vector<ExprTree*> exprs;
+		((const ExprList*)expr)->GetComponents( exprs );
+		buffer += (char)TAG_LIST;
+		putNumber( buffer, exprs.size() );
+		for( vector<ExprTree*>::const_iterator itr = exprs.begin(); itr != exprs.end(); itr++ ) {
+			Unparse( buffer, *itr );
+		}
+		break;
+	}
+
+	default:
+		unparseText( buffer, expr );
+		break;
+	}
+}
+
+void ClassAdBinaryUnParser::
+unparseName( string &buffer, const string &name )
+{
+	if( useDictionary ) {
+		classad_unordered<string, unsigned int>::const_iterator itr = dictionary.find( name );
+		if( itr != dictionary.end() ) {
+			putNumber( buffer, ( (unsigned long long)itr->second + 1 ) << 1 );
+			return;
+		}
+		if( dictionary.size() < MAX_DICTIONARY_SIZE ) {
+			unsigned int index = (unsigned int)dictionary.size();
+			dictionary[name] = index;
+			putNumber( buffer, ( (unsigned long long)index << 1 ) | 1 );
+			putString( buffer, name.data(), name.size() );
+			return;
+		}
+	}
+	putNumber( buffer, 0 );
+	putString( buffer, name.data(), name.size() );
+}
+
+bool ClassAdBinaryUnParser::
+unparseLiteral( string &buffer, const Literal *lit )
+{
+	Value::NumberFactor factor;
+	const Value &val = lit->getValue( factor );
+	if( factor != Value::NO_FACTOR ) {
+		buffer += (char)TAG_FACTOR;
+		buffer += (char)factor;
+	}
+
+	long long i;
+	double d;
+	bool b;
+	const char *s;
+	int len;
+	abstime_t abst;
+	switch( val.GetType() ) {
+	case Value::UNDEFINED_VALUE:
+		buffer += (char)TAG_UNDEFINED;
+		return true;
+	case Value::ERROR_VALUE:
+		buffer += (char)TAG_ERROR;
+		return true;
+	case Value::BOOLEAN_VALUE:
+		val.IsBooleanValue( b );
+		buffer += (char)( b ? TAG_TRUE : TAG_FALSE );
+		return true;
+	case Value::INTEGER_VALUE:
+		val.IsIntegerValue( i );
+		buffer += (char)TAG_INTEGER;
+		putSigned( buffer, i );
+		return true;
+	case Value::REAL_VALUE:
+		val.IsRealValue( d );
+		buffer += (char)TAG_REAL;
+		putReal( buffer, d );
+		return true;
+	case Value::STRING_VALUE:
+		val.IsStringValue( s );
+		val.IsStringValue( len );
+		buffer += (char)TAG_STRING;
+		putString( buffer, s, len );
+		return true;
+	case Value::ABSOLUTE_TIME_VALUE:
+		val.IsAbsoluteTimeValue( abst );
+		buffer += (char)TAG_ABSTIME;
+		putSigned( buffer, abst.secs );
+		putSigned( buffer, abst.offset );
+		return true;
+	case Value::RELATIVE_TIME_VALUE:
+		val.IsRelativeTimeValue( d );
+		buffer += (char)TAG_RELTIME;
+		putReal( buffer, d );
+		return true;
+	default:
+		return false;
+	}
+}
+
+void ClassAdBinaryUnParser::
+unparseText( string &buffer, const ExprTree *expr )
+{
+	string str;
+	textUnparser.Unparse( str, expr );
+	buffer += (char)TAG_TEXT;
+	putString( buffer, str.data(), str.size() );
+}
+
+
+ClassAdBinaryParser::
+ClassAdBinaryParser()
+{
+	textParser.SetOldClassAd( true );
+	textUnparser.SetOldClassAd( true, true );
+}
+
+ClassAdBinaryParser::
+~ClassAdBinaryParser()
+{
+}
+
+bool ClassAdBinaryParser::
+ParseAttr( const char *&buf, const char *end, ClassAd &ad, bool use_cache, bool lazy )
+{
+	if( !parseName( buf, end, name ) || buf >= end || name.empty() ) {
+		return false;
+	}
+
+	ExprTree *tree = NULL;
+	if( (unsigned char)*buf == TAG_TEXT ) {
+		buf++;
+		if( !parseText( buf, end, text ) ) {
+			return false;
+		}
+		if( use_cache ) {
+			return ad.InsertViaCache( name, text, lazy );
+		}
+		tree = textParser.ParseExpression( text );
+	} else {
+			// a tree that will go into the expression cache is shared by
+			// other ads, so it should not come from the arena of this one
+		unsigned char tag = (unsigned char)*buf;
+		bool shared = use_cache && ClassAdGetExpressionCaching() &&
+			name[0] != '\'' && tag >= TAG_ATTRREF && tag <= TAG_FNCALL;
+		ExprArenaScope heap( shared ? NULL : ExprArena::Current() );
+		tree = parseExpr( buf, end, 0 );
+	}
+	if( !tree ) {
+		return false;
+	}
+
+	ExprTree::NodeKind kind = tree->GetKind();
+	if( kind == ExprTree::LITERAL_NODE ) {
+			// like the fast literal parsing of getClassAdEx(), literals
+			// bypass the cache
+		return ad.InsertLiteral( name, (Literal*)tree );
+	}
+	if( use_cache && ClassAdGetExpressionCaching() && name[0] != '\'' &&
+		kind != ExprTree::CLASSAD_NODE && kind != ExprTree::EXPR_LIST_NODE ) {
+			// key the cache the same way a text ad would have
+		text.clear();
+		textUnparser.Unparse( text, tree );
+		tree = CachedExprEnvelope::cache( name, tree, text );
+	}
+	if( !ad.Insert( name, tree ) ) {
+		delete tree;
+		return false;
+	}
+	return true;
+}
+
+ExprTree *ClassAdBinaryParser::
+ParseExpression( const char *&buf, const char *end )
+{
+	return parseExpr( buf, end, 0 );
+}
+
+bool ClassAdBinaryParser::
+parseName( const char *&buf, const char *end, string &str )
+{
+	unsigned long long n;
+	if( !getNumber( buf, end, n ) ) {
+		return false;
+	}
+	if( n != 0 && !( n & 1 ) ) {
+		unsigned long long index = ( n >> 1 ) - 1;
+		if( index >= dictionary.size() ) {
+			return false;
+		}
+		str = dictionary[index];
+		return true;
+	}
+
+	const char *s;
+	size_t len;
+	if( !getString( buf, end, s, len ) ) {
+		return false;
+	}
+	str.assign( s, len );
+	if( n & 1 ) {
+		unsigned long long index = n >> 1;
+		if( index >= MAX_DICTIONARY_SIZE ) {
+			return false;
+		}
+		if( index >= dictionary.size() ) {
+			dictionary.resize( index + 1 );
+		}
+		dictionary[index] = str;
+	}
+	return true;
+}
+
+bool ClassAdBinaryParser::
+parseText( const char *&buf, const char *end, string &str )
+{
+	const char *s;
+	size_t len;
+	if( !getString( buf, end, s, len ) ) {
+		return false;
+	}
+	str.assign( s, len );
+	return true;
+}
+
+ExprTree *ClassAdBinaryParser::
+parseExpr( const char *&buf, const char *end, int depth )
+{
+	if( buf >= end || depth > MAX_DEPTH ) {
+		return NULL;
+	}
+
+	Value val;
+	Value::NumberFactor factor = Value::NO_FACTOR;
+	unsigned char tag = (unsigned char)*buf++;
+	if( tag == TAG_FACTOR ) {
+		if( end - buf < 2 ) {
+			return NULL;
+		}
+		unsigned char f = (unsigned char)*buf++;
+		if( f > Value::T_FACTOR ) {
+			return NULL;
+		}
+		factor = (Value::NumberFactor)f;
+		tag = (unsigned char)*buf++;
+		if( tag != TAG_INTEGER && tag != TAG_REAL ) {
+			return NULL;
+		}
+	}
+
+	switch( tag ) {
+	case TAG_UNDEFINED:
+		return Literal::MakeUndefined();
+
+	case TAG_ERROR:
+		return Literal::MakeError();
+
+	case TAG_TRUE:
+		return Literal::MakeBool( true );
+
+	case TAG_FALSE:
+		return Literal::MakeBool( false );
+
+	case TAG_INTEGER: {
+		long long i;
+		if( !getSigned( buf, end, i ) ) {
+			return NULL;
+		}
+		if( factor == Value::NO_FACTOR ) {
+			return Literal::MakeLong( i );
+		}
+		val.SetIntegerValue( i );
+		return Literal::MakeLiteral( val, factor );
+	}
+
+	case TAG_REAL: {
+		double d;
+		if( !getReal( buf, end, d ) ) {
+			return NULL;
+		}
+		if( factor == Value::NO_FACTOR ) {
+			return Literal::MakeReal( d );
+		}
+		val.SetRealValue( d );
+		return Literal::MakeLiteral( val, factor );
+	}
+
+	case TAG_STRING: {
+		const char *s;
+		size_t len;
+		if( !getString( buf, end, s, len ) ) {
+			return NULL;
+		}
+		return Literal::MakeString( s, len );
+	}
+
+	case TAG_ABSTIME: {
+		long long secs, offset;
+		if( !getSigned( buf, end, secs ) || !getSigned( buf, end, offset ) ) {
+			return NULL;
+		}
+		abstime_t abst;
+		abst.secs = (time_t)secs;
+		abst.offset = (int)offset;
+		return Literal::MakeAbsTime( &abst );
+	}
+
+	case TAG_RELTIME: {
+		double d;
+		if( !getReal( buf, end, d ) ) {
+			return NULL;
+		}
+		val.SetRelativeTimeValue( d );
+		return Literal::MakeLiteral( val );
+	}
+
+	case TAG_ATTRREF: {
+		if( buf >= end ) {
+			return NULL;
+		}
+		unsigned char flags = (unsigned char)*buf++;
+		ExprTree *scope = NULL;
+		if( flags & ATTRREF_SCOPED ) {
+			if( !( scope = parseExpr( buf, end, depth + 1 ) ) ) {
+				return NULL;
+			}
+		}
+		string attr;
+		if( !parseName( buf, end, attr ) ) {
+			delete scope;
+			return NULL;
+		}
+		return AttributeReference::MakeAttributeReference( scope, attr,
+								( flags & ATTRREF_ABSOLUTE ) != 0 );
+	}
+
+	case TAG_OPERATION: {
+		if( end - buf < 2 ) {
+			return NULL;
+		}
+		int op = (unsigned char)*buf++;
+		unsigned char children = (unsigned char)*buf++;
+		if( op < Operation::__FIRST_OP__ || op > Operation::__LAST_OP__ ) {
+			return NULL;
+		}
+			// The elvis operator a ?: b is a TERNARY_OP with no middle child
+		if( children != operandMask( (Operation::OpKind)op ) &&
+			!( op == Operation::TERNARY_OP && children == 5 ) ) {
+			return NULL;
+		}
+		ExprTree *child[3] = { NULL, NULL, NULL };
+		for( int i = 0; i < 3; i++ ) {
+			if( ( children & ( 1 << i ) ) &&
+				!( child[i] = parseExpr( buf, end, depth + 1 ) ) ) {
+				delete child[0];
+				delete child[1];
+				return NULL;
+			}
+		}
+		return Operation::MakeOperation( (Operation::OpKind)op, child[0], child[1], child[2] );
+	}
+
+	case TAG_FNCALL: {
+		string fnName;
+		unsigned long long count;
+		if( !parseName( buf, end, fnName ) || !getNumber( buf, end, count ) ||
+			count > (unsigned long long)( end - buf ) ) {
+			return NULL;
+		}
+		vector<ExprTree*> args;
+		for( unsigned long long i = 0; i < count; i++ ) {
+			ExprTree *arg = parseExpr( buf, end, depth + 1 );
+			if( !arg ) {
+				for( vector<ExprTree*>::iterator itr = args.begin(); itr != args.end(); itr++ ) {
+					delete *itr;
+				}
+				return NULL;
+			}
+			args.push_back( arg );
+		}
+		return FunctionCall::MakeFunctionCall( fnName, args );
+	}
+
+	case TAG_CLASSAD: {
+		unsigned long long count;
+		if( !getNumber( buf, end, count ) ) {
+			return NULL;
+		}
+		ClassAd *ad = new ClassAd();
+		for( unsigned long long i = 0; i < count; i++ ) {
+			string attr;
+			ExprTree *tree = NULL;
+			if( !parseName( buf, end, attr ) ||
+				!( tree = parseExpr( buf, end, depth + 1 ) ) ) {
+				delete ad;
+				return NULL;
+			}
+			if( !ad->Insert( attr, tree ) ) {
+				delete tree;
+				delete ad;
+				return NULL;
+			}
+		}
+		return ad;
+	}
+
+	case TAG_LIST: {
+		unsigned long long count;
+		if( !getNumber( buf, end, count ) || count > (unsigned long long)( end - buf ) ) {
+			return NULL;
+		}
+		vector<ExprTree*> exprs;
+		for( unsigned long long i = 0; i < count; i++ ) {
+			ExprTree *expr = parseExpr( buf, end, depth + 1 );
+			if( !expr ) {
+				for( vector<ExprTree*>::iterator itr = exprs.begin(); itr != exprs.end(); itr++ ) {
+					delete *itr;
+				}
+				return NULL;
+			}
+			exprs.push_back( expr );
+		}
+		return ExprList::MakeExprList( exprs );
+	}
+
+	case TAG_TEXT: {
+		string str;
+		if( !parseText( buf, end, str ) ) {
+			return NULL;
+		}
+		return textParser.ParseExpression( str );
+	}
+
+	default:
+		return NULL;
+	}
+}
+
+} // classad
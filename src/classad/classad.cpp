@@ -22,7 +22,12 @@
 #include "classad/classadItor.h"
 #include "classad/source.h"
 #include "classad/sink.h"
+#include "classad/evalProfile.h"
 #include "classad/classadCache.h"
+#include "classad/compiledExpr.h"
+#include "classad/exprArena.h"
+#include <algorithm>
+#include <mutex>
 
 using namespace std;
 
@@ -55,11 +60,47 @@ bool ClassAdGetExpressionCaching()
 	return doExpressionCaching;
 }
 
+// Should repeatedly evaluated expressions be compiled.
+// The default is false.
+static bool doExpressionCompiling = false;
+
+void ClassAdSetExpressionCompiling(bool do_compiling) {
+	doExpressionCompiling = do_compiling;
+}
+
+bool ClassAdGetExpressionCompiling()
+{
+	return doExpressionCompiling;
+}
+
+// Can many threads evaluate expressions in the same ads at once.
+// The default is false.
+static bool doThreadSafeEvaluation = false;
+
+void ClassAdSetThreadSafeEvaluation(bool thread_safe) {
+	doThreadSafeEvaluation = thread_safe;
+}
+
+bool ClassAdGetThreadSafeEvaluation()
+{
+	return doThreadSafeEvaluation;
+}
+
+// The compiled expressions of an ad are guarded by one of these locks,
+// picked by the address of the ad.
+static const size_t NUM_COMPILED_EXPR_LOCKS = 64;
+
+static std::mutex &getCompiledExprLock( const ClassAd *ad )
+{
+	static std::mutex locks[NUM_COMPILED_EXPR_LOCKS];
+	return locks[( (size_t)ad / sizeof( ClassAd ) ) % NUM_COMPILED_EXPR_LOCKS];
+}
+
 // This is probably not the best place to put these. However, 
 // I am reconsidering how we want to do errors, and this may all
 // change in any case. 
-string CondorErrMsg;
-int CondorErrno;
+thread_local string CondorErrMsg;
+thread_local int CondorErrno;
 
 void ClassAdLibraryVersion(int &major, int &minor, int &patch)
 {
@@ -75,27 +116,33 @@ void ClassAdLibraryVersion(string &version_string)
     return;
 }
 
+static ReferencesBySize makeSpecialAttrNames()
+{
+	ReferencesBySize specialAttrNames;
+	specialAttrNames.insert( ATTR_TOPLEVEL );
+	specialAttrNames.insert( ATTR_ROOT );
+	specialAttrNames.insert( ATTR_SELF );
+	specialAttrNames.insert( ATTR_PARENT );
+	return specialAttrNames;
+}
+
+// These are built the first time they are used; as function-local
+// statics, that is thread-safe.
 static inline ReferencesBySize &getSpecialAttrNames()
 {
-	static ReferencesBySize specialAttrNames;
-	static bool specialAttrNames_inited = false;
-	if ( !specialAttrNames_inited ) {
-		specialAttrNames.insert( ATTR_TOPLEVEL );
-		specialAttrNames.insert( ATTR_ROOT );
-		specialAttrNames.insert( ATTR_SELF );
-		specialAttrNames.insert( ATTR_PARENT );
-		specialAttrNames_inited = true;
-	}
+	static ReferencesBySize specialAttrNames = makeSpecialAttrNames();
 	return specialAttrNames;
 }
 
+static FunctionCall *makeCurrentTimeExpr()
+{
+	vector<ExprTree*> args;
+	return FunctionCall::MakeFunctionCall( "time", args );
+}
+
 static FunctionCall *getCurrentTimeExpr()
 {
-	static classad_shared_ptr<FunctionCall> curr_time_expr;
-	if ( !curr_time_expr ) {
-		vector<ExprTree*> args;
-		curr_time_expr.reset( FunctionCall::MakeFunctionCall( "time", args ) );
-	}
+	static classad_shared_ptr<FunctionCall> curr_time_expr( makeCurrentTimeExpr() );
 	return curr_time_expr.get();
 }
 
@@ -118,12 +165,16 @@ ClassAd ()
 	do_dirty_tracking = false;
 	chained_parent_ad = NULL;
 	alternateScope = NULL;
+	compiledExprs = NULL;
+	frozenAttrs = NULL;
 }
 
 
 ClassAd::
 ClassAd (const ClassAd &ad)
 {
+	compiledExprs = NULL;
+	frozenAttrs = NULL;
     CopyFrom(ad);
 	return;
 }	
@@ -141,7 +192,7 @@ operator=(const ClassAd &rhs)
 bool ClassAd::
 CopyFrom( const ClassAd &ad )
 {
-	AttrList::const_iterator	itr;
+	const_iterator	itr;
 	ExprTree 					*tree;
 	bool                        succeeded;
 
@@ -160,7 +211,7 @@ CopyFrom( const ClassAd &ad )
 		parentScope = ad.parentScope;
 		
 		this->do_dirty_tracking = false;
-		for( itr = ad.attrList.begin( ); itr != ad.attrList.end( ); itr++ ) {
+		for( itr = ad.begin( ); itr != ad.end( ); itr++ ) {
 			if( !( tree = itr->second->Copy( ) ) ) {
 				Clear( );
 				CondorErrno = ERR_MEM_ALLOC_FAILED;
@@ -218,13 +269,13 @@ SameAs(const ExprTree *tree) const
 
        other_classad = (const ClassAd *) pSelfTree;
 
-       if (attrList.size() != other_classad->attrList.size()) {
+       if (size() != other_classad->size()) {
            is_same = false;
        } else {
            is_same = true;
            
-           AttrList::const_iterator	itr;
-           for (itr = attrList.begin(); itr != attrList.end(); itr++) {
+           const_iterator	itr;
+           for (itr = begin(); itr != end(); itr++) {
                ExprTree *this_tree;
                ExprTree *other_tree;
 
@@ -260,19 +311,111 @@ void ClassAd::
 Clear( )
 {
 	Unchain();
+	DiscardCompiledExprs();
 	AttrList::iterator	itr;
 	for( itr = attrList.begin( ); itr != attrList.end( ); itr++ ) {
 		if( itr->second ) delete itr->second;
 	}
 	attrList.clear( );
+	if( frozenAttrs ) {
+		FrozenAttrList::iterator fitr;
+		for( fitr = frozenAttrs->begin( ); fitr != frozenAttrs->end( ); fitr++ ) {
+			if( fitr->second ) delete fitr->second;
+		}
+		delete frozenAttrs;
+		frozenAttrs = NULL;
+	}
+}
+
+void ClassAd::
+_DiscardCompiledExprs( )
+{
+	delete compiledExprs;
+	compiledExprs = NULL;
+}
+
+const CompiledExpr *ClassAd::
+GetCompiledExpr( const ExprTree *tree ) const
+{
+	if( !compiledExprs ) {
+		compiledExprs = new CompiledExprTable;
+	}
+	return compiledExprs->Get( tree );
+}
+
+// Orders the entries of a frozen ad by the hash of the attribute name
+struct FrozenAttrHashLess {
+	bool operator()( const AttrList::value_type &a, const AttrList::value_type &b ) const {
+		return a.first.Hash() < b.first.Hash();
+	}
+	bool operator()( const AttrList::value_type &a, size_t hash ) const {
+		return a.first.Hash() < hash;
+	}
+};
+
+void ClassAd::
+Freeze( )
+{
+	if( frozenAttrs || attrList.empty( ) ) {
+		return;
+	}
+
+	vector< pair< AttrName, ExprTree* > > sorted( attrList.begin( ), attrList.end( ) );
+	std::sort( sorted.begin( ), sorted.end( ), FrozenAttrHashLess( ) );
+
+	frozenAttrs = new FrozenAttrList;
+	frozenAttrs->reserve( sorted.size( ) );
+	vector< pair< AttrName, ExprTree* > >::const_iterator itr;
+	for( itr = sorted.begin( ); itr != sorted.end( ); itr++ ) {
+		frozenAttrs->emplace_back( itr->first, itr->second );
+	}
+
+		// release the hash table's buckets as well as its nodes
+	AttrList( ).swap( attrList );
+}
+
+void ClassAd::
+_Thaw( )
+{
+	attrList.reserve( frozenAttrs->size( ) );
+	FrozenAttrList::const_iterator itr;
+	for( itr = frozenAttrs->begin( ); itr != frozenAttrs->end( ); itr++ ) {
+		attrList.emplace( itr->first, itr->second );
+	}
+	delete frozenAttrs;
+	frozenAttrs = NULL;
+}
+
+void ClassAd::
+_ThawForIterator( const char *method )
+{
+	string msg = "ClassAd::";
+	msg += method;
+	msg += "() thawed a frozen ad; iterate over a const ClassAd to keep it frozen\n";
+	debug_print( msg.c_str( ) );
+	_Thaw( );
+}
+
+const AttrList::value_type *ClassAd::
+_FindFrozen( const AttrName &name ) const
+{
+	FrozenAttrList::const_iterator itr;
+	itr = std::lower_bound( frozenAttrs->begin( ), frozenAttrs->end( ),
+							name.Hash( ), FrozenAttrHashLess( ) );
+	AttrNameCaseIgnEq eq;
+	for( ; itr != frozenAttrs->end( ) && itr->first.Hash( ) == name.Hash( ); itr++ ) {
+		if( eq( itr->first, name ) ) {
+			return &*itr;
+		}
+	}
+	return NULL;
 }
 
 void ClassAd::
 GetComponents( vector< pair< string, ExprTree* > > &attrs ) const
 {
 	attrs.clear( );
-	for( AttrList::const_iterator itr=attrList.begin(); itr!=attrList.end(); 
-		itr++ ) {
+	for( const_iterator itr=begin(); itr!=end(); itr++ ) {
 		attrs.emplace_back(itr->first, itr->second);
 	}
 }
@@ -283,8 +426,8 @@ GetComponents( vector< pair< string, ExprTree* > > &attrs,
 {
 	attrs.clear( );
 	for ( References::const_iterator wl_itr = whitelist.begin(); wl_itr != whitelist.end(); wl_itr++ ) {
-		AttrList::const_iterator attr_itr = attrList.find( *wl_itr );
-		if ( attr_itr != attrList.end() ) {
+		const_iterator attr_itr = find( *wl_itr );
+		if ( attr_itr != end() ) {
 			attrs.emplace_back( attr_itr->first, attr_itr->second );
 		}
 	}
@@ -334,12 +477,13 @@ InsertAttr( const string &name, long long value)
 	MarkAttributeDirty(name);
 
 	// Optimized insert of long long values that overwrite the destination value if the destination is a literal.
-	classad::ExprTree* & expr = attrList[name];
+	classad::ExprTree* & expr = _GetAttrSlot(name);
 	if (expr) {
 		if (expr->GetKind() == LITERAL_NODE) {
 			((Literal*)expr)->SetLong(value);
 			return true;
 		} else {
+			DiscardCompiledExprs();
 			delete expr;
 		}
 	}
@@ -400,12 +544,13 @@ InsertAttr( const string &name, double value)
 	MarkAttributeDirty(name);
 
 	// Optimized insert of Real values that overwrite the destination value if the destination is a literal.
-	classad::ExprTree* & expr = attrList[name];
+	classad::ExprTree* & expr = _GetAttrSlot(name);
 	if (expr) {
 		if (expr->GetKind() == LITERAL_NODE) {
 			((Literal*)expr)->SetReal(value);
 			return true;
 		} else {
+			DiscardCompiledExprs();
 			delete expr;
 		}
 	}
@@ -433,12 +578,13 @@ InsertAttr( const string &name, bool value )
 	MarkAttributeDirty(name);
 
 	// Optimized insert of bool values that overwrite the destination value if the destination is a literal.
-	classad::ExprTree* & expr = attrList[name];
+	classad::ExprTree* & expr = _GetAttrSlot(name);
 	if (expr) {
 		if (expr->GetKind() == LITERAL_NODE) {
 			((Literal*)expr)->SetBool(value);
 			return true;
 		} else {
+			DiscardCompiledExprs();
 			delete expr;
 		}
 	}
@@ -472,12 +618,13 @@ InsertAttr( const string &name, const char * str, size_t len)
 	MarkAttributeDirty(name);
 
 	// Optimized insert of long long values that overwrite the destination value if the destination is a literal.
-	classad::ExprTree* & expr = attrList[name];
+	classad::ExprTree* & expr = _GetAttrSlot(name);
 	if (expr) {
 		if (expr->GetKind() == LITERAL_NODE) {
 			((Literal*)expr)->SetString(str, len);
 			return true;
 		} else {
+			DiscardCompiledExprs();
 			delete expr;
 		}
 	}
@@ -543,7 +690,10 @@ bool ClassAd::InsertViaCache( std::string& name, const std::string & rhs, bool l
 		}
 	}
 
-	// we did not use the cache, or get a hit in the cache... parse the expression
+	// we did not use the cache, or get a hit in the cache... parse the expression.
+	// a tree that goes into the cache is shared by other ads, so it should not
+	// come from the arena of this one.
+	ExprArenaScope heap(use_cache ? NULL : ExprArena::Current());
 	ClassAdParser parser;
 	parser.SetOldClassAd(true);
 	tree = parser.ParseExpression(rhs);
@@ -639,18 +789,32 @@ bool ClassAd::Insert( const std::string& attrName, ExprTree * tree )
 	// parent of the expression is this classad
 	tree->SetParentScope( this );
 
-	pair<AttrList::iterator,bool> insert_result = attrList.emplace(attrName, tree);
-	if ( ! insert_result.second) {
+	ExprTree *&slot = _GetAttrSlot(attrName);
+	if ( slot ) {
 			// replace existing value
-		delete insert_result.first->second;
-		insert_result.first->second = tree;
+		DiscardCompiledExprs();
+		delete slot;
 	}
+	slot = tree;
 
 	MarkAttributeDirty(attrName);
 
 	return true;
 }
 
+// Returns the slot in attrList for the named attribute, adding an empty
+// one if the attribute isn't there.  The name is only interned when a new
+// slot is added.
+ExprTree *&ClassAd::_GetAttrSlot( const std::string &name )
+{
+	Thaw();
+	AttrList::iterator itr = attrList.find( AttrName::Borrow( name ) );
+	if( itr == attrList.end( ) ) {
+		itr = attrList.emplace( AttrName( name ), (ExprTree*)NULL ).first;
+	}
+	return itr->second;
+}
+
 // Optimized code for inserting literals, use when the caller has guaranteed the validity
 // of the name and literal and wants a fast code path for insertion.  This function ALWAYS
 // bypasses the classad cache, which is fine for numeral literals, but probably a bad idea
@@ -658,19 +822,13 @@ bool ClassAd::Insert( const std::string& attrName, ExprTree * tree )
 //
 bool ClassAd::InsertLiteral(const std::string & name, Literal* lit)
 {
-#if 0 // tj wonders, is this slower/faster?
-	classad::ExprTree* & ppv = attrList[name];
-	if (ppv) delete ppv;
-	ppv = lit;
-#else
-	pair<AttrList::iterator,bool> insert_result = attrList.emplace(name, lit);
-
-	if( !insert_result.second ) {
+	ExprTree *&slot = _GetAttrSlot(name);
+	if( slot ) {
 			// replace existing value
-		delete insert_result.first->second;
-		insert_result.first->second = lit;
+		DiscardCompiledExprs();
+		delete slot;
 	}
-#endif
+	slot = lit;
 	MarkAttributeDirty(name);
 	return true;
 }
@@ -689,25 +847,41 @@ DeepInsert( ExprTree *scopeExpr, const string &name, ExprTree *tree )
 ClassAd::iterator ClassAd::
 find(string const& attrName)
 {
-    return attrList.find(attrName);
+    ThawForIterator("find");
+    return attrList.find(AttrName::Borrow(attrName));
 }
  
 ClassAd::const_iterator ClassAd::
 find(string const& attrName) const
 {
-    return attrList.find(attrName);
+    if (frozenAttrs) {
+        const AttrList::value_type *entry = _FindFrozen(AttrName::Borrow(attrName));
+        return entry ? const_iterator(entry) : end();
+    }
+    return attrList.find(AttrName::Borrow(attrName));
 }
 // --- end STL-like functions
 
 // --- begin lookup methods
 ExprTree *ClassAd::
 Lookup( const string &name ) const
+{
+	return Lookup( AttrName::Borrow( name ) );
+}
+
+ExprTree *ClassAd::
+Lookup( const AttrName &name ) const
 {
 	ExprTree *tree;
 	AttrList::const_iterator itr;
+	const AttrList::value_type *entry;
 
-	itr = attrList.find( name );
-	if (itr != attrList.end()) {
+	if (frozenAttrs) {
+		if ((entry = _FindFrozen( name ))) {
+			return entry->second;
+		}
+		tree = chained_parent_ad ? chained_parent_ad->Lookup(name) : NULL;
+	} else if ((itr = attrList.find( name )) != attrList.end()) {
 		tree = itr->second;
 	} else if (chained_parent_ad != NULL) {
 		tree = chained_parent_ad->Lookup(name);
@@ -723,7 +897,11 @@ LookupIgnoreChain( const string &name ) const
 	ExprTree *tree;
 	AttrList::const_iterator itr;
 
-	itr = attrList.find( name );
+	if (frozenAttrs) {
+		const AttrList::value_type *entry = _FindFrozen( AttrName::Borrow( name ) );
+		return entry ? entry->second : NULL;
+	}
+	itr = attrList.find( AttrName::Borrow( name ) );
 	if (itr != attrList.end()) {
 		tree = itr->second;
 	} else {
@@ -752,7 +930,7 @@ LookupInScope( const string &name, const ClassAd *&finalScope ) const
 
 
 int ClassAd::
-LookupInScope(const string &name, ExprTree*& expr, EvalState &state) const
+LookupInScope(const AttrName &name, ExprTree*& expr, EvalState &state) const
 {
 	const ClassAd *current = this, *superScope;
 
@@ -773,7 +951,7 @@ LookupInScope(const string &name, ExprTree*& expr, EvalState &state) const
 		} else {
 			superScope = current->parentScope;
 		}
-		if ( getSpecialAttrNames().find(name) == getSpecialAttrNames().end() ) {
+		if ( getSpecialAttrNames().find(name.str()) == getSpecialAttrNames().end() ) {
 			// continue searching from the superScope ...
 			current = superScope;
 			if( current == this ) {		// NAC - simple loop checker
@@ -817,8 +995,10 @@ Delete( const string &name )
 	bool deleted_attribute;
 
     deleted_attribute = false;
-	AttrList::iterator itr = attrList.find( name );
+	Thaw();
+	AttrList::iterator itr = attrList.find( AttrName::Borrow( name ) );
 	if( itr != attrList.end( ) ) {
+		DiscardCompiledExprs();
 		delete itr->second;
 		attrList.erase( itr );
 		deleted_attribute = true;
@@ -865,8 +1045,10 @@ Remove( const string &name )
 	ExprTree *tree;
 
 	tree = NULL;
-	AttrList::iterator itr = attrList.find( name );
+	Thaw();
+	AttrList::iterator itr = attrList.find( AttrName::Borrow( name ) );
 	if( itr != attrList.end( ) ) {
+		DiscardCompiledExprs();
 		tree = itr->second;
 		attrList.erase( itr );
 		tree->SetParentScope( NULL );
@@ -913,8 +1095,8 @@ _SetParentScope( const ClassAd *scope )
 bool ClassAd::
 Update( const ClassAd& ad )
 {
-	AttrList::const_iterator itr;
-	for( itr=ad.attrList.begin( ); itr!=ad.attrList.end( ); itr++ ) {
+	const_iterator itr;
+	for( itr=ad.begin( ); itr!=ad.end( ); itr++ ) {
 		ExprTree * cpy = itr->second->Copy();
 		if(!Insert( itr->first, cpy )) {
 			return false;
@@ -1018,8 +1200,8 @@ Copy( ) const
 	newAd->parentScope = parentScope;
 	newAd->chained_parent_ad = chained_parent_ad;
 
-	AttrList::const_iterator	itr;
-	for( itr=attrList.begin( ); itr != attrList.end( ); itr++ ) {
+	const_iterator	itr;
+	for( itr=begin( ); itr != end( ); itr++ ) {
 		if( !( tree = itr->second->Copy( ) ) ) {
 			delete newAd;
 			CondorErrno = ERR_MEM_ALLOC_FAILED;
@@ -1056,14 +1238,14 @@ _Flatten( EvalState& state, Value&, ExprTree*& tree, int* ) const
 	Value		eval;
 	ExprTree	*etree;
 	const ClassAd *oldAd;
-	AttrList::const_iterator	itr;
+	const_iterator	itr;
 
 	tree = NULL; // Just to be safe...  wenger 2003-12-11.
 
 	oldAd = state.curAd;
 	state.curAd = this;
 
-	for( itr = attrList.begin( ); itr != attrList.end( ); itr++ ) {
+	for( itr = begin( ); itr != end( ); itr++ ) {
 		// flatten expression
 		if( !itr->second->Flatten( state, eval, etree ) ) {
 			delete newAd;
@@ -1120,8 +1302,66 @@ EvaluateAttr( const string &attr , Value &val ) const
 		case EVAL_FAIL:
 			return false;
 
-		case EVAL_OK:
+		case EVAL_OK: {
+			EvalProfileScope profile( EvalProfile::ATTRIBUTE, attr );
 			return( tree->Evaluate( state, val ) );
+		}
+
+		case EVAL_UNDEF:
+			val.SetUndefinedValue( );
+			return( true );
+
+		case EVAL_ERROR:
+			val.SetErrorValue( );
+			return( true );
+
+		default:
+			return false;
+	}
+}
+
+bool ClassAd::
+EvaluateAttrCompiled( const string &attr , Value &val ) const
+{
+	EvalState	state;
+	ExprTree	*tree;
+
+	if( !doExpressionCompiling ) {
+		return EvaluateAttr( attr, val );
+	}
+
+	state.SetScopes( this );
+	switch( LookupInScope( attr, tree, state ) ) {
+		case EVAL_FAIL:
+			return false;
+
+		case EVAL_OK: {
+			EvalProfileScope profile( EvalProfile::ATTRIBUTE, attr );
+				// The compiled form is kept by the ad that holds the
+				// expression, which may be a chained parent of the ad
+				// it was found in.
+			const ClassAd *owner = state.curAd;
+			while( owner && owner->chained_parent_ad &&
+				   owner->LookupIgnoreChain( attr ) != tree ) {
+				owner = owner->chained_parent_ad;
+			}
+			if( !owner || tree->GetKind() == CLASSAD_NODE ) {
+				return( tree->Evaluate( state, val ) );
+			}
+				// The table is filled in by const evaluation, so it needs
+				// a lock when several threads may be evaluating this ad.
+			const CompiledExpr *compiled;
+			if( doThreadSafeEvaluation ) {
+				std::lock_guard<std::mutex> guard( getCompiledExprLock( owner ) );
+				compiled = owner->GetCompiledExpr( tree );
+			} else {
+				compiled = owner->GetCompiledExpr( tree );
+			}
+			if( compiled ) {
+				return( compiled->Evaluate( state, val ) );
+			}
+			return( tree->Evaluate( state, val ) );
+		}
 
 		case EVAL_UNDEF:
 			val.SetUndefinedValue( );
@@ -2116,9 +2356,9 @@ NextAttribute( string &attr, const ExprTree *&expr )
 
 	attr = "";
 	expr = NULL;
-	if( itr==ad->attrList.end( ) ) return( false );
+	if( itr==ad->end( ) ) return( false );
 	itr++;
-	if( itr==ad->attrList.end( ) ) return( false );
+	if( itr==ad->end( ) ) return( false );
 	attr = itr->first;
 	expr = itr->second;
 	return( true );
@@ -2129,7 +2369,7 @@ bool ClassAdIterator::
 CurrentAttribute (string &attr, const ExprTree *&expr) const
 {
 	if (!ad ) return( false );
-	if( itr==ad->attrList.end( ) ) return( false );
+	if( itr==ad->end( ) ) return( false );
 	attr = itr->first;
 	expr = itr->second;
 	return true;	
@@ -2150,7 +2390,8 @@ bool ClassAd::PruneChildAttr(const std::string & attrName, bool if_child_matches
 	if ( ! chained_parent_ad)
 		return false;
 
-	AttrList::iterator itr = attrList.find(attrName);
+	Thaw();
+	AttrList::iterator itr = attrList.find(AttrName::Borrow(attrName));
 	if (itr == attrList.end())
 		return false;
 
@@ -2161,6 +2402,7 @@ bool ClassAd::PruneChildAttr(const std::string & attrName, bool if_child_matches
 	}
 
 	if (prune_it) {
+		DiscardCompiledExprs();
 		delete itr->second;
 		attrList.erase(itr);
 		return true;
@@ -2174,6 +2416,7 @@ int ClassAd::PruneChildAd()
 	
 	if (chained_parent_ad)
 	{
+		Thaw();
 		// loop through cleaning all expressions which are the same.
 		AttrList::const_iterator	itr= attrList.begin( );
 		ExprTree 					*tree;
@@ -2187,6 +2430,7 @@ int ClassAd::PruneChildAd()
 				itr++; // once 
 				// 1st remove from dirty list
 				MarkAttributeClean(rm_itr->first);
+				DiscardCompiledExprs();
 				delete rm_itr->second;
 				attrList.erase( rm_itr->first );
 				iRet++;
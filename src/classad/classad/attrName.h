@@ -0,0 +1,162 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef __CLASSAD_ATTR_NAME_H__
+#define __CLASSAD_ATTR_NAME_H__
+
+#include <string>
+#include <atomic>
+#include "classad/common.h"
+
+namespace classad {
+
+/** The name of an attribute, as used for the keys of a ClassAd.  Names
+	are interned: each distinct spelling is stored once, in a process-wide
+	table, together with its case-insensitive hash.  So ads holding the
+	same attributes share the name strings, and looking a name up in an
+	ad compares pointers and a precomputed hash rather than hashing and
+	comparing the string.  Interning is thread-safe.
+
+	Interned names are reference counted, and a name is dropped from the
+	table when the last AttrName holding it goes away, so names that
+	arrive in ads from the network don't accumulate in a long-running
+	daemon.
+
+	An AttrName converts to a const std::string &, and supports the
+	read-only std::string methods that are commonly used on attribute
+	names, so code iterating over a ClassAd can treat the key as a string.
+*/
+class AttrName
+{
+	public:
+		/// The empty name
+		AttrName();
+
+		/** Intern a name
+			@param name The attribute name, with the spelling (case) to
+				be kept when the name is unparsed.
+		*/
+		explicit AttrName( const std::string &name );
+		explicit AttrName( const char *name );
+
+		AttrName( const AttrName &other )
+			: name( other.name ), hash( other.hash ), refs( other.refs )
+		{
+			if( refs ) { refs->fetch_add( 1, std::memory_order_relaxed ); }
+		}
+
+		AttrName &operator=( const AttrName &other ) {
+			if( other.refs ) { other.refs->fetch_add( 1, std::memory_order_relaxed ); }
+			if( refs ) { Release( name, refs ); }
+			name = other.name;
+			hash = other.hash;
+			refs = other.refs;
+			return *this;
+		}
+
+		~AttrName() { if( refs ) { Release( name, refs ); } }
+
+		/** Make a name for a lookup, without interning it.  The result
+			refers to the given string, so it must not outlive it, and
+			must not be used as the key of an attribute.
+			@param name The attribute name to look up.
+		*/
+		static AttrName Borrow( const std::string &name ) {
+			return AttrName( &name, ClassadAttrNameHash()( name ) );
+		}
+
+		/// The name as a string
+		const std::string &str() const { return *name; }
+		operator const std::string &() const { return *name; }
+
+		/// The case-insensitive hash of the name
+		size_t Hash() const { return hash; }
+
+		/**@name std::string-like accessors */
+		//@{
+		const char *c_str() const { return name->c_str(); }
+		const char *data() const { return name->data(); }
+		size_t size() const { return name->size(); }
+		size_t length() const { return name->length(); }
+		bool empty() const { return name->empty(); }
+		char operator[]( size_t pos ) const { return (*name)[pos]; }
+		std::string::const_iterator begin() const { return name->begin(); }
+		std::string::const_iterator end() const { return name->end(); }
+		int compare( const std::string &s ) const { return name->compare( s ); }
+		int compare( const char *s ) const { return name->compare( s ); }
+		size_t find( const std::string &s, size_t pos = 0 ) const { return name->find( s, pos ); }
+		size_t find( const char *s, size_t pos = 0 ) const { return name->find( s, pos ); }
+		size_t find( char ch, size_t pos = 0 ) const { return name->find( ch, pos ); }
+		size_t rfind( const std::string &s, size_t pos = std::string::npos ) const { return name->rfind( s, pos ); }
+		size_t rfind( const char *s, size_t pos = std::string::npos ) const { return name->rfind( s, pos ); }
+		size_t rfind( char ch, size_t pos = std::string::npos ) const { return name->rfind( ch, pos ); }
+		std::string substr( size_t pos = 0, size_t len = std::string::npos ) const {
+			return name->substr( pos, len );
+		}
+		//@}
+
+	private:
+		AttrName( const std::string *n, size_t h ) : name( n ), hash( h ), refs( NULL ) {}
+
+		void Intern( const std::string &str );
+		static void Release( const std::string *name, std::atomic<size_t> *refs );
+
+		const std::string *name;
+		size_t hash;
+			// The interned name's reference count; NULL for a borrowed name
+		std::atomic<size_t> *refs;
+};
+
+// Comparisons are exact, like comparisons of std::string.  Interned names
+// with the same spelling are the same string, so they compare quickly.
+inline bool operator==( const AttrName &a, const AttrName &b ) {
+	return &a.str() == &b.str() || a.str() == b.str();
+}
+inline bool operator!=( const AttrName &a, const AttrName &b ) { return !( a == b ); }
+inline bool operator<( const AttrName &a, const AttrName &b ) { return a.str() < b.str(); }
+inline bool operator==( const AttrName &a, const std::string &b ) { return a.str() == b; }
+inline bool operator==( const std::string &a, const AttrName &b ) { return a == b.str(); }
+inline bool operator!=( const AttrName &a, const std::string &b ) { return a.str() != b; }
+inline bool operator!=( const std::string &a, const AttrName &b ) { return a != b.str(); }
+inline bool operator==( const AttrName &a, const char *b ) { return a.str() == b; }
+inline bool operator==( const char *a, const AttrName &b ) { return a == b.str(); }
+inline bool operator!=( const AttrName &a, const char *b ) { return a.str() != b; }
+inline bool operator!=( const char *a, const AttrName &b ) { return a != b.str(); }
+inline std::string operator+( const std::string &a, const AttrName &b ) { return a + b.str(); }
+inline std::string operator+( const AttrName &a, const std::string &b ) { return a.str() + b; }
+inline std::string operator+( const char *a, const AttrName &b ) { return a + b.str(); }
+inline std::string operator+( const AttrName &a, const char *b ) { return a.str() + b; }
+
+/// Hash for AttrName keys, using the precomputed case-insensitive hash
+struct AttrNameHash {
+	inline size_t operator()( const AttrName &n ) const { return n.Hash(); }
+};
+
+/// Case-insensitive equality for AttrName keys
+struct AttrNameCaseIgnEq {
+	inline bool operator()( const AttrName &a, const AttrName &b ) const {
+		return &a.str() == &b.str() ||
+			( a.Hash() == b.Hash() && strcasecmp( a.c_str(), b.c_str() ) == 0 );
+	}
+};
+
+} // classad
+
+#endif//__CLASSAD_ATTR_NAME_H__
@@ -61,6 +61,13 @@ class AttributeReference : public ExprTree
 		 */
 		void GetComponents( ExprTree *&expr,std::string &attr, bool &abs ) const;
 
+		/// The expression part of the reference, as from GetComponents()
+		ExprTree *GetExpr( ) const { return expr; }
+		/// The name of the attribute, without copying it
+		const std::string &GetAttributeName( ) const { return attributeStr; }
+		/// true iff the reference is absolute (i.e., .attr)
+		bool IsAbsolute( ) const { return absolute; }
+
 		/** Overwrite the components of an attribute reference
 		 * 	@param expr The expression part of the reference (NULL for
 		 * 		absolute or simple references)
@@ -113,7 +120,7 @@ class AttributeReference : public ExprTree
 
 		ExprTree	*expr;
 		bool		absolute;
-    	std::string attributeStr;
+    	AttrName attributeStr;
 };
 
 } // classad
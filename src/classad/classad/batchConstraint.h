@@ -0,0 +1,128 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef __CLASSAD_BATCH_CONSTRAINT_H__
+#define __CLASSAD_BATCH_CONSTRAINT_H__
+
+#include "classad/classad.h"
+#include "classad/operators.h"
+#include "classad/compiledExpr.h"
+#include <vector>
+
+namespace classad {
+
+/** A constraint prepared for evaluation against many ClassAds at once.
+	The constraint is split into a tree of &&, || and ! over leaves.  A
+	leaf that compares an attribute with a literal (e.g. Memory > 4096 or
+	State == "Unclaimed") is evaluated a column at a time: the attribute
+	is gathered from every ad of the batch into a contiguous array, and
+	the comparison and the logical operators are applied to whole arrays
+	in tight loops the compiler can vectorize.  Ads whose attribute isn't
+	a plain literal, and any other kind of leaf, are evaluated one ad at
+	a time, so the result is always the same as evaluating the
+	constraint in the scope of each ad.  The object holds pointers into
+	the constraint, and must not outlive it.
+*/
+class BatchConstraint
+{
+	public:
+		BatchConstraint();
+		~BatchConstraint();
+
+		/** Prepare a constraint for evaluation.
+			@param constraint The constraint.
+			@return false if the constraint is NULL, true otherwise.
+		*/
+		bool Initialize( const ExprTree *constraint );
+
+		/** Evaluate the constraint against a batch of ads.
+			@param ads The ads; the constraint is evaluated in the scope
+				of each ad, as ClassAd::EvaluateExpr() does.
+			@param matches Set to one flag per ad, true if the constraint
+				evaluated to true (or a non-zero number) for that ad.
+		*/
+		void Evaluate( const std::vector<const ClassAd*> &ads,
+					   std::vector<bool> &matches ) const;
+
+		/** Does the constraint have any leaves that are evaluated a
+			column at a time?  If not, there is no gain over evaluating
+			the constraint one ad at a time.
+		*/
+		bool IsVectorized() const { return numColumnLeaves > 0; }
+
+	private:
+		// The three-valued (plus error) logic of && and ||, as
+		// implemented by Operation::doLogical().
+		enum {
+			RESULT_FALSE = 0,
+			RESULT_TRUE = 1,
+			RESULT_UNDEF = 2,
+			RESULT_ERROR = 3
+		};
+
+		enum NodeKind {
+			COLUMN_LEAF,	// attribute compared with a literal
+			SCALAR_LEAF,	// anything else, evaluated ad by ad
+			AND_NODE,
+			OR_NODE,
+			NOT_NODE
+		};
+
+		struct Node {
+			NodeKind kind;
+			int left, right;			// child nodes, for the logical ops
+			const ExprTree *tree;		// the subtree, for the leaves
+			CompiledExpr *compiled;		// SCALAR_LEAF, may be NULL
+
+				// COLUMN_LEAF: attr op literal
+			AttrName attr;
+			Operation::OpKind op;
+			Value::ValueType litType;
+			double litNumber;
+			std::string litString;
+		};
+
+		// Ads are evaluated in chunks of this many, so that the columns
+		// of all the nodes stay in the cache.
+		enum { CHUNK_SIZE = 256 };
+
+		int compileNode( const ExprTree *tree );
+		int addScalarLeaf( const ExprTree *tree );
+		bool makeColumnLeaf( const ExprTree *tree, Node &node );
+
+		void evalChunk( const ClassAd * const *ads, int count,
+						unsigned char *results ) const;
+		void gatherColumn( const Node &node, const ClassAd * const *ads,
+						   int count, double *numbers, unsigned char *isNumber,
+						   unsigned char *out ) const;
+		void evalScalar( const Node &node, const ClassAd *ad,
+						 unsigned char &out ) const;
+		static unsigned char resultOf( const Value &val );
+
+		std::vector<Node> nodes;	// children before parents; root last
+		int numColumnLeaves;
+
+		BatchConstraint( const BatchConstraint & );            // not implemented
+		BatchConstraint &operator=( const BatchConstraint & ); // not implemented
+};
+
+} // classad
+
+#endif//__CLASSAD_BATCH_CONSTRAINT_H__
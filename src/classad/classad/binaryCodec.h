@@ -0,0 +1,146 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef __CLASSAD_BINARY_CODEC_H__
+#define __CLASSAD_BINARY_CODEC_H__
+
+#include "classad/classad.h"
+#include "classad/sink.h"
+#include "classad/source.h"
+#include <string>
+#include <vector>
+
+namespace classad {
+
+/** The version of the binary encoding produced by ClassAdBinaryUnParser.
+	Bump this whenever the encoding changes in a way older parsers can't
+	read.
+*/
+static const int BINARY_CLASSAD_VERSION = 1;
+
+/** Encodes the attributes of ClassAds in a compact binary form, which
+	ClassAdBinaryParser decodes.  Literals are sent with their type, and
+	other expressions as their parsed tree, so the receiver rebuilds them
+	without the lexer or parser.  Expressions that came from the
+	expression cache are sent as the text they were cached under, which
+	the sender has at hand and the receiver can look up in its own cache.
+
+	Attribute and function names may be sent through a dictionary: the
+	first time a name is sent it is given a number, and later uses send
+	just the number.  The dictionary lives as long as the object, so it
+	only works if every encoding made with the object is decoded, in
+	order, by a single ClassAdBinaryParser.
+*/
+class ClassAdBinaryUnParser
+{
+	public:
+		ClassAdBinaryUnParser();
+		~ClassAdBinaryUnParser();
+
+		/** Turn the name dictionary on or off; it is off by default.
+			With the dictionary off, every name is sent in full, and
+			the output can be decoded by any ClassAdBinaryParser.
+		*/
+		void SetUseDictionary( bool use ) { useDictionary = use; }
+
+		/// Forget all the names in the dictionary
+		void ClearDictionary() { dictionary.clear(); }
+
+		/** Append the encoding of an attribute.
+			@param buffer The buffer to append to.
+			@param name The name of the attribute.
+			@param expr The expression of the attribute.
+		*/
+		void UnparseAttr( std::string &buffer, const std::string &name,
+						  const ExprTree *expr );
+
+		/** Append the encoding of an expression.
+			@param buffer The buffer to append to.
+			@param expr The expression.
+		*/
+		void Unparse( std::string &buffer, const ExprTree *expr );
+
+	private:
+		void unparseName( std::string &buffer, const std::string &name );
+		bool unparseLiteral( std::string &buffer, const Literal *lit );
+		void unparseText( std::string &buffer, const ExprTree *expr );
+
+		bool useDictionary;
+		classad_unordered<std::string, unsigned int> dictionary;
+		ClassAdUnParser textUnparser;
+
+		ClassAdBinaryUnParser( const ClassAdBinaryUnParser & );            // not implemented
+		ClassAdBinaryUnParser &operator=( const ClassAdBinaryUnParser & ); // not implemented
+};
+
+/** Decodes what ClassAdBinaryUnParser encodes.  The object holds the
+	names the encoder has put in its dictionary, so an encoding that uses
+	the dictionary must be decoded by an object that has decoded all the
+	encodings made before it by the same ClassAdBinaryUnParser.
+*/
+class ClassAdBinaryParser
+{
+	public:
+		ClassAdBinaryParser();
+		~ClassAdBinaryParser();
+
+		/// Forget all the names in the dictionary
+		void ClearDictionary() { dictionary.clear(); }
+
+		/** Decode an attribute and insert it into an ad.
+			@param buf The position in the buffer, advanced past the
+				attribute.
+			@param end The end of the buffer.
+			@param ad The ad to insert the attribute into.
+			@param use_cache Insert expressions other than literals via
+				the expression cache, as ClassAd::InsertViaCache() does.
+			@param lazy Parse expressions sent as text only when they are
+				first evaluated (only with use_cache).
+			@return false if the buffer is malformed.
+		*/
+		bool ParseAttr( const char *&buf, const char *end, ClassAd &ad,
+						bool use_cache, bool lazy = false );
+
+		/** Decode an expression.
+			@param buf The position in the buffer, advanced past the
+				expression.
+			@param end The end of the buffer.
+			@return The expression, or NULL if the buffer is malformed.
+		*/
+		ExprTree *ParseExpression( const char *&buf, const char *end );
+
+	private:
+		bool parseName( const char *&buf, const char *end, std::string &name );
+		ExprTree *parseExpr( const char *&buf, const char *end, int depth );
+		bool parseText( const char *&buf, const char *end, std::string &text );
+
+		std::vector<std::string> dictionary;
+		ClassAdParser textParser;
+		ClassAdUnParser textUnparser;
+		std::string name;
+		std::string text;
+
+		ClassAdBinaryParser( const ClassAdBinaryParser & );            // not implemented
+		ClassAdBinaryParser &operator=( const ClassAdBinaryParser & ); // not implemented
+};
+
+} // classad
+
+#endif//__CLASSAD_BINARY_CODEC_H__
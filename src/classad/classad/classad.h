@@ -27,6 +27,7 @@
 #include <vector>
 #include "classad/classad_containers.h"
 #include "classad/exprTree.h"
+#include "classad/attrName.h"
 
 namespace classad {
 
@@ -34,11 +35,16 @@ typedef std::set<std::string, CaseIgnLTStr> References;
 typedef std::set<std::string, CaseIgnSizeLTStr> ReferencesBySize;
 typedef std::map<const ClassAd*, References> PortReferences;
 
+class CompiledExpr;
+class CompiledExprTable;
+
 #if defined( EXPERIMENTAL )
 #include "classad/rectangle.h"
 #endif
 
-typedef classad_unordered<std::string, ExprTree*, ClassadAttrNameHash, CaseIgnEqStr> AttrList;
+typedef classad_unordered<AttrName, ExprTree*, AttrNameHash, AttrNameCaseIgnEq> AttrList;
+// The attributes of a frozen ClassAd, sorted by the hash of the name
+typedef std::vector<AttrList::value_type> FrozenAttrList;
 typedef std::set<std::string, CaseIgnLTStr> DirtyAttrList;
 
 void ClassAdLibraryVersion(int &major, int &minor, int &patch);
@@ -49,6 +55,27 @@ void ClassAdLibraryVersion(std::string &version_string);
 void ClassAdSetExpressionCaching(bool do_caching);
 bool ClassAdGetExpressionCaching();
 
+// Should expressions that are evaluated repeatedly, such as Requirements
+// during matchmaking, be compiled (see EvaluateAttrCompiled()).
+// The default is false.
+void ClassAdSetExpressionCompiling(bool do_compiling);
+bool ClassAdGetExpressionCompiling();
+
+// Thread-safe evaluation.  With this set, any number of threads may
+// evaluate expressions in the same ads at once, each with its own
+// EvalState (i.e. through the ClassAd Evaluate*() methods) and, to match
+// ads, its own MatchClassAd with the ads bound to it by BindLeftAd() and
+// BindRightAd(), which leaves them unmodified.  The shared ads must not
+// be changed, or inserted in an ad, while they are being evaluated;
+// functions must be registered and SetOldClassAdSemantics() called before
+// the threads start.  Parsing, making new ads and the expression cache
+// are thread-safe regardless of this setting; it makes the compiled forms
+// of expressions (see EvaluateAttrCompiled()) safe to share, at the cost
+// of a lock per compiled evaluation.
+// The default is false.
+void ClassAdSetThreadSafeEvaluation(bool thread_safe);
+bool ClassAdGetThreadSafeEvaluation();
+
 // This flag is only meant for use in Condor, which is transitioning
 // from an older version of ClassAds with slightly different evaluation
 // semantics. It will be removed without warning in a future release.
@@ -287,6 +314,7 @@ class ClassAd : public ExprTree
 				otherwise.
 		*/
 		ExprTree *Lookup( const std::string &attrName ) const;
+		ExprTree *Lookup( const AttrName &attrName ) const;
 		ExprTree* LookupExpr(const std::string &name) const
 		{ return Lookup( name ); }
 
@@ -389,6 +417,18 @@ class ClassAd : public ExprTree
 		*/
 		bool EvaluateAttr( const std::string& attrName, Value &result ) const;
 
+		/** Evaluates expression bound to an attribute, using a compiled
+				form of the expression if expression compiling is enabled.
+				The result is the same as for EvaluateAttr().  The compiled
+				form is kept with the ad until the attribute is replaced or
+				removed, so this is only worthwhile for expressions that
+				are evaluated many times, such as Requirements.
+			@param attrName The name of the attribute in the ClassAd.
+			@param result The result of the evaluation.
+			@see ClassAdSetExpressionCompiling
+		*/
+		bool EvaluateAttrCompiled( const std::string& attrName, Value &result ) const;
+
 		/** Evaluates an expression.
 			@param buf Buffer containing the external representation of the
 				expression.  This buffer is parsed to yield the expression to
@@ -565,27 +605,72 @@ class ClassAd : public ExprTree
 		/**@name STL-like Iterators */
 		//@{
 
-		/** Define an iterator we can use on a ClassAd */
+		/** Define an iterator we can use on a ClassAd.  Getting a
+			non-constant iterator thaws a frozen ad (see Freeze()), and
+			says so through the debug function (see
+			ExprTree::set_user_debug_function()); code that only reads
+			the ad should iterate over a const ClassAd. */
 		typedef AttrList::iterator iterator;
 
 		/** Define a constatnt iterator we can use on a ClassAd */
-		typedef AttrList::const_iterator const_iterator;
+		class const_iterator
+		{
+		  public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef AttrList::value_type value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef const value_type *pointer;
+			typedef const value_type &reference;
+
+			const_iterator() : frozen(NULL) {}
+			const_iterator( AttrList::const_iterator i ) : itr(i), frozen(NULL) {}
+			const_iterator( AttrList::iterator i ) : itr(i), frozen(NULL) {}
+			explicit const_iterator( const value_type *f ) : frozen(f) {}
+
+			reference operator*() const { return frozen ? *frozen : *itr; }
+			pointer operator->() const { return frozen ? frozen : &*itr; }
+			const_iterator &operator++() {
+				if( frozen ) { ++frozen; } else { ++itr; }
+				return *this;
+			}
+			const_iterator operator++(int) {
+				const_iterator tmp( *this );
+				++*this;
+				return tmp;
+			}
+			bool operator==( const const_iterator &rhs ) const {
+				return frozen == rhs.frozen && ( frozen || itr == rhs.itr );
+			}
+			bool operator!=( const const_iterator &rhs ) const {
+				return !( *this == rhs );
+			}
+
+		  private:
+			AttrList::const_iterator itr;
+			const value_type *frozen;
+		};
 
 		/** Returns an iterator pointing to the beginning of the
 			attribute/value pairs in the ClassAd */
-		iterator begin() { return attrList.begin(); }
+		iterator begin() { ThawForIterator( "begin" ); return attrList.begin(); }
 
 		/** Returns a constant iterator pointing to the beginning of the
 			attribute/value pairs in the ClassAd */
-		const_iterator begin() const { return attrList.begin(); }
+		const_iterator begin() const {
+			if( frozenAttrs ) return const_iterator( frozenAttrs->data() );
+			return attrList.begin();
+		}
 
 		/** Returns aniterator pointing past the end of the
 			attribute/value pairs in the ClassAd */
-		iterator end() { return attrList.end(); }
+		iterator end() { ThawForIterator( "end" ); return attrList.end(); }
 
 		/** Returns a constant iterator pointing past the end of the
 			attribute/value pairs in the ClassAd */
-		const_iterator end() const { return attrList.end(); }
+		const_iterator end() const {
+			if( frozenAttrs ) return const_iterator( frozenAttrs->data() + frozenAttrs->size() );
+			return attrList.end();
+		}
 
         /** Return an interator pointing to the attribute with a particular name.
          */
@@ -597,10 +682,34 @@ class ClassAd : public ExprTree
 
         /** Return the number of attributes at the root level of this ClassAd.
          */
-        int size(void) const { return (int)attrList.size(); }
+        int size(void) const {
+			return (int)( frozenAttrs ? frozenAttrs->size() : attrList.size() );
+		}
 		//@}
 
-		void rehash(size_t s) { attrList.rehash(s);}
+		void rehash(size_t s) { Thaw(); attrList.rehash(s);}
+
+		/**@name Frozen ClassAds */
+		//@{
+		/** Freezes the ClassAd into a compact, read-only form.  The
+				attributes are kept in a single array sorted by the hash of
+				their names, instead of a hash table, which takes much less
+				memory and is faster to scan.  A frozen ad supports all the
+				lookup, evaluation and const iteration methods.  Any
+				modification of the ad, or asking for a non-constant
+				iterator, thaws it back into the normal form first.
+				Freezing and thawing don't copy or move the expressions, so
+				pointers returned by Lookup() stay valid.  Freezing is
+				meant for ads that are stored in bulk and rarely modified.
+		*/
+		void Freeze();
+
+		/** Is the ClassAd frozen?
+			@return true if Freeze() has been called and the ad hasn't
+				been thawed since.
+		*/
+		bool IsFrozen() const { return frozenAttrs != NULL; }
+		//@}
 		/** Deconstructor to get the components of a classad
 		 * 	@param vec A vector of (name,expression) pairs which are the
 		 * 		attributes of the classad
@@ -642,6 +751,11 @@ class ClassAd : public ExprTree
 
 			this->dirtyAttrList = std::move(rhs.dirtyAttrList);
 			this->attrList = std::move(rhs.attrList);
+			delete this->frozenAttrs;
+			this->frozenAttrs = rhs.frozenAttrs;
+			rhs.frozenAttrs = NULL;
+			DiscardCompiledExprs();
+			rhs.DiscardCompiledExprs();
 
 			return *this;
 		}
@@ -854,12 +968,42 @@ class ClassAd : public ExprTree
 		virtual bool _Evaluate( EvalState&, Value&, ExprTree*& ) const;
 		virtual bool _Flatten( EvalState&, Value&, ExprTree*&, int* ) const;
 	
-		int LookupInScope( const std::string&, ExprTree*&, EvalState& ) const;
+		int LookupInScope( const AttrName&, ExprTree*&, EvalState& ) const;
+		ExprTree *&_GetAttrSlot( const std::string &name );
+
+			// Turn a frozen ad back into a normal one; must be called
+			// before attrList is modified.
+		void Thaw() { if( frozenAttrs ) _Thaw(); }
+		void _Thaw();
+			// Thaw() on behalf of a non-constant iterator method, which
+			// undoes the freeze without the caller modifying anything,
+			// so log it
+		void ThawForIterator( const char *method ) {
+			if( frozenAttrs ) _ThawForIterator( method );
+		}
+		void _ThawForIterator( const char *method );
+		const AttrList::value_type *_FindFrozen( const AttrName &name ) const;
+		int LookupInScope( const std::string &name, ExprTree*& tree, EvalState& state ) const {
+			return LookupInScope( AttrName::Borrow( name ), tree, state );
+		}
+
+			// Forget compiled expressions; must be called whenever an
+			// expression held in attrList is deleted or removed.
+		void DiscardCompiledExprs() { if( compiledExprs ) _DiscardCompiledExprs(); }
+		void _DiscardCompiledExprs();
+			// The compiled form of an expression held by this ad, see
+			// CompiledExprTable::Get().  Fills in compiledExprs, so with
+			// thread-safe evaluation the caller must hold the ad's
+			// compiled expression lock.
+		const CompiledExpr *GetCompiledExpr( const ExprTree *tree ) const;
+
 		AttrList	  attrList;
 		DirtyAttrList dirtyAttrList;
 		bool          do_dirty_tracking;
 		ClassAd       *chained_parent_ad;
 		const ClassAd *parentScope;
+		mutable CompiledExprTable *compiledExprs;
+		FrozenAttrList *frozenAttrs;
 };
 
 } // classad
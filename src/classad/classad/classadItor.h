@@ -56,10 +56,10 @@ class ClassAdIterator
         inline void Initialize(const ClassAd &ca){ ad=&ca; ToFirst( ); }
 
         /// Positions the iterator to the "before first" position.
-        inline void ToFirst () { if(ad) itr = ad->attrList.begin( ); }
+        inline void ToFirst () { if(ad) itr = ad->begin( ); }
 
         /// Positions the iterator to the "after last" position
-        inline void ToAfterLast ()  { if(ad) itr = ad->attrList.end( ); }
+        inline void ToAfterLast ()  { if(ad) itr = ad->end( ); }
 
         /** Gets the next attribute in the ClassAd.
             @param attr The name of the next attribute in the ClassAd.
@@ -80,18 +80,18 @@ class ClassAdIterator
             @return true iff the iterator is before the first element.
         */
         inline bool IsAtFirst() const {
-			return(ad?(itr==ad->attrList.begin()):false);
+			return(ad?(itr==ad->begin()):false);
 		}
 
         /** Predicate to check the position of the iterator.
             @return true iff the iterator is after the last element.
         */
         inline bool IsAfterLast() const {
-			return(ad?(itr==ad->attrList.end()):false); 
+			return(ad?(itr==ad->end()):false); 
 		}
 
     private:
-		AttrList::const_iterator	itr;
+		ClassAd::const_iterator	itr;
         const ClassAd   			*ad;
 };
 
@@ -155,6 +155,31 @@ public:
     virtual bool FindPartitionName( const ViewName &viewName, ClassAd *rep, 
                                     ViewName &partition );
 
+    /**@name Attribute indexes
+     * A view can index its members by the values of attributes.
+     * LocalCollectionQuery uses the indexes of the view it queries to
+     * find the members that may satisfy comparisons of an indexed
+     * attribute with a literal (like TARGET.Owner == "alice" or
+     * TARGET.JobStatus >= 2) that the constraint requires, and only
+     * evaluates the constraint on those.  Indexes are kept up to date as
+     * ads are added, changed and removed, whether directly, by committed
+     * or aborted transactions, or by replaying the log.  They are not
+     * themselves part of the log, so they should be declared again
+     * after InitializeFromLog().
+     */
+    //@{
+    /** Index the members of a view by an attribute.
+     *  @param viewName The view to index
+     *  @param attr The attribute to index on
+     *  @param ordered false for a hash index, which answers equality
+     *         comparisons; true for an ordered index, which also answers
+     *         range comparisons with numbers
+     */
+    bool CreateIndex( const ViewName &viewName, const std::string &attr,
+                      bool ordered=false );
+    bool DeleteIndex( const ViewName &viewName, const std::string &attr );
+    //@}
+
     // Transaction management
     virtual bool OpenTransaction( const std::string &transactionName );
     virtual bool CloseTransaction(const std::string &transactionName,bool commit,
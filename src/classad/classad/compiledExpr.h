@@ -0,0 +1,153 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef __CLASSAD_COMPILED_EXPR_H__
+#define __CLASSAD_COMPILED_EXPR_H__
+
+#include "classad/exprTree.h"
+#include "classad/operators.h"
+#include <vector>
+
+namespace classad {
+
+/** A compiled form of an expression tree.  The operator nodes of the tree
+	are flattened into a linear sequence of instructions that operate on a
+	small register file of Values, with the short-circuit behaviour of &&,
+	|| and ?: turned into jumps.  Literals and attribute references are
+	evaluated directly from their tree nodes and anything else (function
+	calls, lists, nested ads) is handed back to the tree evaluator, so the
+	result of Evaluate() is always the same as evaluating the tree itself.
+	The compiled expression holds pointers into the tree it was built
+	from, and must not outlive it.
+*/
+class CompiledExpr
+{
+	public:
+		~CompiledExpr() {}
+
+		/** Compile an expression tree.
+			@param tree The expression to compile.
+			@return The compiled expression, or NULL if the tree is not
+				worth compiling (i.e. it is not an operator expression) or
+				is too deeply nested.
+		*/
+		static CompiledExpr *Compile( const ExprTree *tree );
+
+		/** Evaluate the compiled expression.
+			@param state The evaluation state, as for ExprTree::Evaluate().
+			@param result The result of the evaluation.
+			@return false if the evaluation failed, true otherwise.
+		*/
+		bool Evaluate( EvalState &state, Value &result ) const;
+
+		/// The expression this was compiled from
+		const ExprTree *GetTree() const { return tree; }
+
+		/// The number of instructions in the compiled expression
+		int NumInstructions() const { return (int)code.size(); }
+
+	private:
+		enum Opcode {
+			LOAD_LITERAL,	// reg[dst] = literal node
+			LOAD_ATTR,		// reg[dst] = value of attribute reference node
+			EVAL_TREE,		// reg[dst] = tree evaluation of node
+			OPERATE1,		// reg[dst] = op reg[a]
+			OPERATE2,		// reg[dst] = reg[a] op reg[a+1]
+			TERNARY,		// reg[dst] = reg[a] ? reg[a+1] : reg[a+2]
+			AND_JUMP,		// if reg[a] is false, reg[dst] = false, goto jump
+			OR_JUMP,		// if reg[a] is true, reg[dst] = true, goto jump
+			SELECT,			// ?: short-circuit on reg[a], see Evaluate()
+			COPY,			// reg[dst] = reg[a]
+			JUMP			// goto jump
+		};
+
+		// flags for the SELECT and TERNARY instructions
+		enum {
+			HAS_TRUE_ARM = 1,
+			HAS_FALSE_ARM = 2
+		};
+
+		struct Instruction {
+			unsigned char code;		// Opcode
+			unsigned char flags;	// HAS_*_ARM for SELECT and TERNARY
+			unsigned short dst;		// destination register
+			unsigned short a;		// first operand register
+			Operation::OpKind op;	// operator for OPERATE* and TERNARY
+			int jump;				// jump target(s) for SELECT and *JUMP
+			int jump2;
+			const ExprTree *node;	// literal, reference or subtree
+		};
+
+		// Expressions needing more registers than this are not compiled
+		enum { MAX_REGISTERS = 1024 };
+
+		CompiledExpr( const ExprTree *t ) : tree(t), numRegisters(0) {}
+
+		bool compileNode( const ExprTree *node, int dst );
+		int emit( Opcode code, int dst, int a = 0,
+				Operation::OpKind op = Operation::__NO_OP__,
+				const ExprTree *node = NULL );
+
+		const ExprTree *tree;
+		std::vector<Instruction> code;
+		int numRegisters;
+
+		CompiledExpr( const CompiledExpr & );            // not implemented
+		CompiledExpr &operator=( const CompiledExpr & ); // not implemented
+};
+
+/** The compiled expressions belonging to the attributes of one ClassAd.
+	An expression is compiled the second time it is asked for, so that
+	ads which are modified between every evaluation don't pay for
+	compilation.  The table is discarded whenever an attribute of the
+	ad is replaced or removed.
+*/
+class CompiledExprTable
+{
+	public:
+		CompiledExprTable() {}
+		~CompiledExprTable();
+
+		/** Get the compiled form of an expression held by the ad.
+			@param tree The expression bound to an attribute of the ad.
+			@return The compiled expression, or NULL if the expression
+				should be evaluated as a tree.
+		*/
+		const CompiledExpr *Get( const ExprTree *tree );
+
+	private:
+		struct Entry {
+			const ExprTree *tree;
+			CompiledExpr *compiled;
+			bool tried;
+		};
+
+		// Beyond this many expressions per ad, evaluate as trees
+		enum { MAX_ENTRIES = 16 };
+
+		std::vector<Entry> entries;
+
+		CompiledExprTable( const CompiledExprTable & );            // not implemented
+		CompiledExprTable &operator=( const CompiledExprTable & ); // not implemented
+};
+
+} // classad
+
+#endif//__CLASSAD_COMPILED_EXPR_H__
@@ -0,0 +1,129 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef __CLASSAD_EVAL_PROFILE_H__
+#define __CLASSAD_EVAL_PROFILE_H__
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace classad {
+
+class ClassAd;
+
+/** An opt-in profile of ClassAd evaluation:  for each attribute and each
+	builtin function, how many times it was evaluated and how long that
+	took.  An attribute is counted each time a reference to it is
+	evaluated (and by ClassAd::EvaluateAttr()), a function each time a
+	call to it is.  Times are inclusive of the attributes and calls
+	evaluated inside.  Names are compared without regard to case.
+
+	Profiling is off by default, and costs one test per evaluation while
+	off.  When it is on, one in every SampleInterval() evaluations on each
+	thread is timed and recorded, and its count and time are scaled by
+	the interval, so a large interval keeps the cost low enough to leave
+	profiling on in a busy daemon.  Each thread records into its own
+	profile; the profiles are combined when read.
+*/
+class EvalProfile
+{
+	public:
+		/// What a profile entry is for
+		enum Kind { ATTRIBUTE, FUNCTION };
+
+		/** Turn profiling on or off.
+			@param enable Whether to profile evaluation
+			@param sample_interval Record one in this many evaluations;
+				ignored when turning profiling off, so the interval of a
+				finished run is still reported with its profile
+		*/
+		static void Enable( bool enable, int sample_interval = 1 );
+
+		/// Whether evaluation is being profiled
+		static bool IsEnabled( ) { return enabled.load( std::memory_order_relaxed ); }
+
+		/// One in this many evaluations is recorded
+		static int SampleInterval( ) { return sampleInterval.load( std::memory_order_relaxed ); }
+
+		/// Discard everything recorded so far, on all threads
+		static void Reset( );
+
+		/** Put the profile into an ad, replacing its contents, as
+			[ SampleInterval = 1;
+			  Attributes = [ Requirements = [ Calls = 10; Seconds = 0.001 ]; ... ];
+			  Functions = [ strcat = [ Calls = 4; Seconds = 0.0002 ]; ... ] ]
+		*/
+		static void GetProfile( ClassAd &ad );
+
+		/** Append the entries that took the most time to a buffer, as a
+			table with one line per entry.
+			@param buffer The buffer to append to
+			@param max_entries The most entries of each kind to list
+		*/
+		static void Format( std::string &buffer, int max_entries = 20 );
+
+	private:
+		friend class EvalProfileScope;
+
+		static bool sample( Kind kind );
+		static void record( Kind kind, const std::string &name, double seconds );
+
+		static std::atomic<bool> enabled;
+		static std::atomic<int> sampleInterval;
+};
+
+/** Times an evaluation for the profile, from construction to destruction,
+	if profiling is on and the evaluation is sampled.  The name must
+	outlive the scope.
+*/
+class EvalProfileScope
+{
+	public:
+		EvalProfileScope( EvalProfile::Kind k, const std::string &n ) : name( NULL )
+		{
+			if( EvalProfile::IsEnabled( ) && EvalProfile::sample( k ) ) {
+				kind = k;
+				name = &n;
+				begin = std::chrono::steady_clock::now( );
+			}
+		}
+
+		~EvalProfileScope( )
+		{
+			if( name ) {
+				std::chrono::duration<double> elapsed =
+					std::chrono::steady_clock::now( ) - begin;
+				EvalProfile::record( kind, *name, elapsed.count( ) );
+			}
+		}
+
+	private:
+		EvalProfile::Kind kind;
+		const std::string *name;	// NULL if not timing
+		std::chrono::steady_clock::time_point begin;
+
+		EvalProfileScope( const EvalProfileScope & );            // not implemented
+		EvalProfileScope &operator=( const EvalProfileScope & ); // not implemented
+};
+
+} // classad
+
+#endif//__CLASSAD_EVAL_PROFILE_H__
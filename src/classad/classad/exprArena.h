@@ -0,0 +1,122 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef __CLASSAD_EXPR_ARENA_H__
+#define __CLASSAD_EXPR_ARENA_H__
+
+#include <stddef.h>
+
+namespace classad {
+
+/** An arena for the nodes of expression trees.  While an ExprArenaScope
+	is active on a thread, every ExprTree node created with new on that
+	thread (by the parser, by InsertAttr(), by Copy(), ...) is carved out
+	of large chunks owned by the arena, instead of being allocated from
+	the heap one by one.  Use one arena per ClassAd, or one for a batch
+	of ads that are created and discarded together.
+
+	Nodes are still deleted individually, and their destructors run as
+	usual, but deleting a node just drops a count on its chunk.  A chunk
+	goes back to the heap all at once when the arena has moved on from it
+	(or been destroyed) and the last node in it has been deleted, so
+	deleting or replacing all the ads that came from an arena frees its
+	memory in a few large pieces.  If every node of the current chunk has
+	been deleted, the arena reuses the chunk from the start.
+
+	Nodes may be moved between ads, deleted on other threads, and outlive
+	the arena; a chunk is kept until its last node is gone.  So a node
+	that is kept much longer than the rest of its chunk (for instance,
+	one put into the expression cache) holds the whole chunk, and should
+	not be created in an arena.  An ExprArena itself may be used by only
+	one thread at a time.
+
+	Nodes carry no header.  Chunks are made of whole pages, and deleting
+	a node finds its chunk from the page it is in, in a map that is read
+	without taking a lock.
+*/
+class ExprArena
+{
+	public:
+		/** Make an arena.
+			@param chunk_size The size of the first chunk the arena takes
+				from the heap (at most MAX_CHUNK_SIZE).  Each further chunk
+				is twice the size of the one before it, up to
+				MAX_CHUNK_SIZE.  Chunks are rounded up to a whole number
+				of 4K pages.
+		*/
+		explicit ExprArena( size_t chunk_size = DEFAULT_CHUNK_SIZE );
+		~ExprArena();
+
+		/// The size of the first chunk, if not given to the constructor
+		static const size_t DEFAULT_CHUNK_SIZE = 16 * 1024;
+		/// The size beyond which chunks no longer grow
+		static const size_t MAX_CHUNK_SIZE = 64 * 1024;
+
+		/// The arena that nodes are allocated from on this thread, or NULL
+		static ExprArena *Current();
+
+		/** Allocate memory for a node, from the current arena or from
+			the heap.  Used by ExprTree::operator new.
+		*/
+		static void *AllocateNode( size_t size );
+
+		/** Free memory returned by AllocateNode().  Used by
+			ExprTree::operator delete.
+		*/
+		static void FreeNode( void *ptr );
+
+		/// The number of chunks taken from the heap so far
+		size_t NumChunks() const { return numChunks; }
+
+		/// A chunk of memory nodes are carved from (internal)
+		struct Chunk;
+
+	private:
+		void *allocate( size_t size );
+		void retire();
+
+		Chunk *current;
+		size_t nextChunkSize;
+		size_t numChunks;
+
+		ExprArena( const ExprArena & );            // not implemented
+		ExprArena &operator=( const ExprArena & ); // not implemented
+};
+
+/** Makes an arena the current one for the thread for the life of the
+	scope, and restores the previous one (usually none) afterwards.
+	Passing NULL makes nodes come from the heap within the scope.
+*/
+class ExprArenaScope
+{
+	public:
+		explicit ExprArenaScope( ExprArena *arena );
+		~ExprArenaScope();
+
+	private:
+		ExprArena *saved;
+
+		ExprArenaScope( const ExprArenaScope & );            // not implemented
+		ExprArenaScope &operator=( const ExprArenaScope & ); // not implemented
+};
+
+} // classad
+
+#endif//__CLASSAD_EXPR_ARENA_H__
@@ -57,6 +57,9 @@ class ExprList : public ExprTree
 		 */
 		void GetComponents( std::vector<ExprTree*>& list) const;
 
+		/// The list of expressions, without copying it
+		const std::vector<ExprTree*> &GetExprs( ) const { return exprList; }
+
 		virtual ExprTree* Copy( ) const;
 
         bool CopyFrom(const ExprList &other_list);
@@ -24,6 +24,7 @@
 #include "classad/classad_containers.h"
 #include "classad/common.h"
 #include "classad/value.h"
+#include "classad/attrName.h"
 
 namespace classad {
 
@@ -95,6 +96,15 @@ class ExprTree
 		/// Virtual destructor
 		virtual ~ExprTree () {};
 
+		/** Nodes are allocated from the thread's current ExprArena, if
+			there is one, and from the heap otherwise.
+			@see ExprArena
+		*/
+		static void *operator new( size_t size );
+		static void operator delete( void *ptr );
+		static void *operator new( size_t, void *where ) { return where; }
+		static void operator delete( void *, void * ) { }
+
 		/** Sets the lexical parent scope of the expression, which is used to 
 				determine the lexical scoping structure for resolving attribute
 				references. (However, the semantic parent may be different from 
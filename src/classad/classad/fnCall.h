@@ -82,6 +82,11 @@ class FunctionCall : public ExprTree
 	 * 	@param argList  The argument list
 	 */
 	void GetComponents( std::string &, std::vector<ExprTree*> &) const;
+
+	/// The name of the function being called, without copying it
+	const std::string &GetFunctionName( ) const { return functionName; }
+	/// The argument list, without copying it
+	const ArgumentList &GetArguments( ) const { return arguments; }
 	
 	/// Make a deep copy of the expression
 	virtual ExprTree* Copy( ) const;
@@ -121,6 +126,7 @@ class FunctionCall : public ExprTree
 	// return the object--it's static, and we want to make sure that
 	// it's constructor has been called whenever we need to use it.
     static FuncTable &getFunctionTable(void);
+	static bool InitializeFunctionTable(void);
 	static bool		 initialized;
 	
 	const ClassAd *parentScope;
@@ -55,18 +55,21 @@ class ClassAdJsonUnParser
 	void Unparse( std::string &buffer, const ClassAd *ad, const References &whitelist );
 
 	static void UnparseAuxEscapeString( std::string &buffer, const std::string &value );
+	static void UnparseAuxEscapeString( std::string &buffer, const char *str, size_t len );
 
  protected:
 	void UnparseAuxQuoteExpr( std::string &buffer, const ExprTree *expr );
 
 	void UnparseAuxQuoteExpr( std::string &buffer, const std::string &expr );
 
-	void UnparseAuxClassAd( std::string &buffer,
-			const std::vector< std::pair< std::string, ExprTree*> >& attrs );
+	// from either a ClassAd or the vector of its components
+	template <class Iter>
+	void UnparseAuxClassAd( std::string &buffer, Iter begin, Iter end );
 
 	int m_indentLevel;
 	int m_indentIncrement;
 	bool m_oneline;
+	std::string m_exprBuffer;	// for UnparseAuxQuoteExpr()
 };
 
 
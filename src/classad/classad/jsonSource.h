@@ -23,7 +23,9 @@
 
 #include <vector>
 #include <iosfwd>
+#include <stdio.h>
 #include "classad/lexer.h"
+#include "classad/source.h"
 
 namespace classad {
 
@@ -125,6 +127,76 @@ class ClassAdJsonParser
 		bool parseExprList( ExprList*&, bool=false);
 };
 
+/** A faster reader for JSON ClassAds.  It makes the same ads as
+	ClassAdJsonParser from the JSON that ClassAdJsonUnParser writes (and
+	from standard JSON generally), but works directly on text in memory
+	rather than through the lexer a character at a time.  It also reads a
+	top-level array of ads, as condor_q -json and condor_status -json
+	write them, one ad at a time.
+*/
+class ClassAdJsonReader
+{
+	public:
+		/// Constructor
+		ClassAdJsonReader();
+
+		/// Destructor
+		~ClassAdJsonReader();
+
+		/** Parse a ClassAd
+			@param buffer Buffer containing the JSON object.
+			@param ad The classad to be populated
+			@param full If this parameter is true, the parse is considered to
+				succeed only if nothing but white space follows the ad.
+			@return true on success, false on failure
+		*/
+		bool ParseClassAd( const std::string &buffer, ClassAd &ad, bool full=false );
+		ClassAd *ParseClassAd( const std::string &buffer, bool full=false );
+
+		/** Read the next ad from a sequence of ads, such as a JSON array
+			of ads.  White space, and the brackets and commas of an
+			enclosing array, are skipped before the ad.
+			@param buffer The text of the ads (need not be NUL-terminated)
+			@param len The length of the text
+			@param offset Where to start reading; on return, the position
+				just after the ad.
+			@param ad The classad to be populated
+			@return 1 if an ad was read, 0 at the end of the text, or -1
+				if the text is not a valid ad.
+		*/
+		int NextClassAd( const char *buffer, size_t len, size_t &offset, ClassAd &ad );
+
+		/** Read the next ad from a file, as above.  The file is read up
+			to the end of the ad and no further, so it can be read by
+			other means between ads.
+			@param file The file to read
+			@param ad The classad to be populated
+			@return 1 if an ad was read, 0 at the end of the file, or -1
+				if the file does not hold a valid ad.
+		*/
+		int NextClassAd( FILE *file, ClassAd &ad );
+
+	private:
+		// the text being parsed
+		const char *cur;
+		const char *end;
+
+		ClassAdParser exprParser;	// for quoted expressions
+		std::string fileBuffer;		// the text of an ad read from a file
+		std::string stringBuffer;	// the text of a string being parsed
+
+		void skipWhiteSpace( );
+		bool parseError( const char *msg );
+		bool parseClassAd( ClassAd &ad );
+		bool parseValue( ExprTree *&tree );
+		bool parseExprList( ExprTree *&tree );
+		bool parseString( std::string &str, bool &quoted_expr );
+		bool parseNumber( ExprTree *&tree );
+
+		ClassAdJsonReader( const ClassAdJsonReader & );            // not implemented
+		ClassAdJsonReader &operator=( const ClassAdJsonReader & ); // not implemented
+};
+
 } // classad
 
 #endif//__CLASSAD_JSON_SOURCE_H__
@@ -120,6 +120,44 @@ class MatchClassAd : public ClassAd
 		*/
 		bool ReplaceRightAd( ClassAd *ar );
 
+		/** Makes an ad the left candidate without inserting it in the
+			match classad or modifying it in any way, so that many match
+			classads (in different threads, say) can use the same ad at
+			once.  The left candidate becomes an empty ad owned by the
+			match classad and chained to the given one (see
+			ClassAd::ChainToAd()); GetLeftAd() returns it, and
+			expressions to be evaluated against the match should be
+			evaluated in it.  Rebinding just rechains the empty ad, so it
+			is cheap to bind each of many candidates in turn.  The ad
+			must not be changed or deleted while it is bound.
+			@param al The ad to be bound in the left context, or NULL.
+			@return true if the operation succeeded and false otherwise.
+		*/
+		bool BindLeftAd( const ClassAd *al );
+
+		/** Makes an ad the right candidate without inserting it in the
+			match classad or modifying it in any way.  See BindLeftAd().
+			@param ar The ad to be bound in the right context, or NULL.
+			@return true if the operation succeeded and false otherwise.
+		*/
+		bool BindRightAd( const ClassAd *ar );
+
+		/** Binds an ad as the left candidate, as BindLeftAd() does, and
+			partially evaluates its requirements for matching it against
+			many right ads ("bound-left" mode).  Everything in the
+			requirements that depends only on the left ad is evaluated
+			once, here, leaving a residual expression that refers only to
+			the right ad; symmetricMatch() and rightMatchesLeft() then
+			evaluate the residual against each right ad bound afterwards.
+			As with OptimizeLeftAdForMatchmaking(), functions such as
+			time() are evaluated when the ad is bound.  The residual is
+			discarded when another left ad is bound or inserted, and the
+			ad must not change while it is bound.
+			@param al The ad to be bound in the left context.
+			@return true if the operation succeeded and false otherwise.
+		*/
+		bool BindLeftAdForMatchmaking( const ClassAd *al );
+
 		/** Gets the ad in the left context.
 			@return The ClassAd, or NULL if the ad doesn't exist.
 		*/
@@ -130,6 +168,13 @@ class MatchClassAd : public ClassAd
 		*/
 		ClassAd *GetRightAd();
 
+		/** Gets what is left of the left ad's requirements once the parts
+			that depend only on it are evaluated, if it was bound with
+			BindLeftAdForMatchmaking().
+			@return The residual expression, or NULL if there is none.
+		*/
+		const ExprTree *GetLeftResidual() const { return lResidual; }
+
 		/** Gets the left context ad. (<tt>.adcl</tt> in the above example)
 		 	@return The left context ad, or NULL if the MatchClassAd is not
 				valid
@@ -198,6 +243,8 @@ class MatchClassAd : public ClassAd
 	protected:
 		const ClassAd *ladParent, *radParent;
 		ClassAd *lCtx, *rCtx, *lad, *rad;
+		ClassAd *lProxy, *rProxy;	// the ads bound by BindLeftAd() and BindRightAd()
+		ExprTree *lResidual;	// see BindLeftAdForMatchmaking()
 		ExprTree *symmetric_match, *right_matches_left, *left_matches_right;
 		std::string lAlias, rAlias;
 
@@ -222,10 +269,36 @@ class MatchClassAd : public ClassAd
 		*/
 		static bool OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, const std::string &left_alias, const std::string &right_alias );
 
+		/** Inserts the names by which the requirements of an ad refer
+			to the ad itself and to its candidate (my, target, other and
+			the aliases), so that flattening the requirements resolves
+			them.  Fails if the ad already has any of them.
+		*/
+		static bool InsertMatchmakingNames( ClassAd *ad, bool is_right, const std::string &left_alias, const std::string &right_alias );
+
+		/// Removes the names inserted by InsertMatchmakingNames()
+		static void RemoveMatchmakingNames( ClassAd *ad, const std::string &left_alias, const std::string &right_alias );
+
 		/**
 		   @return true if the given expression evaluates to true
 		*/
 		bool EvalMatchExpr(ExprTree *match_expr);
+
+		/** Evaluates ad1.requirements && ad2.requirements (or just
+			ad1.requirements if ad2 is NULL) the same way as the match
+			expressions, but using compiled requirements expressions.
+		   @return true if the requirements evaluate to true
+		*/
+		bool EvalCompiledRequirements(ClassAd *ad1, ClassAd *ad2);
+
+		/** Evaluates the residual of the left requirements, and the right
+			requirements too if symmetric is true, the same way as the
+			match expressions.
+		   @return true if the requirements evaluate to true
+		*/
+		bool EvalResidualRequirements(bool symmetric);
+
+		void DiscardLeftResidual() { delete lResidual; lResidual = NULL; }
 };
 
 } // classad
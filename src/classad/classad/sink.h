@@ -92,14 +92,25 @@ class ClassAdUnParser
 		// to unparse attribute names (quoted & unquoted attributes)
 		virtual void UnparseAux( std::string &buffer, const std::string &identifier);
 
+		// to unparse a nested ad.  The default walks the ad's attributes
+		// in place; a subclass that overrides the attribute list form of
+		// UnparseAux() should override this one to use it.
+		virtual void UnparseAux( std::string &buffer, const ClassAd *ad );
+
 		// table of string representation of operators
 		static const char *opString[];
 
  protected:
+		void UnparseAuxEscapeString( std::string &buffer, const char *str, size_t len );
+
 		bool oldClassAd;
 		bool xmlUnparse;
 		char delimiter; // string delimiter - initialized to '\"' in the constructor
 		bool oldClassAdValue;
+
+ private:
+		template <class Iter>
+		void UnparseAuxAttrs( std::string &buffer, Iter begin, Iter end );
 };
 
 
@@ -135,6 +146,7 @@ class PrettyPrint : public ClassAdUnParser
         virtual void UnparseAux( std::string &buffer,
                     std::vector< std::pair< std::string, ExprTree*> >& attrlist );
         virtual void UnparseAux( std::string &buffer, std::vector<ExprTree*>& );
+        virtual void UnparseAux( std::string &buffer, const ClassAd *ad );
 
     private:
         int  classadIndent;
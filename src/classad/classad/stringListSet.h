@@ -0,0 +1,100 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#ifndef __CLASSAD_STRING_LIST_SET_H__
+#define __CLASSAD_STRING_LIST_SET_H__
+
+#include "classad/common.h"
+#include "classad/classad_containers.h"
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace classad {
+
+class StringListSet;
+typedef classad_shared_ptr<const StringListSet> StringListSetPtr;
+
+/** The items of a delimited string list, such as "a, b, c", split once
+	and kept in hash sets, so that testing whether an item is in the list
+	doesn't re-tokenize the string.  The functions that treat a string as
+	a list (stringListMember(), stringListsIntersect(), ...) get the split
+	form of their list argument with Find(), which keeps the split forms
+	of recently used lists in a cache shared by all threads.  The cache
+	holds a bounded number of lists and a bounded number of bytes of list
+	text, dropping the least recently used.
+*/
+class StringListSet
+{
+	public:
+		/** Get the split form of a list, from the cache if it is there.
+			@param list The list string
+			@param delimiters The characters that separate items
+			@param trim_whitespace If true, whitespace is also a separator
+				at the start of an item and is trimmed from its end, as
+				Condor's StringList does.  If false, every run of characters
+				between delimiters is an item, and no delimiters means
+				space and comma, as stringListsIntersect() has it.
+		*/
+		static StringListSetPtr Find( const std::string &list,
+									  const std::string &delimiters,
+									  bool trim_whitespace );
+
+		/// Discard every cached list.  Lists still in use are unaffected.
+		static void ClearCache( );
+
+		/// The number of items, counting duplicates
+		size_t Size( ) const { return size; }
+
+		/// Whether the list has an item equal to the given one
+		bool Contains( const std::string &item ) const
+			{ return items.find( item ) != items.end( ); }
+
+		/// Whether the list has an item equal to the given one, ignoring case
+		bool ContainsAnyCase( const std::string &item ) const;
+
+	private:
+		friend class StringListSetCache;
+
+		StringListSet( const std::string &list, const std::string &delimiters,
+					   bool trim_whitespace );
+		StringListSet( const StringListSet & );            // not implemented
+		StringListSet &operator=( const StringListSet & ); // not implemented
+
+		bool Matches( const std::string &list, const std::string &delimiters,
+					  bool trim_whitespace ) const;
+
+		typedef std::unordered_set<std::string> ItemSet;
+		typedef std::unordered_set<std::string, ClassadAttrNameHash, CaseIgnEqStr> AnyCaseItemSet;
+
+		std::string	list;
+		std::string	delimiters;
+		bool		trimWhitespace;
+		size_t		size;
+		ItemSet		items;
+
+			// built on the first case-insensitive test
+		mutable std::once_flag	anyCaseOnce;
+		mutable AnyCaseItemSet	anyCaseItems;
+};
+
+}
+
+#endif // __CLASSAD_STRING_LIST_SET_H__
@@ -24,9 +24,11 @@
 // STL includes
 #include <string>
 #include <set>
+#include <vector>
 
 #include "classad/classad_containers.h"
 #include "classad/exprTree.h"
+#include "classad/operators.h"
 #include "classad/matchClassad.h"
 
 namespace classad {
@@ -64,11 +66,65 @@ struct ViewMemberLT {
 };
 
 
+/** An index of the members of a view by the value of one attribute.  A
+	hash index answers equality comparisons (==, =?=) of the attribute
+	with a literal; an ordered index also answers the range comparisons
+	(<, <=, >, >=) with a number.  Only values that are literals in the
+	ad are indexed by value: members whose attribute is some other
+	expression are kept aside and returned by every lookup, since what
+	they evaluate to depends on the context of the query.
+*/
+class ViewIndex {
+public:
+	ViewIndex( const std::string &attr, bool ordered );
+	~ViewIndex( );
+
+	const std::string &GetAttributeName( ) const { return( attr ); }
+	bool IsOrdered( ) const { return( ordered ); }
+	int	Size( ) const { return( (int)members.size( ) ); }
+
+	void Insert( const std::string &key, ClassAd *ad );
+	void Remove( const std::string &key );
+	void Clear( );
+
+	/** Find the members whose attribute may compare true with a value.
+		@param op The comparison, with the attribute on the left
+		@param val The value compared against
+		@param keys Filled with the keys of the members that may satisfy
+			the comparison; members not returned certainly don't
+		@return false if the index can't answer this comparison
+	*/
+	bool Lookup( Operation::OpKind op, const Value &val,
+			std::set<std::string> &keys ) const;
+
+private:
+	static bool makeSignature( const Value &val, std::string &sig,
+			double &number, bool &isNumber );
+
+	struct IndexedValue {
+		std::string	sig;		// empty for members kept aside
+		double		number;
+		bool		isNumber;
+	};
+
+	std::string	attr;
+	bool		ordered;
+	classad_map<std::string,IndexedValue> members;	// key->its value
+	classad_unordered<std::string,std::set<std::string> > byValue;
+	std::set<std::pair<double,std::string> > byNumber;	// ordered only
+	std::set<std::string> notIndexed;
+
+	ViewIndex( const ViewIndex & );				// not implemented
+	ViewIndex &operator=( const ViewIndex & );	// not implemented
+};
+
+
 typedef std::string ViewName;
 typedef std::multiset<ViewMember, ViewMemberLT> ViewMembers;
 typedef classad_slist<View*> SubordinateViews;
 typedef classad_map<std::string,View*> PartitionedViews;
 typedef classad_map<std::string,ViewMembers::iterator> MemberIndex;
+typedef std::map<std::string,ViewIndex*,CaseIgnLTStr> ViewIndexes;
 
 
 /* View class */
@@ -114,6 +170,14 @@ public:
 	bool DeletePartitionedView( ClassAdCollection *coll,
 			const ViewName &viewName );
 	bool DeletePartitionedView( ClassAdCollection *coll, ClassAd *rep );
+
+		// attribute indexes
+	bool AddIndex( ClassAdCollection *coll, const std::string &attr,
+			bool ordered );
+	bool RemoveIndex( const std::string &attr );
+	void GetIndexNames( std::vector<std::string>& );
+	bool FindCandidates( MatchClassAd &mad, ExprTree *constraint,
+			std::vector<ViewMembers::iterator> &candidates );
 			
 		// classad manipulation
 	bool ClassAdInserted ( ClassAdCollection *coll, 
@@ -157,6 +221,10 @@ private:
 		// private helper function
 	std::string makePartitionSignature( ClassAd *ad );
 	void        DeleteView( ClassAdCollection * );
+	void        indexInsert( const std::string &key, ClassAd *ad );
+	void        indexRemove( const std::string &key );
+	void        indexLookup( MatchClassAd &mad, ClassAd *probe,
+					ExprTree *tree, std::set<std::string> &keys, bool &found );
 
 	ViewName			viewName;			// name of the view
 	View				*parent;			// pointer to parent view
@@ -166,6 +234,7 @@ private:
 	SubordinateViews	subordinateViews;	// views explicitly added
 	std::string			oldAdSignature;		// old signature of ad to be changed
 	MatchClassAd		evalEnviron;		// also stores view info
+	ViewIndexes			indexes;			// attribute->index of members
 };
 
 }
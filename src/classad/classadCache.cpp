@@ -20,9 +20,11 @@
 #include "classad/classadCache.h"
 #include "classad/sink.h"
 #include "classad/source.h"
+#include "classad/exprArena.h"
 #include <assert.h>
 #include <stdio.h>
 #include <list>
+#include <mutex>
 
 using namespace classad;
 using namespace std;
@@ -45,6 +47,7 @@ protected:
 	typedef classad_unordered<std::string, AttrValues, ClassadAttrNameHash, CaseIgnEqStr>::iterator cache_iterator;
 
 	AttrCache m_Cache;		///< Data Store
+	std::mutex m_Lock;		///< Guards everything else, so ads can be made and deleted by many threads
 	unsigned long m_HitCount;	///< Hit Counter
 	unsigned long m_MissCount;	///< Miss Counter
 	unsigned long m_QueryCount;	///< Checks that don't offer an expr-tree
@@ -91,6 +94,7 @@ public:
 #endif
 	{
 		pCacheData pRet;
+		std::lock_guard<std::mutex> guard(m_Lock);
 
 		cache_iterator itr = m_Cache.find(szName);
 		bool bValidName=false;
@@ -102,10 +106,9 @@ public:
 			szName = itr->first;
 #endif
 
-			// check the value cache
-			if (vtr != itr->second.end()) {
-				pRet = vtr->second.lock();
-
+			// check the value cache.  the entry may have expired, with
+			// its flush() waiting for the lock; if so, replace it.
+			if (vtr != itr->second.end() && (pRet = vtr->second.lock())) {
 				m_HitCount++;
 				if (pVal) {
 					delete pVal;
@@ -144,6 +147,7 @@ public:
 #endif
 	{
 		pCacheData pRet;
+		std::lock_guard<std::mutex> guard(m_Lock);
 
 		cache_iterator itr = m_Cache.find(szName);
 		bool bValidName=false;
@@ -156,8 +160,7 @@ public:
 #endif
 
 			// check the value cache
-			if (vtr != itr->second.end()) {
-				pRet = vtr->second.lock();
+			if (vtr != itr->second.end() && (pRet = vtr->second.lock())) {
 				m_HitCount++;
 				// don't to any more checks just return.
 				return pRet;
@@ -184,13 +187,18 @@ public:
 		// and possibly other places as well.
 		if (m_destroyed) return false;
 
+		std::lock_guard<std::mutex> guard(m_Lock);
 		cache_iterator itr = m_Cache.find(szName);
 
 		if (itr != m_Cache.end()) {
+			value_iterator vtr = itr->second.find(szValue);
+			// the entry may already have been replaced by a live one
+			if (vtr == itr->second.end() || ! vtr->second.expired()) {
+				return false;
+			}
 			if (itr->second.size() == 1) {
 				m_Cache.erase(itr);
 			} else {
-				value_iterator vtr = itr->second.find(szValue);
 				itr->second.erase(vtr);
 			}
 
@@ -206,6 +214,7 @@ public:
 	{
 	  FILE * fp = fopen ( szFile.c_str(), "a+" );
 	  bool bRet = false;
+	  std::lock_guard<std::mutex> guard(m_Lock);
 
 	  if (fp)
 	  {
@@ -279,6 +288,7 @@ public:
 		unsigned long cSingletonValues = 0;
 		unsigned long cAttribsWithOnlySingletonValues = 0;
 		unsigned long cSingletonAttribs = 0;
+		std::lock_guard<std::mutex> guard(m_Lock);
 
 		if (m_HitCount+m_MissCount) {
 			double dTot = m_HitCount + m_MissCount;
@@ -329,7 +339,15 @@ public:
 };
 
 
-static classad_shared_ptr<ClassAdCache> _cache;
+// Never destroyed: a CacheEntry flushes itself from the cache when the
+// last expression using it is deleted, and ads held in other static
+// objects are deleted during exit, possibly after this one would be.
+static classad_shared_ptr<ClassAdCache> &getCache()
+{
+	static classad_shared_ptr<ClassAdCache> *cache =
+		new classad_shared_ptr<ClassAdCache>( new ClassAdCache() );
+	return *cache;
+}
 //////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -339,8 +357,9 @@ static classad_shared_ptr<ClassAdCache> _cache;
 
 CacheEntry::~CacheEntry()
 {
-	if (_cache && _cache.use_count()) {
-		_cache->flush(szName, szValue);
+	classad_shared_ptr<ClassAdCache> &cache = getCache();
+	if (cache && cache.use_count()) {
+		cache->flush(szName, szValue);
 	}
 	delete pData;
 	pData = NULL;
@@ -372,9 +391,8 @@ ExprTree * CachedExprEnvelope::cache (const std::string & pName, ExprTree * pTre
 		break;
 
 	default:
-		if ( ! _cache) { _cache.reset( new ClassAdCache() ); }
 		pNewEnv = new CachedExprEnvelope();
-		pNewEnv->m_pLetter = _cache->cache(pName, szValue, pTree);
+		pNewEnv->m_pLetter = getCache()->cache(pName, szValue, pTree);
 		pRet = pNewEnv;
 		break;
 	}
@@ -388,40 +406,32 @@ ExprTree * CachedExprEnvelope::cache_lazy (std::string & pName, const std::strin
 ExprTree * CachedExprEnvelope::cache_lazy (const std::string & pName, const std::string & szValue)
 #endif
 {
-	if ( ! _cache) { _cache.reset( new ClassAdCache() ); }
 	CachedExprEnvelope *pEnv = new CachedExprEnvelope();
-	pEnv->m_pLetter = _cache->insert_lazy(pName, szValue);
+	pEnv->m_pLetter = getCache()->insert_lazy(pName, szValue);
 	return pEnv;
 }
 
 bool CachedExprEnvelope::_debug_dump_keys(const string & szFile)
 {
-  if ( ! _cache) return false;
-  return _cache->dump_keys(szFile);
+  return getCache()->dump_keys(szFile);
 }
 
 bool CachedExprEnvelope::_debug_get_counts(unsigned long &hits, unsigned long &misses, unsigned long &querys, unsigned long & hitdels, unsigned long &removals, unsigned long &unparse)
 {
-	if ( ! _cache) return false;
-	_cache->get_counts(hits, misses, querys, hitdels, removals, unparse);
+	getCache()->get_counts(hits, misses, querys, hitdels, removals, unparse);
 	return true;
 }
 
 void CachedExprEnvelope::_debug_print_stats(FILE* fp)
 {
-  if (_cache) _cache->print_stats(fp);
+  getCache()->print_stats(fp);
 }
 
 CachedExprEnvelope * CachedExprEnvelope::check_hit (string & szName, const string& szValue)
 {
    CachedExprEnvelope * pRet = 0; 
 
-   if (!_cache)
-   {
-	_cache.reset(new ClassAdCache());
-   }
-
-   pCacheData cache_check = _cache->cache( szName, szValue, 0);
+   pCacheData cache_check = getCache()->cache( szName, szValue, 0);
 
    if (cache_check)
    {
@@ -439,12 +449,19 @@ ExprTree * CachedExprEnvelope::get() const
 	
 	if (m_pLetter) {
 		CacheEntry * ptr = m_pLetter.get();
-		expr = ptr->pData;
+		expr = ptr->pData.load(std::memory_order_acquire);
 		if ( ! expr) {
-			ClassAdParser parser;
-			parser.SetOldClassAd(true);
-			expr = parser.ParseExpression(ptr->szValue);
-			ptr->pData = expr;
+			// many threads may evaluate the same lazy entry at once
+			static std::mutex lazy_parse_lock;
+			std::lock_guard<std::mutex> guard(lazy_parse_lock);
+			expr = ptr->pData.load(std::memory_order_relaxed);
+			if ( ! expr) {
+				ExprArenaScope heap(NULL); // the tree is shared by every ad using the entry
+				ClassAdParser parser;
+				parser.SetOldClassAd(true);
+				expr = parser.ParseExpression(ptr->szValue);
+				ptr->pData.store(expr, std::memory_order_release);
+			}
 		}
 	}
 	
@@ -482,8 +499,9 @@ bool CachedExprEnvelope::SameAs(const ExprTree* tree) const
 	}
 
 	if (tree->GetKind() != EXPR_ENVELOPE) {
-		if (m_pLetter && m_pLetter->pData) {
-			return m_pLetter->pData->SameAs(tree);
+		ExprTree * expr = m_pLetter ? m_pLetter->pData.load(std::memory_order_acquire) : NULL;
+		if (expr) {
+			return expr->SameAs(tree);
 		}
 		return false;
 	}
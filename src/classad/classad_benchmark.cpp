@@ -0,0 +1,696 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+/*
+ * Micro-benchmarks of the ClassAd library: parsing, unparsing, copying,
+ * lookups, evaluation and matching of synthetic job and slot ads shaped
+ * like the ones the schedd and startd produce.  The ads are generated
+ * from a fixed seed, so runs on different builds see the same input.
+ *
+ * Each benchmark repeats its operation until it has run for the minimum
+ * time, and reports the time per operation.  With -json, the results are
+ * written as a JSON array, one object per benchmark, for tracking across
+ * releases.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "classad/classad_distribution.h"
+#include "classad/classadCache.h"
+#include "classad/jsonSink.h"
+#include "classad/jsonSource.h"
+#include <chrono>
+#include <iostream>
+#include <stdio.h>
+
+using namespace std;
+using namespace classad;
+
+class Parameters
+{
+public:
+	int    num_jobs;
+	int    num_slots;
+	double min_seconds;
+	bool   json;
+	string only;
+
+	Parameters() : num_jobs(200), num_slots(500), min_seconds(1.0), json(false) {}
+	bool ParseCommandLine(int argc, char **argv);
+};
+
+struct BenchmarkResult
+{
+	string name;
+	long   operations;
+	double seconds;
+	string extra_name;	// an additional measurement, if any
+	double extra_value;
+};
+
+// Everything the benchmarks work on
+struct BenchmarkData
+{
+	vector<ClassAd *> jobs;
+	vector<ClassAd *> slots;
+	vector<string>    job_texts;
+	vector<string>    job_old_texts;
+	vector<string>    job_json_texts;
+	vector<string>    slot_old_texts;
+};
+
+typedef long (*BenchmarkFunc)(BenchmarkData &data);
+
+static void make_ads(const Parameters &parameters, BenchmarkData &data);
+static void free_ads(BenchmarkData &data);
+static bool run_benchmark(const Parameters &parameters, BenchmarkData &data,
+						  const char *name, BenchmarkFunc func,
+						  vector<BenchmarkResult> &results);
+static void print_results(const Parameters &parameters,
+						  const vector<BenchmarkResult> &results);
+
+static long bench_parse(BenchmarkData &data);
+static long bench_parse_old(BenchmarkData &data);
+static long bench_parse_json(BenchmarkData &data);
+static long bench_parse_json_reader(BenchmarkData &data);
+static long bench_unparse(BenchmarkData &data);
+static long bench_unparse_old(BenchmarkData &data);
+static long bench_unparse_json(BenchmarkData &data);
+static long bench_copy(BenchmarkData &data);
+static long bench_lookup(BenchmarkData &data);
+static long bench_eval_requirements(BenchmarkData &data);
+static long bench_eval_rank(BenchmarkData &data);
+static long bench_match(BenchmarkData &data);
+static long bench_match_compiled(BenchmarkData &data);
+static long bench_match_bound_left(BenchmarkData &data);
+static long bench_parse_cached(BenchmarkData &data);
+static long bench_string_list(BenchmarkData &data);
+
+int main(int argc, char **argv)
+{
+	Parameters parameters;
+	BenchmarkData data;
+	vector<BenchmarkResult> results;
+
+	if (!parameters.ParseCommandLine(argc, argv)) {
+		return 1;
+	}
+
+	make_ads(parameters, data);
+
+	bool ok = true;
+	ok = run_benchmark(parameters, data, "parse", bench_parse, results) && ok;
+	ok = run_benchmark(parameters, data, "parse_old", bench_parse_old, results) && ok;
+	ok = run_benchmark(parameters, data, "parse_json", bench_parse_json, results) && ok;
+	ok = run_benchmark(parameters, data, "parse_json_reader", bench_parse_json_reader, results) && ok;
+	ok = run_benchmark(parameters, data, "unparse", bench_unparse, results) && ok;
+	ok = run_benchmark(parameters, data, "unparse_old", bench_unparse_old, results) && ok;
+	ok = run_benchmark(parameters, data, "unparse_json", bench_unparse_json, results) && ok;
+	ok = run_benchmark(parameters, data, "copy", bench_copy, results) && ok;
+	ok = run_benchmark(parameters, data, "lookup", bench_lookup, results) && ok;
+	ok = run_benchmark(parameters, data, "eval_requirements", bench_eval_requirements, results) && ok;
+	ok = run_benchmark(parameters, data, "eval_rank", bench_eval_rank, results) && ok;
+	ok = run_benchmark(parameters, data, "match", bench_match, results) && ok;
+	ok = run_benchmark(parameters, data, "match_compiled", bench_match_compiled, results) && ok;
+	ok = run_benchmark(parameters, data, "match_bound_left", bench_match_bound_left, results) && ok;
+	ok = run_benchmark(parameters, data, "parse_cached", bench_parse_cached, results) && ok;
+	ok = run_benchmark(parameters, data, "string_list", bench_string_list, results) && ok;
+
+	print_results(parameters, results);
+	free_ads(data);
+
+	return ok ? 0 : 1;
+}
+
+bool Parameters::ParseCommandLine(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "-json") {
+			json = true;
+		} else if (arg == "-jobs" && i + 1 < argc) {
+			num_jobs = atoi(argv[++i]);
+		} else if (arg == "-slots" && i + 1 < argc) {
+			num_slots = atoi(argv[++i]);
+		} else if (arg == "-seconds" && i + 1 < argc) {
+			min_seconds = atof(argv[++i]);
+		} else if (arg == "-only" && i + 1 < argc) {
+			only = argv[++i];
+		} else {
+			cerr << "Usage: " << argv[0]
+				 << " [-jobs N] [-slots N] [-seconds S] [-only NAME] [-json]\n"
+				 << "    -jobs:    the number of job ads (default 200)\n"
+				 << "    -slots:   the number of slot ads (default 500)\n"
+				 << "    -seconds: the minimum time to run each benchmark (default 1)\n"
+				 << "    -only:    run only the named benchmark\n"
+				 << "    -json:    write the results as JSON\n";
+			return false;
+		}
+	}
+	if (num_jobs < 1 || num_slots < 1) {
+		cerr << "The numbers of jobs and slots must be positive\n";
+		return false;
+	}
+	return true;
+}
+
+/*********************************************************************
+ *
+ * Synthetic ads
+ *
+ *********************************************************************/
+
+// A small, fixed pseudo-random sequence, so the ads don't depend on the
+// platform's rand()
+static unsigned int seed = 12345;
+
+static int pick(int n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (int)((seed >> 16) % n);
+}
+
+static const char *owners[] = { "alice", "bob", "carol", "dave", "erin", "frank" };
+static const char *arches[] = { "X86_64", "X86_64", "X86_64", "ppc64le", "aarch64" };
+static const char *opsyses[] = { "LINUX", "LINUX", "LINUX", "WINDOWS", "OSX" };
+
+static string make_job_text(int i)
+{
+	char buf[4096];
+	const char *owner = owners[pick(6)];
+	snprintf(buf, sizeof(buf),
+		"[ClusterId = %d; ProcId = %d; Owner = \"%s\"; User = \"%s@example.org\";"
+		" AccountingGroup = \"group_%s.%s\"; JobUniverse = 5; JobStatus = 1;"
+		" QDate = %d; EnteredCurrentStatus = %d; JobPrio = %d;"
+		" Cmd = \"/home/%s/bin/analyze\"; Arguments = \"-n %d -o out.%d\";"
+		" Iwd = \"/home/%s/run%d\"; Out = \"out.%d\"; Err = \"err.%d\";"
+		" Environment = \"HOME=/home/%s PATH=/usr/bin:/bin OMP_NUM_THREADS=%d\";"
+		" TransferInput = \"input.%d,params.json,lib.tar.gz\";"
+		" ShouldTransferFiles = \"YES\"; WhenToTransferOutput = \"ON_EXIT\";"
+		" RequestCpus = %d; RequestMemory = %d; RequestDisk = %d;"
+		" ImageSize = %d; DiskUsage = %d; NumJobStarts = 0; NumRestarts = 0;"
+		" MaxHosts = 1; MinHosts = 1; CurrentHosts = 0; WantRemoteIO = true;"
+		" Rank = TARGET.KFlops / 1000 + (TARGET.Arch == \"X86_64\" ? 100 : 0);"
+		" Requirements = (TARGET.Arch == \"X86_64\" || TARGET.Arch == \"aarch64\") &&"
+		" TARGET.OpSys == \"LINUX\" && TARGET.Disk >= RequestDisk &&"
+		" TARGET.Memory >= RequestMemory && TARGET.Cpus >= RequestCpus &&"
+		" (TARGET.HasFileTransfer || TARGET.FileSystemDomain == MY.FileSystemDomain);"
+		" FileSystemDomain = \"example.org\";"
+		" PeriodicRemove = JobStatus == 5 && time() - EnteredCurrentStatus > 86400;"
+		" OnExitRemove = ExitCode =?= 0 || NumJobStarts > 3 ]",
+		1000 + i / 10, i % 10, owner, owner, pick(2) ? "physics" : "chem", owner,
+		1600000000 + i * 7, 1600000000 + i * 7, pick(20) - 10,
+		owner, i, i, owner, i, i, i, owner, 1 + pick(8), i,
+		1 << pick(4), 512 * (1 + pick(16)), 1024 * (1 + pick(100)),
+		1024 * pick(1000), pick(100000));
+	return buf;
+}
+
+static string make_slot_text(int i)
+{
+	char buf[4096];
+	int cpus = 1 << pick(5);
+	snprintf(buf, sizeof(buf),
+		"[Name = \"slot%d@node%d.example.org\"; Machine = \"node%d.example.org\";"
+		" MyAddress = \"<10.0.%d.%d:9618?addrs=10.0.%d.%d-9618&noUDP&sock=startd>\";"
+		" Arch = \"%s\"; OpSys = \"%s\"; OpSysAndVer = \"RedHat8\"; OpSysMajorVer = 8;"
+		" State = \"Unclaimed\"; Activity = \"Idle\"; EnteredCurrentState = %d;"
+		" Cpus = %d; TotalCpus = %d; Memory = %d; TotalMemory = %d; Disk = %d;"
+		" KFlops = %d; Mips = %d; LoadAvg = %d.%d; CondorLoadAvg = 0.0;"
+		" TotalLoadAvg = %d.%d; KeyboardIdle = %d; ConsoleIdle = %d;"
+		" HasFileTransfer = true; HasJICLocalConfig = true; HasVM = false;"
+		" FileSystemDomain = \"%s\"; UidDomain = \"example.org\";"
+		" SlotType = \"Partitionable\"; SlotID = %d; NumDynamicSlots = 0;"
+		" CondorVersion = \"$CondorVersion: 8.9.11 Jan 27 2021 $\";"
+		" CondorPlatform = \"$CondorPlatform: x86_64_CentOS8 $\";"
+		" StartdIpAddr = \"<10.0.%d.%d:9618>\"; IsOwner = false; Rank = 0;"
+		" Start = KeyboardIdle > 15 * 60 && (TARGET.Owner != \"frank\" ||"
+		" TARGET.RequestCpus <= 2) && (LoadAvg - CondorLoadAvg) <= 0.3;"
+		" Requirements = START && TARGET.RequestMemory <= MY.Memory ]",
+		i % 8 + 1, i / 8, i / 8, i / 256, i % 256, i / 256, i % 256,
+		arches[pick(5)], opsyses[pick(5)], 1600000000 + i * 3,
+		cpus, cpus, 2048 * cpus, 2048 * cpus, 1024 * 1024 * (1 + pick(20)),
+		800000 + pick(800000), 10000 + pick(40000), pick(2), pick(100),
+		pick(2), pick(100), pick(4000), pick(4000),
+		pick(4) ? "example.org" : "other.org", i % 8 + 1, i / 256, i % 256);
+	return buf;
+}
+
+static void make_ads(const Parameters &parameters, BenchmarkData &data)
+{
+	ClassAdParser parser;
+	ClassAdUnParser old_unparser;
+	ClassAdJsonUnParser json_unparser;
+	string old_text;
+
+	old_unparser.SetOldClassAd(true);
+	for (int i = 0; i < parameters.num_jobs; i++) {
+		string text = make_job_text(i);
+		ClassAd *ad = parser.ParseClassAd(text, true);
+		if (!ad) {
+			cerr << "Failed to parse job ad " << text << "\n";
+			exit(1);
+		}
+		string json_text;
+		old_text.clear();
+		old_unparser.Unparse(old_text, ad);
+		json_unparser.Unparse(json_text, ad);
+		data.jobs.push_back(ad);
+		data.job_texts.push_back(text);
+		data.job_old_texts.push_back(old_text);
+		data.job_json_texts.push_back(json_text);
+	}
+	for (int i = 0; i < parameters.num_slots; i++) {
+		string text = make_slot_text(i);
+		ClassAd *ad = parser.ParseClassAd(text, true);
+		if (!ad) {
+			cerr << "Failed to parse slot ad " << text << "\n";
+			exit(1);
+		}
+		old_text.clear();
+		old_unparser.Unparse(old_text, ad);
+		data.slots.push_back(ad);
+		data.slot_old_texts.push_back(old_text);
+	}
+}
+
+static void free_ads(BenchmarkData &data)
+{
+	for (size_t i = 0; i < data.jobs.size(); i++) {
+		delete data.jobs[i];
+	}
+	for (size_t i = 0; i < data.slots.size(); i++) {
+		delete data.slots[i];
+	}
+}
+
+/*********************************************************************
+ *
+ * Running and reporting
+ *
+ *********************************************************************/
+
+// Results of benchmarks that have more to say than their speed
+static string extra_name;
+static double extra_value;
+
+static bool run_benchmark(const Parameters &parameters, BenchmarkData &data,
+						  const char *name, BenchmarkFunc func,
+						  vector<BenchmarkResult> &results)
+{
+	if (!parameters.only.empty() && parameters.only != name) {
+		return true;
+	}
+
+	BenchmarkResult result;
+	result.name = name;
+	result.operations = 0;
+	result.seconds = 0;
+
+		// once untimed, to warm up caches and compiled expressions
+	extra_name.clear();
+	if (func(data) < 0) {
+		cerr << "Benchmark " << name << " failed\n";
+		return false;
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	do {
+		long ops = func(data);
+		if (ops < 0) {
+			cerr << "Benchmark " << name << " failed\n";
+			return false;
+		}
+		result.operations += ops;
+		result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	} while (result.seconds < parameters.min_seconds);
+
+	result.extra_name = extra_name;
+	result.extra_value = extra_value;
+	results.push_back(result);
+	return true;
+}
+
+static void print_results(const Parameters &parameters,
+						  const vector<BenchmarkResult> &results)
+{
+	string version;
+	ClassAdLibraryVersion(version);
+
+	if (parameters.json) {
+		printf("[\n");
+		for (size_t i = 0; i < results.size(); i++) {
+			const BenchmarkResult &r = results[i];
+			printf("  { \"benchmark\": \"%s\", \"version\": \"%s\", \"jobs\": %d, \"slots\": %d,"
+				   " \"operations\": %ld, \"seconds\": %.6f, \"ns_per_op\": %.1f",
+				   r.name.c_str(), version.c_str(), parameters.num_jobs, parameters.num_slots,
+				   r.operations, r.seconds, r.seconds * 1e9 / r.operations);
+			if (!r.extra_name.empty()) {
+				printf(", \"%s\": %.4f", r.extra_name.c_str(), r.extra_value);
+			}
+			printf(" }%s\n", i + 1 < results.size() ? "," : "");
+		}
+		printf("]\n");
+		return;
+	}
+
+	printf("ClassAd Library v%s, %d jobs, %d slots\n\n",
+		   version.c_str(), parameters.num_jobs, parameters.num_slots);
+	printf("%-20s %14s %12s\n", "benchmark", "operations", "ns/op");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult &r = results[i];
+		printf("%-20s %14ld %12.1f", r.name.c_str(), r.operations,
+			   r.seconds * 1e9 / r.operations);
+		if (!r.extra_name.empty()) {
+			printf("   %s %.4f", r.extra_name.c_str(), r.extra_value);
+		}
+		printf("\n");
+	}
+}
+
+/*********************************************************************
+ *
+ * The benchmarks.  Each does one pass over the ads and returns the number
+ * of operations it did, or -1 if something went wrong.
+ *
+ *********************************************************************/
+
+static long bench_parse(BenchmarkData &data)
+{
+	ClassAdParser parser;
+	for (size_t i = 0; i < data.job_texts.size(); i++) {
+		ClassAd *ad = parser.ParseClassAd(data.job_texts[i], true);
+		if (!ad) {
+			return -1;
+		}
+		delete ad;
+	}
+	return (long)data.job_texts.size();
+}
+
+// Makes an ad from old ClassAd syntax one line at a time, the way Condor
+// reads ads from files
+static ClassAd *parse_old_ad(const string &text)
+{
+	ClassAd *ad = new ClassAd;
+	size_t start = 0;
+	while (start < text.size()) {
+		size_t end = text.find('\n', start);
+		if (end == string::npos) {
+			end = text.size();
+		}
+		if (end > start && !ad->Insert(text.substr(start, end - start))) {
+			delete ad;
+			return NULL;
+		}
+		start = end + 1;
+	}
+	return ad;
+}
+
+static long bench_parse_old(BenchmarkData &data)
+{
+	for (size_t i = 0; i < data.job_old_texts.size(); i++) {
+		ClassAd *ad = parse_old_ad(data.job_old_texts[i]);
+		if (!ad) {
+			return -1;
+		}
+		delete ad;
+	}
+	return (long)data.job_old_texts.size();
+}
+
+static long bench_parse_json(BenchmarkData &data)
+{
+	ClassAdJsonParser parser;
+	for (size_t i = 0; i < data.job_json_texts.size(); i++) {
+		ClassAd *ad = parser.ParseClassAd(data.job_json_texts[i], true);
+		if (!ad) {
+			return -1;
+		}
+		delete ad;
+	}
+	return (long)data.job_json_texts.size();
+}
+
+static long bench_parse_json_reader(BenchmarkData &data)
+{
+	ClassAdJsonReader reader;
+	ClassAd ad;
+	for (size_t i = 0; i < data.job_json_texts.size(); i++) {
+		if (!reader.ParseClassAd(data.job_json_texts[i], ad, true)) {
+			return -1;
+		}
+	}
+	return (long)data.job_json_texts.size();
+}
+
+static long bench_unparse(BenchmarkData &data)
+{
+	ClassAdUnParser unparser;
+	string buffer;
+	for (size_t i = 0; i < data.jobs.size(); i++) {
+		buffer.clear();
+		unparser.Unparse(buffer, data.jobs[i]);
+	}
+	return (long)data.jobs.size();
+}
+
+static long bench_unparse_old(BenchmarkData &data)
+{
+	ClassAdUnParser unparser;
+	string buffer;
+	unparser.SetOldClassAd(true);
+	for (size_t i = 0; i < data.jobs.size(); i++) {
+		buffer.clear();
+		unparser.Unparse(buffer, data.jobs[i]);
+	}
+	return (long)data.jobs.size();
+}
+
+static long bench_unparse_json(BenchmarkData &data)
+{
+	ClassAdJsonUnParser unparser;
+	string buffer;
+	for (size_t i = 0; i < data.jobs.size(); i++) {
+		buffer.clear();
+		unparser.Unparse(buffer, data.jobs[i]);
+	}
+	return (long)data.jobs.size();
+}
+
+static long bench_copy(BenchmarkData &data)
+{
+	for (size_t i = 0; i < data.jobs.size(); i++) {
+		ClassAd *ad = new ClassAd(*data.jobs[i]);
+		delete ad;
+	}
+	return (long)data.jobs.size();
+}
+
+static long bench_lookup(BenchmarkData &data)
+{
+		// attributes the negotiator and schedd look up often, and
+		// some that are not there
+	static const char *names[] = {
+		"Requirements", "Rank", "RequestMemory", "RequestCpus", "Owner",
+		"JobStatus", "ClusterId", "ProcId", "ConcurrencyLimits", "JobPrio",
+		"NiceUser", "AccountingGroup", "RemoteUserCpu", "Cmd", "DiskUsage",
+		NULL
+	};
+	long ops = 0;
+	long found = 0;
+	for (size_t i = 0; i < data.jobs.size(); i++) {
+		for (int j = 0; names[j]; j++) {
+			if (data.jobs[i]->Lookup(names[j])) {
+				found++;
+			}
+			ops++;
+		}
+	}
+	return found ? ops : -1;
+}
+
+static long bench_eval_requirements(BenchmarkData &data)
+{
+	MatchClassAd match;
+	long ops = 0;
+	long matched = 0;
+	for (size_t j = 0; j < data.jobs.size(); j++) {
+		match.BindLeftAd(data.jobs[j]);
+		ClassAd *job = match.GetLeftAd();
+		for (size_t s = 0; s < data.slots.size(); s++) {
+			bool result = false;
+			match.BindRightAd(data.slots[s]);
+			if (job->EvaluateAttrBool("Requirements", result) && result) {
+				matched++;
+			}
+			ops++;
+		}
+	}
+	extra_name = "true_fraction";
+	extra_value = (double)matched / ops;
+	return ops;
+}
+
+static long bench_eval_rank(BenchmarkData &data)
+{
+	MatchClassAd match;
+	long ops = 0;
+	for (size_t j = 0; j < data.jobs.size(); j++) {
+		match.BindLeftAd(data.jobs[j]);
+		ClassAd *job = match.GetLeftAd();
+		for (size_t s = 0; s < data.slots.size(); s++) {
+			double rank = 0;
+			match.BindRightAd(data.slots[s]);
+			if (!job->EvaluateAttrNumber("Rank", rank)) {
+				return -1;
+			}
+			ops++;
+		}
+	}
+	return ops;
+}
+
+static long do_match(BenchmarkData &data, bool bound_left = false)
+{
+	MatchClassAd match;
+	long ops = 0;
+	long matched = 0;
+	for (size_t j = 0; j < data.jobs.size(); j++) {
+		if (bound_left) {
+			match.BindLeftAdForMatchmaking(data.jobs[j]);
+		} else {
+			match.BindLeftAd(data.jobs[j]);
+		}
+		for (size_t s = 0; s < data.slots.size(); s++) {
+			match.BindRightAd(data.slots[s]);
+			if (match.symmetricMatch()) {
+				matched++;
+			}
+			ops++;
+		}
+	}
+	extra_name = "match_fraction";
+	extra_value = (double)matched / ops;
+	return ops;
+}
+
+static long bench_match(BenchmarkData &data)
+{
+	return do_match(data);
+}
+
+static long bench_match_compiled(BenchmarkData &data)
+{
+	bool was_compiling = ClassAdGetExpressionCompiling();
+	ClassAdSetExpressionCompiling(true);
+	long ops = do_match(data);
+	ClassAdSetExpressionCompiling(was_compiling);
+	return ops;
+}
+
+static long bench_match_bound_left(BenchmarkData &data)
+{
+	return do_match(data, true);
+}
+
+static long bench_parse_cached(BenchmarkData &data)
+{
+	unsigned long hits = 0, misses = 0, queries, hitdels, removals, unparse;
+	unsigned long hits_before = 0, misses_before = 0;
+	bool was_caching = ClassAdGetExpressionCaching();
+
+		// the ads are all kept until the end, as a collector would keep
+		// them, since an entry leaves the cache with the last ad using it
+	vector<ClassAd *> ads;
+	bool ok = true;
+	CachedExprEnvelope::_debug_get_counts(hits_before, misses_before, queries, hitdels, removals, unparse);
+	ClassAdSetExpressionCaching(true);
+	for (size_t i = 0; ok && i < data.slot_old_texts.size(); i++) {
+		ClassAd *ad = parse_old_ad(data.slot_old_texts[i]);
+		if (ad) {
+			ads.push_back(ad);
+		} else {
+			ok = false;
+		}
+	}
+	ClassAdSetExpressionCaching(was_caching);
+	CachedExprEnvelope::_debug_get_counts(hits, misses, queries, hitdels, removals, unparse);
+	for (size_t i = 0; i < ads.size(); i++) {
+		delete ads[i];
+	}
+	if (!ok) {
+		return -1;
+	}
+
+	hits -= hits_before;
+	misses -= misses_before;
+	extra_name = "cache_hit_rate";
+	extra_value = (hits + misses) ? (double)hits / (hits + misses) : 0;
+	return (long)data.slot_old_texts.size();
+}
+
+// A job testing slots' long lists of software tags, as
+// stringListsIntersect() is used in requirements
+static long bench_string_list(BenchmarkData &data)
+{
+	ClassAdParser parser;
+	ClassAd *job = parser.ParseClassAd(
+		"[WantsSoftware = stringListsIntersect(\"software_7,software_250,software_499\","
+		" TARGET.SoftwareTags)]");
+	vector<ClassAd *> tagged;
+	for (int i = 0; i < 8; i++) {
+		string tags;
+		for (int t = 0; t < 200; t++) {
+			tags += tags.empty() ? "" : ",";
+			tags += "software_" + to_string((i * 37 + t) % 500);
+		}
+		ClassAd *ad = new ClassAd;
+		ad->InsertAttr("SoftwareTags", tags);
+		tagged.push_back(ad);
+	}
+
+	MatchClassAd match;
+	long ops = 0;
+	long matched = 0;
+	match.BindLeftAd(job);
+	ClassAd *bound = match.GetLeftAd();
+	for (size_t j = 0; j < data.jobs.size(); j++) {
+		for (size_t s = 0; s < tagged.size(); s++) {
+			bool result = false;
+			match.BindRightAd(tagged[s]);
+			if (bound->EvaluateAttrBool("WantsSoftware", result) && result) {
+				matched++;
+			}
+			ops++;
+		}
+	}
+	match.RemoveRightAd();
+	match.RemoveLeftAd();
+	delete job;
+	for (size_t s = 0; s < tagged.size(); s++) {
+		delete tagged[s];
+	}
+	extra_name = "true_fraction";
+	extra_value = (double)matched / ops;
+	return ops;
+}
@@ -34,8 +34,16 @@
 
 #include "classad/classad_distribution.h"
 #include "classad/lexerSource.h"
+#include "classad/compiledExpr.h"
+#include "classad/batchConstraint.h"
+#include "classad/binaryCodec.h"
+#include "classad/exprArena.h"
+#include "classad/evalProfile.h"
+#include "classad/stringListSet.h"
 #include "classad/xmlSink.h"
+#include "classad/jsonSink.h"
 #include <fstream>
+#include <thread>
 #include <iostream>
 #include <ctype.h>
 #include <assert.h>
@@ -94,9 +102,12 @@ static void test_parsing(const Parameters &parameters, Results &results);
 static void test_classad(const Parameters &parameters, Results &results);
 static void test_exprlist(const Parameters &parameters, Results &results);
 static void test_value(const Parameters &parameters, Results &results);
+static void test_match(const Parameters &parameters, Results &results);
+static void test_threaded_match(const Parameters &parameters, Results &results);
 static void test_collection(const Parameters &parameters, Results &results);
 static void test_utils(const Parameters &parameters, Results &results);
 static bool check_in_view(ClassAdCollection *collection, string view_name, string classad_name);
+static string query_view(ClassAdCollection *collection, string view_name, string constraint);
 static void print_version(void);
 
 /*********************************************************************
@@ -288,6 +299,8 @@ int main(
     if (parameters.check_all || parameters.check_literal) {
     }
     if (parameters.check_all || parameters.check_match) {
+        test_match(parameters, results);
+        test_threaded_match(parameters, results);
     }
     if (parameters.check_all || parameters.check_operator) {
     }
@@ -543,6 +556,407 @@ static void test_classad(const Parameters &, Results &results)
     TEST("update from chain is merged",(have_attribute==true));
     TEST("update from chain has attribute c==6",(i==6));
 
+    // Attribute names are interned, but keep their spelling
+    ClassAd classad4, classad5;
+    classad4.InsertAttr("InternedName", 1);
+    classad5.InsertAttr("internedname", 2);
+    classad5.InsertAttr("InternedName", 3);
+    TEST("interned names are shared between ads",
+         &classad4.begin()->first.str() == &AttrName("InternedName").str());
+    TEST("interned names keep their spelling",
+         classad5.size() == 1 && classad5.begin()->first == "internedname");
+    have_attribute = classad5.EvaluateAttrInt("INTERNEDNAME", i);
+    TEST("interned names are looked up without case", have_attribute && i == 3);
+    TEST("different spellings are different names",
+         AttrName("InternedName") != AttrName("internedname"));
+    AttrName *transient = new AttrName("TransientName");
+    AttrName transient_copy = *transient;
+    delete transient;
+    TEST("interned names outlive the name they were copied from",
+         transient_copy == "TransientName");
+    transient_copy = AttrName("InternedName");
+    TEST("assigned names share the interned string",
+         &transient_copy.str() == &classad4.begin()->first.str());
+
+    // Frozen ads can be read like any other, and thaw when written
+    ClassAd *frozen = parser.ParseClassAd("[ A = 3; B = A + 1; C = \"str\"; D = [ E = 5; ]; ]");
+    const ClassAd *cfrozen = frozen;
+    ExprTree *a_expr = frozen->Lookup("A");
+    Value value;
+    frozen->Freeze();
+    TEST("ad is frozen", frozen->IsFrozen());
+    TEST("frozen ad has all attributes", frozen->size() == 4);
+    TEST("frozen lookup keeps the expression", frozen->Lookup("a") == a_expr);
+    TEST("frozen lookup of missing attribute", frozen->Lookup("Z") == NULL);
+    have_attribute = frozen->EvaluateAttrInt("B", i);
+    TEST("frozen ad evaluates B", have_attribute && i == 4);
+    have_attribute = frozen->EvaluateExpr("D.E", value);
+    TEST("frozen ad evaluates D.E", have_attribute && value.IsIntegerValue(i) && i == 5);
+    TEST("frozen find", cfrozen->find("C") != cfrozen->end() &&
+         cfrozen->find("C")->first == "C");
+    i = 0;
+    for (ClassAd::const_iterator itr = cfrozen->begin(); itr != cfrozen->end(); itr++) {
+        i++;
+    }
+    TEST("frozen iteration sees all attributes", i == 4 && frozen->IsFrozen());
+    ClassAd thawed_copy(*frozen);
+    TEST("copy of frozen ad", thawed_copy.size() == 4 && !thawed_copy.IsFrozen());
+    frozen->InsertAttr("F", 6);
+    TEST("insert thaws ad", !frozen->IsFrozen() && frozen->size() == 5);
+    TEST("thawing keeps the expression", frozen->Lookup("A") == a_expr);
+    have_attribute = frozen->EvaluateAttrInt("B", i);
+    TEST("thawed ad evaluates B", have_attribute && i == 4);
+    delete frozen;
+
+    // Batch evaluation gives the same answers as evaluating ad by ad
+    const char *batch_ads[] = {
+        "[ State = \"Unclaimed\"; Memory = 8192; Cpus = 4; Arch = \"X86_64\"; ]",
+        "[ State = \"claimed\"; Memory = 8192.0; Cpus = true; ]",
+        "[ State = \"UNCLAIMED\"; Memory = 2048; Cpus = \"four\"; ]",
+        "[ Memory = 4096; Cpus = undefined; Arch = error; ]",
+        "[ State = \"Unclaimed\"; Memory = TotalMemory / 2; TotalMemory = 10000; ]",
+        "[ State = 3; Memory = \"lots\"; Cpus = 2K; ]",
+        "[ State = \"Unclaimed\"; Memory = 9007199254740993; Arch = \"INTEL\"; ]",
+        NULL
+    };
+    const char *batch_constraints[] = {
+        "State == \"Unclaimed\" && Memory > 4096",
+        "(4096 <= Memory) || !(Cpus >= 2)",
+        "State =?= \"Unclaimed\" || Arch =!= undefined",
+        "Cpus =?= undefined && Memory != 8192",
+        "Memory =?= 8192 || Cpus == 2048",
+        "Arch == \"intel\" || strcmp(Arch, \"X86_64\") == 0",
+        "Memory > 9007199254740992",
+        "Memory",
+        NULL
+    };
+    vector<const ClassAd *> batch;
+    for (int ad_index = 0; batch_ads[ad_index]; ad_index++) {
+        batch.push_back(parser.ParseClassAd(batch_ads[ad_index]));
+    }
+    bool batch_same = true;
+    bool batch_vectorized = true;
+    for (int c_index = 0; batch_constraints[c_index]; c_index++) {
+        ExprTree *constraint = NULL;
+        parser.ParseExpression(batch_constraints[c_index], constraint);
+        BatchConstraint batch_constraint;
+        batch_constraint.Initialize(constraint);
+        if (c_index < 5 && !batch_constraint.IsVectorized()) {
+            batch_vectorized = false;
+        }
+        vector<bool> matches;
+        batch_constraint.Evaluate(batch, matches);
+        for (size_t ad_index = 0; ad_index < batch.size(); ad_index++) {
+            bool expected = batch[ad_index]->EvaluateExpr(constraint, value) &&
+                value.IsBooleanValueEquiv(b) && b;
+            if (matches[ad_index] != expected) {
+                batch_same = false;
+            }
+        }
+        delete constraint;
+    }
+    TEST("batch constraints are vectorized", batch_vectorized);
+    TEST("batch evaluation matches scalar evaluation", batch_same);
+    for (size_t ad_index = 0; ad_index < batch.size(); ad_index++) {
+        delete batch[ad_index];
+    }
+    ClassAd *batch_parent = parser.ParseClassAd("[ State = \"Unclaimed\"; Memory = 8192; ]");
+    ClassAd batch_child;
+    batch_child.SetParentScope(batch_parent);
+    batch.assign(1, &batch_child);
+    ExprTree *scoped_constraint = NULL;
+    parser.ParseExpression(batch_constraints[0], scoped_constraint);
+    BatchConstraint scoped_batch;
+    scoped_batch.Initialize(scoped_constraint);
+    vector<bool> scoped_matches;
+    scoped_batch.Evaluate(batch, scoped_matches);
+    TEST("batch evaluation finds attributes in the parent scope", scoped_matches[0]);
+    delete scoped_constraint;
+    delete batch_parent;
+
+    /* ----- Test the binary encoding ----- */
+    ClassAd *binary_ad = parser.ParseClassAd(
+        "[ A = 1; B = -7.5; C = \"a \\\"quoted\\\" string\"; D = undefined; E = error;"
+        "  F = true; G = 2K; H = absTime(\"2021-03-04T05:06:07-05:00\"); I = relTime(90);"
+        "  J = {1, \"two\", [ x = 3 ]}; K = [ y = A + 1; z = parent.A ];"
+        "  L = ifThenElse(A > 0, MY.B, TARGET.C); M = (A - B) * -C;"
+        "  N = A ? B : C; O = K.y; P = J[1]; Q = .A; R = !F || E =?= D ]");
+    ClassAdBinaryUnParser binary_unparser;
+    ClassAdBinaryParser binary_parser;
+    binary_unparser.SetUseDictionary(true);
+    string binary_first, binary_second;
+    for (ClassAd::const_iterator itr = binary_ad->begin(); itr != binary_ad->end(); itr++) {
+        binary_unparser.UnparseAttr(binary_first, itr->first, itr->second);
+    }
+    for (ClassAd::const_iterator itr = binary_ad->begin(); itr != binary_ad->end(); itr++) {
+        binary_unparser.UnparseAttr(binary_second, itr->first, itr->second);
+    }
+    TEST("Names are sent once through the dictionary", binary_second.size() < binary_first.size());
+    bool binary_ok = true;
+    for (int pass = 0; pass < 2 && binary_ok; pass++) {
+        const string &encoded = pass ? binary_second : binary_first;
+        const char *buf = encoded.data();
+        const char *end = buf + encoded.size();
+        ClassAd decoded;
+        while (buf < end && binary_ok) {
+            binary_ok = binary_parser.ParseAttr(buf, end, decoded, false);
+        }
+        TEST("Binary encoding decodes to the same ad", binary_ok && decoded.SameAs(binary_ad));
+    }
+    ClassAd *elvis_ad = parser.ParseClassAd("[ A = undefined; B = 2; S = A ?: B ]");
+    ClassAdBinaryUnParser elvis_unparser;
+    ClassAdBinaryParser elvis_parser;
+    string elvis_encoded;
+    elvis_unparser.UnparseAttr(elvis_encoded, "S", elvis_ad->Lookup("S"));
+    const char *elvis_buf = elvis_encoded.data();
+    ClassAd elvis_decoded;
+    bool elvis_ok = elvis_parser.ParseAttr(elvis_buf, elvis_buf + elvis_encoded.size(), elvis_decoded, false);
+    TEST("Elvis operator survives the binary encoding",
+        elvis_ok && elvis_decoded.Lookup("S") && elvis_decoded.Lookup("S")->SameAs(elvis_ad->Lookup("S")));
+    delete elvis_ad;
+    ClassAdBinaryParser truncated_parser;
+    bool truncated_fails = true;
+    for (size_t len = 0; len < binary_first.size(); len++) {
+        const char *buf = binary_first.data();
+        const char *end = buf + len;
+        ClassAd decoded;
+        bool ok = true;
+        while (buf < end && ok) {
+            ok = truncated_parser.ParseAttr(buf, end, decoded, false);
+        }
+        if (ok && decoded.size() == binary_ad->size()) {
+            truncated_fails = false;
+        }
+        truncated_parser.ClearDictionary();
+    }
+    TEST("Truncated binary encoding is rejected", truncated_fails);
+    string factor_encoded;
+    binary_unparser.Unparse(factor_encoded, binary_ad->Lookup("G"));
+    factor_encoded[1] = (char)(Value::T_FACTOR + 1);
+    const char *factor_buf = factor_encoded.data();
+    ExprTree *bad_factor = truncated_parser.ParseExpression(factor_buf, factor_buf + factor_encoded.size());
+    TEST("Binary encoding with a bad factor is rejected", bad_factor == NULL);
+    delete bad_factor;
+
+    /* ----- Test arena allocation ----- */
+    string arena_text;
+    ClassAdUnParser arena_unparser;
+    arena_unparser.Unparse(arena_text, binary_ad);
+    ExprTree *arena_escapee = NULL;
+    bool arena_same = true;
+    size_t arena_chunks = 0;
+    {
+        ExprArena arena;
+        ExprArenaScope scope(&arena);
+        for (int pass = 0; pass < 10; pass++) {
+            ClassAd *arena_ad = parser.ParseClassAd(arena_text);
+            if (!arena_ad || !arena_ad->SameAs(binary_ad)) {
+                arena_same = false;
+            }
+            if (pass == 0) {
+                arena_chunks = arena.NumChunks();
+            } else if (pass == 9 && arena_ad) {
+                arena_escapee = arena_ad->Remove("K");
+            }
+            delete arena_ad;
+        }
+        TEST("Arena allocates parsed ads", arena_chunks > 0);
+        TEST("Arena reuses the memory of deleted ads", arena.NumChunks() == arena_chunks);
+    }
+    TEST("Ads parsed in an arena are the same", arena_same);
+    TEST("Nodes outlive their arena", arena_escapee &&
+        arena_escapee->SameAs(binary_ad->Lookup("K")));
+    delete arena_escapee;
+    delete binary_ad;
+
+    /* ----- Test compiled regular expressions ----- */
+    ClassAd *regex_ad = parser.ParseClassAd(
+        "[Pat = \"^a.c$\"; Name = \"abc\";"
+        " LitMatch = regexp(\"^A.C$\", Name, \"i\");"
+        " LitNoMatch = regexp(\"^A.C$\", Name);"
+        " RefMatch = regexp(Pat, Name);"
+        " Bad = regexp(\"(\", Name);"
+        " Subst = regexps(\"(b)\", Name, \"[\\\\1]\");"
+        " Repl = replaceall(\"[ac]\", Name, \"x\")]");
+    TEST("Parsed regexp ad", regex_ad != NULL);
+    if (regex_ad) {
+        bool regex_same = true;
+        for (int pass = 0; pass < 3; pass++) {
+            bool b;
+            string str;
+            Value v;
+            regex_same = regex_same &&
+                regex_ad->EvaluateAttrBool("LitMatch", b) && b &&
+                regex_ad->EvaluateAttrBool("LitNoMatch", b) && !b &&
+                regex_ad->EvaluateAttrBool("RefMatch", b) && b &&
+                regex_ad->EvaluateAttr("Bad", v) && v.IsErrorValue() &&
+                regex_ad->EvaluateAttrString("Subst", str) && str == "[b]" &&
+                regex_ad->EvaluateAttrString("Repl", str) && str == "xbx";
+        }
+        TEST("Regexp results are the same every time", regex_same);
+
+            // more patterns than the cache holds
+        bool regex_evicted = true;
+        char pattern[64], name[64];
+        for (int i = 0; i < 1500; i++) {
+            bool b;
+            snprintf(pattern, sizeof(pattern), "^a%d$", i % 600);
+            snprintf(name, sizeof(name), "a%d", i % 600);
+            regex_ad->InsertAttr("Pat", pattern);
+            regex_ad->InsertAttr("Name", name);
+            regex_evicted = regex_evicted &&
+                regex_ad->EvaluateAttrBool("RefMatch", b) && b;
+        }
+        TEST("Regexp results survive cache eviction", regex_evicted);
+        delete regex_ad;
+    }
+
+    /* ----- Test the evaluation profile ----- */
+    ClassAd *profile_ad = parser.ParseClassAd(
+        "[A = B + c; B = strcat(\"x\", \"y\") == \"xy\" ? 1 : 0; C = size(\"abc\")]");
+    TEST("Parsed profile ad", profile_ad != NULL);
+    if (profile_ad) {
+        ClassAd profile;
+        Value v;
+        long long calls = 0;
+        int a;
+        EvalProfile::Reset();
+        EvalProfile::Enable(true);
+        bool profiled = true;
+        for (int i = 0; i < 10; i++) {
+            profiled = profiled && profile_ad->EvaluateAttrInt("A", a) && a == 4;
+        }
+        EvalProfile::Enable(false);
+        profile_ad->EvaluateAttrInt("A", a);
+        EvalProfile::GetProfile(profile);
+        TEST("Evaluation with profiling", profiled);
+        TEST("Profile counts top-level attributes",
+             profile.EvaluateExpr("Attributes.A.Calls", v) && v.IsIntegerValue(calls) && calls == 10);
+        TEST("Profile counts attribute references regardless of case",
+             profile.EvaluateExpr("Attributes.C.Calls", v) && v.IsIntegerValue(calls) && calls == 10);
+        TEST("Profile counts function calls",
+             profile.EvaluateExpr("Functions.strcat.Calls", v) && v.IsIntegerValue(calls) && calls == 10 &&
+             profile.EvaluateExpr("Functions.size.Calls", v) && v.IsIntegerValue(calls) && calls == 10);
+
+        EvalProfile::Reset();
+        EvalProfile::Enable(true, 5);
+        for (int i = 0; i < 100; i++) {
+            profile_ad->EvaluateAttrInt("C", a);
+        }
+        EvalProfile::Enable(false);
+        EvalProfile::GetProfile(profile);
+        TEST("Sampled profile scales counts",
+             profile.EvaluateExpr("Attributes.C.Calls", v) && v.IsIntegerValue(calls) && calls == 100 &&
+             profile.EvaluateExpr("SampleInterval", v) && v.IsIntegerValue(calls) && calls == 5);
+        string table;
+        EvalProfile::Format(table);
+        TEST("Formatted profile", table.find("size") != string::npos);
+        EvalProfile::Reset();
+        EvalProfile::GetProfile(profile);
+        TEST("Reset profile",
+             profile.EvaluateExpr("Functions.size", v) && v.IsUndefinedValue());
+        delete profile_ad;
+    }
+
+    /* ----- Test unparsing ----- */
+    ClassAd *unparse_ad = parser.ParseClassAd(
+        "[S = \"a\\\"b\\n\\\\c<&>\"; 'odd name' = 1; Ref = 'odd name' + .top.x;"
+        " L = {1, [X = 2]}; F = strcat(\"x\", L[0])]");
+    TEST("Parsed unparse ad", unparse_ad != NULL);
+    if (unparse_ad) {
+        ClassAdUnParser new_unparser, old_unparser, xml_unparser;
+        ClassAdJsonUnParser json_unparser(true);
+        old_unparser.SetOldClassAd(true);
+        xml_unparser.setXMLUnparse(true);
+        string text = "S = ";
+        new_unparser.Unparse(text, unparse_ad->Lookup("S"));
+        TEST("Unparse appends to the buffer", text == "S = \"a\\\"b\\n\\\\c<&>\"");
+        text.clear();
+        old_unparser.Unparse(text, unparse_ad->Lookup("S"));
+        TEST("Old syntax escapes only quotes", text == "\"a\\\"b\n\\c<&>\"");
+        text.clear();
+        xml_unparser.Unparse(text, unparse_ad->Lookup("S"));
+        TEST("XML unparse escapes markup", text == "\"a\\\"b\\n\\\\c&lt;&amp;&gt;\"");
+        text.clear();
+        json_unparser.Unparse(text, unparse_ad->Lookup("S"));
+        TEST("JSON unparse escapes strings", text == "\"a\\\"b\\n\\\\c<&>\"");
+        text.clear();
+        new_unparser.Unparse(text, unparse_ad->Lookup("Ref"));
+        TEST("Unparse quotes odd attribute names", text == "'odd name' + .top.x");
+        text.clear();
+        new_unparser.Unparse(text, unparse_ad->Lookup("L"));
+        TEST("Unparse nested lists and ads", text == "{ 1,[ X = 2 ] }");
+        text.clear();
+        new_unparser.Unparse(text, unparse_ad->Lookup("F"));
+        TEST("Unparse function calls", text == "strcat(\"x\",L[0])");
+        text.clear();
+        json_unparser.Unparse(text, unparse_ad->Lookup("L"));
+        TEST("JSON unparse nested lists and ads", text == "[1,{\"X\": 2}]");
+
+        unparse_ad->InsertAttr("Min", (long long)(-9223372036854775807LL - 1));
+        text.clear();
+        new_unparser.Unparse(text, unparse_ad->Lookup("Min"));
+        TEST("Unparse the most negative integer", text == "-9223372036854775808");
+        text.clear();
+        json_unparser.Unparse(text, unparse_ad->Lookup("Min"));
+        TEST("JSON unparse the most negative integer", text == "-9223372036854775808");
+
+            /* ----- Test reading JSON ----- */
+        ClassAdJsonUnParser json_ad_unparser;
+        ClassAdJsonParser json_parser;
+        ClassAdJsonReader json_reader;
+        text.clear();
+        json_ad_unparser.Unparse(text, unparse_ad);
+        ClassAd *json_parsed = json_parser.ParseClassAd(text, true);
+        ClassAd *json_read = json_reader.ParseClassAd(text, true);
+        TEST("JSON reader reads unparsed ad", json_read != NULL);
+        TEST("JSON reader agrees with parser", json_parsed && json_read &&
+             json_read->SameAs(json_parsed));
+        delete json_parsed;
+        delete json_read;
+
+        const char *json_list =
+            "[\n{ \"A\": 1, \"B\": -2.5e1, \"C\": \"x\\u0041\", \"D\": null },\n"
+            "{ \"E\": [true, FALSE, {}], \"F\": \"\\/Expr(size(E) + 1)\\/\" }\n]\n";
+        ClassAd list_ad;
+        size_t offset = 0;
+        long long a;
+        double b;
+        string c;
+        bool read_list = json_reader.NextClassAd(json_list, strlen(json_list), offset, list_ad) == 1 &&
+            list_ad.EvaluateAttrInt("A", a) && a == 1 &&
+            list_ad.EvaluateAttrReal("B", b) && b == -25.0 &&
+            list_ad.EvaluateAttrString("C", c) && c == "xA" &&
+            list_ad.Lookup("D") != NULL;
+        read_list = read_list &&
+            json_reader.NextClassAd(json_list, strlen(json_list), offset, list_ad) == 1 &&
+            list_ad.Lookup("A") == NULL &&
+            list_ad.EvaluateAttrInt("F", a) && a == 4;
+        TEST("JSON reader reads a list of ads", read_list);
+        TEST("JSON reader reports the end of the list",
+             json_reader.NextClassAd(json_list, strlen(json_list), offset, list_ad) == 0);
+
+        TEST("JSON reader rejects a bare value", !json_reader.ParseClassAd("1", true));
+        TEST("JSON reader rejects an unterminated string",
+             !json_reader.ParseClassAd("{\"A\": \"x}", true));
+        TEST("JSON reader rejects a leading zero",
+             !json_reader.ParseClassAd("{\"A\": 01}", true));
+        TEST("JSON reader rejects a missing comma",
+             !json_reader.ParseClassAd("{\"A\": 1 \"B\": 2}", true));
+        TEST("JSON reader rejects trailing text",
+             !json_reader.ParseClassAd("{\"A\": 1} x", true));
+        TEST("JSON reader rejects an unclosed outer list",
+             !json_reader.ParseClassAd("{\"a\": [[1]}", true));
+        TEST("JSON reader rejects an unclosed list ending in a list",
+             !json_reader.ParseClassAd("{\"a\": [1, [2]}", true));
+        TEST("JSON reader rejects a trailing comma in a list",
+             !json_reader.ParseClassAd("{\"a\": [1,]}", true));
+        ClassAd *nested_ad = json_reader.ParseClassAd("{\"a\": [[1], [], [2, [3]]]}", true);
+        TEST("JSON reader reads nested lists", nested_ad != NULL);
+        delete nested_ad;
+        delete unparse_ad;
+    }
+
     return;
 }
 
@@ -779,6 +1193,319 @@ static void test_value(const Parameters &, Results &results)
     return;
 }
 
+/*********************************************************************
+ *
+ * Function: test_match
+ * Purpose:  Test matching, and that compiled expressions evaluate
+ *           the same as the expression trees they came from.
+ *
+ *********************************************************************/
+static void test_match(const Parameters &, Results &results)
+{
+    ClassAdParser parser;
+
+    cout << "Testing matching and compiled expressions...\n";
+
+    const char *exprs[] = {
+        "MY.Memory >= TARGET.RequestMemory && TARGET.Owner == \"alice\"",
+        "Memory * 2 - Cpus / 2 + -Disk % 7",
+        "!(Cpus > 4) || Missing",
+        "Missing && false",
+        "false && Missing",
+        "Missing || true",
+        "Missing =?= undefined && Cpus =!= \"4\"",
+        "(Cpus > 2) ? Memory : Disk",
+        "(Cpus < 2) ? Memory : Disk",
+        "Missing ? 1 : 2",
+        "Missing ?: Cpus",
+        "Cpus ?: Disk",
+        "false ?: Disk",
+        "\"str\" ? 1 : 2",
+        "strcat(Name, \"x\") == \"slot1x\" && size({1,2,3}) == 3",
+        "{ Cpus, Memory }[1] + [a = 3].a",
+        "ifThenElse(Cpus > 2, 1, 2) + (Cpus > 2 ? 10 : 20)",
+        "Memory / 0",
+        "(Memory & 0xff) | (Cpus << 2) ^ ~Disk",
+        "Name == \"slot1\" && TARGET.Owner =?= \"alice\" && MY.Undef =?= undefined",
+        NULL
+    };
+
+    ClassAd *slot = parser.ParseClassAd(
+        "[Name = \"slot1\"; Cpus = 4; Memory = 2048; Disk = 100000;"
+        " Requirements = TARGET.RequestMemory <= MY.Memory && TARGET.Owner != \"bob\"]");
+    ClassAd *job = parser.ParseClassAd(
+        "[Owner = \"alice\"; RequestMemory = 1024;"
+        " Requirements = TARGET.Memory >= MY.RequestMemory && (TARGET.Cpus > 2 ? true : false)]");
+    TEST("Parsed slot and job ads", slot != NULL && job != NULL);
+    if (slot == NULL || job == NULL) {
+        return;
+    }
+
+    MatchClassAd match(job, slot);
+    for (int i = 0; exprs[i]; i++) {
+        ExprTree *tree = parser.ParseExpression(exprs[i]);
+        TEST("Parsed expression for compiling", tree != NULL);
+        if (tree == NULL) continue;
+        slot->Insert("Test", tree);
+
+        CompiledExpr *compiled = CompiledExpr::Compile(tree);
+        TEST("Compiled expression", compiled != NULL);
+        if (compiled == NULL) continue;
+
+        EvalState tree_state, compiled_state;
+        Value tree_val, compiled_val;
+        tree_state.SetScopes(slot);
+        compiled_state.SetScopes(slot);
+        bool tree_ok = tree->Evaluate(tree_state, tree_val);
+        bool compiled_ok = compiled->Evaluate(compiled_state, compiled_val);
+        TEST("Compiled expression evaluates like the tree",
+             tree_ok == compiled_ok && tree_val.SameAs(compiled_val));
+        delete compiled;
+    }
+
+    Literal *lit = Literal::MakeLong(1);
+    TEST("Literals are not compiled", CompiledExpr::Compile(lit) == NULL);
+    delete lit;
+
+    bool tree_sym = match.symmetricMatch();
+    bool tree_left = match.leftMatchesRight();
+    ClassAdSetExpressionCompiling(true);
+    for (int i = 0; i < 3; i++) {
+        TEST("Compiled symmetric match", match.symmetricMatch() == tree_sym);
+        TEST("Compiled left match", match.leftMatchesRight() == tree_left);
+    }
+    TEST("Job matches slot", tree_sym);
+
+        // replacing an expression must not leave a stale compiled copy
+    slot->AssignExpr("Requirements", "TARGET.Owner == \"bob\"");
+    TEST("Replaced requirements don't match", !match.symmetricMatch());
+    TEST("Replaced requirements don't match again", !match.symmetricMatch());
+    slot->Delete("Requirements");
+    TEST("Missing requirements don't match", !match.symmetricMatch());
+
+    Value val;
+    TEST("EvaluateAttrCompiled of missing attribute is undefined",
+         slot->EvaluateAttrCompiled("NoSuchAttr", val) && val.IsUndefinedValue());
+
+        // a self-referential attribute must hit the recursion limit
+    slot->AssignExpr("Loop", "Loop + 1");
+    for (int i = 0; i < 3; i++) {
+        TEST("Compiled self-reference is not a value",
+             !slot->EvaluateAttrCompiled("Loop", val) || val.IsErrorValue());
+    }
+    ClassAdSetExpressionCompiling(false);
+
+    match.RemoveLeftAd();
+    match.RemoveRightAd();
+    delete slot;
+    delete job;
+
+        // bound-left matching gives the same results as plain matching
+    const char *job_texts[] = {
+        "[RequestMemory = 1024; Owner = \"alice\";"
+        " Requirements = TARGET.Memory >= MY.RequestMemory && RequestMemory > 512 && TARGET.Arch == \"X86_64\"]",
+        "[RequestMemory = 4096; Requirements = TARGET.Memory >= RequestMemory || TARGET.Cpus > 8]",
+        "[RequestMemory = 100; Requirements = RequestMemory > 200 && TARGET.Memory > 0]",
+        "[RequestMemory = 100; Requirements = TARGET.NoSuchAttr =?= undefined && TARGET.Memory > RequestMemory]",
+        "[Requirements = TARGET.Owner =?= MY.Owner]",
+        "[Target = 5; Requirements = TARGET.Memory > 0]",
+        "[RequestMemory = 100]",
+        NULL
+    };
+    const char *slot_texts[] = {
+        "[Memory = 2048; Cpus = 4; Arch = \"X86_64\"; Requirements = TARGET.RequestMemory < 2000]",
+        "[Memory = 512; Cpus = 16; Arch = \"X86_64\"; Requirements = true]",
+        "[Memory = 8192; Cpus = 1; Arch = \"ppc64le\"; Requirements = TARGET.Owner =!= \"bob\"]",
+        "[Memory = 8192; Cpus = 2; Arch = \"X86_64\"]",
+        NULL
+    };
+    vector<ClassAd *> bound_jobs, bound_slots;
+    for (int i = 0; job_texts[i]; i++) {
+        bound_jobs.push_back(parser.ParseClassAd(job_texts[i]));
+    }
+    for (int i = 0; slot_texts[i]; i++) {
+        bound_slots.push_back(parser.ParseClassAd(slot_texts[i]));
+    }
+    MatchClassAd plain_match, bound_match;
+    bool bound_same = true, bound_unmodified = true;
+    for (size_t j = 0; j < bound_jobs.size(); j++) {
+        string before, after;
+        ClassAdUnParser unparser;
+        unparser.Unparse(before, bound_jobs[j]);
+
+        plain_match.BindLeftAd(bound_jobs[j]);
+            // a right ad already bound must not be folded into the residual
+        bound_match.BindRightAd(bound_slots[j % bound_slots.size()]);
+        bound_match.BindLeftAdForMatchmaking(bound_jobs[j]);
+        for (size_t i = 0; i < bound_slots.size(); i++) {
+            plain_match.BindRightAd(bound_slots[i]);
+            bound_match.BindRightAd(bound_slots[i]);
+            if (plain_match.symmetricMatch() != bound_match.symmetricMatch() ||
+                plain_match.rightMatchesLeft() != bound_match.rightMatchesLeft() ||
+                plain_match.leftMatchesRight() != bound_match.leftMatchesRight()) {
+                bound_same = false;
+            }
+        }
+
+        unparser.Unparse(after, bound_jobs[j]);
+        if (before != after) {
+            bound_unmodified = false;
+        }
+    }
+    TEST("Bound-left matching is the same as plain matching", bound_same);
+    TEST("Bound-left matching doesn't modify the left ad", bound_unmodified);
+
+        // the residual goes away when another left ad is bound
+    bound_match.BindLeftAdForMatchmaking(bound_jobs[2]);
+    bound_match.BindRightAd(bound_slots[0]);
+    TEST("Residual that is false matches nothing", !bound_match.symmetricMatch());
+    bound_match.BindLeftAd(bound_jobs[0]);
+    TEST("Rebinding the left ad discards the residual", bound_match.symmetricMatch());
+
+    for (size_t i = 0; i < bound_jobs.size(); i++) {
+        delete bound_jobs[i];
+    }
+    for (size_t i = 0; i < bound_slots.size(); i++) {
+        delete bound_slots[i];
+    }
+
+    return;
+}
+
+/*********************************************************************
+ *
+ * Function: test_threaded_match
+ * Purpose:  Test that many threads can match the same ads at once,
+ *           and get the same results as matching them one at a time.
+ *
+ *********************************************************************/
+struct MatchOutcome
+{
+    bool  matched;
+    Value job_rank;
+    Value slot_rank;
+};
+
+static void match_all(const vector<ClassAd *> &jobs, const vector<ClassAd *> &slots,
+                      size_t first, vector<MatchOutcome> *outcomes)
+{
+    MatchClassAd match;
+    size_t count = jobs.size() * slots.size();
+
+    outcomes->resize(count);
+    for (size_t n = 0; n < count; n++) {
+            // each thread starts with a different pair
+        size_t i = (first + n) % count;
+        MatchOutcome &outcome = (*outcomes)[i];
+        match.BindLeftAd(jobs[i / slots.size()]);
+        match.BindRightAd(slots[i % slots.size()]);
+        outcome.matched = match.symmetricMatch();
+        match.GetLeftAd()->EvaluateAttrCompiled("Rank", outcome.job_rank);
+        match.GetRightAd()->EvaluateAttrCompiled("Rank", outcome.slot_rank);
+    }
+}
+
+static bool same_outcomes(const vector<MatchOutcome> &a, const vector<MatchOutcome> &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].matched != b[i].matched ||
+            !a[i].job_rank.SameAs(b[i].job_rank) ||
+            !a[i].slot_rank.SameAs(b[i].slot_rank)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_threaded_match(const Parameters &, Results &results)
+{
+    const int num_threads = 8;
+    bool was_caching = ClassAdGetExpressionCaching();
+    vector<ClassAd *> jobs, slots;
+    char buf[512];
+
+    cout << "Testing matching in many threads at once...\n";
+
+        // identical expressions in different ads share cache entries,
+        // some of them not parsed until they are first evaluated
+    ClassAdSetExpressionCaching(true);
+    for (int i = 0; i < 16; i++) {
+        ClassAd *job = new ClassAd;
+        string attr;
+        job->InsertAttr("Owner", (i % 3) ? "alice" : "bob");
+        job->InsertAttr("RequestMemory", 256 * (i % 5 + 1));
+        job->InsertAttr("RequestCpus", i % 4 + 1);
+        attr = "Requirements";
+        job->InsertViaCache(attr, "TARGET.Memory >= MY.RequestMemory && "
+                            "TARGET.Cpus >= MY.RequestCpus && "
+                            "regexp(\"^slot[0-9]+$\", TARGET.Name)", true);
+        attr = "Rank";
+        job->InsertViaCache(attr, "TARGET.Memory / 1024.0 + (TARGET.Arch =?= \"X86_64\" ? 10 : 0)", true);
+        jobs.push_back(job);
+    }
+    ClassAdParser parser;
+    for (int i = 0; i < 24; i++) {
+        snprintf(buf, sizeof(buf),
+                 "[Name = \"slot%d\"; Arch = \"%s\"; Memory = %d; Cpus = %d;"
+                 " Requirements = TARGET.Owner != \"bob\" || MY.Cpus > 2;"
+                 " Rank = strcat(\"r\", TARGET.Owner) == \"ralice\" ? TARGET.RequestMemory : 0 ]",
+                 i, (i % 2) ? "X86_64" : "ppc64le", 128 * (i % 11), i % 5 + 1);
+        ClassAd *slot = parser.ParseClassAd(buf);
+        TEST("Parsed slot ad for threaded match", slot != NULL);
+        if (slot == NULL) {
+            return;
+        }
+        slots.push_back(slot);
+    }
+    ClassAdSetExpressionCaching(was_caching);
+
+    ClassAdSetThreadSafeEvaluation(true);
+    for (int compiling = 0; compiling < 2; compiling++) {
+        ClassAdSetExpressionCompiling(compiling != 0);
+
+        vector<MatchOutcome> serial;
+        match_all(jobs, slots, 0, &serial);
+        bool some_match = false, some_fail = false;
+        for (size_t i = 0; i < serial.size(); i++) {
+            some_match |= serial[i].matched;
+            some_fail |= !serial[i].matched;
+        }
+        TEST("Some pairs match and some don't", some_match && some_fail);
+
+            // twice, so that compiled expressions are made by the threads
+            // the first time through and shared the second
+        for (int round = 0; round < 2; round++) {
+            vector<MatchOutcome> outcomes[num_threads];
+            vector<std::thread> threads;
+            for (int t = 0; t < num_threads; t++) {
+                threads.push_back(std::thread(match_all, std::cref(jobs), std::cref(slots),
+                                              t * serial.size() / num_threads, &outcomes[t]));
+            }
+            for (int t = 0; t < num_threads; t++) {
+                threads[t].join();
+            }
+            for (int t = 0; t < num_threads; t++) {
+                TEST("Threaded match is the same as serial match",
+                     same_outcomes(outcomes[t], serial));
+            }
+        }
+    }
+    ClassAdSetExpressionCompiling(false);
+    ClassAdSetThreadSafeEvaluation(false);
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        delete jobs[i];
+    }
+    for (size_t i = 0; i < slots.size(); i++) {
+        delete slots[i];
+    }
+
+    return;
+}
+
 /*********************************************************************
  *
  * Function: test_collection
@@ -926,6 +1653,51 @@ static void test_collection(const Parameters &, Results &results)
     TEST("machine2 in BigLinux-View", (check_in_view(collection, "BigLinux-View", "machine2") == false));
     TEST("machine3 not in BigLinux-View", (check_in_view(collection, "BigLinux-View", "machine3") == false));
 
+    /* ----- Test attribute indexes ----- */
+    static const char *index_queries[] = {
+        "other.OS == \"linux\"",
+        "other.OS =?= \"Linux\" && (other.Memory > 3000)",
+        "other.Memory >= 5000",
+        "5000 > other.Memory",
+        "other.Memory == 6000.0 || other.OS == \"Linux\"",
+        "other.Memory < 7000 && other.OS == \"Windows\"",
+        NULL
+    };
+    vector<string> unindexed_results;
+    for (int i = 0; index_queries[i]; i++) {
+        unindexed_results.push_back(query_view(collection, "root", index_queries[i]));
+    }
+    TEST("Created hash index", collection->CreateIndex("root", "OS"));
+    TEST("Created ordered index", collection->CreateIndex("root", "Memory", true));
+    TEST("Can't index a missing view", !collection->CreateIndex("no-such-view", "OS"));
+    bool same_results = true;
+    for (int i = 0; index_queries[i]; i++) {
+        same_results = same_results &&
+            query_view(collection, "root", index_queries[i]) == unindexed_results[i];
+    }
+    TEST("Indexes don't change query results", same_results);
+    TEST("Equality query uses hash index",
+         query_view(collection, "root", "other.OS == \"LINUX\"") == "machine1,machine2");
+    TEST("Range query uses ordered index",
+         query_view(collection, "root", "other.Memory > 4000 && other.Memory <= 5000") == "machine1");
+
+    ClassAd *update = parser.ParseClassAd("[ OS = \"Windows\"; Memory = 8000 ]", true);
+    TEST("Updated machine2", collection->UpdateClassAd("machine2", update));
+    TEST("Index follows updates",
+         query_view(collection, "root", "other.OS == \"Windows\"") == "machine2,machine3" &&
+         query_view(collection, "root", "other.Memory > 7000") == "machine2");
+    ClassAd *machine4 = parser.ParseClassAd("[ OS = \"Linux\"; Memory = 2 * 3000 ]", true);
+    TEST("Added machine4", collection->AddClassAd("machine4", machine4));
+    TEST("Index keeps unindexable values",
+         query_view(collection, "root", "other.Memory == 6000") == "machine3,machine4");
+    TEST("Removed machine1", collection->RemoveClassAd("machine1"));
+    TEST("Index follows removals",
+         query_view(collection, "root", "other.OS == \"Linux\"") == "machine4");
+    TEST("Deleted index", collection->DeleteIndex("root", "OS"));
+    TEST("Can't delete a missing index", !collection->DeleteIndex("root", "OS"));
+    TEST("Query without index",
+         query_view(collection, "root", "other.OS == \"Linux\"") == "machine4");
+
     delete collection;
 
     unlink(collection_log_file_name);
@@ -961,6 +1733,31 @@ static bool check_in_view(
     return in_view;
 }
 
+// The keys of the ads in a view that satisfy a constraint, in the order
+// of the view, separated by commas
+static string query_view(
+    ClassAdCollection  *collection,
+    string             view_name,
+    string             constraint)
+{
+    ClassAdParser         parser;
+    LocalCollectionQuery  query;
+    string                keys;
+
+    ExprTree *tree = parser.ParseExpression(constraint);
+    query.Bind(collection);
+    if (tree && query.Query(view_name, tree)) {
+        for (LocalCollectionQuery::iterator itr = query.begin(); itr != query.end(); itr++) {
+            if (!keys.empty()) {
+                keys += ",";
+            }
+            keys += *itr;
+        }
+    }
+    delete tree;
+    return keys;
+}
+
 /*********************************************************************
  *
  * Function: test_utils
@@ -1023,6 +1820,23 @@ static void test_utils(const Parameters &, Results &results)
     TEST("Dec 31, 2005->6, 364", weekday==6 && yearday==364);
     day_numbers(2004, 12, 31, weekday, yearday);
     TEST("Dec 31, 2005->5, 365", weekday==5 && yearday==365);
+
+    StringListSetPtr list = StringListSet::Find(" a, b ,c d,,a", ", ", true);
+    TEST("Trimmed list size", list->Size() == 5);
+    TEST("Trimmed list members",
+         list->Contains("a") && list->Contains("b") && list->Contains("c") && list->Contains("d"));
+    TEST("Trimmed list non-members", !list->Contains("A") && !list->Contains("") && !list->Contains(" b"));
+    TEST("Trimmed list members ignoring case", list->ContainsAnyCase("A") && list->ContainsAnyCase("D"));
+    TEST("Lists are cached", StringListSet::Find(" a, b ,c d,,a", ", ", true) == list);
+    TEST("Lists are cached by delimiters",
+         StringListSet::Find(" a, b ,c d,,a", ",", true) != list &&
+         StringListSet::Find(" a, b ,c d,,a", ",", true)->Contains("c d"));
+    list = StringListSet::Find(" a, b ,c d,,a", ",", false);
+    TEST("Untrimmed list members", list->Contains(" a") && list->Contains(" b ") && !list->Contains("a "));
+    list = StringListSet::Find("x y,z", "", false);
+    TEST("Untrimmed list default delimiters", list->Size() == 3 && list->Contains("y"));
+    StringListSet::ClearCache();
+    TEST("Cleared lists still usable", list->Contains("z"));
     return;
 }
 
@@ -914,6 +914,36 @@ SetViewInfo( const ViewName &viewName, const string &constraint,
 }
 
 
+bool ClassAdCollection::
+CreateIndex( const ViewName &viewName, const string &attr, bool ordered )
+{
+	ViewRegistry::iterator i;
+
+	i = viewRegistry.find( viewName );
+	if( i == viewRegistry.end( ) ) {
+		CondorErrno = ERR_NO_SUCH_VIEW;
+		CondorErrMsg = "view " + viewName + " not found";
+		return( false );
+	}
+	return( i->second->AddIndex( this, attr, ordered ) );
+}
+
+
+bool ClassAdCollection::
+DeleteIndex( const ViewName &viewName, const string &attr )
+{
+	ViewRegistry::iterator i;
+
+	i = viewRegistry.find( viewName );
+	if( i == viewRegistry.end( ) ) {
+		CondorErrno = ERR_NO_SUCH_VIEW;
+		CondorErrMsg = "view " + viewName + " not found";
+		return( false );
+	}
+	return( i->second->RemoveIndex( attr ) );
+}
+
+
 bool ClassAdCollection::
 GetViewInfo( const ViewName &viewName, ClassAd *&info )
 {
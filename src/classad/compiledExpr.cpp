@@ -0,0 +1,368 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#include "classad/common.h"
+#include "classad/compiledExpr.h"
+#include "classad/literals.h"
+#include <new>
+
+using namespace std;
+
+namespace classad {
+
+CompiledExpr *CompiledExpr::
+Compile( const ExprTree *tree )
+{
+	if( !tree ) {
+		return NULL;
+	}
+		// Only operator expressions gain anything from compiling; a lone
+		// literal, reference or function call is evaluated just as
+		// quickly as a tree.
+	const ExprTree *expr = tree->self();
+	if( expr->GetKind() != ExprTree::OP_NODE ) {
+		return NULL;
+	}
+
+	CompiledExpr *compiled = new CompiledExpr( tree );
+	if( !compiled->compileNode( expr, 0 ) ) {
+		delete compiled;
+		return NULL;
+	}
+	return compiled;
+}
+
+int CompiledExpr::
+emit( Opcode opcode, int dst, int a, Operation::OpKind op, const ExprTree *node )
+{
+	Instruction inst;
+	inst.code = (unsigned char)opcode;
+	inst.flags = 0;
+	inst.dst = (unsigned short)dst;
+	inst.a = (unsigned short)a;
+	inst.op = op;
+	inst.jump = 0;
+	inst.jump2 = 0;
+	inst.node = node;
+	code.push_back( inst );
+
+	if( dst >= numRegisters ) numRegisters = dst + 1;
+	if( a >= numRegisters ) numRegisters = a + 1;
+	return (int)code.size() - 1;
+}
+
+bool CompiledExpr::
+compileNode( const ExprTree *node, int dst )
+{
+	if( dst + 4 > MAX_REGISTERS ) {
+		return false;
+	}
+
+	switch( node->GetKind() ) {
+	case ExprTree::LITERAL_NODE:
+		emit( LOAD_LITERAL, dst, 0, Operation::__NO_OP__, node );
+		return true;
+
+	case ExprTree::ATTRREF_NODE:
+		emit( LOAD_ATTR, dst, 0, Operation::__NO_OP__, node );
+		return true;
+
+	case ExprTree::OP_NODE:
+		break;
+
+	default:
+		emit( EVAL_TREE, dst, 0, Operation::__NO_OP__, node );
+		return true;
+	}
+
+	Operation::OpKind op = Operation::__NO_OP__;
+	ExprTree *child1 = NULL, *child2 = NULL, *child3 = NULL;
+	((const Operation*)node)->GetComponents( op, child1, child2, child3 );
+
+	if( !child1 ) {
+		emit( EVAL_TREE, dst, 0, Operation::__NO_OP__, node );
+		return true;
+	}
+
+	if( op == Operation::PARENTHESES_OP ) {
+		return compileNode( child1, dst );
+	}
+
+	if( op == Operation::LOGICAL_AND_OP || op == Operation::LOGICAL_OR_OP ) {
+		if( !child2 || child3 ) {
+			emit( EVAL_TREE, dst, 0, Operation::__NO_OP__, node );
+			return true;
+		}
+		if( !compileNode( child1, dst + 1 ) ) return false;
+		int jmp = emit( op == Operation::LOGICAL_AND_OP ? AND_JUMP : OR_JUMP,
+						dst, dst + 1 );
+		if( !compileNode( child2, dst + 2 ) ) return false;
+		emit( OPERATE2, dst, dst + 1, op );
+		code[jmp].jump = (int)code.size();
+		return true;
+	}
+
+	if( op == Operation::TERNARY_OP ) {
+		unsigned char flags = (child2 ? HAS_TRUE_ARM : 0) |
+							  (child3 ? HAS_FALSE_ARM : 0);
+		int true_jmp = -1, false_jmp = -1;
+
+		if( !compileNode( child1, dst + 1 ) ) return false;
+		int sel = emit( SELECT, dst, dst + 1, op );
+		code[sel].flags = flags;
+
+			// selector is true
+		if( child2 ) {
+			if( !compileNode( child2, dst ) ) return false;
+			true_jmp = emit( JUMP, dst );
+		}
+
+			// selector is false
+		code[sel].jump = (int)code.size();
+		if( child2 && child3 ) {
+			if( !compileNode( child3, dst ) ) return false;
+			false_jmp = emit( JUMP, dst );
+		} else if( !child2 ) {
+			emit( COPY, dst, dst + 1 );
+			false_jmp = emit( JUMP, dst );
+		}
+
+			// selector is neither, or one of the arms is missing;
+			// evaluate everything and let the operator sort it out.
+		code[sel].jump2 = (int)code.size();
+		if( child2 ) {
+			emit( EVAL_TREE, dst + 2, 0, Operation::__NO_OP__, child2 );
+		}
+		if( child3 ) {
+			emit( EVAL_TREE, dst + 3, 0, Operation::__NO_OP__, child3 );
+		}
+		int tern = emit( TERNARY, dst, dst + 1, op );
+		code[tern].flags = flags;
+		if( dst + 4 > numRegisters ) numRegisters = dst + 4;
+
+		if( true_jmp >= 0 ) code[true_jmp].jump = (int)code.size();
+		if( false_jmp >= 0 ) code[false_jmp].jump = (int)code.size();
+		return true;
+	}
+
+	if( !child2 && !child3 ) {
+		if( !compileNode( child1, dst + 1 ) ) return false;
+		emit( OPERATE1, dst, dst + 1, op );
+		return true;
+	}
+
+	if( child2 && !child3 ) {
+		if( !compileNode( child1, dst + 1 ) ) return false;
+		if( !compileNode( child2, dst + 2 ) ) return false;
+		emit( OPERATE2, dst, dst + 1, op );
+		return true;
+	}
+
+	emit( EVAL_TREE, dst, 0, Operation::__NO_OP__, node );
+	return true;
+}
+
+namespace {
+
+	// The registers of one evaluation: exactly as many Values as the
+	// program uses, kept on the stack unless the program is large.
+class RegisterFile
+{
+	public:
+		explicit RegisterFile( int n ) : count( n ), regs( (Value *)local ) {
+			if( count > LOCAL_REGISTERS ) {
+				regs = (Value *)::operator new( count * sizeof( Value ) );
+			}
+			for( int i = 0; i < count; i++ ) {
+				new( &regs[i] ) Value;
+			}
+		}
+		~RegisterFile() {
+			for( int i = 0; i < count; i++ ) {
+				regs[i].~Value();
+			}
+			if( count > LOCAL_REGISTERS ) {
+				::operator delete( regs );
+			}
+		}
+		Value &operator[]( int i ) { return regs[i]; }
+
+	private:
+		enum { LOCAL_REGISTERS = 8 };
+		int count;
+		Value *regs;
+		alignas( Value ) unsigned char local[LOCAL_REGISTERS * sizeof( Value )];
+
+		RegisterFile( const RegisterFile & );            // not implemented
+		RegisterFile &operator=( const RegisterFile & ); // not implemented
+};
+
+}
+
+bool CompiledExpr::
+Evaluate( EvalState &state, Value &result ) const
+{
+		// Debug output is produced per tree node, so leave that to the tree.
+	if( state.debug ) {
+		return tree->Evaluate( state, result );
+	}
+
+	RegisterFile regs( numRegisters );
+	Value undef;	// operand for missing children, never written to
+	bool b;
+	int sig;
+
+	const Instruction *insts = &code[0];
+	int pc = 0;
+	int end = (int)code.size();
+	while( pc < end ) {
+		const Instruction &inst = insts[pc++];
+		Value &dst = regs[inst.dst];
+		switch( inst.code ) {
+		case LOAD_LITERAL:
+			((const Literal*)inst.node)->GetValue( dst );
+			break;
+
+		case LOAD_ATTR:
+			if( !inst.node->Evaluate( state, dst ) ) {
+				result.SetErrorValue();
+				return false;
+			}
+			break;
+
+		case EVAL_TREE:
+			if( !inst.node->Evaluate( state, dst ) ) {
+				result.SetErrorValue();
+				return false;
+			}
+			break;
+
+		case OPERATE1:
+			sig = Operation::_doOperation( inst.op, regs[inst.a], undef, undef,
+							true, false, false, dst, &state );
+			if( sig == Operation::SIG_NONE ) {
+				return false;
+			}
+			break;
+
+		case OPERATE2:
+			sig = Operation::_doOperation( inst.op, regs[inst.a], regs[inst.a+1],
+							undef, true, true, false, dst, &state );
+			if( sig == Operation::SIG_NONE ) {
+				return false;
+			}
+			break;
+
+		case TERNARY:
+			sig = Operation::_doOperation( inst.op, regs[inst.a],
+							(inst.flags & HAS_TRUE_ARM) ? regs[inst.a+1] : undef,
+							(inst.flags & HAS_FALSE_ARM) ? regs[inst.a+2] : undef,
+							true, (inst.flags & HAS_TRUE_ARM) != 0,
+							(inst.flags & HAS_FALSE_ARM) != 0, dst, &state );
+			if( sig == Operation::SIG_NONE ) {
+				return false;
+			}
+			break;
+
+		case AND_JUMP:
+			if( regs[inst.a].IsBooleanValueEquiv( b ) && !b ) {
+				dst.SetBooleanValue( false );
+				pc = inst.jump;
+			}
+			break;
+
+		case OR_JUMP:
+			if( regs[inst.a].IsBooleanValueEquiv( b ) && b ) {
+				dst.SetBooleanValue( true );
+				pc = inst.jump;
+			}
+			break;
+
+		case SELECT:
+				// Mirrors Operation3::shortCircuit().  The one difference
+				// is that a false selector with no true arm (a ?: b) is
+				// copied rather than evaluated a second time.
+			if( !regs[inst.a].IsBooleanValueEquiv( b ) ) {
+				pc = inst.jump2;
+			} else if( b ) {
+				if( !(inst.flags & HAS_TRUE_ARM) ) {
+					pc = inst.jump2;
+				}
+			} else if( (inst.flags & HAS_TRUE_ARM) && (inst.flags & HAS_FALSE_ARM) ) {
+				pc = inst.jump;
+			} else if( !(inst.flags & HAS_TRUE_ARM) ) {
+				pc = inst.jump;
+			} else {
+				pc = inst.jump2;
+			}
+			break;
+
+		case COPY:
+			dst.CopyFrom( regs[inst.a] );
+			break;
+
+		case JUMP:
+			pc = inst.jump;
+			break;
+
+		default:
+			CLASSAD_EXCEPT( "Unknown compiled expression instruction %d", inst.code );
+			return false;
+		}
+	}
+
+	result.CopyFrom( regs[0] );
+	return true;
+}
+
+
+CompiledExprTable::
+~CompiledExprTable()
+{
+	for( vector<Entry>::iterator itr = entries.begin(); itr != entries.end(); itr++ ) {
+		delete itr->compiled;
+	}
+}
+
+const CompiledExpr *CompiledExprTable::
+Get( const ExprTree *tree )
+{
+	for( vector<Entry>::iterator itr = entries.begin(); itr != entries.end(); itr++ ) {
+		if( itr->tree == tree ) {
+			if( !itr->tried ) {
+				itr->compiled = CompiledExpr::Compile( tree );
+				itr->tried = true;
+			}
+			return itr->compiled;
+		}
+	}
+
+		// first time this expression has been asked for
+	if( entries.size() < MAX_ENTRIES ) {
+		Entry entry;
+		entry.tree = tree;
+		entry.compiled = NULL;
+		entry.tried = false;
+		entries.push_back( entry );
+	}
+	return NULL;
+}
+
+} // classad
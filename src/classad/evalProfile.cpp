@@ -0,0 +1,250 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#include "classad/common.h"
+#include "classad/evalProfile.h"
+#include "classad/classad.h"
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <stdio.h>
+
+using namespace std;
+
+namespace classad {
+
+std::atomic<bool> EvalProfile::enabled( false );
+std::atomic<int> EvalProfile::sampleInterval( 1 );
+
+struct ProfileEntry {
+	string	name;		// as first seen
+	double	calls;		// scaled by the sample interval
+	double	seconds;	// ditto
+	ProfileEntry( ) : calls( 0 ), seconds( 0 ) { }
+};
+
+// Entries by lower-cased name, for each kind
+typedef classad_unordered<string,ProfileEntry> ProfileTable;
+
+static void
+mergeTable( ProfileTable &into, const ProfileTable &from )
+{
+	for( ProfileTable::const_iterator itr = from.begin( ); itr != from.end( ); itr++ ) {
+		ProfileEntry &entry = into[itr->first];
+		if( entry.name.empty( ) ) {
+			entry.name = itr->second.name;
+		}
+		entry.calls += itr->second.calls;
+		entry.seconds += itr->second.seconds;
+	}
+}
+
+// The profile of one thread.  Its lock is only contended while the
+// profile is being read or reset.
+struct ThreadProfile {
+	std::mutex		lock;
+	ProfileTable	tables[2];
+	string			key;	// scratch space for lower-casing names
+
+	ThreadProfile( );
+	~ThreadProfile( );
+};
+
+// The profiles of running threads, and what exited threads recorded
+static std::mutex &
+profilesLock( )
+{
+	static std::mutex lock;
+	return lock;
+}
+
+static set<ThreadProfile*> &
+liveProfiles( )
+{
+	static set<ThreadProfile*> profiles;
+	return profiles;
+}
+
+static ProfileTable *
+retiredTables( )
+{
+	static ProfileTable tables[2];
+	return tables;
+}
+
+ThreadProfile::
+ThreadProfile( )
+{
+	std::lock_guard<std::mutex> guard( profilesLock( ) );
+	liveProfiles( ).insert( this );
+}
+
+ThreadProfile::
+~ThreadProfile( )
+{
+	std::lock_guard<std::mutex> guard( profilesLock( ) );
+	liveProfiles( ).erase( this );
+	mergeTable( retiredTables( )[EvalProfile::ATTRIBUTE], tables[EvalProfile::ATTRIBUTE] );
+	mergeTable( retiredTables( )[EvalProfile::FUNCTION], tables[EvalProfile::FUNCTION] );
+}
+
+// one countdown per kind, so nested attribute and function events
+// don't fall into lock step and starve one another of samples
+static thread_local int samplesToSkip[2] = { 0, 0 };
+
+static ThreadProfile &
+threadProfile( )
+{
+	static thread_local ThreadProfile profile;
+	return profile;
+}
+
+void EvalProfile::
+Enable( bool enable, int sample_interval )
+{
+	if( enable ) {
+		sampleInterval.store( sample_interval < 1 ? 1 : sample_interval,
+							  std::memory_order_relaxed );
+	}
+	enabled.store( enable, std::memory_order_relaxed );
+}
+
+bool EvalProfile::
+sample( Kind kind )
+{
+	if( --samplesToSkip[kind] > 0 ) {
+		return false;
+	}
+	samplesToSkip[kind] = SampleInterval( );
+	return true;
+}
+
+void EvalProfile::
+record( Kind kind, const string &name, double seconds )
+{
+	ThreadProfile &profile = threadProfile( );
+	double weight = SampleInterval( );
+
+	profile.key = name;
+	for( size_t i = 0; i < profile.key.size( ); i++ ) {
+		profile.key[i] = tolower( (unsigned char)profile.key[i] );
+	}
+
+	std::lock_guard<std::mutex> guard( profile.lock );
+	ProfileEntry &entry = profile.tables[kind][profile.key];
+	if( entry.name.empty( ) ) {
+		entry.name = name;
+	}
+	entry.calls += weight;
+	entry.seconds += seconds * weight;
+}
+
+void EvalProfile::
+Reset( )
+{
+	std::lock_guard<std::mutex> guard( profilesLock( ) );
+	set<ThreadProfile*>::iterator itr;
+	for( itr = liveProfiles( ).begin( ); itr != liveProfiles( ).end( ); itr++ ) {
+		std::lock_guard<std::mutex> tguard( (*itr)->lock );
+		(*itr)->tables[ATTRIBUTE].clear( );
+		(*itr)->tables[FUNCTION].clear( );
+	}
+	retiredTables( )[ATTRIBUTE].clear( );
+	retiredTables( )[FUNCTION].clear( );
+}
+
+// Combines the profiles of all the threads
+static void
+collectProfile( ProfileTable tables[2] )
+{
+	std::lock_guard<std::mutex> guard( profilesLock( ) );
+	for( int kind = 0; kind < 2; kind++ ) {
+		tables[kind] = retiredTables( )[kind];
+	}
+	set<ThreadProfile*>::iterator itr;
+	for( itr = liveProfiles( ).begin( ); itr != liveProfiles( ).end( ); itr++ ) {
+		std::lock_guard<std::mutex> tguard( (*itr)->lock );
+		for( int kind = 0; kind < 2; kind++ ) {
+			mergeTable( tables[kind], (*itr)->tables[kind] );
+		}
+	}
+}
+
+void EvalProfile::
+GetProfile( ClassAd &ad )
+{
+	ProfileTable tables[2];
+	collectProfile( tables );
+
+	ad.Clear( );
+	ad.InsertAttr( "SampleInterval", SampleInterval( ) );
+	for( int kind = 0; kind < 2; kind++ ) {
+		ClassAd *entries = new ClassAd( );
+		ProfileTable::iterator itr;
+		for( itr = tables[kind].begin( ); itr != tables[kind].end( ); itr++ ) {
+			ClassAd *entry = new ClassAd( );
+			entry->InsertAttr( "Calls", (long long)( itr->second.calls + 0.5 ) );
+			entry->InsertAttr( "Seconds", itr->second.seconds );
+			entries->Insert( itr->second.name, entry );
+		}
+		ad.Insert( kind == ATTRIBUTE ? "Attributes" : "Functions", entries );
+	}
+}
+
+static bool
+moreSeconds( const ProfileEntry *e1, const ProfileEntry *e2 )
+{
+	return e1->seconds > e2->seconds;
+}
+
+void EvalProfile::
+Format( string &buffer, int max_entries )
+{
+	ProfileTable tables[2];
+	collectProfile( tables );
+
+	char line[256];
+	for( int kind = 0; kind < 2; kind++ ) {
+		vector<const ProfileEntry*> entries;
+		ProfileTable::iterator itr;
+		for( itr = tables[kind].begin( ); itr != tables[kind].end( ); itr++ ) {
+			entries.push_back( &itr->second );
+		}
+		sort( entries.begin( ), entries.end( ), moreSeconds );
+		if( (int)entries.size( ) > max_entries ) {
+			entries.resize( max_entries );
+		}
+
+		snprintf( line, sizeof( line ), "%-32s %14s %12s %12s\n",
+				  kind == ATTRIBUTE ? "Attribute" : "Function",
+				  "Calls", "Seconds", "us/call" );
+		buffer += line;
+		for( size_t i = 0; i < entries.size( ); i++ ) {
+			const ProfileEntry *e = entries[i];
+			snprintf( line, sizeof( line ), "%-32.32s %14.0f %12.6f %12.3f\n",
+					  e->name.c_str( ), e->calls, e->seconds,
+					  e->calls > 0 ? e->seconds * 1e6 / e->calls : 0.0 );
+			buffer += line;
+		}
+	}
+}
+
+} // classad
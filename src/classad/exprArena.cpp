@@ -0,0 +1,300 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#include "classad/common.h"
+#include "classad/exprArena.h"
+#include <atomic>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+namespace classad {
+
+// Nodes in a chunk are aligned for a double.
+static const size_t NODE_ALIGN = sizeof( double );
+
+// Chunks are made of whole pages of this size, aligned to it.
+static const int PAGE_BITS = 12;
+static const size_t CHUNK_ALIGN = (size_t)1 << PAGE_BITS;
+
+struct ExprArena::Chunk {
+	// The nodes in the chunk that have not been deleted, plus one while
+	// the chunk is the current chunk of its arena.
+	std::atomic<size_t> refs;
+	size_t size;	// bytes available for nodes
+	size_t used;	// bytes handed out
+};
+
+// The nodes of a chunk start this far past the start of the chunk.
+static const size_t CHUNK_HEADER_SIZE =
+	( sizeof( ExprArena::Chunk ) + NODE_ALIGN - 1 ) & ~( NODE_ALIGN - 1 );
+
+static thread_local ExprArena *currentArena = NULL;
+
+// The chunk owning each page, so FreeNode() can tell a node carved from
+// a chunk from one that came from the heap without a header in front of
+// every node.  A chunk owns all of its pages, so any address in a page
+// that maps to a chunk is in that chunk.  The map is a three level radix
+// tree over the page number, read without a lock; the levels below the
+// top are made as chunks need them and never freed, since nodes may be
+// deleted during exit.  Addresses beyond the 52 bits the map covers are
+// never given to a chunk.
+static const int LEAF_BITS = 12;
+static const int MID_BITS = 12;
+static const int TOP_BITS = 16;
+
+struct ChunkMapLeaf {
+	std::atomic<ExprArena::Chunk *> chunks[1 << LEAF_BITS];
+};
+
+struct ChunkMapMid {
+	std::atomic<ChunkMapLeaf *> leaves[1 << MID_BITS];
+};
+
+static std::atomic<ChunkMapMid *> chunkMap[1 << TOP_BITS];
+
+// The number of chunks that have not been freed yet.  Nodes from the heap
+// only pay for the lookup while some chunk is alive.
+static std::atomic<size_t> liveChunks( 0 );
+
+static bool
+mappable( const void *ptr, size_t size )
+{
+	uintptr_t last = ( (uintptr_t)ptr + size - 1 ) >> PAGE_BITS;
+	return ( last >> ( LEAF_BITS + MID_BITS + TOP_BITS ) ) == 0;
+}
+
+static ExprArena::Chunk *
+findChunk( const void *ptr )
+{
+	if( !mappable( ptr, 1 ) ) {
+		return NULL;
+	}
+	uintptr_t page = (uintptr_t)ptr >> PAGE_BITS;
+	ChunkMapMid *mid = chunkMap[page >> ( LEAF_BITS + MID_BITS )].load( std::memory_order_acquire );
+	if( !mid ) {
+		return NULL;
+	}
+	ChunkMapLeaf *leaf = mid->leaves[( page >> LEAF_BITS ) & ( ( 1 << MID_BITS ) - 1 )].load( std::memory_order_acquire );
+	if( !leaf ) {
+		return NULL;
+	}
+	return leaf->chunks[page & ( ( 1 << LEAF_BITS ) - 1 )].load( std::memory_order_acquire );
+}
+
+// Makes a level of the map, or finds the one another thread made first.
+template <class T> static T *
+makeLevel( std::atomic<T *> &slot )
+{
+	T *level = slot.load( std::memory_order_acquire );
+	if( !level ) {
+		T *fresh = (T *)calloc( 1, sizeof( T ) );
+		if( !fresh ) {
+			throw std::bad_alloc();
+		}
+		if( slot.compare_exchange_strong( level, fresh, std::memory_order_acq_rel ) ) {
+			level = fresh;
+		} else {
+			free( fresh );
+		}
+	}
+	return level;
+}
+
+// Points the pages of a chunk at it, or at NULL when it is freed.
+static void
+mapChunk( ExprArena::Chunk *chunk, size_t bytes, ExprArena::Chunk *value )
+{
+	uintptr_t first = (uintptr_t)chunk >> PAGE_BITS;
+	uintptr_t last = ( (uintptr_t)chunk + bytes - 1 ) >> PAGE_BITS;
+	for( uintptr_t page = first; page <= last; page++ ) {
+		ChunkMapMid *mid = makeLevel( chunkMap[page >> ( LEAF_BITS + MID_BITS )] );
+		ChunkMapLeaf *leaf = makeLevel( mid->leaves[( page >> LEAF_BITS ) & ( ( 1 << MID_BITS ) - 1 )] );
+		leaf->chunks[page & ( ( 1 << LEAF_BITS ) - 1 )].store( value, std::memory_order_release );
+	}
+}
+
+static void *
+allocChunkMemory( size_t bytes )
+{
+#ifdef WIN32
+	return _aligned_malloc( bytes, CHUNK_ALIGN );
+#else
+	void *mem = NULL;
+	if( posix_memalign( &mem, CHUNK_ALIGN, bytes ) != 0 ) {
+		return NULL;
+	}
+	return mem;
+#endif
+}
+
+static void
+freeChunkMemory( void *mem )
+{
+#ifdef WIN32
+	_aligned_free( mem );
+#else
+	free( mem );
+#endif
+}
+
+static void
+releaseChunk( ExprArena::Chunk *chunk )
+{
+	if( chunk->refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+		mapChunk( chunk, CHUNK_HEADER_SIZE + chunk->size, NULL );
+		liveChunks.fetch_sub( 1, std::memory_order_relaxed );
+		chunk->~Chunk();
+		freeChunkMemory( chunk );
+	}
+}
+
+ExprArena::
+ExprArena( size_t chunk_size ) :
+	current( NULL ), nextChunkSize( chunk_size ), numChunks( 0 )
+{
+	if( nextChunkSize < 256 ) {
+		nextChunkSize = 256;
+	} else if( nextChunkSize > MAX_CHUNK_SIZE ) {
+		nextChunkSize = MAX_CHUNK_SIZE;
+	}
+}
+
+ExprArena::
+~ExprArena()
+{
+	retire();
+}
+
+ExprArena *ExprArena::
+Current()
+{
+	return currentArena;
+}
+
+void *ExprArena::
+AllocateNode( size_t size )
+{
+	ExprArena *arena = currentArena;
+	if( arena ) {
+		return arena->allocate( size );
+	}
+	void *ptr = malloc( size );
+	if( !ptr ) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void ExprArena::
+FreeNode( void *ptr )
+{
+	if( !ptr ) {
+		return;
+	}
+	Chunk *chunk = NULL;
+	if( liveChunks.load( std::memory_order_relaxed ) ) {
+		chunk = findChunk( ptr );
+	}
+	if( chunk ) {
+		releaseChunk( chunk );
+	} else {
+		free( ptr );
+	}
+}
+
+void *ExprArena::
+allocate( size_t size )
+{
+	size_t need = ( size + NODE_ALIGN - 1 ) & ~( NODE_ALIGN - 1 );
+
+		// if every node in the current chunk is gone, start it over
+	if( current && current->refs.load( std::memory_order_acquire ) == 1 ) {
+		current->used = 0;
+	}
+
+	if( !current || current->size - current->used < need ) {
+		retire();
+
+		size_t size = nextChunkSize;
+		if( size < need ) {
+			size = need;
+		}
+		if( nextChunkSize < MAX_CHUNK_SIZE ) {
+			nextChunkSize *= 2;
+			if( nextChunkSize > MAX_CHUNK_SIZE ) {
+				nextChunkSize = MAX_CHUNK_SIZE;
+			}
+		}
+
+			// take whole pages, and use all of them
+		size_t bytes = ( CHUNK_HEADER_SIZE + size + CHUNK_ALIGN - 1 ) & ~( CHUNK_ALIGN - 1 );
+		void *mem = allocChunkMemory( bytes );
+		if( !mem ) {
+			throw std::bad_alloc();
+		}
+		if( !mappable( mem, bytes ) ) {
+			freeChunkMemory( mem );
+			void *ptr = malloc( need );
+			if( !ptr ) {
+				throw std::bad_alloc();
+			}
+			return ptr;
+		}
+		current = new( mem ) Chunk;
+		current->refs.store( 1, std::memory_order_relaxed );
+		current->size = bytes - CHUNK_HEADER_SIZE;
+		current->used = 0;
+		numChunks++;
+		mapChunk( current, bytes, current );
+		liveChunks.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	void *node = (char *)current + CHUNK_HEADER_SIZE + current->used;
+	current->used += need;
+	current->refs.fetch_add( 1, std::memory_order_relaxed );
+	return node;
+}
+
+void ExprArena::
+retire()
+{
+	if( current ) {
+		releaseChunk( current );
+		current = NULL;
+	}
+}
+
+ExprArenaScope::
+ExprArenaScope( ExprArena *arena ) : saved( currentArena )
+{
+	currentArena = arena;
+}
+
+ExprArenaScope::
+~ExprArenaScope()
+{
+	currentArena = saved;
+}
+
+} // classad
@@ -21,6 +21,7 @@
 #include "classad/common.h"
 #include "classad/exprTree.h"
 #include "classad/sink.h"
+#include "classad/exprArena.h"
 
 #ifndef WIN32
 #include <sys/time.h>
@@ -36,6 +37,18 @@ static const int MAX_CLASSAD_RECURSION = 1000;
 
 void (*ExprTree::user_debug_function)(const char *) = 0;
 
+void *ExprTree::
+operator new( size_t size )
+{
+	return ExprArena::AllocateNode( size );
+}
+
+void ExprTree::
+operator delete( void *ptr )
+{
+	ExprArena::FreeNode( ptr );
+}
+
 /* static */ void 
 ExprTree:: set_user_debug_function(void (*dbf)(const char *)) {
 	user_debug_function = dbf;
@@ -28,6 +28,8 @@
 #include "classad/sink.h"
 #include "classad/util.h"
 #include "classad/natural_cmp.h"
+#include "classad/evalProfile.h"
+#include "classad/stringListSet.h"
 
 #ifdef WIN32
  #if _MSC_VER < 1900
@@ -56,6 +58,10 @@
 #include <dlfcn.h>
 #endif
 
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
 using namespace std;
 
 namespace classad {
@@ -73,6 +79,124 @@ static void make_formatted_time(
 static bool
 stringListsIntersect(const char*,const ArgumentList &argList,EvalState &state,Value &result);
 
+#if defined USE_PCRE
+// A pattern compiled by PCRE.  Compiled patterns are shared by all the
+// calls that use the same pattern with the same options, in any thread;
+// pcre_exec() does not modify them.
+struct CompiledRegex
+{
+	CompiledRegex( const string &pat, int opts, pcre *r ) :
+		pattern( pat ), options( opts ), re( r ), capture_count( 0 )
+	{
+		pcre_fullinfo( re, NULL, PCRE_INFO_CAPTURECOUNT, &capture_count );
+	}
+	~CompiledRegex() { pcre_free( re ); }
+
+	string	pattern;
+	int		options;
+	pcre	*re;
+	int		capture_count;
+
+ private:
+	CompiledRegex( const CompiledRegex & );            // not implemented
+	CompiledRegex &operator=( const CompiledRegex & ); // not implemented
+};
+
+typedef classad_shared_ptr<CompiledRegex> CompiledRegexPtr;
+
+// The most recently used compiled patterns.  Patterns that don't compile
+// are not kept.
+static const size_t MAX_CACHED_REGEXES = 512;
+
+static std::mutex regexCacheLock;
+static std::list<CompiledRegexPtr> regexCacheLru;	// most recent first
+static std::unordered_map<string, std::list<CompiledRegexPtr>::iterator> regexCacheIndex;
+
+// Patterns given as literals are remembered by each thread by the address
+// of the literal, so evaluating the same expression again finds its
+// compiled pattern without taking the cache lock.  An entry is only used
+// if its pattern and options still match, so a literal reusing the address
+// of a deleted one is harmless.
+static const size_t NUM_LITERAL_REGEXES = 32;
+
+struct LiteralRegex
+{
+	const ExprTree		*literal;
+	CompiledRegexPtr	regex;
+};
+
+static thread_local LiteralRegex literalRegexes[NUM_LITERAL_REGEXES];
+
+static void
+makeRegexKey( const char *pattern, int options, string &key )
+{
+	key = pattern;
+	key += '\0';
+	key.append( (const char *)&options, sizeof( options ) );
+}
+
+// Returns the compiled form of a pattern, or NULL if it doesn't compile.
+// pattern_expr is the argument the pattern came from.
+static CompiledRegexPtr
+getCompiledRegex( const ExprTree *pattern_expr, const char *pattern, int options )
+{
+	LiteralRegex *memo = NULL;
+	if( pattern_expr && pattern_expr->GetKind() == ExprTree::LITERAL_NODE ) {
+		memo = &literalRegexes[( (size_t)pattern_expr / sizeof( void * ) ) % NUM_LITERAL_REGEXES];
+		if( memo->literal == pattern_expr && memo->regex &&
+			memo->regex->options == options && memo->regex->pattern == pattern ) {
+			return memo->regex;
+		}
+	}
+
+	string key;
+	makeRegexKey( pattern, options, key );
+
+	CompiledRegexPtr regex;
+	{
+		std::lock_guard<std::mutex> guard( regexCacheLock );
+		auto found = regexCacheIndex.find( key );
+		if( found != regexCacheIndex.end( ) ) {
+			regexCacheLru.splice( regexCacheLru.begin( ), regexCacheLru, found->second );
+			regex = *found->second;
+		}
+	}
+
+	if( !regex ) {
+		const char *error_message;
+		int error_offset;
+		pcre *re = pcre_compile( pattern, options, &error_message, &error_offset, NULL );
+		if( !re ) {
+			return regex;
+		}
+		regex.reset( new CompiledRegex( pattern, options, re ) );
+
+		std::lock_guard<std::mutex> guard( regexCacheLock );
+		auto found = regexCacheIndex.find( key );
+		if( found != regexCacheIndex.end( ) ) {
+				// another thread got there first
+			regexCacheLru.splice( regexCacheLru.begin( ), regexCacheLru, found->second );
+			regex = *found->second;
+		} else {
+			regexCacheLru.push_front( regex );
+			regexCacheIndex[key] = regexCacheLru.begin( );
+			if( regexCacheLru.size( ) > MAX_CACHED_REGEXES ) {
+				const CompiledRegexPtr &oldest = regexCacheLru.back( );
+				makeRegexKey( oldest->pattern.c_str( ), oldest->options, key );
+				regexCacheIndex.erase( key );
+				regexCacheLru.pop_back( );
+			}
+		}
+	}
+
+	if( memo ) {
+		memo->literal = pattern_expr;
+		memo->regex = regex;
+	}
+	return regex;
+}
+#endif
+
 // start up with an argument list of size 4
 FunctionCall::
 FunctionCall( )
@@ -81,129 +205,137 @@ FunctionCall( )
 
 	function = NULL;
 
-	if( !initialized ) {
-		FuncTable &functionTable = getFunctionTable();
-
-		// load up the function dispatch table
-			// type predicates
-		functionTable["isundefined"	] = (void*)isType;
-		functionTable["iserror"		] =	(void*)isType;
-		functionTable["isstring"	] =	(void*)isType;
-		functionTable["isinteger"	] =	(void*)isType;
-		functionTable["isreal"		] =	(void*)isType;
-		functionTable["islist"		] =	(void*)isType;
-		functionTable["isclassad"	] =	(void*)isType;
-		functionTable["isboolean"	] =	(void*)isType;
-		functionTable["isabstime"	] =	(void*)isType;
-		functionTable["isreltime"	] =	(void*)isType;
-
-			// list membership
-		functionTable["member"		] =	(void*)testMember;
-		functionTable["identicalmember"	] =	(void*)testMember;
-
-		// Some list functions, useful for lists as sets
-		functionTable["size"        ] = (void*)size;
-		functionTable["sum"         ] = (void*)sumAvg;
-		functionTable["avg"         ] = (void*)sumAvg;
-		functionTable["min"         ] = (void*)minMax;
-		functionTable["max"         ] = (void*)minMax;
-		functionTable["anycompare"  ] = (void*)listCompare;
-		functionTable["allcompare"  ] = (void*)listCompare;
-
-			// basic apply-like functions
-		/*
-		functionTable["sumfrom"		sumAvgFrom );
-		functionTable["avgfrom"		sumAvgFrom );
-		functionTable["maxfrom"		boundFrom );
-		functionTable["minfrom"		boundFrom );
-		*/
-
-			// time management
-		functionTable["time"        ] = (void*)epochTime;
-		functionTable["currenttime"	] =	(void*)currentTime;
-		functionTable["timezoneoffset"] =(void*)timeZoneOffset;
-		functionTable["daytime"		] =	(void*)dayTime;
-		//functionTable["makedate"	] =	(void*)makeDate;
-		functionTable["getyear"		] =	(void*)getField;
-		functionTable["getmonth"	] =	(void*)getField;
-		functionTable["getdayofyear"] =	(void*)getField;
-		functionTable["getdayofmonth"] =(void*)getField;
-		functionTable["getdayofweek"] =	(void*)getField;
-		functionTable["getdays"		] =	(void*)getField;
-		functionTable["gethours"	] =	(void*)getField;
-		functionTable["getminutes"	] =	(void*)getField;
-		functionTable["getseconds"	] =	(void*)getField;
-		functionTable["splittime"   ] = (void*)splitTime;
-		functionTable["formattime"  ] = (void*)formatTime;
-		//functionTable["indays"		] =	(void*)inTimeUnits;
-		//functionTable["inhours"		] =	(void*)inTimeUnits;
-		//functionTable["inminutes"	] =	(void*)inTimeUnits;
-		//functionTable["inseconds"	] =	(void*)inTimeUnits;
-
-			// string manipulation
-		functionTable["strcat"		] =	(void*)strCat;
-		functionTable["join"		] =	(void*)strCat;
-		functionTable["toupper"		] =	(void*)changeCase;
-		functionTable["tolower"		] =	(void*)changeCase;
-		functionTable["substr"		] =	(void*)subString;
-		functionTable["strcmp"      ] = (void*)compareString;
-		functionTable["stricmp"     ] = (void*)compareString;
-
-			// version comparison
-		functionTable["versioncmp"  ] = (void*)compareVersion;
-		functionTable["versionLE"   ] = (void*)compareVersion;
-		functionTable["versionLT"   ] = (void*)compareVersion;
-		functionTable["versionGE"   ] = (void*)compareVersion;
-		functionTable["versionGT"   ] = (void*)compareVersion;
-		// Not identical to str1 =?= str2 because it won't eat undefined.
-		functionTable["versionEQ"   ] = (void*)compareVersion;
-		functionTable["version_in_range"] = (void*)versionInRange;
-
-			// pattern matching (regular expressions)
+		// the function table is filled in when the first FunctionCall is
+		// made; as a function-local static, that is thread-safe
+	static bool table_initialized = InitializeFunctionTable( );
+	(void)table_initialized;
+}
+
+bool FunctionCall::
+InitializeFunctionTable( )
+{
+	FuncTable &functionTable = getFunctionTable();
+
+	// load up the function dispatch table
+		// type predicates
+	functionTable["isundefined"	] = (void*)isType;
+	functionTable["iserror"		] =	(void*)isType;
+	functionTable["isstring"	] =	(void*)isType;
+	functionTable["isinteger"	] =	(void*)isType;
+	functionTable["isreal"		] =	(void*)isType;
+	functionTable["islist"		] =	(void*)isType;
+	functionTable["isclassad"	] =	(void*)isType;
+	functionTable["isboolean"	] =	(void*)isType;
+	functionTable["isabstime"	] =	(void*)isType;
+	functionTable["isreltime"	] =	(void*)isType;
+
+		// list membership
+	functionTable["member"		] =	(void*)testMember;
+	functionTable["identicalmember"	] =	(void*)testMember;
+
+	// Some list functions, useful for lists as sets
+	functionTable["size"        ] = (void*)size;
+	functionTable["sum"         ] = (void*)sumAvg;
+	functionTable["avg"         ] = (void*)sumAvg;
+	functionTable["min"         ] = (void*)minMax;
+	functionTable["max"         ] = (void*)minMax;
+	functionTable["anycompare"  ] = (void*)listCompare;
+	functionTable["allcompare"  ] = (void*)listCompare;
+
+		// basic apply-like functions
+	/*
+	functionTable["sumfrom"		sumAvgFrom );
+	functionTable["avgfrom"		sumAvgFrom );
+	functionTable["maxfrom"		boundFrom );
+	functionTable["minfrom"		boundFrom );
+	*/
+
+		// time management
+	functionTable["time"        ] = (void*)epochTime;
+	functionTable["currenttime"	] =	(void*)currentTime;
+	functionTable["timezoneoffset"] =(void*)timeZoneOffset;
+	functionTable["daytime"		] =	(void*)dayTime;
+	//functionTable["makedate"	] =	(void*)makeDate;
+	functionTable["getyear"		] =	(void*)getField;
+	functionTable["getmonth"	] =	(void*)getField;
+	functionTable["getdayofyear"] =	(void*)getField;
+	functionTable["getdayofmonth"] =(void*)getField;
+	functionTable["getdayofweek"] =	(void*)getField;
+	functionTable["getdays"		] =	(void*)getField;
+	functionTable["gethours"	] =	(void*)getField;
+	functionTable["getminutes"	] =	(void*)getField;
+	functionTable["getseconds"	] =	(void*)getField;
+	functionTable["splittime"   ] = (void*)splitTime;
+	functionTable["formattime"  ] = (void*)formatTime;
+	//functionTable["indays"		] =	(void*)inTimeUnits;
+	//functionTable["inhours"		] =	(void*)inTimeUnits;
+	//functionTable["inminutes"	] =	(void*)inTimeUnits;
+	//functionTable["inseconds"	] =	(void*)inTimeUnits;
+
+		// string manipulation
+	functionTable["strcat"		] =	(void*)strCat;
+	functionTable["join"		] =	(void*)strCat;
+	functionTable["toupper"		] =	(void*)changeCase;
+	functionTable["tolower"		] =	(void*)changeCase;
+	functionTable["substr"		] =	(void*)subString;
+	functionTable["strcmp"      ] = (void*)compareString;
+	functionTable["stricmp"     ] = (void*)compareString;
+
+		// version comparison
+	functionTable["versioncmp"  ] = (void*)compareVersion;
+	functionTable["versionLE"   ] = (void*)compareVersion;
+	functionTable["versionLT"   ] = (void*)compareVersion;
+	functionTable["versionGE"   ] = (void*)compareVersion;
+	functionTable["versionGT"   ] = (void*)compareVersion;
+	// Not identical to str1 =?= str2 because it won't eat undefined.
+	functionTable["versionEQ"   ] = (void*)compareVersion;
+	functionTable["version_in_range"] = (void*)versionInRange;
+
+		// pattern matching (regular expressions)
 #if defined USE_POSIX_REGEX || defined USE_PCRE
-		functionTable["regexp"		] =	(void*)matchPattern;
-		functionTable["regexpmember"] =	(void*)matchPatternMember;
-		functionTable["regexps"     ] = (void*)substPattern;
-		functionTable["replace"     ] = (void*)substPattern;
-		functionTable["replaceall"  ] = (void*)substPattern;
+	functionTable["regexp"		] =	(void*)matchPattern;
+	functionTable["regexpmember"] =	(void*)matchPatternMember;
+	functionTable["regexps"     ] = (void*)substPattern;
+	functionTable["replace"     ] = (void*)substPattern;
+	functionTable["replaceall"  ] = (void*)substPattern;
 #endif
 
-			// conversion functions
-		functionTable["int"			] =	(void*)convInt;
-		functionTable["real"		] =	(void*)convReal;
-		functionTable["string"		] =	(void*)convString;
-		functionTable["bool"		] =	(void*)convBool;
-		functionTable["absTime"		] =	(void*)convTime;
-		functionTable["relTime"		] = (void*)convTime;
-
-		// turn the contents of an expression into a string
-		// but *do not* evaluate it
-		functionTable["unparse"		] =	(void*)unparse;
-		functionTable["unresolved"	] = (void*)hasRefs;
-
-			// mathematical functions
-		functionTable["floor"		] =	(void*)doRound;
-		functionTable["ceil"		] =	(void*)doRound;
-		functionTable["ceiling"		] =	(void*)doRound;
-		functionTable["round"		] =	(void*)doRound;
-		functionTable["pow" 		] =	(void*)doMath2;
-		//functionTable["log" 		] =	(void*)doMath2;
-		functionTable["quantize"	] =	(void*)doMath2;
-		functionTable["random"      ] = (void*)random;
-
-			// for compatibility with old classads:
-		functionTable["ifThenElse"  ] = (void*)ifThenElse;
-		functionTable["interval" ] = (void*)interval;
-		functionTable["eval"] = (void*)eval;
-
-			// string list functions:
-			// Note that many other string list functions are defined
-			// externally in the Condor classad compatibility layer.
-		functionTable["stringListsIntersect" ] = (void*)stringListsIntersect;
-		functionTable["debug"      ] = (void*)debug;
-
-		initialized = true;
-	}
+		// conversion functions
+	functionTable["int"			] =	(void*)convInt;
+	functionTable["real"		] =	(void*)convReal;
+	functionTable["string"		] =	(void*)convString;
+	functionTable["bool"		] =	(void*)convBool;
+	functionTable["absTime"		] =	(void*)convTime;
+	functionTable["relTime"		] = (void*)convTime;
+
+	// turn the contents of an expression into a string
+	// but *do not* evaluate it
+	functionTable["unparse"		] =	(void*)unparse;
+	functionTable["unresolved"	] = (void*)hasRefs;
+
+		// mathematical functions
+	functionTable["floor"		] =	(void*)doRound;
+	functionTable["ceil"		] =	(void*)doRound;
+	functionTable["ceiling"		] =	(void*)doRound;
+	functionTable["round"		] =	(void*)doRound;
+	functionTable["pow" 		] =	(void*)doMath2;
+	//functionTable["log" 		] =	(void*)doMath2;
+	functionTable["quantize"	] =	(void*)doMath2;
+	functionTable["random"      ] = (void*)random;
+
+		// for compatibility with old classads:
+	functionTable["ifThenElse"  ] = (void*)ifThenElse;
+	functionTable["interval" ] = (void*)interval;
+	functionTable["eval"] = (void*)eval;
+
+		// string list functions:
+		// Note that many other string list functions are defined
+		// externally in the Condor classad compatibility layer.
+	functionTable["stringListsIntersect" ] = (void*)stringListsIntersect;
+	functionTable["debug"      ] = (void*)debug;
+
+	initialized = true;
+	return true;
 }
 
 FunctionCall::
@@ -482,6 +614,7 @@ bool FunctionCall::
 _Evaluate (EvalState &state, Value &value) const
 {
 	if( function ) {
+		EvalProfileScope profile( EvalProfile::FUNCTION, functionName );
 		return( (*function)( functionName.c_str( ), arguments, state, value ) );
 	} else {
 		value.SetErrorValue();
@@ -2077,7 +2210,7 @@ bool FunctionCall::hasRefs(const char*, const ArgumentList& argList, EvalState&
 
 	// for the 2 arg form, the second argument is a regex pattern to be compared against
 	// each of the unresolved references
-	pcre * re = nullptr;
+	CompiledRegexPtr re;
 	if (argList.size() == 2) {
 		const char* pattern = nullptr;
 		if ( !argList[1]->Evaluate(state, arg) || ! arg.IsStringValue(pattern)) {
@@ -2085,9 +2218,7 @@ bool FunctionCall::hasRefs(const char*, const ArgumentList& argList, EvalState&
 			return false;
 		}
 
-		const char  *error_message;
-		int error_offset;
-		re = pcre_compile(pattern, PCRE_CASELESS, &error_message, &error_offset, NULL);
+		re = getCompiledRegex(argList[1], pattern, PCRE_CASELESS);
 		if ( ! re) {
 			// error in pattern
 			result.SetErrorValue();
@@ -2108,7 +2239,7 @@ bool FunctionCall::hasRefs(const char*, const ArgumentList& argList, EvalState&
 				}
 				if (re) {
 					int ovec[6];
-					if (pcre_exec(re, NULL, attr, len, 0, PCRE_NOTEMPTY, ovec, 6) > 0) {
+					if (pcre_exec(re->re, NULL, attr, len, 0, PCRE_NOTEMPTY, ovec, 6) > 0) {
 						result.SetBooleanValue(true); // found a match
 						break;
 					}
@@ -2122,8 +2253,6 @@ bool FunctionCall::hasRefs(const char*, const ArgumentList& argList, EvalState&
 
 	if ( ! re) {
 		result.SetStringValue(val);
-	} else {
-		pcre_free(re);
 	}
 	return true;
 }
@@ -2780,7 +2909,8 @@ debug( const char* name,const ArgumentList &argList,EvalState &state,
 }
 
 #if defined USE_POSIX_REGEX || defined USE_PCRE
-static bool regexp_helper(const char *pattern, const char *target,
+static bool regexp_helper(const ExprTree *pattern_expr,
+                          const char *pattern, const char *target,
                           const char *replace,
                           bool have_options, string options_string,
                           Value &result);
@@ -2853,7 +2983,7 @@ substPattern( const char *name,const ArgumentList &argList,EvalState &state,
 		result.SetErrorValue( );
 		return( true );
 	}
-    return regexp_helper(pattern, target, replace, have_options, options_string, result);
+    return regexp_helper(argList[0], pattern, target, replace, have_options, options_string, result);
 }
 
 bool FunctionCall::
@@ -2915,7 +3045,7 @@ matchPattern( const char*,const ArgumentList &argList,EvalState &state,
 		result.SetErrorValue( );
 		return( true );
 	}
-    return regexp_helper(pattern, target, NULL, have_options, options_string, result);
+    return regexp_helper(argList[0], pattern, target, NULL, have_options, options_string, result);
 }
 
 bool FunctionCall::
@@ -3006,7 +3136,7 @@ matchPatternMember( const char*,const ArgumentList &argList,EvalState &state,
 				}
             } else {
                 bool have_match;
-                bool success = regexp_helper(pattern, target, NULL, have_options, options_string, have_match_value);
+                bool success = regexp_helper(argList[0], pattern, target, NULL, have_options, options_string, have_match_value);
                 if (!success) {
                     result.SetErrorValue();
                     return true;
@@ -3030,6 +3160,7 @@ matchPatternMember( const char*,const ArgumentList &argList,EvalState &state,
 }
 
 static bool regexp_helper(
+    const ExprTree *pattern_expr,
     const char *pattern,
     const char *target,
 	const char *replace,
@@ -3154,9 +3285,7 @@ static bool regexp_helper(
 		return( true );
 	}
 #elif defined (USE_PCRE)
-    const char  *error_message;
-    int         error_offset;
-    pcre        *re = NULL;
+    CompiledRegexPtr regex;
 	int group_count = 0;
 	int oveccount = 0;
 	int *ovector = NULL;
@@ -3198,15 +3327,14 @@ static bool regexp_helper(
 		}
     }
 
-    re = pcre_compile( pattern, options, &error_message,
-                      &error_offset, NULL );
-    if ( re == NULL ){
+    regex = getCompiledRegex( pattern_expr, pattern, options );
+    if ( !regex ){
 			// error in pattern
 		result.SetErrorValue( );
 		goto cleanup;
 	}
 
-	pcre_fullinfo(re, NULL, PCRE_INFO_CAPTURECOUNT, &group_count);
+	group_count = regex->capture_count;
 	oveccount = 3 * (group_count + 1); // +1 for the string itself
 	ovector = (int *) malloc(oveccount * sizeof(int));
 
@@ -3224,7 +3352,7 @@ static bool regexp_helper(
 			addl_opts = 0;
 		}
 
-        status = pcre_exec(re, NULL, target, target_len,
+        status = pcre_exec(regex->re, NULL, target, target_len,
                            target_idx, addl_opts, ovector, oveccount);
 
 		if (empty_match && status == PCRE_ERROR_NOMATCH) {
@@ -3289,9 +3417,6 @@ static bool regexp_helper(
 		result.SetStringValue(output);
 	}
  cleanup:
-	if ( re ) {
-		pcre_free(re);
-	}
 	free(ovector);
     return true;
 #endif
@@ -3431,29 +3556,6 @@ split_string_list(char const *str,char const *delim,vector< string > &list)
 	}
 }
 
-static void
-split_string_set(char const *str,char const *delim,set< string > &string_set)
-{
-	if( !delim || !delim[0] ) {
-		delim = " ,";
-	}
-	if( !str ) {
-		return;
-	}
-	set<string>::value_type item;
-	while( *str ) {
-		size_t len = strcspn(str,delim);
-		if( len > 0 ) {
-			item.assign(str,len);
-			string_set.insert(item);
-			str += len;
-		}
-		if( *str ) {
-			str++;
-		}
-	}
-}
-
 static bool
 stringListsIntersect(const char*,const ArgumentList &argList,EvalState &state,Value &result)
 {
@@ -3515,17 +3617,18 @@ stringListsIntersect(const char*,const ArgumentList &argList,EvalState &state,Va
     result.SetBooleanValue(false);
 
 	vector< string > list0;
-	set< string > set1;
-
 	split_string_list(str0.c_str(),delimiter_string.c_str(),list0);
-	split_string_set(str1.c_str(),delimiter_string.c_str(),set1);
+
+		// the second list is usually the long one, such as a slot's
+		// list of capabilities, so get it already split
+	StringListSetPtr set1 = StringListSet::Find(str1,delimiter_string,false);
 
 	vector< string >::iterator it;
 	for(it = list0.begin();
 		it != list0.end();
 		it++)
 	{
-		if( set1.count(*it) ) {
+		if( set1->Contains(*it) ) {
 			result.SetBooleanValue(true);
 			break;
 		}
@@ -59,18 +59,19 @@ Unparse( string &buffer, const Value &val )
 			break;
 
 		case Value::STRING_VALUE: {
-			string	s;
+			const char *s = NULL;
+			int len = 0;
 			val.IsStringValue( s );
+			val.IsStringValue( len );
 			buffer += '"';
-			UnparseAuxEscapeString( buffer, s );
+			UnparseAuxEscapeString( buffer, s, len );
 			buffer += '"';
 			return;
 		}
 		case Value::INTEGER_VALUE: {
 			long long	i;
 			val.IsIntegerValue( i );
-			sprintf( tempBuf, "%lld", i );
-			buffer += tempBuf;
+			append_long( buffer, i );
 			return;
 		}
 		case Value::REAL_VALUE: {
@@ -201,17 +202,14 @@ Unparse( string &buffer, const ExprTree *tree )
 		}
 
 		case ExprTree::CLASSAD_NODE: {
-			vector< pair<string, ExprTree*> > attrs;
-			((ClassAd*)tree)->GetComponents( attrs );
-
-			UnparseAuxClassAd( buffer, attrs );
+			const ClassAd *ad = (const ClassAd*)tree;
+			UnparseAuxClassAd( buffer, ad->begin( ), ad->end( ) );
 			return;
 		}
 
 		case ExprTree::EXPR_LIST_NODE: {
-			vector<ExprTree*> exprs;
-			vector<ExprTree*>::iterator	itr;
-			((ExprList*)tree)->GetComponents( exprs );
+			const vector<ExprTree*> &exprs = ((const ExprList*)tree)->GetExprs( );
+			vector<ExprTree*>::const_iterator	itr;
 
 			buffer += "[";
 			m_indentLevel += m_indentIncrement;
@@ -220,7 +218,8 @@ Unparse( string &buffer, const ExprTree *tree )
 					buffer += ",";
 				}
 				if ( !m_oneline ) {
-					buffer += "\n" + string( m_indentLevel, ' ' );
+					buffer += '\n';
+					buffer.append( m_indentLevel, ' ' );
 				}
 				Unparse( buffer, *itr );
 			}
@@ -228,7 +227,9 @@ Unparse( string &buffer, const ExprTree *tree )
 			if ( m_oneline ) {
 				buffer += "]";
 			} else {
-				buffer += "\n" + string( m_indentLevel, ' ' ) + "]";
+				buffer += '\n';
+				buffer.append( m_indentLevel, ' ' );
+				buffer += ']';
 			}
 			return;
 		}
@@ -262,16 +263,16 @@ Unparse( string &buffer, const ClassAd *ad, const References &whitelist )
 	vector< pair<string, ExprTree*> > attrs;
 	ad->GetComponents( attrs, whitelist );
 
-	UnparseAuxClassAd( buffer, attrs );
+	UnparseAuxClassAd( buffer, attrs.begin( ), attrs.end( ) );
 }
 
 void ClassAdJsonUnParser::
 UnparseAuxQuoteExpr( std::string &buffer, const ExprTree *expr )
 {
 	ClassAdUnParser unparser;
-	string expr_str;
-	unparser.Unparse( expr_str, expr );
-	UnparseAuxQuoteExpr( buffer, expr_str );
+	m_exprBuffer.clear( );
+	unparser.Unparse( m_exprBuffer, expr );
+	UnparseAuxQuoteExpr( buffer, m_exprBuffer );
 	
 }
 
@@ -285,10 +286,25 @@ UnparseAuxQuoteExpr( std::string &buffer, const std::string &expr )
 
 void ClassAdJsonUnParser::
 UnparseAuxEscapeString( std::string &buffer, const std::string &value )
+{
+	UnparseAuxEscapeString( buffer, value.data( ), value.size( ) );
+}
+
+// Runs of characters that need no escaping are appended in one piece
+void ClassAdJsonUnParser::
+UnparseAuxEscapeString( std::string &buffer, const char *str, size_t len )
 {
 	char	tempBuf[10];
+	const char *run = str;
+	const char *end = str + len;
+
+	for( const char *itr = str; itr != end; itr++ ) {
+		if( *itr != '"' && *itr != '\\' && ( *itr <= 0 || *itr >= 32 ) ) {
+			continue;
+		}
+		buffer.append( run, itr - run );
+		run = itr + 1;
 
-	for( string::const_iterator itr=value.begin( ); itr!=value.end( ); itr++ ) {
 		if( *itr == '"' ) {
 			buffer += "\\\""; 
 			continue;
@@ -314,26 +330,26 @@ UnparseAuxEscapeString( std::string &buffer, const std::string &value )
 
 		buffer += *itr;
 	}
+	buffer.append( run, end - run );
 }
 
-void ClassAdJsonUnParser::
-UnparseAuxClassAd( std::string &buffer,
-	const std::vector< std::pair< std::string, ExprTree*> >& attrs )
+// Unparses the attributes of an ad, from either a ClassAd or the vector
+// of its components
+template <class Iter> void ClassAdJsonUnParser::
+UnparseAuxClassAd( std::string &buffer, Iter begin, Iter end )
 {
-	vector< pair<string, ExprTree*> >::const_iterator itr;
-
 	buffer += "{";
 	m_indentLevel += m_indentIncrement;
-	for( itr=attrs.begin( ); itr!=attrs.end( ); itr++ ) {
-		if ( itr != attrs.begin() ) {
+	for( Iter itr=begin; itr!=end; itr++ ) {
+		if ( itr != begin ) {
 			buffer += ",";
 		}
-		if ( m_oneline ) {
-			buffer += "\"";
-		} else {
-			buffer += "\n" + string( m_indentLevel, ' ' ) + "\"";
+		if ( !m_oneline ) {
+			buffer += '\n';
+			buffer.append( m_indentLevel, ' ' );
 		}
-		UnparseAuxEscapeString( buffer, itr->first );
+		buffer += '"';
+		UnparseAuxEscapeString( buffer, static_cast<const string &>( itr->first ) );
 		buffer += "\": ";
 		Unparse( buffer, itr->second );
 	}
@@ -341,7 +357,9 @@ UnparseAuxClassAd( std::string &buffer,
 	if ( m_oneline ) {
 		buffer += "}";
 	} else {
-		buffer += "\n" + string( m_indentLevel, ' ' ) + "}";
+		buffer += '\n';
+		buffer.append( m_indentLevel, ' ' );
+		buffer += '}';
 	}
 }
 
@@ -590,4 +590,456 @@ ConsumeToken(void)
 }
 
 
+/*--------------------------------------------------------------------
+ *
+ * ClassAdJsonReader
+ *
+ *-------------------------------------------------------------------*/
+
+ClassAdJsonReader::
+ClassAdJsonReader( ) : cur( NULL ), end( NULL )
+{
+}
+
+ClassAdJsonReader::
+~ClassAdJsonReader( )
+{
+}
+
+bool ClassAdJsonReader::
+ParseClassAd( const string &buffer, ClassAd &ad, bool full )
+{
+	cur = buffer.data( );
+	end = cur + buffer.size( );
+
+	skipWhiteSpace( );
+	if( !parseClassAd( ad ) ) {
+		ad.Clear( );
+		return false;
+	}
+
+	// if a full parse was requested, ensure that input is exhausted
+	if( full ) {
+		skipWhiteSpace( );
+		if( cur != end ) {
+			ad.Clear( );
+			return parseError( "while parsing classad:  expected end of input "
+							   "for full parse" );
+		}
+	}
+	return true;
+}
+
+ClassAd *ClassAdJsonReader::
+ParseClassAd( const string &buffer, bool full )
+{
+	ClassAd *ad = new ClassAd;
+	if( !ParseClassAd( buffer, *ad, full ) ) {
+		delete ad;
+		ad = NULL;
+	}
+	return ad;
+}
+
+int ClassAdJsonReader::
+NextClassAd( const char *buffer, size_t len, size_t &offset, ClassAd &ad )
+{
+	cur = buffer + offset;
+	end = buffer + len;
+
+	// skip to the start of the next ad
+	for( ;; ) {
+		skipWhiteSpace( );
+		if( cur == end ) {
+			offset = len;
+			return 0;
+		}
+		if( *cur != '[' && *cur != ',' && *cur != ']' ) {
+			break;
+		}
+		cur++;
+	}
+
+	bool success = parseClassAd( ad );
+	offset = cur - buffer;
+	return success ? 1 : -1;
+}
+
+int ClassAdJsonReader::
+NextClassAd( FILE *file, ClassAd &ad )
+{
+	int ch;
+
+	// skip to the start of the next ad
+	do {
+		ch = getc( file );
+	} while( ch != EOF && ( isspace( ch ) || ch == '[' || ch == ',' || ch == ']' ) );
+	if( ch == EOF ) {
+		return 0;
+	}
+
+	// read up to the brace that closes the ad, so the ad can be parsed
+	// in memory
+	fileBuffer.clear( );
+	fileBuffer += (char)ch;
+	int depth = ( ch == '{' ) ? 1 : 0;
+	bool in_string = false;
+	bool escaped = false;
+	while( depth > 0 && ( ch = getc( file ) ) != EOF ) {
+		fileBuffer += (char)ch;
+		if( in_string ) {
+			if( escaped ) {
+				escaped = false;
+			} else if( ch == '\\' ) {
+				escaped = true;
+			} else if( ch == '"' ) {
+				in_string = false;
+			}
+		} else if( ch == '"' ) {
+			in_string = true;
+		} else if( ch == '{' || ch == '[' ) {
+			depth++;
+		} else if( ch == '}' || ch == ']' ) {
+			depth--;
+		}
+	}
+	if( depth > 0 ) {
+		parseError( "while parsing classad:  unexpected end of file" );
+		return -1;
+	}
+
+	cur = fileBuffer.data( );
+	end = cur + fileBuffer.size( );
+	return parseClassAd( ad ) ? 1 : -1;
+}
+
+// Skips white space and comments, as the lexer does
+void ClassAdJsonReader::
+skipWhiteSpace( )
+{
+	while( cur != end ) {
+		if( isspace( (unsigned char)*cur ) ) {
+			cur++;
+		} else if( *cur == '/' && cur + 1 != end && cur[1] == '/' ) {
+			while( cur != end && *cur != '\n' ) {
+				cur++;
+			}
+		} else if( *cur == '/' && cur + 1 != end && cur[1] == '*' ) {
+			const char *close = cur + 2;
+			while( close + 1 < end && ( close[0] != '*' || close[1] != '/' ) ) {
+				close++;
+			}
+			if( close + 1 >= end ) {
+				return;	// unterminated; the caller fails on the '/'
+			}
+			cur = close + 2;
+		} else {
+			return;
+		}
+	}
+}
+
+bool ClassAdJsonReader::
+parseError( const char *msg )
+{
+	CondorErrno = ERR_PARSE_ERROR;
+	CondorErrMsg = msg;
+	return false;
+}
+
+bool ClassAdJsonReader::
+parseClassAd( ClassAd &ad )
+{
+	string name;
+	bool quoted_expr;
+
+	ad.Clear( );
+
+	if( cur == end || *cur != '{' ) {
+		return parseError( "putative JSON did not begin with open brace" );
+	}
+	cur++;
+
+	for( ;; ) {
+		skipWhiteSpace( );
+		if( cur == end ) {
+			return parseError( "while parsing classad:  unexpected end of input" );
+		}
+		if( *cur == '}' ) {
+			cur++;
+			return true;
+		}
+		if( *cur == ',' ) {
+			// empty members are allowed, as ClassAdJsonParser allows them
+			cur++;
+			continue;
+		}
+
+		// the name of the attribute, then the intermediate ':'
+		if( *cur != '"' ) {
+			return parseError( "while parsing classad:  expected LEX_STRING_VALUE" );
+		}
+		if( !parseString( name, quoted_expr ) ) {
+			return false;
+		}
+		skipWhiteSpace( );
+		if( cur == end || *cur != ':' ) {
+			return parseError( "while parsing classad:  expected LEX_COLON" );
+		}
+		cur++;
+
+		ExprTree *tree = NULL;
+		if( !parseValue( tree ) ) {
+			return false;
+		}
+		if( !ad.Insert( name, tree ) ) {
+			delete tree;
+			return false;
+		}
+
+		// the next token must be a ',' or a '}'
+		skipWhiteSpace( );
+		if( cur == end || ( *cur != ',' && *cur != '}' ) ) {
+			return parseError( "while parsing classad:  expected LEX_COMMA or "
+							   "LEX_CLOSE_BRACE" );
+		}
+	}
+}
+
+bool ClassAdJsonReader::
+parseValue( ExprTree *&tree )
+{
+	tree = NULL;
+	skipWhiteSpace( );
+	if( cur == end ) {
+		return parseError( "while parsing classad:  unexpected end of input" );
+	}
+
+	switch( *cur ) {
+		case '{': {
+			ClassAd *newAd = new ClassAd;
+			if( !parseClassAd( *newAd ) ) {
+				delete newAd;
+				return false;
+			}
+			tree = newAd;
+			return true;
+		}
+
+		case '[':
+			return parseExprList( tree );
+
+		case '"': {
+			bool quoted_expr = false;
+			if( !parseString( stringBuffer, quoted_expr ) ) {
+				return false;
+			}
+			const string &s = stringBuffer;
+			if ( quoted_expr &&
+				 strncasecmp( s.c_str(), "/Expr(", 6 ) == 0 &&
+				 strcmp( s.c_str() + s.length() - 2, ")/" ) == 0 ) {
+				tree = exprParser.ParseExpression( s.substr( 6, s.length() - 8 ), true );
+				return tree != NULL;
+			}
+			Value val;
+			val.SetStringValue( s );
+			return( (tree=Literal::MakeLiteral(val)) != NULL );
+		}
+
+		case '-': case '.':
+		case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9':
+			return parseNumber( tree );
+
+		default:
+			break;
+	}
+
+	// true, false and null, in any case, as the lexer takes them
+	const char *word = cur;
+	while( cur != end && isalpha( (unsigned char)*cur ) ) {
+		cur++;
+	}
+	size_t len = cur - word;
+	Value val;
+	if( len == 4 && strncasecmp( word, "true", 4 ) == 0 ) {
+		val.SetBooleanValue( true );
+	} else if( len == 5 && strncasecmp( word, "false", 5 ) == 0 ) {
+		val.SetBooleanValue( false );
+	} else if( len == 4 && strncasecmp( word, "null", 4 ) == 0 ) {
+		val.SetUndefinedValue( );
+	} else {
+		return parseError( "while parsing classad:  expected a JSON value" );
+	}
+	if( cur != end && ( isdigit( (unsigned char)*cur ) || *cur == '_' ) ) {
+		return parseError( "while parsing classad:  expected a JSON value" );
+	}
+	return( (tree=Literal::MakeLiteral(val)) != NULL );
+}
+
+bool ClassAdJsonReader::
+parseExprList( ExprTree *&tree )
+{
+	vector<ExprTree*> loe;
+	ExprTree *elem = NULL;
+	bool closed = false;
+
+	cur++;	// the '['
+	skipWhiteSpace( );
+	if( cur != end && *cur == ']' ) {
+		cur++;
+		closed = true;
+	}
+	while( !closed ) {
+		if( !parseValue( elem ) ) {
+			break;
+		}
+		loe.push_back( elem );
+		elem = NULL;
+
+		// the next token must be a ',' followed by a value, or a ']'
+		skipWhiteSpace( );
+		if( cur != end && *cur == ']' ) {
+			cur++;
+			closed = true;
+		} else if( cur != end && *cur == ',' ) {
+			cur++;
+			skipWhiteSpace( );
+			if( cur != end && *cur == ']' ) {
+				parseError( "while parsing expression list:  expected "
+							"a value after LEX_COMMA" );
+				break;
+			}
+		} else {
+			parseError( "while parsing expression list:  expected "
+						"LEX_CLOSE_BOX or LEX_COMMA" );
+			break;
+		}
+	}
+
+	if( !closed ) {
+		for( vector<ExprTree*>::iterator i = loe.begin( ); i != loe.end( ); i++ ) {
+			delete *i;
+		}
+		return false;
+	}
+	return( (tree=ExprList::MakeExprList( loe )) != NULL );
+}
+
+// Parses a string, which must start at the current position.  The end of
+// the string is found with memchr(), and only strings with escapes are
+// copied character by character, so long values are cheap.
+bool ClassAdJsonReader::
+parseString( string &str, bool &quoted_expr )
+{
+	const char *start = ++cur;	// after the opening '"'
+	const char *close = start;
+	bool has_escapes = false;
+
+	for( ;; ) {
+		close = (const char *)memchr( close, '"', end - close );
+		if( !close ) {
+			return parseError( "while parsing classad:  unterminated string" );
+		}
+		// the quote is escaped if an odd number of backslashes precede it
+		const char *bs = close;
+		while( bs > start && bs[-1] == '\\' ) {
+			bs--;
+		}
+		if( ( close - bs ) % 2 == 0 ) {
+			break;
+		}
+		close++;
+	}
+	cur = close + 1;
+
+	// the lexer stops at a NUL character
+	if( memchr( start, '\0', close - start ) ) {
+		return parseError( "while parsing classad:  NUL character in string" );
+	}
+
+	str.assign( start, close - start );
+	quoted_expr = false;
+	has_escapes = memchr( start, '\\', close - start ) != NULL;
+	if( has_escapes ) {
+		bool valid = true;
+		convert_escapes_json( str, valid, quoted_expr );
+		if( !valid ) {
+			return parseError( "while parsing classad:  invalid escape in string" );
+		}
+	}
+	return true;
+}
+
+// Parses a number, with the lexer's rules for JSON: no octal or
+// hexadecimal integers, and no number factors
+bool ClassAdJsonReader::
+parseNumber( ExprTree *&tree )
+{
+	const char *start = cur;
+	bool is_real = false;
+
+	if( *cur == '-' ) {
+		cur++;
+	}
+	const char *digits = cur;
+	while( cur != end && isdigit( (unsigned char)*cur ) ) {
+		cur++;
+	}
+	if( cur != end && *cur == '.' ) {
+		cur++;
+		if( cur == end || !isdigit( (unsigned char)*cur ) ) {
+			return parseError( "while parsing classad:  bad number" );
+		}
+		while( cur != end && isdigit( (unsigned char)*cur ) ) {
+			cur++;
+		}
+		is_real = true;
+	} else if( cur == digits ) {
+		return parseError( "while parsing classad:  bad number" );
+	}
+	if( cur != end && ( *cur == 'e' || *cur == 'E' ) ) {
+		cur++;
+		if( cur != end && ( *cur == '+' || *cur == '-' ) ) {
+			cur++;
+		}
+		if( cur == end || !isdigit( (unsigned char)*cur ) ) {
+			return parseError( "while parsing classad:  bad number" );
+		}
+		while( cur != end && isdigit( (unsigned char)*cur ) ) {
+			cur++;
+		}
+		is_real = true;
+	}
+
+	// the text may not be NUL-terminated, so convert a copy
+	char number[64];
+	string long_number;
+	const char *text = number;
+	size_t len = cur - start;
+	if( len < sizeof( number ) ) {
+		memcpy( number, start, len );
+		number[len] = '\0';
+	} else {
+		long_number.assign( start, len );
+		text = long_number.c_str( );
+	}
+
+	Value val;
+	if( is_real ) {
+		val.SetRealValue( strtod( text, NULL ) );
+	} else {
+		if( text[0] == '0' && len > 1 ) {
+			return parseError( "while parsing classad:  bad number" );
+		}
+#ifdef WIN32
+		val.SetIntegerValue( _strtoi64( text, NULL, 10 ) );
+#else
+		val.SetIntegerValue( strtoll( text, NULL, 10 ) );
+#endif
+	}
+	return( (tree=Literal::MakeLiteral(val)) != NULL );
+}
+
+
 } // classad
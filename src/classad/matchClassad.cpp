@@ -21,6 +21,7 @@
 #include "classad/common.h"
 #include "classad/source.h"
 #include "classad/matchClassad.h"
+#include "classad/operators.h"
 
 using namespace std;
 
@@ -33,6 +34,8 @@ MatchClassAd()
 {
 	lCtx = rCtx = NULL;
 	lad = rad = NULL;
+	lProxy = rProxy = NULL;
+	lResidual = NULL;
 	ladParent = radParent = NULL;
 	symmetric_match = NULL;
 	right_matches_left = NULL;
@@ -45,6 +48,8 @@ MatchClassAd::
 MatchClassAd( ClassAd *adl, ClassAd *adr ) : ClassAd()
 {
 	lad = rad = lCtx = rCtx = NULL;
+	lProxy = rProxy = NULL;
+	lResidual = NULL;
 	ladParent = radParent = NULL;
 	InitMatchClassAd( adl, adr );
 }
@@ -53,6 +58,7 @@ MatchClassAd( ClassAd *adl, ClassAd *adr ) : ClassAd()
 MatchClassAd::
 ~MatchClassAd()
 {
+	DiscardLeftResidual( );
 }
 
 
@@ -74,6 +80,8 @@ InitMatchClassAd( ClassAd *adl, ClassAd *adr )
 	Clear( );
 	lad = rad = NULL;
 	lCtx = rCtx = NULL;
+	lProxy = rProxy = NULL;
+	DiscardLeftResidual( );
 
 		// convenience expressions
 	ClassAd *upd;
@@ -143,6 +151,7 @@ InitMatchClassAd( ClassAd *adl, ClassAd *adr )
 bool MatchClassAd::
 ReplaceLeftAd( ClassAd *ad )
 {
+	DiscardLeftResidual( );
 	lad = ad;
 	ladParent = ad ? ad->GetParentScope( ) : (ClassAd*)NULL;
 	if( ad ) {
@@ -205,6 +214,82 @@ ReplaceRightAd( ClassAd *ad )
 }
 
 
+bool MatchClassAd::
+BindLeftAd( const ClassAd *ad )
+{
+	if( !lProxy || lad != lProxy ) {
+		ClassAd *proxy = new ClassAd();
+		if( !ReplaceLeftAd( proxy ) ) {
+			delete proxy;
+			return false;
+		}
+		lProxy = proxy;
+	}
+		// lookups through the chain never modify the ad
+	DiscardLeftResidual( );
+	lProxy->Unchain();
+	lProxy->ChainToAd( const_cast<ClassAd*>( ad ) );
+	return true;
+}
+
+
+bool MatchClassAd::
+BindLeftAdForMatchmaking( const ClassAd *ad )
+{
+	if( !BindLeftAd( ad ) ) {
+		return false;
+	}
+	ExprTree *requirements = lProxy->Lookup( ATTR_REQUIREMENTS );
+	if( !requirements ) {
+		return true;
+	}
+
+		// Flatten the requirements in the bound ad alone: a right ad
+		// left over from an earlier match must not be folded in.
+	const ClassAd *parent = lProxy->GetParentScope( );
+	ClassAd *alternate = lProxy->alternateScope;
+	lProxy->SetParentScope( NULL );
+	lProxy->alternateScope = NULL;
+
+	if( InsertMatchmakingNames( lProxy, false, lAlias, rAlias ) ) {
+		Value flat_val;
+		ExprTree *flat_requirements = NULL;
+		if( lProxy->FlattenAndInline( requirements, flat_val, flat_requirements ) ) {
+			if( !flat_requirements ) {
+					// flattened to a value
+				flat_requirements = Literal::MakeLiteral( flat_val );
+			}
+			lResidual = flat_requirements;
+		}
+		RemoveMatchmakingNames( lProxy, lAlias, rAlias );
+	}
+
+	lProxy->SetParentScope( parent );
+	lProxy->alternateScope = alternate;
+	if( lResidual ) {
+		lResidual->SetParentScope( lProxy );
+	}
+	return true;
+}
+
+
+bool MatchClassAd::
+BindRightAd( const ClassAd *ad )
+{
+	if( !rProxy || rad != rProxy ) {
+		ClassAd *proxy = new ClassAd();
+		if( !ReplaceRightAd( proxy ) ) {
+			delete proxy;
+			return false;
+		}
+		rProxy = proxy;
+	}
+	rProxy->Unchain();
+	rProxy->ChainToAd( const_cast<ClassAd*>( ad ) );
+	return true;
+}
+
+
 ClassAd *MatchClassAd::
 GetLeftAd()
 {
@@ -236,6 +321,7 @@ GetRightContext( )
 ClassAd *MatchClassAd::
 RemoveLeftAd( )
 {
+	DiscardLeftResidual( );
 	ClassAd *ad = lad;
 	Remove( "LEFT" );
 	if( lad ) {
@@ -321,26 +407,14 @@ OptimizeLeftAdForMatchmaking( ClassAd *ad, std::string *error_msg, const std::st
 }
 
 bool MatchClassAd::
-OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, const std::string &left_alias, const std::string &right_alias )
+InsertMatchmakingNames( ClassAd *ad, bool is_right, const std::string &left_alias, const std::string &right_alias )
 {
 	if( ad->Lookup("my") ||
 		ad->Lookup("target") ||
 		ad->Lookup("other") ||
 		( !left_alias.empty() && ad->Lookup(left_alias) ) ||
-		( !right_alias.empty() && ad->Lookup(right_alias) ) ||
-		ad->Lookup(ATTR_UNOPTIMIZED_REQUIREMENTS) )
+		( !right_alias.empty() && ad->Lookup(right_alias) ) )
 	{
-		if( error_msg ) {
-			*error_msg = "Optimization of matchmaking requirements failed, because ad already contains one of my, target, other, or UnoptimizedRequirements.";
-		}
-		return false;
-	}
-
-	ExprTree *requirements = ad->Lookup(ATTR_REQUIREMENTS);
-	if( !requirements ) {
-		if( error_msg ) {
-			*error_msg = "No requirements found in ad to be optimized.";
-		}
 		return false;
 	}
 
@@ -375,7 +449,48 @@ OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, co
 			ad->Insert( right_alias, AttributeReference::MakeAttributeReference( NULL, "RIGHT", true ) );
 		}
 	}
+	return true;
+}
+
+void MatchClassAd::
+RemoveMatchmakingNames( ClassAd *ad, const std::string &left_alias, const std::string &right_alias )
+{
+		// After flatenning, no references should remain to MY or TARGET.
+		// Even if there are, those can be resolved by the context ads, so
+		// we don't need to leave these attributes in the ad.
+	if ( !_useOldClassAdSemantics ) {
+		ad->Delete("my");
+	}
+	ad->Delete("other"); 
+	ad->Delete("target");
+	if ( !left_alias.empty() ) {
+		ad->Delete( left_alias );
+	}
+	if ( !right_alias.empty() ) {
+		ad->Delete( right_alias );
+	}
+}
+
+bool MatchClassAd::
+OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, const std::string &left_alias, const std::string &right_alias )
+{
+	if( ad->Lookup(ATTR_UNOPTIMIZED_REQUIREMENTS) ||
+		!InsertMatchmakingNames( ad, is_right, left_alias, right_alias ) )
+	{
+		if( error_msg ) {
+			*error_msg = "Optimization of matchmaking requirements failed, because ad already contains one of my, target, other, or UnoptimizedRequirements.";
+		}
+		return false;
+	}
 
+	ExprTree *requirements = ad->Lookup(ATTR_REQUIREMENTS);
+	if( !requirements ) {
+		if( error_msg ) {
+			*error_msg = "No requirements found in ad to be optimized.";
+		}
+		RemoveMatchmakingNames( ad, left_alias, right_alias );
+		return false;
+	}
 
 	ExprTree *flat_requirements = NULL;
 	Value flat_val;
@@ -412,21 +527,8 @@ OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, co
 		}
 	}
 
-		// After flatenning, no references should remain to MY or TARGET.
-		// Even if there are, those can be resolved by the context ads, so
-		// we don't need to leave these attributes in the ad.
 	// TODO The failure cases above should run this cleanup code
-	if ( !_useOldClassAdSemantics ) {
-		ad->Delete("my");
-	}
-	ad->Delete("other"); 
-	ad->Delete("target");
-	if ( !left_alias.empty() ) {
-		ad->Delete( left_alias );
-	}
-	if ( !right_alias.empty() ) {
-		ad->Delete( right_alias );
-	}
+	RemoveMatchmakingNames( ad, left_alias, right_alias );
 
 	return true;
 }
@@ -443,6 +545,20 @@ UnoptimizeAdForMatchmaking( ClassAd *ad )
 	return true;
 }
 
+static bool
+IsMatchValue( Value &val )
+{
+	bool result = false;
+	if( val.IsBooleanValueEquiv( result ) ) {
+		return result;
+	}
+	long long int_result = 0;
+	if( val.IsIntegerValue( int_result ) ) {
+		return int_result != 0;
+	}
+	return false;
+}
+
 bool MatchClassAd::
 EvalMatchExpr(ExprTree *match_expr)
 {
@@ -452,33 +568,103 @@ EvalMatchExpr(ExprTree *match_expr)
 	}
 
 	if( EvaluateExpr( match_expr, val ) ) {
-		bool result = false;
-		if( val.IsBooleanValueEquiv( result ) ) {
-			return result;
+		return IsMatchValue( val );
+	}
+	return false;
+}
+
+bool MatchClassAd::
+EvalCompiledRequirements(ClassAd *ad1, ClassAd *ad2)
+{
+	Value val1, val2, result;
+	bool b;
+
+	if( !ad1->EvaluateAttrCompiled( "requirements", val1 ) ) {
+		return false;
+	}
+	if( !ad2 ) {
+		return IsMatchValue( val1 );
+	}
+
+		// same short-circuit as the && in symmetricMatch
+	if( val1.IsBooleanValueEquiv( b ) && !b ) {
+		return false;
+	}
+	if( !ad2->EvaluateAttrCompiled( "requirements", val2 ) ) {
+		return false;
+	}
+	Operation::Operate( Operation::LOGICAL_AND_OP, val1, val2, result );
+	return IsMatchValue( result );
+}
+
+bool MatchClassAd::
+EvalResidualRequirements(bool symmetric)
+{
+	Value lval, rval, result;
+	bool b;
+
+	if( !symmetric ) {
+		return lad->EvaluateExpr( lResidual, lval ) && IsMatchValue( lval );
+	}
+
+		// left requirements that flattened to false match no right ad,
+		// whatever its requirements evaluate to
+	bool left_done = false;
+	if( lResidual->GetKind() == LITERAL_NODE ) {
+		if( !lad->EvaluateExpr( lResidual, lval ) ) {
+			return false;
 		}
-		long long int_result = 0;
-		if( val.IsIntegerValue( int_result ) ) {
-			return int_result != 0;
+		if( lval.IsBooleanValueEquiv( b ) && !b ) {
+			return false;
 		}
+		left_done = true;
 	}
-	return false;
+
+		// otherwise, the same order and short-circuit as the && in
+		// symmetricMatch
+	if( !rad->EvaluateAttrCompiled( "requirements", rval ) ) {
+		return false;
+	}
+	if( rval.IsBooleanValueEquiv( b ) && !b ) {
+		return false;
+	}
+	if( !left_done && !lad->EvaluateExpr( lResidual, lval ) ) {
+		return false;
+	}
+	Operation::Operate( Operation::LOGICAL_AND_OP, rval, lval, result );
+	return IsMatchValue( result );
 }
 
 bool MatchClassAd::
 symmetricMatch()
 {
+	if( lResidual && rad ) {
+		return EvalResidualRequirements( true );
+	}
+	if( lad && rad && ClassAdGetExpressionCompiling() ) {
+		return EvalCompiledRequirements( rad, lad );
+	}
 	return EvalMatchExpr( symmetric_match );
 }
 
 bool MatchClassAd::
 rightMatchesLeft()
 {
+	if( lResidual ) {
+		return EvalResidualRequirements( false );
+	}
+	if( lad && ClassAdGetExpressionCompiling() ) {
+		return EvalCompiledRequirements( lad, NULL );
+	}
 	return EvalMatchExpr( right_matches_left );
 }
 
 bool MatchClassAd::
 leftMatchesRight()
 {
+	if( rad && ClassAdGetExpressionCompiling() ) {
+		return EvalCompiledRequirements( rad, NULL );
+	}
 	return EvalMatchExpr( left_matches_right );
 }
 
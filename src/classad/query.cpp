@@ -92,10 +92,21 @@ Query( const string &viewName, ExprTree *expr, bool two_way_matching )
 	}
 	keys.clear( );
 
+	// the members to try:  those the view's indexes say may satisfy the
+	// constraint, or else all of them
+	vector<ViewMembers::iterator> members;
+	if( !expr || !view->FindCandidates( mad, mad.GetLeftAd( )->Lookup( ATTR_REQUIREMENTS ),
+										members ) ) {
+		members.reserve( view->viewMembers.size( ) );
+		for( vmi=view->viewMembers.begin(); vmi!=view->viewMembers.end(); vmi++ ) {
+			members.push_back( vmi );
+		}
+	}
 
 	// iterate over the view members
-	for( vmi=view->viewMembers.begin(); vmi!=view->viewMembers.end(); vmi++ ) {
+	for( size_t i = 0; i < members.size( ); i++ ) {
 		// ... and insert keys into local list in same order
+		vmi = members[i];
 		vmi->GetKey( key );
 
 		if( expr ) {
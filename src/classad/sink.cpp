@@ -30,7 +30,7 @@ using namespace std;
 
 namespace classad {
 
-static bool identifierNeedsQuoting( const string & );
+static bool identifierNeedsQuoting( const char *, size_t );
 
 
 // should be in same order as OpKind enumeration in common.h
@@ -97,55 +97,12 @@ Unparse( string &buffer, const Value &val )
 			break;
 
 		case Value::STRING_VALUE: {
-			string	s;
+			const char *s = NULL;
+			int len = 0;
 			val.IsStringValue( s );
+			val.IsStringValue( len );
 			buffer += '"';
-			for( string::const_iterator itr=s.begin( ); itr!=s.end( ); itr++ ) {
-				if(*itr == delimiter) {
-					if(delimiter == '\"') {
-						buffer += "\\\""; 
-						continue;
-					}
-					else {
-						buffer += "\\\'"; 
-						continue;
-					}   
-				}
-				if( !oldClassAd ) {
-					switch( *itr ) {
-						case '\a': buffer += "\\a"; continue;
-						case '\b': buffer += "\\b"; continue;
-						case '\f': buffer += "\\f"; continue;
-						case '\n': buffer += "\\n"; continue;
-						case '\r': buffer += "\\r"; continue;
-						case '\t': buffer += "\\t"; continue;
-						case '\v': buffer += "\\v"; continue;
-						case '\\': buffer += "\\\\"; continue;
-						case '\'': buffer += "\'"; continue;
-						case '\"': buffer += "\""; continue;
-
-						default:
-							if( !isprint( *itr ) ) {
-									// print octal representation
-								sprintf( tempBuf, "\\%03o", (unsigned char)*itr );
-								buffer += tempBuf;
-								continue;
-							}
-							break;
-					}
-				}
-
-				if (!xmlUnparse) {
-					buffer += *itr;
-				} else {
-					switch (*itr) {
-						case '&': buffer += "&amp;"; break;
-						case '<': buffer += "&lt;";  break;
-						case '>': buffer += "&gt;";  break;
-						default:  buffer += *itr;    break;
-					}
-				}
-			}
+			UnparseAuxEscapeString( buffer, s, len );
 			buffer += '"';
 			return;
 		}
@@ -223,19 +180,15 @@ Unparse( string &buffer, const Value &val )
 		case Value::SCLASSAD_VALUE:
 		case Value::CLASSAD_VALUE: {
 			const ClassAd *ad = NULL;
-			vector< pair<string,ExprTree*> > attrs;
 			val.IsClassAdValue( ad );
-			ad->GetComponents( attrs );
-			UnparseAux( buffer, attrs );
+			UnparseAux( buffer, ad );
 			return;
 		}
 		case Value::SLIST_VALUE:
 		case Value::LIST_VALUE: {
 			const ExprList *el = NULL;
-			vector<ExprTree*> exprs;
 			val.IsListValue( el );
-			el->GetComponents( exprs );
-			UnparseAux( buffer, exprs );
+			UnparseAux( buffer, const_cast<vector<ExprTree*>&>( el->GetExprs( ) ) );
 			return;
 		}
 		default:
@@ -244,6 +197,68 @@ Unparse( string &buffer, const Value &val )
 }
 
 
+// Appends the contents of a string literal, escaped for the current
+// delimiter and mode.  Runs of characters that need no escaping are
+// appended in one piece.
+void ClassAdUnParser::
+UnparseAuxEscapeString( string &buffer, const char *str, size_t len )
+{
+	char	tempBuf[8];
+	const char *run = str;
+	const char *end = str + len;
+
+	for( const char *itr = str; itr != end; itr++ ) {
+		if( *itr != delimiter &&
+			( oldClassAd || ( *itr != '\\' && isprint( *itr ) ) ) &&
+			( !xmlUnparse || ( *itr != '&' && *itr != '<' && *itr != '>' ) ) ) {
+			continue;
+		}
+		buffer.append( run, itr - run );
+		run = itr + 1;
+
+		if(*itr == delimiter) {
+			if(delimiter == '\"') {
+				buffer += "\\\""; 
+				continue;
+			}
+			else {
+				buffer += "\\\'"; 
+				continue;
+			}   
+		}
+		if( !oldClassAd ) {
+			switch( *itr ) {
+				case '\a': buffer += "\\a"; continue;
+				case '\b': buffer += "\\b"; continue;
+				case '\f': buffer += "\\f"; continue;
+				case '\n': buffer += "\\n"; continue;
+				case '\r': buffer += "\\r"; continue;
+				case '\t': buffer += "\\t"; continue;
+				case '\v': buffer += "\\v"; continue;
+				case '\\': buffer += "\\\\"; continue;
+
+				default:
+					if( !isprint( *itr ) ) {
+							// print octal representation
+						sprintf( tempBuf, "\\%03o", (unsigned char)*itr );
+						buffer += tempBuf;
+						continue;
+					}
+					break;
+			}
+		}
+
+		switch (*itr) {
+			case '&': buffer += "&amp;"; break;
+			case '<': buffer += "&lt;";  break;
+			case '>': buffer += "&gt;";  break;
+			default:  buffer += *itr;    break;
+		}
+	}
+	buffer.append( run, end - run );
+}
+
+
 void ClassAdUnParser::
 Unparse( string &buffer, const ExprTree *tree )
 {
@@ -254,24 +269,20 @@ Unparse( string &buffer, const ExprTree *tree )
 
 	switch( tree->GetKind( ) ) {
 		case ExprTree::LITERAL_NODE: {
-#if 0
 			Value::NumberFactor factor;
 			const Value & val = ((const Literal*)tree)->getValue(factor);
-#else
-			Value				val;
-			Value::NumberFactor	factor;
-			((Literal*)tree)->GetComponents( val, factor );
-#endif
 			UnparseAux( buffer, val, factor );
 			return;
 		}
 
+			// The UnparseAux() hooks take non-const references to the
+			// names and lists of the nodes, but don't change them, so
+			// the nodes' own are passed rather than copies.
 		case ExprTree::ATTRREF_NODE: {
-			ExprTree *expr;
-			string	ref;
-			bool	absolute;
-			((AttributeReference*)tree)->GetComponents( expr, ref, absolute );
-			UnparseAux( buffer, expr, ref, absolute );
+			const AttributeReference *ref = (const AttributeReference*)tree;
+			UnparseAux( buffer, ref->GetExpr( ),
+						const_cast<string&>( ref->GetAttributeName( ) ),
+						ref->IsAbsolute( ) );
 			return;
 		}
 
@@ -284,24 +295,19 @@ Unparse( string &buffer, const ExprTree *tree )
 		}
 
 		case ExprTree::FN_CALL_NODE: {
-			string					fnName;
-			vector<ExprTree*> args;
-			((FunctionCall*)tree)->GetComponents( fnName, args );
-			UnparseAux( buffer, fnName, args );
+			const FunctionCall *fn = (const FunctionCall*)tree;
+			UnparseAux( buffer, const_cast<string&>( fn->GetFunctionName( ) ),
+						const_cast<ArgumentList&>( fn->GetArguments( ) ) );
 			return;
 		}
 
 		case ExprTree::CLASSAD_NODE: {
-			vector< pair<string, ExprTree*> > attrs;
-			((ClassAd*)tree)->GetComponents( attrs );
-			UnparseAux( buffer, attrs );
+			UnparseAux( buffer, (const ClassAd*)tree );
 			return;
 		}
 
 		case ExprTree::EXPR_LIST_NODE: {
-			vector<ExprTree*> exprs;
-			((ExprList*)tree)->GetComponents( exprs );
-			UnparseAux( buffer, exprs );
+			UnparseAux( buffer, const_cast<vector<ExprTree*>&>( ((const ExprList*)tree)->GetExprs( ) ) );
 			return;
 		}
 		
@@ -364,7 +370,8 @@ UnparseAux( string &buffer, const ExprTree *expr, string &attrName, bool absolut
 {
 	if( expr ) {
 		Unparse( buffer, expr );
-		buffer += "." + attrName;
+		buffer += '.';
+		buffer += attrName;
 		return;
 	}
 	if( absolute ) buffer += ".";
@@ -453,7 +460,8 @@ UnparseAux( string &buffer, string &fnName, vector<ExprTree*>& args )
 {
 	vector<ExprTree*>::const_iterator	itr;
 
-	buffer += fnName + "(";
+	buffer += fnName;
+	buffer += '(';
 	for( itr=args.begin( ); itr!=args.end( ); itr++ ) {
 		Unparse( buffer, *itr );
 		if( itr+1 != args.end( ) ) buffer += ',';
@@ -464,9 +472,23 @@ UnparseAux( string &buffer, string &fnName, vector<ExprTree*>& args )
 void ClassAdUnParser::
 UnparseAux( string &buffer, vector< pair<string,ExprTree*> >& attrs )
 {
-	vector< pair<string,ExprTree*> >::const_iterator itr;
+	UnparseAuxAttrs( buffer, attrs.begin( ), attrs.end( ) );
+}
+
+
+void ClassAdUnParser::
+UnparseAux( string &buffer, const ClassAd *ad )
+{
+	UnparseAuxAttrs( buffer, ad->begin( ), ad->end( ) );
+}
+
 
-	string delim;		// NAC
+// Unparses the attributes of an ad, from either a ClassAd or the vector
+// of its components
+template <class Iter> void ClassAdUnParser::
+UnparseAuxAttrs( string &buffer, Iter begin, Iter end )
+{
+	const char *delim;		// NAC
 	if( oldClassAd && !oldClassAdValue ) {	// NAC
 		delim = "\n";	// NAC
 	}					// NAC
@@ -477,16 +499,14 @@ UnparseAux( string &buffer, vector< pair<string,ExprTree*> >& attrs )
 	if( !oldClassAd || oldClassAdValue ) {	// NAC
 		buffer += "[ ";
 	}					// NAC
-	for( itr=attrs.begin( ); itr!=attrs.end( ); itr++ ) {
-	  UnparseAux( buffer, itr->first ); 
+	for( Iter itr=begin; itr!=end; itr++ ) {
+		if( itr != begin ) buffer += delim;	// NAC
+	  UnparseAux( buffer, static_cast<const string &>( itr->first ) );
 	  buffer += " = ";
 		bool save = oldClassAdValue;
 		oldClassAdValue = true;
 		Unparse( buffer, itr->second );
 		oldClassAdValue = save;
-//		if( itr+1 != attrs.end( ) ) buffer += "; ";
-		if( itr+1 != attrs.end( ) ) buffer += delim;	// NAC
-
 	}
 	if( !oldClassAd || oldClassAdValue ) {	// NAC
 		buffer += " ]";
@@ -518,6 +538,12 @@ UnparseAux( string &buffer, vector<ExprTree*>& exprs )
 void ClassAdUnParser::
 UnparseAux( string &buffer, const string &identifier )
 {
+		// most names need neither escaping nor quoting
+	if( !identifierNeedsQuoting( identifier.data( ), identifier.size( ) ) ) {
+		buffer += identifier;
+		return;
+	}
+
 	Value  val;
 	string idstr;
 
@@ -527,7 +553,7 @@ UnparseAux( string &buffer, const string &identifier )
 	setDelimiter('\"'); // set delimiter back to default setting
 	idstr.erase(0,1);
 	idstr.erase(idstr.length()-1,1);
-	if (identifierNeedsQuoting(idstr)) {
+	if (identifierNeedsQuoting(idstr.data(), idstr.size())) {
 		idstr.insert(0,"'");
 		idstr += "'";
 	}
@@ -690,6 +716,15 @@ UnparseAux(string &buffer,Operation::OpKind op,ExprTree *op1,ExprTree *op2,
 }
 
 
+void PrettyPrint::
+UnparseAux( string &buffer, const ClassAd *ad )
+{
+	vector< pair<string, ExprTree*> > attrs;
+	ad->GetComponents( attrs );
+	UnparseAux( buffer, attrs );
+}
+
+
 void PrettyPrint::
 UnparseAux( string &buffer, vector< pair<string,ExprTree*> >& attrs )
 {
@@ -697,14 +732,17 @@ UnparseAux( string &buffer, vector< pair<string,ExprTree*> >& attrs )
 
 	if( classadIndent > 0 ) {
 		indentLevel += classadIndent;
-		buffer += '\n' + string( indentLevel, ' ' ) + '[';
+		buffer += '\n';
+		buffer.append( indentLevel, ' ' );
+		buffer += '[';
 		indentLevel += classadIndent;
 	} else {
 		buffer += "[ ";
 	}
 	for( itr=attrs.begin( ); itr!=attrs.end( ); itr++ ) {
 		if( classadIndent > 0 ) {
-			buffer += '\n' + string( indentLevel, ' ' );
+			buffer += '\n';
+			buffer.append( indentLevel, ' ' );
 		} 
 		ClassAdUnParser::UnparseAux( buffer, itr->first );
 		buffer +=  " = ";
@@ -715,7 +753,9 @@ UnparseAux( string &buffer, vector< pair<string,ExprTree*> >& attrs )
 	}
 	if( classadIndent > 0 ) {
 		indentLevel -= classadIndent;
-		buffer += '\n' + string( indentLevel, ' ' ) + ']';
+		buffer += '\n';
+		buffer.append( indentLevel, ' ' );
+		buffer += ']';
 		indentLevel -= classadIndent;
 	} else {
 		buffer += " ]";
@@ -730,21 +770,26 @@ UnparseAux( string &buffer, vector<ExprTree*>& exprs )
 
 	if( listIndent > 0 ) {
 		indentLevel += listIndent;
-		buffer += '\n' + string( indentLevel, ' ' ) + '{';
+		buffer += '\n';
+		buffer.append( indentLevel, ' ' );
+		buffer += '{';
 		indentLevel += listIndent;
 	} else {
 		buffer += "{ ";
 	}
 	for( itr=exprs.begin( ); itr!=exprs.end( ); itr++ ) {
 		if( listIndent > 0 ) {
-			buffer += '\n' + string( indentLevel, ' ' );
+			buffer += '\n';
+			buffer.append( indentLevel, ' ' );
 		}
 		ClassAdUnParser::Unparse( buffer, *itr );
 		if( itr+1 != exprs.end( ) ) buffer += ',';
 	}
 	if( listIndent > 0 ) {
 		indentLevel -= listIndent;
-		buffer += '\n' + string( indentLevel, ' ' ) + '}';
+		buffer += '\n';
+		buffer.append( indentLevel, ' ' );
+		buffer += '}';
 		indentLevel -= listIndent;
 	} else {
 		buffer += " }";
@@ -753,25 +798,25 @@ UnparseAux( string &buffer, vector<ExprTree*>& exprs )
 
 /* Checks whether string qualifies to be a non-quoted attribute */
 static bool 
-identifierNeedsQuoting( const string &str )
+identifierNeedsQuoting( const char *ch, size_t len )
 {
 	bool  needs_quoting;
-	const char *ch = str.c_str( );
+	const char *end = ch + len;
 
 	// must start with [a-zA-Z_]
-	if( !isalpha( *ch ) && *ch != '_' ) {
+	if( ch == end || ( !isalpha( *ch ) && *ch != '_' ) ) {
 		needs_quoting = true;
 	} else {
 
 		// all other characters must be [a-zA-Z0-9_]
 		ch++;
-		while( isalnum( *ch ) || *ch == '_' ) {
+		while( ch != end && ( isalnum( *ch ) || *ch == '_' ) ) {
 			ch++;
 		}
 
 		// needs quoting if we found a special character
 		// before the end of the string.
-		needs_quoting =  !(*ch == '\0' );
+		needs_quoting =  !( ch == end );
 	}
 	return needs_quoting;
 }
@@ -0,0 +1,220 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+
+#include "classad/common.h"
+#include "classad/stringListSet.h"
+#include <list>
+#include <unordered_map>
+
+using namespace std;
+
+namespace classad {
+
+// At most this many lists, holding at most this many bytes of list text,
+// are kept in the shared cache.
+static const size_t MAX_CACHED_LISTS = 4096;
+static const size_t MAX_CACHED_LIST_BYTES = 16 * 1024 * 1024;
+
+// Each thread also remembers the last few lists it used, found by a hash
+// of the list text, so repeated tests of a list in a row don't take the
+// cache lock.
+static const size_t NUM_THREAD_LISTS = 16;
+
+class StringListSetCache
+{
+	public:
+		StringListSetCache( ) : bytes( 0 ) { }
+
+		StringListSetPtr Find( const string &list, const string &delimiters,
+							   bool trim_whitespace );
+		void Clear( );
+
+	private:
+		static void makeKey( const string &list, const string &delimiters,
+							 bool trim_whitespace, string &key );
+
+		std::mutex lock;
+		std::list<StringListSetPtr> lru;	// most recent first
+		std::unordered_map<string, std::list<StringListSetPtr>::iterator> index;
+		size_t bytes;	// of list text
+};
+
+// Made on first use, since a StringListSet may be used by the static
+// initializers of other files.
+static StringListSetCache &getListCache()
+{
+	static StringListSetCache listCache;
+	return listCache;
+}
+
+struct ThreadListSet
+{
+	size_t				hash;
+	StringListSetPtr	set;
+};
+
+static thread_local ThreadListSet threadListSets[NUM_THREAD_LISTS];
+
+StringListSet::
+StringListSet( const string &l, const string &d, bool trim_whitespace ) :
+	list( l ), delimiters( d ), trimWhitespace( trim_whitespace ), size( 0 )
+{
+	const char *delims = delimiters.c_str( );
+	if( !trimWhitespace && !*delims ) {
+		delims = " ,";
+	}
+
+	const char *str = list.c_str( );
+	string item;
+	if( trimWhitespace ) {
+		while( *str ) {
+				// skip leading separators & whitespace
+			while( *str && ( strchr( delims, *str ) || isspace( (unsigned char)*str ) ) ) {
+				str++;
+			}
+			if( !*str ) {
+				break;
+			}
+			const char *begin = str;
+			const char *end = str;
+			while( *str && !strchr( delims, *str ) ) {
+				if( !isspace( (unsigned char)*str ) ) {
+					end = str;
+				}
+				str++;
+			}
+			item.assign( begin, end - begin + 1 );
+			items.insert( item );
+			size++;
+		}
+	} else {
+		while( *str ) {
+			size_t len = strcspn( str, delims );
+			if( len > 0 ) {
+				item.assign( str, len );
+				items.insert( item );
+				size++;
+				str += len;
+			}
+			if( *str ) {
+				str++;
+			}
+		}
+	}
+}
+
+bool StringListSet::
+Matches( const string &l, const string &d, bool trim_whitespace ) const
+{
+	return trimWhitespace == trim_whitespace && delimiters == d && list == l;
+}
+
+bool StringListSet::
+ContainsAnyCase( const string &item ) const
+{
+	std::call_once( anyCaseOnce, [this]( ) {
+		anyCaseItems.insert( items.begin( ), items.end( ) );
+	} );
+	return anyCaseItems.find( item ) != anyCaseItems.end( );
+}
+
+StringListSetPtr StringListSet::
+Find( const string &list, const string &delimiters, bool trim_whitespace )
+{
+	size_t hash = std::hash<string>( )( list );
+	ThreadListSet &memo = threadListSets[hash % NUM_THREAD_LISTS];
+	if( memo.set && memo.hash == hash &&
+		memo.set->Matches( list, delimiters, trim_whitespace ) ) {
+		return memo.set;
+	}
+
+	memo.hash = hash;
+	memo.set = getListCache().Find( list, delimiters, trim_whitespace );
+	return memo.set;
+}
+
+void StringListSet::
+ClearCache( )
+{
+	getListCache().Clear( );
+}
+
+void StringListSetCache::
+makeKey( const string &list, const string &delimiters, bool trim_whitespace,
+		 string &key )
+{
+	key = delimiters;
+	key += '\0';
+	key += trim_whitespace ? 't' : 'r';
+	key += list;
+}
+
+StringListSetPtr StringListSetCache::
+Find( const string &list, const string &delimiters, bool trim_whitespace )
+{
+	string key;
+	makeKey( list, delimiters, trim_whitespace, key );
+
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		auto found = index.find( key );
+		if( found != index.end( ) ) {
+			lru.splice( lru.begin( ), lru, found->second );
+			return *found->second;
+		}
+	}
+
+		// split the list outside the lock
+	StringListSetPtr set( new StringListSet( list, delimiters, trim_whitespace ) );
+
+	std::lock_guard<std::mutex> guard( lock );
+	auto found = index.find( key );
+	if( found != index.end( ) ) {
+			// another thread got there first
+		lru.splice( lru.begin( ), lru, found->second );
+		return *found->second;
+	}
+	if( list.size( ) > MAX_CACHED_LIST_BYTES / 4 ) {
+			// too big to keep without pushing out most everything else
+		return set;
+	}
+	lru.push_front( set );
+	index[key] = lru.begin( );
+	bytes += list.size( );
+	while( lru.size( ) > MAX_CACHED_LISTS || bytes > MAX_CACHED_LIST_BYTES ) {
+		const StringListSetPtr &oldest = lru.back( );
+		makeKey( oldest->list, oldest->delimiters, oldest->trimWhitespace, key );
+		index.erase( key );
+		bytes -= oldest->list.size( );
+		lru.pop_back( );
+	}
+	return set;
+}
+
+void StringListSetCache::
+Clear( )
+{
+	std::lock_guard<std::mutex> guard( lock );
+	index.clear( );
+	lru.clear( );
+	bytes = 0;
+}
+
+}
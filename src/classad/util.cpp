@@ -24,16 +24,21 @@
 #include "classad/util.h"
 #include <limits.h>
 #include <math.h>
+#include <mutex>
 
 using namespace std;
 
 namespace classad {
 
+// the C library's random number generators aren't thread-safe
+static std::mutex random_lock;
+
 #ifdef WIN32
 #define BIGGEST_RANDOM_INT RAND_MAX
 int get_random_integer(void)
 {
     static char initialized = 0;
+	std::lock_guard<std::mutex> guard(random_lock);
 
 	if (!initialized) {
         int seed = time(NULL);
@@ -48,6 +53,7 @@ int get_random_integer(void)
 int get_random_integer(void)
 {
     static char initialized = 0;
+	std::lock_guard<std::mutex> guard(random_lock);
 
 	if (!initialized) {
         int seed = time(NULL);
@@ -290,34 +296,21 @@ void convert_escapes_json(string &text, bool &validStr, bool &quotedExpr)
 void
 append_long(std::string &s, long long l) {
 	char buf[28]; // build up the string backwards here
-	char *p = buf;
+	char *end = buf + sizeof(buf);
+	char *p = end;
 
 	if (l >= 0) {
 		do {
-			*p = '0' + l % 10;
-			p++;
+			*--p = '0' + l % 10;
 		} while (l /= 10);
-
-		while (p != buf) {
-			p--;
-			s += *p;
-		}
-		return;
-
 	} else {
-		s += '-';
 		do {
 			// a negative number mod 10 is a negative
-			*p = '0' - l % 10;
-			p++;
+			*--p = '0' - l % 10;
 		} while (l /= 10);
-
-		while (p != buf) {
-			p--;
-			s += *p;
-		}
-		return;
+		*--p = '-';
 	}
+	s.append(p, end - p);
 }
 
 void 
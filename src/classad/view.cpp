@@ -22,6 +22,7 @@
 #include "classad/view.h"
 #include "classad/collection.h"
 #include "classad/collectionBase.h"
+#include <algorithm>
 
 using namespace std;
 
@@ -130,6 +131,215 @@ bool operator<(const ViewMember &vm1, const ViewMember &vm2)
 // ---------------- </implementation of ViewMember class> ------------------
 
 
+// ----------------- <implementation of ViewIndex class> -------------------
+
+ViewIndex::
+ViewIndex( const string &attrName, bool isOrdered )
+{
+	attr = attrName;
+	ordered = isOrdered;
+}
+
+
+ViewIndex::
+~ViewIndex( )
+{
+}
+
+
+// The form a value is filed under.  Strings are folded to lower case,
+// and all numbers (and booleans) are kept as reals, so that values which
+// == considers equal share a signature; a signature can stand for values
+// that aren't equal, but never the other way around.
+bool ViewIndex::
+makeSignature( const Value &val, string &sig, double &number, bool &isNumber )
+{
+	const char	*str;
+	bool		b;
+	long long	i;
+
+	switch( val.GetType( ) ) {
+		case Value::STRING_VALUE:
+			val.IsStringValue( str );
+			sig = "s";
+			sig += str;
+			for( size_t n = 1; n < sig.size( ); n++ ) {
+				sig[n] = tolower( (unsigned char)sig[n] );
+			}
+			isNumber = false;
+			return( true );
+
+		case Value::BOOLEAN_VALUE:
+			val.IsBooleanValue( b );
+			number = b ? 1 : 0;
+			break;
+
+		case Value::INTEGER_VALUE:
+			val.IsIntegerValue( i );
+			number = (double)i;
+			break;
+
+		case Value::REAL_VALUE:
+			val.IsRealValue( number );
+			if( number != number ) {
+				return( false );	// NaN compares equal to nothing
+			}
+			if( number == 0 ) {
+				number = 0;			// -0.0 == 0.0
+			}
+			break;
+
+		default:
+			return( false );
+	}
+
+	char buf[32];
+	snprintf( buf, sizeof( buf ), "n%.17g", number );
+	sig = buf;
+	isNumber = true;
+	return( true );
+}
+
+
+void ViewIndex::
+Insert( const string &key, ClassAd *ad )
+{
+	IndexedValue	iv;
+	Value			val;
+	const ExprTree	*tree;
+
+	Remove( key );
+
+		// an attribute the ad doesn't have is undefined, which compares
+		// true with no literal, so the ad needn't be indexed at all
+	if( !( tree = ad->Lookup( attr ) ) ) {
+		return;
+	}
+	tree = tree->self( );
+	iv.number = 0;
+	iv.isNumber = false;
+	if( tree->GetKind( ) == ExprTree::LITERAL_NODE ) {
+		((const Literal*)tree)->GetValue( val );
+		if( val.IsUndefinedValue( ) || val.IsErrorValue( ) ) {
+			return;
+		}
+		if( !makeSignature( val, iv.sig, iv.number, iv.isNumber ) ) {
+			iv.sig.clear( );
+		}
+	}
+
+	if( iv.sig.empty( ) ) {
+		notIndexed.insert( key );
+	} else {
+		byValue[iv.sig].insert( key );
+		if( ordered && iv.isNumber ) {
+			byNumber.insert( make_pair( iv.number, key ) );
+		}
+	}
+	members[key] = iv;
+}
+
+
+void ViewIndex::
+Remove( const string &key )
+{
+	classad_map<string,IndexedValue>::iterator itr = members.find( key );
+	if( itr == members.end( ) ) {
+		return;
+	}
+
+	const IndexedValue &iv = itr->second;
+	if( iv.sig.empty( ) ) {
+		notIndexed.erase( key );
+	} else {
+		classad_unordered<string,set<string> >::iterator bucket;
+		bucket = byValue.find( iv.sig );
+		if( bucket != byValue.end( ) ) {
+			bucket->second.erase( key );
+			if( bucket->second.empty( ) ) {
+				byValue.erase( bucket );
+			}
+		}
+		if( ordered && iv.isNumber ) {
+			byNumber.erase( make_pair( iv.number, key ) );
+		}
+	}
+	members.erase( itr );
+}
+
+
+void ViewIndex::
+Clear( )
+{
+	members.clear( );
+	byValue.clear( );
+	byNumber.clear( );
+	notIndexed.clear( );
+}
+
+
+bool ViewIndex::
+Lookup( Operation::OpKind op, const Value &val, set<string> &keys ) const
+{
+	string	sig;
+	double	number = 0;
+	bool	isNumber = false;
+
+	if( !makeSignature( val, sig, number, isNumber ) ) {
+		return( false );
+	}
+
+	switch( op ) {
+		case Operation::EQUAL_OP:
+		case Operation::META_EQUAL_OP: {
+			keys = notIndexed;
+			classad_unordered<string,set<string> >::const_iterator bucket;
+			bucket = byValue.find( sig );
+			if( bucket != byValue.end( ) ) {
+				keys.insert( bucket->second.begin( ), bucket->second.end( ) );
+			}
+			return( true );
+		}
+
+		case Operation::LESS_THAN_OP:
+		case Operation::LESS_OR_EQUAL_OP:
+		case Operation::GREATER_OR_EQUAL_OP:
+		case Operation::GREATER_THAN_OP:
+			break;
+
+		default:
+			return( false );
+	}
+
+		// a range comparison; only an ordered index of numbers can say
+	if( !ordered || !isNumber ) {
+		return( false );
+	}
+	keys = notIndexed;
+	set<pair<double,string> >::const_iterator	itr;
+	pair<double,string>							bound( number, string( ) );
+	if( op == Operation::LESS_THAN_OP || op == Operation::LESS_OR_EQUAL_OP ) {
+		for( itr = byNumber.begin( ); itr != byNumber.end( ); itr++ ) {
+			if( itr->first > number ||
+				( itr->first == number && op == Operation::LESS_THAN_OP ) ) {
+				break;
+			}
+			keys.insert( itr->second );
+		}
+	} else {
+		for( itr = byNumber.lower_bound( bound ); itr != byNumber.end( ); itr++ ) {
+			if( itr->first == number && op == Operation::GREATER_THAN_OP ) {
+				continue;
+			}
+			keys.insert( itr->second );
+		}
+	}
+	return( true );
+}
+
+// ----------------- </implementation of ViewIndex class> -------------------
+
+
 // ----------------- <implementation of View class> -------------------
 
 View::
@@ -165,6 +375,11 @@ View::
 	for( mi = partitionedViews.begin( ); mi != partitionedViews.end( ); mi++ ) {
 		delete mi->second;
 	}
+
+		// ... and the indexes
+	for( ViewIndexes::iterator ii = indexes.begin( ); ii != indexes.end( ); ii++ ) {
+		delete ii->second;
+	}
 }
 
 
@@ -893,6 +1108,7 @@ ClassAdInserted( ClassAdCollection *coll, const string &key,
 	vm.SetKey( key );
 	vm.SetRankValue( rankValue );
 	memberIndex[key] = viewMembers.insert(vm);
+	indexInsert( key, ad );
 
 	return( true );
 }
@@ -1013,6 +1229,9 @@ ClassAdModified( ClassAdCollection *coll, const string &key,
 			}
 		}
 
+			// refile the ad in the indexes
+		indexInsert( key, mad );
+
 			// send modification notification to all subordinate children
 		SubordinateViews::iterator xi;
 		for( xi=subordinateViews.begin( ); xi!=subordinateViews.end( ); xi++ ){
@@ -1055,6 +1274,7 @@ ClassAdDeleted( ClassAdCollection *coll, const string &key,
 	vmi = memberIndex[key];
 	memberIndex.erase( key );
 	viewMembers.erase( vmi );
+	indexRemove( key );
 
 		// delete from every subordinate child view
 	SubordinateViews::iterator	xi;
@@ -1077,6 +1297,257 @@ ClassAdDeleted( ClassAdCollection *coll, const string &key,
 }
 
 
+bool View::
+AddIndex( ClassAdCollection *coll, const string &attr, bool ordered )
+{
+	ViewMembers::iterator	vmi;
+	ViewIndexes::iterator	itr;
+	ViewIndex				*index;
+	ClassAd					*ad;
+	string					key;
+
+	if( attr.empty( ) ) {
+		CondorErrno = ERR_MISSING_ATTRNAME;
+		CondorErrMsg = "no attribute to index view " + viewName + " on";
+		return( false );
+	}
+
+		// an index of the other kind is replaced
+	itr = indexes.find( attr );
+	if( itr != indexes.end( ) ) {
+		if( itr->second->IsOrdered( ) == ordered ) {
+			return( true );
+		}
+		delete itr->second;
+		indexes.erase( itr );
+	}
+
+		// index the current members; later changes come through
+		// ClassAdInserted(), ClassAdModified() and ClassAdDeleted()
+	index = new ViewIndex( attr, ordered );
+	for( vmi = viewMembers.begin( ); vmi != viewMembers.end( ); vmi++ ) {
+		vmi->GetKey( key );
+		if( ( ad = coll->GetClassAd( key ) ) == NULL ) {
+			CLASSAD_EXCEPT( "internal error:  classad %s in view but not in collection",
+				key.c_str( ) );
+		}
+		index->Insert( key, ad );
+	}
+	indexes[attr] = index;
+	return( true );
+}
+
+
+bool View::
+RemoveIndex( const string &attr )
+{
+	ViewIndexes::iterator itr = indexes.find( attr );
+	if( itr == indexes.end( ) ) {
+		CondorErrno = ERR_MISSING_ATTRIBUTE;
+		CondorErrMsg = "view " + viewName + " has no index on " + attr;
+		return( false );
+	}
+	delete itr->second;
+	indexes.erase( itr );
+	return( true );
+}
+
+
+void View::
+GetIndexNames( vector<string>& names )
+{
+	names.clear( );
+	for( ViewIndexes::iterator itr = indexes.begin( ); itr != indexes.end( ); itr++ ) {
+		names.push_back( itr->second->GetAttributeName( ) );
+	}
+}
+
+
+void View::
+indexInsert( const string &key, ClassAd *ad )
+{
+	for( ViewIndexes::iterator itr = indexes.begin( ); itr != indexes.end( ); itr++ ) {
+		itr->second->Insert( key, ad );
+	}
+}
+
+
+void View::
+indexRemove( const string &key )
+{
+	for( ViewIndexes::iterator itr = indexes.begin( ); itr != indexes.end( ); itr++ ) {
+		itr->second->Remove( key );
+	}
+}
+
+
+static Operation::OpKind
+reverseComparison( Operation::OpKind op )
+{
+	switch( op ) {
+		case Operation::LESS_THAN_OP:		return( Operation::GREATER_THAN_OP );
+		case Operation::LESS_OR_EQUAL_OP:	return( Operation::GREATER_OR_EQUAL_OP );
+		case Operation::GREATER_OR_EQUAL_OP:return( Operation::LESS_OR_EQUAL_OP );
+		case Operation::GREATER_THAN_OP:	return( Operation::LESS_THAN_OP );
+		default:							return( op );
+	}
+}
+
+
+// Looks for comparisons of indexed attributes of the member with literals
+// among the conjuncts of a constraint, and narrows keys to the members
+// the indexes say may satisfy them all.  found is set once any
+// comparison has been answered by an index.
+void View::
+indexLookup( MatchClassAd &mad, ClassAd *probe, ExprTree *tree,
+	set<string> &keys, bool &found )
+{
+	Operation::OpKind	op;
+	ExprTree			*t1, *t2, *t3;
+
+	if( !tree ) {
+		return;
+	}
+	tree = const_cast<ExprTree*>( tree->self( ) );
+	if( tree->GetKind( ) != ExprTree::OP_NODE ) {
+		return;
+	}
+	((Operation*)tree)->GetComponents( op, t1, t2, t3 );
+	switch( op ) {
+		case Operation::PARENTHESES_OP:
+			indexLookup( mad, probe, t1, keys, found );
+			return;
+
+		case Operation::LOGICAL_AND_OP:
+			indexLookup( mad, probe, t1, keys, found );
+			indexLookup( mad, probe, t2, keys, found );
+			return;
+
+		case Operation::EQUAL_OP:
+		case Operation::META_EQUAL_OP:
+		case Operation::LESS_THAN_OP:
+		case Operation::LESS_OR_EQUAL_OP:
+		case Operation::GREATER_OR_EQUAL_OP:
+		case Operation::GREATER_THAN_OP:
+			break;
+
+		default:
+			return;
+	}
+
+		// one side must name an attribute, and the other be a literal
+	if( !t1 || !t2 ) {
+		return;
+	}
+	if( t1->self( )->GetKind( ) == ExprTree::LITERAL_NODE ) {
+		swap( t1, t2 );
+		op = reverseComparison( op );
+	}
+	if( t1->self( )->GetKind( ) != ExprTree::ATTRREF_NODE ||
+		t2->self( )->GetKind( ) != ExprTree::LITERAL_NODE ) {
+		return;
+	}
+
+		// ... and the attribute must be looked up in the member:  either
+		// TARGET.attr (or OTHER.attr), or with old ClassAd semantics a bare
+		// name that the constraint's own ad doesn't have
+	const ClassAd	*finalScope;
+	ExprTree		*scope;
+	string			attr;
+	bool			absolute;
+	ClassAd			*left = mad.GetLeftAd( );
+	((const AttributeReference*)t1->self( ))->GetComponents( scope, attr, absolute );
+	if( absolute ) {
+		return;
+	}
+	if( scope ) {
+		ExprTree	*scope2;
+		string		scopeName;
+		if( scope->self( )->GetKind( ) != ExprTree::ATTRREF_NODE ) {
+			return;
+		}
+		((const AttributeReference*)scope->self( ))->GetComponents( scope2,
+			scopeName, absolute );
+		if( scope2 || absolute || left->Lookup( scopeName ) ||
+			( strcasecmp( scopeName.c_str( ), "target" ) &&
+			  strcasecmp( scopeName.c_str( ), "other" ) ) ) {
+			return;
+		}
+	} else if( !_useOldClassAdSemantics || left->LookupInScope( attr, finalScope ) ) {
+		return;
+	}
+		// an attribute the member doesn't have mustn't be found around it
+	if( probe->LookupInScope( attr, finalScope ) ) {
+		return;
+	}
+
+	ViewIndexes::iterator itr = indexes.find( attr );
+	if( itr == indexes.end( ) ) {
+		return;
+	}
+	Value		val;
+	set<string>	matches;
+	((const Literal*)t2->self( ))->GetValue( val );
+	if( !itr->second->Lookup( op, val, matches ) ) {
+		return;
+	}
+
+	if( found ) {
+		set<string> both;
+		set_intersection( keys.begin( ), keys.end( ), matches.begin( ),
+			matches.end( ), inserter( both, both.begin( ) ) );
+		keys.swap( both );
+	} else {
+		keys.swap( matches );
+		found = true;
+	}
+}
+
+
+static bool
+memberBefore( const ViewMembers::iterator &vm1, const ViewMembers::iterator &vm2 )
+{
+	return( *vm1 < *vm2 );
+}
+
+
+// Uses the indexes to find the members that may satisfy a constraint
+// evaluated in mad, with the member as the right ad.  Returns false if
+// the indexes can't narrow the search, in which case every member must
+// be tried.  The candidates are in the order of the view.  Leaves no
+// right ad bound in mad.
+bool View::
+FindCandidates( MatchClassAd &mad, ExprTree *constraint,
+	vector<ViewMembers::iterator> &candidates )
+{
+	set<string>	keys;
+	bool		found = false;
+	ClassAd		probe;
+
+	candidates.clear( );
+	if( indexes.empty( ) || !constraint || !mad.GetLeftAd( ) ) {
+		return( false );
+	}
+
+		// an empty right ad shows which names resolve around the member
+	mad.ReplaceRightAd( &probe );
+	indexLookup( mad, &probe, constraint, keys, found );
+	mad.RemoveRightAd( );
+	if( !found ) {
+		return( false );
+	}
+
+	for( set<string>::iterator ki = keys.begin( ); ki != keys.end( ); ki++ ) {
+		MemberIndex::iterator mi = memberIndex.find( *ki );
+		if( mi != memberIndex.end( ) ) {
+			candidates.push_back( mi->second );
+		}
+	}
+	sort( candidates.begin( ), candidates.end( ), memberBefore );
+	return( true );
+}
+
+
 string View::
 makePartitionSignature( ClassAd *ad )
 {
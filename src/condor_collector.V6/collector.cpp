@@ -78,6 +78,11 @@ int CollectorDaemon::__failed__;
 List<ClassAd>* CollectorDaemon::__ClassAdResultList__;
 std::string CollectorDaemon::__adType__;
 ExprTree *CollectorDaemon::__filter__;
+classad::BatchConstraint CollectorDaemon::__batchFilter__;
+std::vector<const classad::ClassAd*> CollectorDaemon::__batch__;
+
+	// number of ads gathered before the query filter is evaluated
+static const size_t QUERY_BATCH_SIZE = 1024;
 
 TrackTotals* CollectorDaemon::normalTotals = NULL;
 int CollectorDaemon::submittorRunningJobs;
@@ -114,6 +119,8 @@ int CollectorDaemon::max_pending_query_workers = 50;
 int CollectorDaemon::max_query_worktime = 0;
 int CollectorDaemon::active_query_workers = 0;
 int CollectorDaemon::pending_query_workers = 0;
+CollectorQueryPool CollectorDaemon::query_pool;
+int CollectorDaemon::QueryThreadTimerId = -1;
 
 #ifdef TRACK_QUERIES_BY_SUBSYS
 bool CollectorDaemon::want_track_queries_by_subsys = false;
@@ -396,6 +403,8 @@ void CollectorDaemon::Init()
 	// install command handlers for updates
 	daemonCore->Register_CommandWithPayload(UPDATE_STARTD_AD,"UPDATE_STARTD_AD",
 		receive_update,"receive_update",ADVERTISE_STARTD_PERM);
+	daemonCore->Register_CommandWithPayload(UPDATE_STARTD_AD_DELTA,"UPDATE_STARTD_AD_DELTA",
+		receive_update,"receive_update",ADVERTISE_STARTD_PERM);
 	daemonCore->Register_CommandWithPayload(MERGE_STARTD_AD,"MERGE_STARTD_AD",
 		receive_update,"receive_update",NEGOTIATOR);
 	daemonCore->Register_CommandWithPayload(UPDATE_SCHEDD_AD,"UPDATE_SCHEDD_AD",
@@ -498,12 +507,179 @@ public:
 };
 
 
+// A query answered by the query thread pool, from a snapshot of the ads
+// it may match.  Everything the job uses is its own, or pinned for it by
+// the engine, until the daemon reaps it.
+class QueryThreadJob : public CollectorQueryPool::Job
+{
+  public:
+	QueryThreadJob()
+		: query(NULL), sock(NULL), whichAds((AdTypes) -1), is_locate(false)
+		, filter_private_ads(true), filter(NULL), resultLimit(INT_MAX)
+		, dropped(false)
+	{
+		subsys[0] = 0;
+	}
+	~QueryThreadJob() {
+		delete sock;
+		delete query;
+	}
+
+	virtual void run();
+
+	ClassAd *query;
+	Stream *sock;
+	AdTypes whichAds;
+	bool is_locate;
+	bool filter_private_ads;
+	char subsys[15];
+	ExprTree *filter; // belongs to query
+	std::string adType;
+	int resultLimit;
+	std::vector<ClassAd *> ads;
+	bool dropped;
+};
+
+void QueryThreadJob::run()
+{
+	// Like the query reaper does before it forks, ignore the query if our
+	// deadline has passed or the client has given up while it was queued.
+	if ( sock->deadline_expired() || static_cast<Sock *>(sock)->readReady() ) {
+		dprintf( D_ALWAYS, "QueryThread: dropping stale query request because %s\n",
+			sock->deadline_expired() ? "max worktime expired" : "client gone" );
+		dropped = true;
+		return;
+	}
+
+	List<ClassAd> results;
+	int numAds = 0;
+	int failed = 0;
+	if ( filter ) {
+		classad::BatchConstraint batchFilter;
+		batchFilter.Initialize( filter );
+		std::vector<const classad::ClassAd*> batch;
+		std::vector<bool> matches;
+		size_t next = 0;
+		while ( next < ads.size() && numAds < resultLimit ) {
+			batch.clear();
+			for ( ; next < ads.size() && batch.size() < QUERY_BATCH_SIZE; next++ ) {
+				if ( !adType.empty() ) {
+					std::string type = "";
+					ads[next]->LookupString( ATTR_MY_TYPE, type );
+					if ( strcasecmp( type.c_str(), adType.c_str() ) != 0 ) {
+						continue;
+					}
+				}
+				batch.push_back( ads[next] );
+			}
+
+			if ( batchFilter.IsVectorized() ) {
+				batchFilter.Evaluate( batch, matches );
+			} else {
+				matches.assign( batch.size(), false );
+				for ( size_t i = 0; i < batch.size(); i++ ) {
+					classad::Value result;
+					bool val;
+					matches[i] = EvalExprTree( filter, const_cast<ClassAd *>( batch[i] ), NULL, result ) &&
+						result.IsBooleanValueEquiv(val) && val;
+				}
+			}
+
+			for ( size_t i = 0; i < batch.size(); i++ ) {
+				if ( matches[i] ) {
+					numAds++;
+					results.Append( const_cast<ClassAd *>( batch[i] ) );
+					if ( numAds >= resultLimit ) {
+						break;
+					}
+				} else {
+					failed++;
+				}
+			}
+		}
+	}
+
+	double end_query = condor_gettimestamp_double();
+
+	std::string projection;
+	if ( ! CollectorDaemon::send_query_results( sock, query, whichAds, results, filter_private_ads, projection ) ) {
+		return;
+	}
+
+	std::string requirements;
+	dprintf (D_ALWAYS,
+			 "Query info: matched=%d; skipped=%d; query_time=%f; send_time=%f; type=%s; requirements={%s}; locate=%d; limit=%d; from=%s; peer=%s; projection={%s}; filter_private_ads=%d; wait_time=%f\n",
+			 numAds,
+			 failed,
+			 end_query - started,
+			 condor_gettimestamp_double() - end_query,
+			 AdTypeToString(whichAds),
+			 ExprTreeToString(filter, requirements),
+			 is_locate,
+			 (resultLimit == INT_MAX) ? 0 : resultLimit,
+			 subsys,
+			 sock->peer_description(),
+			 projection.c_str(),
+			 filter_private_ads,
+			 started - queued);
+}
+
+// Hand a query to the query thread pool.  The parts of the query that
+// need the daemon are done here: checking the peer's authorization,
+// rewriting the filter, and pinning the ads the query may match.
+void CollectorDaemon::submit_query_thread(pending_query_entry_t *query_entry, bool high_prio)
+{
+	QueryThreadJob *job = new QueryThreadJob;
+	job->query = query_entry->cad;
+	job->sock = query_entry->sock;
+	job->whichAds = query_entry->whichAds;
+	job->is_locate = query_entry->is_locate;
+	strcpy( job->subsys, query_entry->subsys );
+	job->filter_private_ads = query_filters_private_ads( job->sock, job->whichAds );
+	job->filter = prepare_query_filter( job->whichAds, job->query, job->adType, job->resultLimit );
+	if ( job->filter ) {
+		collector.snapshotAds( job->whichAds, job->filter, job->ads );
+	}
+
+	query_pool.submit( job, high_prio );
+	collectorStats.global.PendingThreadQueries = query_pool.pending();
+}
+
+// Timer handler that releases the snapshots of the queries the query
+// threads have answered, and records how long they took.
+void CollectorDaemon::reapQueryThreads()
+{
+	std::vector<CollectorQueryPool::Job *> done;
+	query_pool.reap( done );
+	for ( size_t i = 0; i < done.size(); i++ ) {
+		QueryThreadJob *job = static_cast<QueryThreadJob *>( done[i] );
+		collector.releaseSnapshot( job->ads );
+		if ( job->dropped ) {
+			collectorStats.global.DroppedQueries += 1;
+		} else {
+			collectorStats.global.ThreadQueryWaitTime += job->started - job->queued;
+			collectorStats.global.ThreadQueryLatency += job->finished - job->queued;
+		}
+		delete job;
+	}
+	collectorStats.global.ActiveQueryThreads = query_pool.running();
+	collectorStats.global.PendingThreadQueries = query_pool.pending();
+
+	if ( query_pool.liveThreads() == 0 && QueryThreadTimerId >= 0 ) {
+		classad::ClassAdSetThreadSafeEvaluation( false );
+		daemonCore->Cancel_Timer( QueryThreadTimerId );
+		QueryThreadTimerId = -1;
+	}
+}
+
+
 int CollectorDaemon::receive_query_cedar(int command,
 										 Stream* sock)
 {
 	int return_status = TRUE;
 	pending_query_entry_t *query_entry = NULL;
 	bool handle_in_proc;
+	bool use_query_thread;
 	bool is_locate;
 	KnownSubsystemId clientSubsys = SUBSYSTEM_ID_UNKNOWN;
 	AdTypes whichAds;
@@ -561,8 +737,15 @@ int CollectorDaemon::receive_query_cedar(int command,
 			}
 		}
 	}
-	// If we are not allowed any forked query workers, i guess we are going in-proc
-	if ( max_query_workers < 1 ) {
+	// Queries that are not handled in-proc go to the query threads, if we
+	// have any, unless they need the daemon while their results are sent:
+	// the collector's self ad is sent with fresh statistics.
+	use_query_thread = !handle_in_proc && query_pool.threads() > 0 &&
+		whichAds != COLLECTOR_AD && whichAds != ANY_AD && whichAds != (AdTypes) -1;
+	// If we are not allowed any forked query workers, i guess we are going in-proc.
+	// Nor do we fork while there are query threads: the child would get
+	// whatever locks they hold at that moment, and never see them released.
+	if ( ( max_query_workers < 1 || query_pool.liveThreads() > 0 ) && !use_query_thread ) {
 		handle_in_proc = true;
 	}
 
@@ -651,7 +834,18 @@ int CollectorDaemon::receive_query_cedar(int command,
 
 		// Now that we know if the incoming query is high priority or not,
 		// place it into the proper queue if we don't already have too many pending.
-		if ( ((high_prio_query==false) &&
+		if ( use_query_thread ) {
+			if ( high_prio_query || query_pool.pending() < max_pending_query_workers ) {
+				submit_query_thread( query_entry, high_prio_query );
+				cad = NULL; // set this to NULL so we won't delete it below; the query thread job owns it now
+				return_status = KEEP_STREAM; // tell daemoncore to not mess with socket when we return
+			} else {
+				dprintf( D_ALWAYS,
+					"QueryThread: dropping low priority query request due to max pending queries of %d ( threads %d pending %d )\n",
+					max_pending_query_workers, query_pool.threads(), query_pool.pending() );
+				collectorStats.global.DroppedQueries += 1;
+			}
+		} else if ( ((high_prio_query==false) &&
 			  (active_query_workers + pending_query_workers <  max_query_workers + max_pending_query_workers - reserved_for_highprio_query_workers))
 			 ||
 			 ((high_prio_query==true) &&
@@ -676,7 +870,7 @@ int CollectorDaemon::receive_query_cedar(int command,
 		}
 
 		// Update a few statistics
-		if ( !daemonCore->DoFakeCreateThread() ) {  // if we are configured to really fork()...
+		if ( !use_query_thread && !daemonCore->DoFakeCreateThread() ) {  // if we are configured to really fork()...
 			if (did_we_fork == TRUE) {
 				// A new worker was forked off
 				if (is_locate) { rt.runtime = &HandleLocateForked_runtime; } else { rt.runtime = &HandleQueryForked_runtime; }
@@ -790,6 +984,18 @@ int CollectorDaemon::QueryReaper(int pid, int /* exit_status */ )
 				query_entry = NULL;  // so we will loop and dequeue another entry
 			}
 		}
+
+		// Queries queued before query threads were configured are answered
+		// here rather than forked, for the same reason receive_query_cedar()
+		// doesn't fork while there are query threads.
+		if ( query_entry && query_pool.liveThreads() > 0 ) {
+			dprintf(D_FULLDEBUG,"QueryWorker: handling queued query in-process because of query threads\n");
+			receive_query_cedar_worker_thread((void *)query_entry, query_entry->sock);
+			delete query_entry->sock;
+			delete query_entry->cad;
+			free(query_entry);
+			query_entry = NULL;  // so we will loop and dequeue another entry
+		}
 	}  // end of while queue_entry == NULL
 
 	// If we have made it here, we are allowed to fork another worker
@@ -840,24 +1046,34 @@ int CollectorDaemon::QueryReaper(int pid, int /* exit_status */ )
 }
 
 
-int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Stream* sock)
+// Should the private attributes of the ads be withheld from the peer
+// that sent this query?
+bool CollectorDaemon::query_filters_private_ads(Stream *sock, AdTypes whichAds)
 {
-	int return_status = TRUE;
-	double begin = condor_gettimestamp_double();
-	List<ClassAd> results;
+		// Always send private attributes in private ads.
+	if (whichAds == STARTD_PVT_AD) {
+		return false;
+	}
 
 		// If our peer is at least 8.9.3 and has NEGOTIATOR authz, then we'll
 		// trust it to handle our capabilities.
-	bool filter_private_ads = true;
 	auto *verinfo = sock->get_peer_version();
 	if (verinfo && verinfo->built_since_version(8, 9, 3)) {
 		auto addr = static_cast<ReliSock*>(sock)->peer_addr();
 			// Given failure here is non-fatal, do not log at D_ALWAYS.
 		if (static_cast<Sock*>(sock)->isAuthorizationInBoundingSet("NEGOTIATOR") &&
 			(USER_AUTH_SUCCESS == daemonCore->Verify("send private ads", NEGOTIATOR, addr, static_cast<ReliSock*>(sock)->getFullyQualifiedUser(), D_SECURITY|D_FULLDEBUG))) {
-			filter_private_ads = false;
+			return false;
 		}
 	}
+	return true;
+}
+
+int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Stream* sock)
+{
+	int return_status = TRUE;
+	double begin = condor_gettimestamp_double();
+	List<ClassAd> results;
 
 	// Pull out relavent state from query_entry
 	pending_query_entry_t *query_entry = (pending_query_entry_t *) in_query_entry;
@@ -865,10 +1081,7 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
 	bool is_locate = query_entry->is_locate;
 	AdTypes whichAds = query_entry->whichAds;
 
-		// Always send private attributes in private ads.
-	if (whichAds == STARTD_PVT_AD) {
-		filter_private_ads = false;
-	}
+	bool filter_private_ads = query_filters_private_ads(sock, whichAds);
 
 	// Perform the query
 
@@ -880,6 +1093,48 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
 	double end_write = 0.0;
 
 	// send the results via cedar			
+	string projection = "";
+	if ( ! send_query_results(sock, cad, whichAds, results, filter_private_ads, projection)) {
+		return_status = 0;
+		goto END;
+	}
+
+	end_write = condor_gettimestamp_double();
+
+	dprintf (D_ALWAYS,
+			 "Query info: matched=%d; skipped=%d; query_time=%f; send_time=%f; type=%s; requirements={%s}; locate=%d; limit=%d; from=%s; peer=%s; projection={%s}; filter_private_ads=%d\n",
+			 __numAds__,
+			 __failed__,
+			 end_query - begin,
+			 end_write - end_query,
+			 AdTypeToString(whichAds),
+			 ExprTreeToString(__filter__),
+			 is_locate,
+			 (__resultLimit__ == INT_MAX) ? 0 : __resultLimit__,
+			 query_entry->subsys,
+			 sock->peer_description(),
+			 projection.c_str(),
+			 filter_private_ads);
+END:
+	
+	// All done.  Deallocate memory allocated in this method.  Note that DaemonCore 
+	// will supposedly free() the query_entry struct itself and also delete sock.
+
+	return return_status;
+}
+
+// Send the results of a query to the client, followed by the end of the
+// response.  Returns false if the client could not be sent the results.
+// Sets projection to the projection of the last ad sent.
+//
+// This is called on a query thread as well as in the daemon, so it must
+// not use the globals of the scan functions, and it may only touch the
+// daemon's state for COLLECTOR_AD queries, which never go to a thread,
+// apart from the engine's cache of encoded ads, which has its own lock.
+bool CollectorDaemon::send_query_results(Stream *sock, ClassAd *cad, AdTypes whichAds,
+										 List<ClassAd> &results, bool filter_private_ads,
+										 std::string &projection)
+{
 	sock->timeout(QueryTimeout); // set up a network timeout of a longer duration
 	sock->encode();
 	results.Rewind();
@@ -887,7 +1142,7 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
 	int more = 1;
 	
 		// See if query ad asks for server-side projection
-	string projection = "";
+	projection = "";
 		// turn projection string into a set of attributes
 	classad::References proj;
 	bool evaluate_projection = false;
@@ -901,6 +1156,21 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
 		evaluate_projection = true;
 	}
 
+		// The projection is evaluated with the results bound into a match
+		// ad of our own, rather than with EvalString(), which inserts the
+		// result ad itself into a shared match ad.
+	classad::MatchClassAd match;
+	if (evaluate_projection) {
+		match.ReplaceLeftAd(cad);
+	}
+
+		// Ads without their private attributes can be sent from the
+		// engine's cache of encoded ads.  The collector's own ad isn't
+		// cached, since the statistics in it are made at query time.
+	bool use_encoded_ads = filter_private_ads && whichAds != COLLECTOR_AD &&
+		collector.cachingSerializedAds() && canPutClassAdEncoded(sock);
+
+	bool sent_all = true;
 	while ( (curr_ad=results.Next()) )
 	{
 		// if querying collector ads, and the collectors own ad appears in this list.
@@ -929,14 +1199,24 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
 		if (evaluate_projection) {
 			proj.clear();
 			projection.clear();
-			if (EvalString(ATTR_PROJECTION, cad, curr_ad, projection) && ! projection.empty()) {
+			match.BindRightAd(curr_ad);
+			if (cad->EvaluateAttrString(ATTR_PROJECTION, projection) && ! projection.empty()) {
 				StringTokenIterator list(projection);
 				const std::string * attr;
 				while ((attr = list.next_string())) { proj.insert(*attr); }
 			}
 		}
 
-		bool send_failed = (!sock->code(more) || !putClassAd(sock, *curr_ad, filter_private_ads ? PUT_CLASSAD_NO_PRIVATE : 0, proj.empty() ? NULL : &proj));
+		CollectorWireCache::Encoding encoded;
+		if (use_encoded_ads) {
+			encoded = collector.encodedAd(curr_ad, proj.empty() ? "" : projection, proj.empty() ? NULL : &proj);
+		}
+		bool send_failed;
+		if (encoded) {
+			send_failed = (!sock->code(more) || !putClassAdEncoded(sock, *encoded));
+		} else {
+			send_failed = (!sock->code(more) || !putClassAd(sock, *curr_ad, PUT_CLASSAD_NAME_DICTIONARY | (filter_private_ads ? PUT_CLASSAD_NO_PRIVATE : 0), proj.empty() ? NULL : &proj));
+		}
         
 		if (stats_ad) {
 			stats_ad->Unchain();
@@ -947,19 +1227,26 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
         {
             dprintf (D_ALWAYS,
                     "Error sending query result to client -- aborting\n");
-            return_status = 0;
-			goto END;
+            sent_all = false;
+			break;
         }
 
 		if (sock->deadline_expired()) {
 			dprintf( D_ALWAYS,
 				"QueryWorker: max_worktime expired while sending query result to client -- aborting\n");
-			return_status = 0;
-			goto END;
+			sent_all = false;
+			break;
 		}
 
 	} // end of while loop for next result ad to send
 
+	if (evaluate_projection) {
+		match.RemoveLeftAd();
+	}
+	if ( ! sent_all) {
+		return false;
+	}
+
 	// end of query response ...
 	more = 0;
 	if (!sock->code(more))
@@ -973,28 +1260,7 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
 		dprintf (D_ALWAYS, "Error flushing CEDAR socket\n");
 	}
 
-	end_write = condor_gettimestamp_double();
-
-	dprintf (D_ALWAYS,
-			 "Query info: matched=%d; skipped=%d; query_time=%f; send_time=%f; type=%s; requirements={%s}; locate=%d; limit=%d; from=%s; peer=%s; projection={%s}; filter_private_ads=%d\n",
-			 __numAds__,
-			 __failed__,
-			 end_query - begin,
-			 end_write - end_query,
-			 AdTypeToString(whichAds),
-			 ExprTreeToString(__filter__),
-			 is_locate,
-			 (__resultLimit__ == INT_MAX) ? 0 : __resultLimit__,
-			 query_entry->subsys,
-			 sock->peer_description(),
-			 projection.c_str(),
-			 filter_private_ads);
-END:
-	
-	// All done.  Deallocate memory allocated in this method.  Note that DaemonCore 
-	// will supposedly free() the query_entry struct itself and also delete sock.
-
-	return return_status;
+	return true;
 }
 
 AdTypes
@@ -1275,6 +1541,10 @@ int CollectorDaemon::receive_update(int command, Stream* sock)
 			// which already does all the necessary logging.
 		}
 
+		// Not stashing the socket makes daemonCore close it.  For a
+		// delta update that doesn't apply to the ad we have (insert ==
+		// -5, logged by applyDeltaClassAd()), that is what tells the
+		// startd to send the whole ad on a new connection.
 		return FALSE;
 
 	}
@@ -1282,6 +1552,12 @@ int CollectorDaemon::receive_update(int command, Stream* sock)
 	CollectorEngine_ru_collect_runtime += rt.tick(rt_last);
 #endif
 
+		// Once a delta has been applied, cad is the whole updated ad,
+		// so everything from here on sees an ordinary update.
+	if (command == UPDATE_STARTD_AD_DELTA) {
+		command = UPDATE_STARTD_AD;
+	}
+
 	/* let the off-line plug-in have at it */
 	offline_plugin_.update ( command, *cad );
 
@@ -1303,6 +1579,9 @@ int CollectorDaemon::receive_update(int command, Stream* sock)
 	CollectorEngine_ru_forward_runtime += rt.tick(rt_last);
 #endif
 
+		// the stored ad is only read until the next update replaces it
+	cad->Freeze();
+
 	if( sock->type() == Stream::reli_sock ) {
 			// stash this socket for future updates...
 		int rv = stashSocket( (ReliSock *)sock );
@@ -1435,6 +1714,10 @@ int CollectorDaemon::receive_update_expect_ack(int command,
 										  cad);
 	}
 
+	if (cad) {
+		cad->Freeze();
+	}
+
 	// let daemon core clean up the socket
 	return TRUE;
 }
@@ -1501,36 +1784,78 @@ int CollectorDaemon::query_scanFunc (ClassAd *cad)
     return 1;
 }
 
+// Like query_scanFunc(), but gathers the ads into a batch so that the
+// filter can be evaluated over many ads at once.
+int CollectorDaemon::query_batchScanFunc (ClassAd *cad)
+{
+	if ( !__adType__.empty() ) {
+		std::string type = "";
+		cad->LookupString( ATTR_MY_TYPE, type );
+		if ( strcasecmp( type.c_str(), __adType__.c_str() ) != 0 ) {
+			return 1;
+		}
+	}
 
-void CollectorDaemon::process_query_public (AdTypes whichAds,
-											ClassAd *query,
-											List<ClassAd>* results)
+	__batch__.push_back( cad );
+	if ( __batch__.size() >= QUERY_BATCH_SIZE ) {
+		return query_flushBatch();
+	}
+	return 1;
+}
+
+int CollectorDaemon::query_flushBatch ()
+{
+	std::vector<bool> matches;
+	__batchFilter__.Evaluate( __batch__, matches );
+
+	int rval = 1;
+	for ( size_t i = 0; i < __batch__.size(); i++ ) {
+		if ( matches[i] ) {
+			// Found a match
+			__numAds__++;
+			__ClassAdResultList__->Append( const_cast<ClassAd *>( __batch__[i] ) );
+			if (__numAds__ >= __resultLimit__) {
+				rval = 0; // stop iterating, we have all the results we want
+				break;
+			}
+		} else {
+			__failed__++;
+		}
+	}
+	__batch__.clear();
+	return rval;
+}
+
+
+// Set up the constraint of a query: the ad type to restrict generic
+// queries to, the limit on the number of results, and the filter, with
+// collector ads and absent ads filtered out as configured.  Returns NULL
+// if the query has no usable constraint.
+ExprTree *CollectorDaemon::prepare_query_filter (AdTypes whichAds,
+												ClassAd *query,
+												std::string &adType,
+												int &resultLimit)
 {
-	// set up for hashtable scan
-	__query__ = query;
-	__numAds__ = 0;
-	__failed__ = 0;
-	__ClassAdResultList__ = results;
 	// An empty adType means don't check the MyType of the ads.
 	// This means either the command indicates we're only checking one
 	// type of ad, or the query's TargetType is "Any" (match all ad types).
-	__adType__ = "";
+	adType = "";
 	if ( whichAds == GENERIC_AD || whichAds == ANY_AD ) {
-		query->LookupString( ATTR_TARGET_TYPE, __adType__ );
-		if ( strcasecmp( __adType__.c_str(), "any" ) == 0 ) {
-			__adType__ = "";
+		query->LookupString( ATTR_TARGET_TYPE, adType );
+		if ( strcasecmp( adType.c_str(), "any" ) == 0 ) {
+			adType = "";
 		}
 	}
 
-	__filter__ = query->LookupExpr( ATTR_REQUIREMENTS );
-	if ( __filter__ == NULL ) {
+	ExprTree *filter = query->LookupExpr( ATTR_REQUIREMENTS );
+	if ( filter == NULL ) {
 		dprintf (D_ALWAYS, "Query missing %s\n", ATTR_REQUIREMENTS );
-		return;
+		return NULL;
 	}
 
-	__resultLimit__ = INT_MAX; // no limit
-	if ( ! query->LookupInteger(ATTR_LIMIT_RESULTS, __resultLimit__) || __resultLimit__ <= 0) {
-		__resultLimit__ = INT_MAX; // no limit
+	resultLimit = INT_MAX; // no limit
+	if ( ! query->LookupInteger(ATTR_LIMIT_RESULTS, resultLimit) || resultLimit <= 0) {
+		resultLimit = INT_MAX; // no limit
 	}
 
 	// See if we should exclude Collector Ads from generic queries.  Still
@@ -1542,13 +1867,13 @@ void CollectorDaemon::process_query_public (AdTypes whichAds,
 		dprintf(D_FULLDEBUG, "Received query with generic type; filtering collector ads\n");
 		MyString modified_filter;
 		modified_filter.formatstr("(%s) && (MyType =!= \"Collector\")",
-			ExprTreeToString(__filter__));
+			ExprTreeToString(filter));
 		query->AssignExpr(ATTR_REQUIREMENTS,modified_filter.Value());
-		__filter__ = query->LookupExpr(ATTR_REQUIREMENTS);
-		if ( __filter__ == NULL ) {
+		filter = query->LookupExpr(ATTR_REQUIREMENTS);
+		if ( filter == NULL ) {
 			dprintf (D_ALWAYS, "Failed to parse modified filter: %s\n", 
 				modified_filter.Value());
-			return;
+			return NULL;
 		}
 		dprintf(D_FULLDEBUG,"Query after modification: *%s*\n",modified_filter.Value());
 	}
@@ -1564,22 +1889,52 @@ void CollectorDaemon::process_query_public (AdTypes whichAds,
 		if (!checks_absent) {
 			MyString modified_filter;
 			modified_filter.formatstr("(%s) && (%s =!= True)",
-				ExprTreeToString(__filter__),ATTR_ABSENT);
+				ExprTreeToString(filter),ATTR_ABSENT);
 			query->AssignExpr(ATTR_REQUIREMENTS,modified_filter.Value());
-			__filter__ = query->LookupExpr(ATTR_REQUIREMENTS);
-			if ( __filter__ == NULL ) {
+			filter = query->LookupExpr(ATTR_REQUIREMENTS);
+			if ( filter == NULL ) {
 				dprintf (D_ALWAYS, "Failed to parse modified filter: %s\n", 
 					modified_filter.Value());
-				return;
+				return NULL;
 			}
 			dprintf(D_FULLDEBUG,"Query after modification: *%s*\n",modified_filter.Value());
 		}
 	}
 
-	if (!collector.walkHashTable (whichAds, query_scanFunc))
+	return filter;
+}
+
+void CollectorDaemon::process_query_public (AdTypes whichAds,
+											ClassAd *query,
+											List<ClassAd>* results)
+{
+	// set up for hashtable scan
+	__query__ = query;
+	__numAds__ = 0;
+	__failed__ = 0;
+	__ClassAdResultList__ = results;
+	__filter__ = prepare_query_filter( whichAds, query, __adType__, __resultLimit__ );
+	if ( __filter__ == NULL ) {
+		return;
+	}
+
+	// When parts of the filter can be evaluated a column at a time,
+	// gather the ads into batches and evaluate the filter over each batch.
+	__batchFilter__.Initialize( __filter__ );
+	if ( __batchFilter__.IsVectorized() ) {
+		__batch__.clear();
+		if (!collector.walkHashTable (whichAds, __filter__, query_batchScanFunc))
+		{
+			dprintf (D_ALWAYS, "Error sending query response\n");
+		}
+		if ( !__batch__.empty() ) {
+			query_flushBatch();
+		}
+	} else if (!collector.walkHashTable (whichAds, __filter__, query_scanFunc))
 	{
 		dprintf (D_ALWAYS, "Error sending query response\n");
 	}
+	__batchFilter__.Initialize( NULL );
 
 	dprintf (D_ALWAYS, "(Sending %d ads in response to query)\n", __numAds__);
 }	
@@ -1668,12 +2023,12 @@ void CollectorDaemon::process_invalidation (AdTypes whichAds, ClassAd &query, St
 
         if (expireInvalidatedAds)
         {
-            collector.walkHashTable (whichAds, expiration_scanFunc);
+            collector.walkHashTableForUpdate (whichAds, expiration_scanFunc);
             collector.invokeHousekeeper (whichAds);
         } else if (param_boolean("HOUSEKEEPING_ON_INVALIDATE", true)) 
 		{
 			// first set all the "LastHeardFrom" attributes to low values ...
-			collector.walkHashTable (whichAds, invalidation_scanFunc);
+			collector.walkHashTableForUpdate (whichAds, invalidation_scanFunc);
 
 			// ... then invoke the housekeeper
 			collector.invokeHousekeeper (whichAds);
@@ -1867,6 +2222,20 @@ void CollectorDaemon::Config()
     collector.setClientTimeout( ClientTimeout );
     collector.scheduleHousekeeper( ClassadLifetime );
 
+	std::string index_attrs;
+	param( index_attrs, "COLLECTOR_QUERY_INDEX_ATTRIBUTES" );
+	StringList index_attr_list( index_attrs.c_str() );
+	std::vector<std::string> index_attr_vec;
+	const char *index_attr;
+	index_attr_list.rewind();
+	while ( (index_attr = index_attr_list.next()) ) {
+		index_attr_vec.push_back( index_attr );
+	}
+	collector.setIndexAttributes( index_attr_vec );
+
+	collector.setSerializedAdCache( param_boolean( "COLLECTOR_CACHE_SERIALIZED_ADS", false ),
+		param_integer( "COLLECTOR_CACHED_PROJECTIONS", 4, 0 ) );
+
     offline_plugin_.configure ();
 
     vc_projection.clear();
@@ -1968,6 +2337,22 @@ void CollectorDaemon::Config()
 				reserved_for_highprio_query_workers);
 	}
 
+	// The query threads evaluate the queries in the ads the daemon's thread
+	// may be evaluating too, and log as they go.  Threads let go by a
+	// smaller COLLECTOR_QUERY_THREADS finish the queued queries and are
+	// joined by reapQueryThreads(), which also turns thread safe evaluation
+	// off once the last one is gone.
+	int query_threads = param_integer("COLLECTOR_QUERY_THREADS", 0, 0);
+	if ( query_threads > 0 ) {
+		dprintf_make_thread_safe();
+		classad::ClassAdSetThreadSafeEvaluation( true );
+	}
+	query_pool.setThreads( query_threads );
+	if ( query_pool.liveThreads() > 0 && QueryThreadTimerId < 0 ) {
+		QueryThreadTimerId = daemonCore->Register_Timer( 1, 1, reapQueryThreads,
+			"CollectorDaemon::reapQueryThreads" );
+	}
+
 #ifdef TRACK_QUERIES_BY_SUBSYS
 	want_track_queries_by_subsys = param_boolean("COLLECTOR_TRACK_QUERY_BY_SUBSYS",true);
 #endif
@@ -2016,6 +2401,13 @@ void CollectorDaemon::Exit()
 		daemonCore->Cancel_Timer(UpdateTimerId);
 		UpdateTimerId = -1;
 	}
+	// Let the query threads finish, so that nothing uses the ads after us.
+	query_pool.stop();
+	reapQueryThreads();
+	if ( QueryThreadTimerId >= 0 ) {
+		daemonCore->Cancel_Timer(QueryThreadTimerId);
+		QueryThreadTimerId = -1;
+	}
 	free( CollectorName );
 	delete ad;
 	delete collectorsToUpdate;
@@ -2038,6 +2430,13 @@ void CollectorDaemon::Shutdown()
 		daemonCore->Cancel_Timer(UpdateTimerId);
 		UpdateTimerId = -1;
 	}
+	// Let the query threads finish, so that nothing uses the ads after us.
+	query_pool.stop();
+	reapQueryThreads();
+	if ( QueryThreadTimerId >= 0 ) {
+		daemonCore->Cancel_Timer(QueryThreadTimerId);
+		QueryThreadTimerId = -1;
+	}
 	free( CollectorName );
 	delete ad;
 	delete collectorsToUpdate;
@@ -24,10 +24,12 @@
 #include <queue>
 
 #include "condor_classad.h"
+#include "classad/batchConstraint.h"
 #include "totals.h"
 #include "forkwork.h"
 
 #include "collector_engine.h"
+#include "collector_query_pool.h"
 #include "collector_stats.h"
 #include "dc_collector.h"
 #include "offline_plugin.h"
@@ -105,11 +107,16 @@ public:
     static int receive_update_expect_ack(int, Stream*);
 
 	static void process_query_public(AdTypes, ClassAd*, List<ClassAd>*);
+	static ExprTree * prepare_query_filter(AdTypes, ClassAd*, std::string &adType, int &resultLimit);
+	static bool query_filters_private_ads(Stream*, AdTypes);
+	static bool send_query_results(Stream*, ClassAd*, AdTypes, List<ClassAd>&, bool filter_private_ads, std::string &projection);
 	static ClassAd * process_global_query( const char *constraint, void *arg );
 	static int select_by_match( ClassAd *cad );
 	static void process_invalidation(AdTypes, ClassAd&, Stream*);
 
 	static int query_scanFunc(ClassAd*);
+	static int query_batchScanFunc(ClassAd*);
+	static int query_flushBatch();
 	static int invalidation_scanFunc(ClassAd*);
 	static int expiration_scanFunc(ClassAd*);
 
@@ -167,6 +174,13 @@ public:
 	static int active_query_workers;
 	static int pending_query_workers;
 
+	// threads that answer queries from snapshots of the ads, if
+	// COLLECTOR_QUERY_THREADS is set, instead of forked query workers
+	static CollectorQueryPool query_pool;
+	static int QueryThreadTimerId;
+	static void submit_query_thread(pending_query_entry_t *, bool high_prio);
+	static void reapQueryThreads();
+
 #ifdef TRACK_QUERIES_BY_SUBSYS
 	static bool want_track_queries_by_subsys;
 #endif
@@ -191,6 +205,8 @@ protected:
 	static int __failed__;
 	static std::string __adType__;
 	static ExprTree *__filter__;
+	static classad::BatchConstraint __batchFilter__;
+	static std::vector<const classad::ClassAd*> __batch__;
 
 	static TrackTotals* normalTotals;
 	static int submittorRunningJobs;
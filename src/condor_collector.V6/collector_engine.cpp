@@ -38,7 +38,6 @@ extern "C" void event_mgr (void);
 
 static void killHashTable (CollectorHashTable &);
 static int killGenericHashTable(CollectorHashTable *);
-static void purgeHashTable (CollectorHashTable &);
 
 int 	engine_clientTimeoutHandler (Service *);
 int 	engine_housekeepingHandler  (Service *);
@@ -93,6 +92,12 @@ CollectorEngine::
 	killHashTable (HadAds);
 	killHashTable (GridAds);
 	GenericAds.walk(killGenericHashTable);
+	deleteIndexes();
+
+	std::unordered_set<ClassAd *>::iterator it;
+	for (it = m_retiredAds.begin(); it != m_retiredAds.end(); ++it) {
+		delete *it;
+	}
 
 	if(m_collector_requirements) {
 		delete m_collector_requirements;
@@ -224,7 +229,15 @@ CollectorEngine::invalidateAds(AdTypes adType, ClassAd &query)
 	MyString hkString;
 	(*table).startIterations();
 	while ((*table).iterate (ad)) {
-		if (IsAHalfMatch(&query, ad)) {
+			// matching binds the ad into a match ad, which a snapshot's
+			// ads must not be, so match a proxy for those instead
+		ClassAd proxy;
+		ClassAd *target = ad;
+		if (isPinned(ad)) {
+			proxy.ChainToAd(ad);
+			target = &proxy;
+		}
+		if (IsAHalfMatch(&query, target)) {
 			(*table).getCurrentKey(hk);
 			hk.sprint(hkString);
 			if ((*table).remove(hk) == -1) {
@@ -235,7 +248,8 @@ CollectorEngine::invalidateAds(AdTypes adType, ClassAd &query)
 				dprintf(D_ALWAYS,
 						"\t\t**** Invalidating ad: \"%s\"\n",
 						hkString.Value());
-				delete ad;
+				unindexAd(*table, ad);
+				discardAd(ad);
 				count++;
 			}
 		}
@@ -310,6 +324,246 @@ walkHashTable (AdTypes adType, int (*scanFunction)(ClassAd *))
 	return 1;
 }
 
+int CollectorEngine::
+walkHashTable (AdTypes adType, classad::ExprTree *constraint, int (*scanFunction)(ClassAd *))
+{
+	CollectorHashTable *table;
+	CollectorEngine::HashFunc func;
+	std::vector<ClassAd *> ads;
+	if (!LookupByAdType(adType, table, func) || !indexCandidates(*table, constraint, ads)) {
+		return walkHashTable(adType, scanFunction);
+	}
+
+	dprintf(D_FULLDEBUG, "Index narrowed query to %d of %d ads\n",
+			(int)ads.size(), table->getNumElements());
+	for (size_t i = 0; i < ads.size(); i++) {
+		if (!scanFunction(ads[i])) {
+			break;
+		}
+	}
+
+	return 1;
+}
+
+int CollectorEngine::
+walkHashTableForUpdate (AdTypes adType, int (*scanFunction)(ClassAd *))
+{
+	if (GENERIC_AD == adType) {
+		CollectorHashTable *cht;
+		GenericAds.startIterations();
+		while (GenericAds.iterate(cht)) {
+			if (!updateTable(*cht, scanFunction)) {
+				return 0;
+			}
+		}
+		return 1;
+	} else if (ANY_AD == adType) {
+		return
+			updateTable(AccountingAds, scanFunction) &&
+			updateTable(StorageAds, scanFunction) &&
+			updateTable(CkptServerAds, scanFunction) &&
+			updateTable(LicenseAds, scanFunction) &&
+			updateTable(CollectorAds, scanFunction) &&
+			updateTable(StartdAds, scanFunction) &&
+			updateTable(ScheddAds, scanFunction) &&
+			updateTable(MasterAds, scanFunction) &&
+			updateTable(SubmittorAds, scanFunction) &&
+			updateTable(NegotiatorAds, scanFunction) &&
+			updateTable(HadAds, scanFunction) &&
+			updateTable(GridAds, scanFunction) &&
+			walkHashTableForUpdate(GENERIC_AD, scanFunction);
+	}
+
+	CollectorHashTable *table;
+	CollectorEngine::HashFunc func;
+	if (!LookupByAdType(adType, table, func)) {
+		dprintf (D_ALWAYS, "Unknown type %d\n", adType);
+		return 0;
+	}
+	updateTable(*table, scanFunction);
+	return 1;
+}
+
+// Call the scan function on each ad of the table, first giving pinned ads
+// a private copy so that the scan function is free to modify them.
+int CollectorEngine::
+updateTable( CollectorHashTable &table, int (*scanFunction)(ClassAd *) )
+{
+	const AdNameHashKey *hk;
+	ClassAd **slot;
+	table.startIterations();
+	while (table.iterate_nocopy(&hk, &slot)) {
+		unshareAd(table, *slot);
+		int rval = scanFunction(*slot);
+		indexAd(table, *slot);
+		if (!rval) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+bool CollectorEngine::
+snapshotAds( AdTypes adType, classad::ExprTree *constraint, std::vector<ClassAd *> &ads )
+{
+	ads.clear();
+	ClassAd *ad;
+	if (GENERIC_AD == adType) {
+		CollectorHashTable *cht;
+		GenericAds.startIterations();
+		while (GenericAds.iterate(cht)) {
+			cht->startIterations();
+			while (cht->iterate(ad)) {
+				ads.push_back(ad);
+			}
+		}
+	} else {
+		CollectorHashTable *table;
+		CollectorEngine::HashFunc func;
+		if (ANY_AD == adType || !LookupByAdType(adType, table, func)) {
+			return false;
+		}
+		if (!indexCandidates(*table, constraint, ads)) {
+			ads.clear();
+			ads.reserve(table->getNumElements());
+			table->startIterations();
+			while (table->iterate(ad)) {
+				ads.push_back(ad);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < ads.size(); i++) {
+		m_pinnedAds[ads[i]]++;
+	}
+	return true;
+}
+
+void CollectorEngine::
+releaseSnapshot( const std::vector<ClassAd *> &ads )
+{
+	for (size_t i = 0; i < ads.size(); i++) {
+		std::unordered_map<const ClassAd *, int>::iterator pin = m_pinnedAds.find(ads[i]);
+		if (pin == m_pinnedAds.end() || --pin->second > 0) {
+			continue;
+		}
+		m_pinnedAds.erase(pin);
+		if (m_retiredAds.erase(ads[i])) {
+			m_wireCache.invalidate(ads[i]);
+			delete ads[i];
+		}
+	}
+}
+
+// Free an ad that has been removed from its table, or if a snapshot
+// still holds it, leave it for releaseSnapshot() to free.
+void CollectorEngine::
+discardAd( ClassAd *ad )
+{
+	if (isPinned(ad)) {
+		m_retiredAds.insert(ad);
+	} else {
+		m_wireCache.invalidate(ad);
+		delete ad;
+	}
+}
+
+// Before an ad in a table is modified in place, give the table its own
+// copy of the ad if a snapshot holds the original, otherwise forget the
+// ad's encodings.
+void CollectorEngine::
+unshareAd( const CollectorHashTable &table, ClassAd *&slot )
+{
+	if ( ! isPinned(slot)) {
+		m_wireCache.invalidate(slot);
+		return;
+	}
+	ClassAd *copy = new ClassAd(*slot);
+	unindexAd(table, slot);
+	indexAd(table, copy);
+	if (isSelfAd(slot)) { __self_ad__ = copy; }
+	m_retiredAds.insert(slot);
+	slot = copy;
+}
+
+void CollectorEngine::
+setIndexAttributes( const std::vector<std::string> &attrs )
+{
+	deleteIndexes();
+	if (attrs.empty()) {
+		return;
+	}
+
+	static const AdTypes indexedTypes[] = {
+		STARTD_AD, SCHEDD_AD, SUBMITTOR_AD, LICENSE_AD, MASTER_AD,
+		CKPT_SRVR_AD, STARTD_PVT_AD, COLLECTOR_AD, STORAGE_AD,
+		ACCOUNTING_AD, NEGOTIATOR_AD, HAD_AD, GRID_AD
+	};
+	for (size_t i = 0; i < sizeof(indexedTypes) / sizeof(indexedTypes[0]); i++) {
+		CollectorHashTable *table;
+		CollectorEngine::HashFunc func;
+		if (!LookupByAdType(indexedTypes[i], table, func)) {
+			continue;
+		}
+		CollectorIndex *index = new CollectorIndex(attrs);
+		ClassAd *ad;
+		table->startIterations();
+		while (table->iterate(ad)) {
+			index->insert(ad);
+		}
+		m_indexes[table] = index;
+	}
+}
+
+// Get the ads of the table that the index can't rule out for the
+// constraint, in the order they were added to the index.  Returns false
+// if the table has no index or the constraint has no part the index can
+// answer.
+bool CollectorEngine::
+indexCandidates( const CollectorHashTable &table, classad::ExprTree *constraint, std::vector<ClassAd *> &ads ) const
+{
+	CollectorIndex *index = constraint ? findIndex(table) : NULL;
+	return index && index->candidates(constraint, ads);
+}
+
+CollectorIndex *CollectorEngine::
+findIndex( const CollectorHashTable &table ) const
+{
+	if (m_indexes.empty()) {
+		return NULL;
+	}
+	std::map<const CollectorHashTable *, CollectorIndex *>::const_iterator found = m_indexes.find(&table);
+	return found == m_indexes.end() ? NULL : found->second;
+}
+
+void CollectorEngine::
+indexAd( const CollectorHashTable &table, ClassAd *ad ) const
+{
+	CollectorIndex *index = findIndex(table);
+	if (index) {
+		index->insert(ad);
+	}
+}
+
+void CollectorEngine::
+unindexAd( const CollectorHashTable &table, ClassAd *ad ) const
+{
+	CollectorIndex *index = findIndex(table);
+	if (index) {
+		index->remove(ad);
+	}
+}
+
+void CollectorEngine::
+deleteIndexes()
+{
+	std::map<const CollectorHashTable *, CollectorIndex *>::iterator it;
+	for (it = m_indexes.begin(); it != m_indexes.end(); ++it) {
+		delete it->second;
+	}
+	m_indexes.clear();
+}
+
 
 CollectorHashTable *CollectorEngine::findOrCreateTable(MyString &type)
 {
@@ -555,7 +809,10 @@ collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,S
 		repeatStartdAds = param_integer("COLLECTOR_REPEAT_STARTD_ADS",0);
 	}
 
-	if( !ValidateClassAd(command,clientAd,sock) ) {
+		// A delta is checked once it has been applied to the ad.
+	if( command != UPDATE_STARTD_AD_DELTA &&
+		!ValidateClassAd(command,clientAd,sock) )
+	{
 	    insert = -4;
 		return NULL;
 	}
@@ -569,7 +826,8 @@ collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,S
 	{
 	  case UPDATE_STARTD_AD:
 	  case UPDATE_STARTD_AD_WITH_ACK:
-		if ( repeatStartdAds > 0 ) {
+	  case UPDATE_STARTD_AD_DELTA:
+		if ( repeatStartdAds > 0 && command != UPDATE_STARTD_AD_DELTA ) {
 			clientAdToRepeat = new ClassAd(*clientAd);
 		}
 		if (!makeStartdAdHashKey (hk, clientAd))
@@ -585,8 +843,16 @@ collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,S
 		CollectorEngine_rucc_makeHashKey_runtime.Add(rt.tick(rt_last));
 #endif
 
-		retVal=updateClassAd (StartdAds, "StartdAd     ", "Start",
-							  clientAd, hk, hashString, insert, from );
+		if ( command == UPDATE_STARTD_AD_DELTA ) {
+			retVal=applyDeltaClassAd (StartdAds, "StartdAd     ", "Start",
+									  clientAd, hk, hashString, insert, sock );
+			if ( ! retVal ) {
+				break;
+			}
+		} else {
+			retVal=updateClassAd (StartdAds, "StartdAd     ", "Start",
+								  clientAd, hk, hashString, insert, from );
+		}
 
 #ifdef PROFILE_RECEIVE_UPDATE
 		if (last_updateClassAd_was_insert) { CollectorEngine_rucc_insertAd_runtime.Add(rt.tick(rt_last));
@@ -633,9 +899,11 @@ collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,S
 
 			// insert the private ad into its hashtable --- use the same
 			// hash key as the public ad
-			(void) updateClassAd (StartdPrivateAds, "StartdPvtAd  ",
+			if (updateClassAd (StartdPrivateAds, "StartdPvtAd  ",
 								  "StartdPvt", pvtAd, hk, hashString, insPvt,
-								  from );
+								  from )) {
+				pvtAd->Freeze();
+			}
 #ifdef PROFILE_RECEIVE_UPDATE
 			if (last_updateClassAd_was_insert) { CollectorEngine_rucc_insertPvtAd_runtime.Add(rt.tick(rt_last));
 			} else { CollectorEngine_rucc_updatePvtAd_runtime.Add(rt.tick(rt_last)); }
@@ -957,7 +1225,8 @@ int CollectorEngine::remove (AdTypes t_AddType, const ClassAd & c_query, bool *q
 				hk.sprint( hkString );
 				iRet = !table->remove(hk);
 				dprintf (D_ALWAYS,"\t\t**** Removed(%d) ad(s): \"%s\"\n", iRet, hkString.Value() );
-				delete pAd;
+				unindexAd(*table, pAd);
+				discardAd(pAd);
 			}
 		}
 	}
@@ -976,11 +1245,14 @@ int CollectorEngine::expire( AdTypes adType, const ClassAd & query, bool * query
         if( (* hFunc)( hKey, & query ) ) {
             if( queryContainsHashKey ) { * queryContainsHashKey = true; }
 
-            ClassAd * cAd = NULL;
-            if( hTable->lookup( hKey, cAd ) != -1 ) {
+            ClassAd ** slot = NULL;
+            if( hTable->lookup( hKey, slot ) != -1 ) {
+                unshareAd( * hTable, * slot );
+                ClassAd * cAd = * slot;
                 cAd->Assign( ATTR_LAST_HEARD_FROM, 1 );
                 
                 if( CollectorDaemon::offline_plugin_.expire( * cAd ) == true ) {
+                    indexAd( * hTable, cAd );
                     return rVal;
                 }
                 
@@ -995,7 +1267,8 @@ int CollectorEngine::expire( AdTypes adType, const ClassAd & query, bool * query
                 hKey.sprint( hkString );                
                 dprintf( D_ALWAYS, "\t\t**** Removed(%d) stale ad(s): \"%s\"\n", rVal, hkString.Value() );
 
-                delete cAd;
+                unindexAd( * hTable, cAd );
+                discardAd( cAd );
             }
         }
     }
@@ -1011,6 +1284,10 @@ remove (AdTypes adType, AdNameHashKey &hk)
 	if (!LookupByAdType(adType, table, func)) {
 		return 0;
 	}
+	ClassAd *ad;
+	if (table->lookup(hk, ad) != -1) {
+		unindexAd(*table, ad);
+	}
 	return !table->remove(hk);
 }
 
@@ -1075,6 +1352,7 @@ updateClassAd (CollectorHashTable &hashTable,
 			new_ad->Assign( ATTR_LAST_FORWARDED, (int)time(NULL) );
 		}
 
+		indexAd( hashTable, new_ad );
 		return new_ad;
 	}
 	else
@@ -1124,7 +1402,9 @@ updateClassAd (CollectorHashTable &hashTable,
 
 		if (isSelfAd(old_ad)) { __self_ad__ = new_ad; }
 
-		delete old_ad;
+		unindexAd( hashTable, old_ad );
+		indexAd( hashTable, new_ad );
+		discardAd( old_ad );
 
 		insert = 0;
 		return new_ad;
@@ -1142,11 +1422,12 @@ mergeClassAd (CollectorHashTable &hashTable,
 			   const condor_sockaddr& /*from*/ )
 {
 	ClassAd		*old_ad = NULL;
+	ClassAd		**slot = NULL;
 
 	insert = 0;
 
 	// check if it already exists in the hash table ...
-	if ( hashTable.lookup (hk, old_ad) == -1)
+	if ( hashTable.lookup (hk, slot) == -1)
     {	 	
 		dprintf (D_ALWAYS, "%s: Failed to merge update for ** \"%s\" because "
 				 "no existing ad matches.\n", adType, hashString.Value() );
@@ -1167,12 +1448,117 @@ mergeClassAd (CollectorHashTable &hashTable,
 		new_ad_copy.Delete(ATTR_TARGET_TYPE);
 
 		// Now, finally, merge the new ClassAd into the old one
+		unshareAd( hashTable, *slot );
+		old_ad = *slot;
 		MergeClassAds(old_ad,&new_ad_copy,true);
+		indexAd( hashTable, old_ad );
 	}
 	delete new_ad;
 	return old_ad;
 }
 
+// Apply the changes in a delta update to the stored ad, if it is the
+// one the delta was made against.  If it isn't, the delta is dropped,
+// and the caller should close the connection, which the sender takes
+// as a request to send the whole ad again.
+ClassAd * CollectorEngine::
+applyDeltaClassAd (CollectorHashTable &hashTable,
+			   const char *adType,
+			   const char *label,
+			   ClassAd *delta_ad,
+			   AdNameHashKey &hk,
+			   const MyString &hashString,
+			   int  &insert,
+			   Sock *sock )
+{
+	ClassAd		*ad = NULL;
+	ClassAd		**slot = NULL;
+	long long	base_seq = -1, cur_seq = -1;
+	long long	new_stime = -1, cur_stime = -1;
+
+	if ( hashTable.lookup (hk, slot) == -1 ) {
+		dprintf (D_ALWAYS, "%s: Dropping delta update for ** \"%s\" because "
+				 "no existing ad matches.\n", adType, hashString.Value() );
+		insert = -5;
+		return NULL;
+	}
+
+	delta_ad->LookupInteger( ATTR_UPDATE_DELTA_BASE_SEQUENCE, base_seq );
+	delta_ad->LookupInteger( ATTR_DAEMON_START_TIME, new_stime );
+	(*slot)->LookupInteger( ATTR_UPDATE_SEQUENCE_NUMBER, cur_seq );
+	(*slot)->LookupInteger( ATTR_DAEMON_START_TIME, cur_stime );
+	if ( base_seq < 0 || base_seq != cur_seq || new_stime != cur_stime ) {
+		dprintf (D_ALWAYS, "%s: Dropping delta update for \"%s\" made against "
+				 "update %lld; have update %lld\n", adType, hashString.Value(),
+				 base_seq, cur_seq );
+		insert = -5;
+		return NULL;
+	}
+
+	dprintf (D_FULLDEBUG, "%s: Applying delta update to ... \"%s\"\n",
+			 adType, hashString.Value() );
+
+	collectorStats->update( label, *slot, delta_ad );
+
+	std::string removed;
+	delta_ad->LookupString( ATTR_UPDATE_DELTA_REMOVED_ATTRS, removed );
+	delta_ad->Delete( ATTR_UPDATE_DELTA_BASE_SEQUENCE );
+	delta_ad->Delete( ATTR_UPDATE_DELTA_REMOVED_ATTRS );
+	StringList removed_attrs( removed.c_str(), "," );
+
+		// Same as updateClassAd(), but any change to a watched attribute
+		// is in the delta.
+	bool forward = false;
+	int last_forwarded = 0;
+	if ( m_forwardFilteringEnabled ) {
+		(*slot)->LookupInteger( ATTR_LAST_FORWARDED, last_forwarded );
+		forward = last_forwarded + m_forwardInterval < time(NULL);
+		const char *attr;
+		m_forwardWatchList.rewind();
+		while ( !forward && (attr = m_forwardWatchList.next()) ) {
+			forward = delta_ad->Lookup( attr ) || removed_attrs.contains_anycase( attr );
+		}
+	}
+
+	unshareAd( hashTable, *slot );
+	ad = *slot;
+	unindexAd( hashTable, ad );
+
+	const char *attr;
+	removed_attrs.rewind();
+	while ( (attr = removed_attrs.next()) ) {
+		ad->Delete( attr );
+	}
+	if ( ! delta_ad->Lookup( ATTR_AUTHENTICATED_IDENTITY ) ) {
+		ad->Delete( ATTR_AUTHENTICATED_IDENTITY );
+		ad->Delete( ATTR_AUTHENTICATION_METHOD );
+	}
+	ad->Update( *delta_ad );
+	ad->Assign( ATTR_LAST_HEARD_FROM, (int)time(NULL) );
+	if ( m_forwardFilteringEnabled ) {
+		ad->Assign( ATTR_SHOULD_FORWARD, forward );
+		ad->Assign( ATTR_LAST_FORWARDED, forward ? (int)time(NULL) : last_forwarded );
+	}
+
+	indexAd( hashTable, ad );
+
+	if ( ! ValidateClassAd( UPDATE_STARTD_AD, ad, sock ) ) {
+			// The old ad is gone, so drop what is left.  The sender
+			// will start over with the whole ad.
+		if ( hashTable.remove( hk ) == -1 ) {
+			EXCEPT( "Error removing ad" );
+		}
+		unindexAd( hashTable, ad );
+		discardAd( ad );
+		insert = -4;
+		return NULL;
+	}
+
+	insert = 0;
+	delete delta_ad;
+	return ad;
+}
+
 
 void
 CollectorEngine::
@@ -1236,6 +1622,8 @@ housekeeper()
 		cleanHashTable (*cht, now, makeGenericAdHashKey);
 	}
 
+	m_wireCache.rankProjections();
+
 	// cron manager
 	event_mgr();
 
@@ -1243,7 +1631,7 @@ housekeeper()
 }
 
 void CollectorEngine::
-cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey) const
+cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey)
 {
 	ClassAd  *ad;
 	int   	 timeStamp;
@@ -1283,8 +1671,15 @@ cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey) con
 				   potentially mark the ad absent. if expire() returns false, then delete
 				   the ad as planned; if it return true, it was likely marked as absent,
 				   so then this ad should NOT be deleted. */
+				ClassAd **slot = NULL;
+				if ( hashTable.lookup( hk, slot ) != -1 ) {
+					unshareAd( hashTable, *slot );
+					ad = *slot;
+				}
 				if ( CollectorDaemon::offline_plugin_.expire( *ad ) == true ) {
 					// plugin say to not delete this ad, so continue
+					// (it may have been marked absent)
+					indexAd( hashTable, ad );
 					continue;
 				} else {
 					dprintf (D_ALWAYS,"\t\t**** Removing stale ad: \"%s\"\n", hkString.Value() );
@@ -1294,7 +1689,8 @@ cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey) con
 			{
 				dprintf (D_ALWAYS, "\t\tError while removing ad\n");
 			}
-			delete ad;
+			unindexAd( hashTable, ad );
+			discardAd( ad );
 		}
 	}
 }
@@ -1367,7 +1763,7 @@ CollectorEngine::LookupByAdType(AdTypes adType,
 }
 
 
-static void
+void CollectorEngine::
 purgeHashTable( CollectorHashTable &table )
 {
 	ClassAd* ad;
@@ -1377,7 +1773,10 @@ purgeHashTable( CollectorHashTable &table )
 		if( table.remove(hk) == -1 ) {
 			dprintf( D_ALWAYS, "\t\tError while removing ad\n" );
 		}		
-		delete ad;
+		discardAd( ad );
+	}
+	if (CollectorIndex *index = findIndex(table)) {
+		index->clear();
 	}
 }
 
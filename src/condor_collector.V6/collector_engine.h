@@ -23,8 +23,14 @@
 #include "condor_classad.h"
 
 #include "collector_stats.h"
+#include "collector_index.h"
+#include "collector_wire_cache.h"
 #include "hashkey.h"
 
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
 class CollectorEngine : public Service
 {
   public:
@@ -70,6 +76,42 @@ class CollectorEngine : public Service
 	// walk specified hash table with the given visit procedure
 	int walkHashTable (AdTypes, int (*)(ClassAd *));
 
+	// as walkHashTable(), but if the table is indexed and the constraint
+	// has a part the index can answer, visit only the ads that may match,
+	// in the order they were added to the index
+	int walkHashTable (AdTypes, classad::ExprTree *constraint, int (*)(ClassAd *));
+
+	// as walkHashTable(), but the scan function may modify the ads it is given
+	int walkHashTableForUpdate (AdTypes, int (*)(ClassAd *));
+
+	// Pin the ads of the given type that may match the constraint, so that
+	// a query can be answered from them on another thread.  Until the
+	// snapshot is released, the engine neither frees nor modifies a pinned
+	// ad: an ad that must change is copied first and the table is pointed
+	// at the copy.  Returns false for ANY_AD and unknown types.
+	bool snapshotAds( AdTypes, classad::ExprTree *constraint, std::vector<ClassAd *> &ads );
+	void releaseSnapshot( const std::vector<ClassAd *> &ads );
+
+	// index the ads of every type (other than generic ads) on these
+	// attributes, replacing any existing indexes; an empty list removes
+	// the indexes
+	void setIndexAttributes( const std::vector<std::string> &attrs );
+
+	// keep the encodings of the ads sent in answer to queries, and of
+	// the ads projected on the max_projections most used projections
+	void setSerializedAdCache( bool enable, int max_projections ) {
+		m_wireCache.configure( enable, max_projections );
+	}
+	bool cachingSerializedAds() const { return m_wireCache.enabled(); }
+
+	// the encoding made by encodeClassAd() of an ad stored in a table, for
+	// a query with the given projection, or NULL if it isn't to be cached;
+	// may be called on a query thread for an ad in its snapshot
+	CollectorWireCache::Encoding encodedAd( const ClassAd *ad,
+			const std::string &projection, const classad::References *proj ) {
+		return m_wireCache.lookup( ad, projection, proj );
+	}
+
 	// Walk through a specific (non-generic, non-ANY) table using a lambda
 	template<typename T>
 	int walkConcreteTable(AdTypes adType, T scanFunction) {
@@ -143,6 +185,30 @@ class CollectorEngine : public Service
 	// table for "generic" ad types
 	GenericAdHashTable GenericAds;
 
+	// secondary indexes on the tables, if any
+	std::map<const CollectorHashTable *, CollectorIndex *> m_indexes;
+	CollectorIndex *findIndex( const CollectorHashTable &table ) const;
+	bool indexCandidates( const CollectorHashTable &table, classad::ExprTree *constraint, std::vector<ClassAd *> &ads ) const;
+	void indexAd( const CollectorHashTable &table, ClassAd *ad ) const;
+	void unindexAd( const CollectorHashTable &table, ClassAd *ad ) const;
+	void deleteIndexes();
+
+	// ads pinned by query snapshots, with the number of snapshots holding
+	// each, and the pinned ads that have since left the tables
+	std::unordered_map<const ClassAd *, int> m_pinnedAds;
+	std::unordered_set<ClassAd *> m_retiredAds;
+	bool isPinned( const ClassAd *ad ) const {
+		return !m_pinnedAds.empty() && m_pinnedAds.count(ad) > 0;
+	}
+	void discardAd( ClassAd *ad );
+
+	// encodings of the stored ads, which must be invalidated before an
+	// ad is changed in place or freed
+	CollectorWireCache m_wireCache;
+	void unshareAd( const CollectorHashTable &table, ClassAd *&slot );
+	int updateTable( CollectorHashTable &table, int (*)(ClassAd *) );
+	void purgeHashTable( CollectorHashTable &table );
+
 	// for walking through the generic hash tables
 	static int (*genericTableScanFunction)(ClassAd *);
 	static int genericTableWalker(CollectorHashTable *cht);
@@ -154,7 +220,7 @@ class CollectorEngine : public Service
 
 	void  housekeeper ();
 	int  housekeeperTimerID;
-	void cleanHashTable (CollectorHashTable &, time_t, HashFunc) const;
+	void cleanHashTable (CollectorHashTable &, time_t, HashFunc);
 	ClassAd* updateClassAd(CollectorHashTable&,const char*, const char *,
 						   ClassAd*,AdNameHashKey&, const MyString &, int &, 
 						   const condor_sockaddr& );
@@ -168,6 +234,15 @@ class CollectorEngine : public Service
 							int  &insert,
 							const condor_sockaddr& /*from*/ );
 
+	ClassAd * applyDeltaClassAd (CollectorHashTable &hashTable,
+							const char *adType,
+							const char *label,
+							ClassAd *delta_ad,
+							AdNameHashKey &hk,
+							const MyString &hashString,
+							int  &insert,
+							Sock *sock );
+
 	// support for dynamically created tables
 	CollectorHashTable *findOrCreateTable(MyString &str);
 
@@ -0,0 +1,269 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_classad.h"
+#include "compat_classad_util.h"
+
+#include "collector_index.h"
+
+#include <algorithm>
+
+CollectorIndex::CollectorIndex( const std::vector<std::string> &attrs )
+	: m_nextSeq( 0 )
+{
+	m_indexes.resize( attrs.size() );
+	for ( size_t i = 0; i < attrs.size(); i++ ) {
+		m_indexes[i].attr = attrs[i];
+	}
+}
+
+// The key of a value that an attribute may be compared to.  Values that
+// == considers equal get the same key: strings ignore case, and numbers
+// and booleans are all numbers.  Returns false for values an attribute
+// can't usefully be compared to.
+bool
+CollectorIndex::valueKey( const classad::Value &value, std::string &key )
+{
+	std::string str;
+	double num;
+	bool b;
+	if ( value.IsStringValue( str ) ) {
+		key = "s";
+		for ( size_t i = 0; i < str.size(); i++ ) {
+			key += (char)tolower( (unsigned char)str[i] );
+		}
+		return true;
+	}
+	if ( value.IsBooleanValue( b ) ) {
+		num = b ? 1 : 0;
+	} else if ( !value.IsNumber( num ) ) {
+		return false;
+	}
+	char buf[40];
+	snprintf( buf, sizeof(buf), "n%.17g", num + 0.0 );	// -0 + 0 is 0
+	key = buf;
+	return true;
+}
+
+// The key of an ad's value of an indexed attribute: empty if the ad can't
+// satisfy any comparison with a literal, "*" if its value isn't a literal.
+void
+CollectorIndex::attrKey( ClassAd *ad, const AttrIndex &index, std::string &key ) const
+{
+	key.clear();
+	classad::ExprTree *tree = ad->Lookup( index.attr );
+	if ( !tree ) {
+		return;
+	}
+	classad::Value value;
+	if ( !ExprTreeIsLiteral( tree, value ) ) {
+		key = "*";
+		return;
+	}
+		// evaluate, so that numbers get their scale factors
+	if ( !ad->EvaluateAttr( index.attr, value ) ||
+		 value.IsUndefinedValue() || value.IsErrorValue() ) {
+		return;
+	}
+	if ( !valueKey( value, key ) ) {
+		key = "*";
+	}
+}
+
+void
+CollectorIndex::insert( ClassAd *ad )
+{
+		// an ad being re-indexed keeps its place
+	auto found = m_ads.find( ad );
+	unsigned long long seq = found == m_ads.end() ? m_nextSeq++ : found->second.seq;
+	remove( ad );
+
+	AdEntry &entry = m_ads[ad];
+	entry.seq = seq;
+	std::vector<std::string> &keys = entry.keys;
+	keys.resize( m_indexes.size() );
+	for ( size_t i = 0; i < m_indexes.size(); i++ ) {
+		AttrIndex &index = m_indexes[i];
+		attrKey( ad, index, keys[i] );
+		if ( keys[i] == "*" ) {
+			index.unindexed.insert( ad );
+		} else if ( !keys[i].empty() ) {
+			index.values[keys[i]].insert( ad );
+		}
+	}
+}
+
+void
+CollectorIndex::remove( ClassAd *ad )
+{
+	auto found = m_ads.find( ad );
+	if ( found == m_ads.end() ) {
+		return;
+	}
+	const std::vector<std::string> &keys = found->second.keys;
+	for ( size_t i = 0; i < m_indexes.size(); i++ ) {
+		AttrIndex &index = m_indexes[i];
+		if ( keys[i] == "*" ) {
+			index.unindexed.erase( ad );
+		} else if ( !keys[i].empty() ) {
+			auto value = index.values.find( keys[i] );
+			if ( value != index.values.end() ) {
+				value->second.erase( ad );
+				if ( value->second.empty() ) {
+					index.values.erase( value );
+				}
+			}
+		}
+	}
+	m_ads.erase( found );
+}
+
+void
+CollectorIndex::clear()
+{
+	for ( size_t i = 0; i < m_indexes.size(); i++ ) {
+		m_indexes[i].values.clear();
+		m_indexes[i].unindexed.clear();
+	}
+	m_ads.clear();
+}
+
+const CollectorIndex::AttrIndex *
+CollectorIndex::findIndex( const std::string &attr ) const
+{
+	for ( size_t i = 0; i < m_indexes.size(); i++ ) {
+		if ( strcasecmp( m_indexes[i].attr.c_str(), attr.c_str() ) == 0 ) {
+			return &m_indexes[i];
+		}
+	}
+	return NULL;
+}
+
+// Gather the conjuncts of a constraint that are either
+//   Attr == literal, Attr =?= literal (either way around) or Attr
+// for an indexed Attr.  Each must be true for the constraint to be true.
+void
+CollectorIndex::findLookups( classad::ExprTree *tree, std::vector<Lookup> &lookups ) const
+{
+	tree = SkipExprParens( tree );
+	if ( !tree ) {
+		return;
+	}
+
+	std::string attr;
+	classad::Value value;
+	classad::Operation::OpKind op;
+	Lookup lookup;
+	if ( tree->GetKind() == classad::ExprTree::OP_NODE ) {
+		classad::ExprTree *t1, *t2, *t3;
+		((classad::Operation *)tree)->GetComponents( op, t1, t2, t3 );
+		if ( op == classad::Operation::LOGICAL_AND_OP ) {
+			findLookups( t1, lookups );
+			findLookups( t2, lookups );
+		} else if ( ExprTreeIsAttrCmpLiteral( tree, op, attr, value ) &&
+					( op == classad::Operation::EQUAL_OP ||
+					  op == classad::Operation::META_EQUAL_OP ) &&
+					( lookup.index = findIndex( attr ) ) &&
+					valueKey( value, lookup.key ) ) {
+			lookups.push_back( lookup );
+		}
+	} else if ( ExprTreeIsAttrRef( tree, attr ) &&
+				( lookup.index = findIndex( attr ) ) ) {
+		lookups.push_back( lookup );
+	}
+}
+
+// The number of candidates a lookup would give
+size_t
+CollectorIndex::lookupSize( const Lookup &lookup ) const
+{
+	const AttrIndex &index = *lookup.index;
+	size_t size = index.unindexed.size();
+	if ( lookup.key.empty() ) {
+			// any non-zero number is true in a logical expression
+		for ( auto it = index.values.begin(); it != index.values.end(); ++it ) {
+			if ( it->first[0] == 'n' && it->first != "n0" ) {
+				size += it->second.size();
+			}
+		}
+	} else {
+		auto found = index.values.find( lookup.key );
+		if ( found != index.values.end() ) {
+			size += found->second.size();
+		}
+	}
+	return size;
+}
+
+// Add ads to a list of candidates, with the order they were indexed in
+void
+CollectorIndex::addAds( const AdSet &set, std::vector<std::pair<unsigned long long, ClassAd *> > &ads ) const
+{
+	for ( auto it = set.begin(); it != set.end(); ++it ) {
+		ads.push_back( std::make_pair( m_ads.find( *it )->second.seq, *it ) );
+	}
+}
+
+bool
+CollectorIndex::candidates( classad::ExprTree *constraint, std::vector<ClassAd *> &ads ) const
+{
+	std::vector<Lookup> lookups;
+	findLookups( constraint, lookups );
+	if ( lookups.empty() ) {
+		return false;
+	}
+
+		// use the conjunct that narrows the search the most
+	size_t best = 0;
+	size_t best_size = lookupSize( lookups[0] );
+	for ( size_t i = 1; i < lookups.size(); i++ ) {
+		size_t size = lookupSize( lookups[i] );
+		if ( size < best_size ) {
+			best = i;
+			best_size = size;
+		}
+	}
+
+	const Lookup &lookup = lookups[best];
+	const AttrIndex &index = *lookup.index;
+	std::vector<std::pair<unsigned long long, ClassAd *> > found_ads;
+	found_ads.reserve( best_size );
+	addAds( index.unindexed, found_ads );
+	if ( lookup.key.empty() ) {
+		for ( auto it = index.values.begin(); it != index.values.end(); ++it ) {
+			if ( it->first[0] == 'n' && it->first != "n0" ) {
+				addAds( it->second, found_ads );
+			}
+		}
+	} else {
+		auto found = index.values.find( lookup.key );
+		if ( found != index.values.end() ) {
+			addAds( found->second, found_ads );
+		}
+	}
+
+	std::sort( found_ads.begin(), found_ads.end() );
+	ads.clear();
+	ads.reserve( found_ads.size() );
+	for ( size_t i = 0; i < found_ads.size(); i++ ) {
+		ads.push_back( found_ads[i].second );
+	}
+	return true;
+}
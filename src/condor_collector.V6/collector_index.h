@@ -0,0 +1,105 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef __COLLECTOR_INDEX_H__
+#define __COLLECTOR_INDEX_H__
+
+#include "condor_classad.h"
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/** Secondary indexes on one of the collector's tables of ads.  For each
+	indexed attribute, the index knows which ads have each literal value
+	of it.  A query whose constraint requires an indexed attribute to
+	equal a literal, such as
+		State == "Unclaimed" && Cpus > 4
+	then only needs to evaluate the constraint on the ads with that
+	value, instead of on every ad in the table.
+
+	The index must be told whenever an ad is added to or removed from
+	the table, or one of its indexed attributes may have changed.  It
+	never leaves out an ad that could match, but may include ads that
+	don't, so the constraint must still be evaluated on every candidate.
+*/
+class CollectorIndex
+{
+  public:
+	CollectorIndex( const std::vector<std::string> &attrs );
+
+	/// Index an ad, or re-index it if it is already indexed
+	void insert( ClassAd *ad );
+
+	/// Forget an ad
+	void remove( ClassAd *ad );
+
+	/// Forget every ad
+	void clear();
+
+	/** Find the ads that may satisfy a constraint, in the order they
+		were first indexed, so a query with a result limit gets the same
+		ads each time.
+		@return false if no part of the constraint narrows the search, in
+			which case every ad in the table must be checked
+	*/
+	bool candidates( classad::ExprTree *constraint, std::vector<ClassAd *> &ads ) const;
+
+	/// The number of ads indexed
+	size_t size() const { return m_ads.size(); }
+
+  private:
+	typedef std::unordered_set<ClassAd *> AdSet;
+
+	struct AdEntry {
+		unsigned long long seq;			// when the ad was first indexed
+		std::vector<std::string> keys;	// its key in each index
+	};
+
+	struct AttrIndex {
+		std::string attr;
+		std::map<std::string, AdSet> values;	// by key of the value
+		AdSet unindexed;						// the value isn't a literal
+	};
+
+		// a conjunct of a constraint that the index can answer
+	struct Lookup {
+		const AttrIndex *index;
+		std::string key;	// empty for "the attribute is true"
+	};
+
+	static bool valueKey( const classad::Value &value, std::string &key );
+	void attrKey( ClassAd *ad, const AttrIndex &index, std::string &key ) const;
+	void findLookups( classad::ExprTree *tree, std::vector<Lookup> &lookups ) const;
+	const AttrIndex *findIndex( const std::string &attr ) const;
+	size_t lookupSize( const Lookup &lookup ) const;
+	void addAds( const AdSet &set, std::vector<std::pair<unsigned long long, ClassAd *> > &ads ) const;
+
+	std::vector<AttrIndex> m_indexes;
+	std::unordered_map<ClassAd *, AdEntry> m_ads;
+	unsigned long long m_nextSeq;
+
+	CollectorIndex( const CollectorIndex & );				// not implemented
+	CollectorIndex &operator=( const CollectorIndex & );	// not implemented
+};
+
+#endif // __COLLECTOR_INDEX_H__
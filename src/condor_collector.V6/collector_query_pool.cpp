@@ -0,0 +1,177 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "utc_time.h"
+
+#include "collector_query_pool.h"
+
+CollectorQueryPool::CollectorQueryPool()
+	: m_target( 0 )
+	, m_retiring( 0 )
+	, m_running( 0 )
+	, m_stopping( false )
+{
+}
+
+CollectorQueryPool::~CollectorQueryPool()
+{
+	stop();
+}
+
+void
+CollectorQueryPool::setThreads( int threads )
+{
+	if ( threads < 0 ) {
+		threads = 0;
+	}
+	if ( threads == m_target ) {
+		return;
+	}
+	m_target = threads;
+
+	int start = 0;
+	{
+		std::lock_guard<std::mutex> guard( m_mutex );
+		int staying = (int)m_threads.size() - m_retiring;
+		if ( threads < staying ) {
+			m_retiring += staying - threads;
+		} else {
+				// keep threads that were asked to exit before starting more
+			int kept = MIN( m_retiring, threads - staying );
+			m_retiring -= kept;
+			start = threads - staying - kept;
+		}
+	}
+	m_wakeup.notify_all();
+	for ( int i = 0; i < start; i++ ) {
+		m_threads.push_back( std::thread( &CollectorQueryPool::worker, this ) );
+	}
+	dprintf( D_ALWAYS, "Query thread pool now has %d threads\n", threads );
+}
+
+void
+CollectorQueryPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard( m_mutex );
+		m_stopping = true;
+	}
+	m_wakeup.notify_all();
+	for ( size_t i = 0; i < m_threads.size(); i++ ) {
+		m_threads[i].join();
+	}
+	m_threads.clear();
+	m_exited.clear();
+	m_target = 0;
+	m_retiring = 0;
+	m_stopping = false;
+}
+
+void
+CollectorQueryPool::submit( Job *job, bool high_prio )
+{
+	job->queued = condor_gettimestamp_double();
+	{
+		std::lock_guard<std::mutex> guard( m_mutex );
+		if ( high_prio ) {
+			m_high_prio.push_back( job );
+		} else {
+			m_low_prio.push_back( job );
+		}
+	}
+	m_wakeup.notify_one();
+}
+
+void
+CollectorQueryPool::reap( std::vector<Job *> &done )
+{
+	std::vector<std::thread> exited;
+	{
+		std::lock_guard<std::mutex> guard( m_mutex );
+		done.insert( done.end(), m_done.begin(), m_done.end() );
+		m_done.clear();
+
+		for ( size_t i = 0; i < m_exited.size(); i++ ) {
+			for ( size_t j = 0; j < m_threads.size(); j++ ) {
+				if ( m_threads[j].get_id() == m_exited[i] ) {
+					exited.push_back( std::move( m_threads[j] ) );
+					m_threads.erase( m_threads.begin() + j );
+					break;
+				}
+			}
+		}
+		m_exited.clear();
+	}
+		// these threads are done with their jobs, so this doesn't wait long
+	for ( size_t i = 0; i < exited.size(); i++ ) {
+		exited[i].join();
+	}
+}
+
+int
+CollectorQueryPool::pending()
+{
+	std::lock_guard<std::mutex> guard( m_mutex );
+	return (int)( m_high_prio.size() + m_low_prio.size() );
+}
+
+int
+CollectorQueryPool::running()
+{
+	std::lock_guard<std::mutex> guard( m_mutex );
+	return m_running;
+}
+
+void
+CollectorQueryPool::worker()
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+	for (;;) {
+		std::deque<Job *> *queue = NULL;
+		if ( ! m_high_prio.empty() ) {
+			queue = &m_high_prio;
+		} else if ( ! m_low_prio.empty() ) {
+			queue = &m_low_prio;
+		} else if ( m_stopping ) {
+			return;
+		} else if ( m_retiring > 0 ) {
+			m_retiring--;
+			m_exited.push_back( std::this_thread::get_id() );
+			return;
+		} else {
+			m_wakeup.wait( lock );
+			continue;
+		}
+
+		Job *job = queue->front();
+		queue->pop_front();
+		m_running++;
+		lock.unlock();
+
+		job->started = condor_gettimestamp_double();
+		job->run();
+		job->finished = condor_gettimestamp_double();
+
+		lock.lock();
+		m_running--;
+		m_done.push_back( job );
+	}
+}
@@ -0,0 +1,105 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef __COLLECTOR_QUERY_POOL_H__
+#define __COLLECTOR_QUERY_POOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A pool of threads that answer queries, so that the collector can go
+	on accepting updates while a large query is evaluated and its results
+	are sent.  Unlike the forked query workers, the threads share the
+	collector's memory, so a job must not touch anything the daemon's
+	thread may change while the job runs; the collector gives each job a
+	snapshot of pinned ads (see CollectorEngine::snapshotAds()).
+
+	Jobs are submitted and reaped by the daemon's thread only.  Reaping
+	hands back the finished jobs, for the daemon to release whatever they
+	hold and to delete them.
+*/
+class CollectorQueryPool
+{
+  public:
+	class Job {
+	  public:
+		Job() : queued(0.0), started(0.0), finished(0.0) {}
+		virtual ~Job() {}
+
+			// Called on one of the pool's threads.
+		virtual void run() = 0;
+
+			// When the job was submitted, started and finished.
+		double queued;
+		double started;
+		double finished;
+	};
+
+	CollectorQueryPool();
+	~CollectorQueryPool();
+
+		// Set the number of threads.  New threads start at once; threads
+		// beyond the number exit once no jobs are queued, without the
+		// caller waiting for them (see reap()).
+	void setThreads( int threads );
+	int threads() const { return m_target; }
+
+		// The number of threads that have not yet been joined, which
+		// may be more than threads() for a while after it shrinks.
+	int liveThreads() const { return (int)m_threads.size(); }
+
+		// Let the threads finish every queued job, and wait for them to
+		// exit.
+	void stop();
+
+		// Queue a job.  High priority jobs run before any normal ones.
+	void submit( Job *job, bool high_prio );
+
+		// Move the jobs that have finished since the last call to done,
+		// and join the threads that have exited.
+	void reap( std::vector<Job *> &done );
+
+		// The number of jobs waiting for a thread, and being run.
+	int pending();
+	int running();
+
+  private:
+	void worker();
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	std::deque<Job *> m_high_prio;
+	std::deque<Job *> m_low_prio;
+	std::vector<Job *> m_done;
+	std::vector<std::thread> m_threads;
+	std::vector<std::thread::id> m_exited;	// threads to join in reap()
+	int m_target;
+	int m_retiring;		// threads asked to exit
+	int m_running;
+	bool m_stopping;
+
+		// not implemented
+	CollectorQueryPool( const CollectorQueryPool & );
+	CollectorQueryPool &operator=( const CollectorQueryPool & );
+};
+
+#endif // __COLLECTOR_QUERY_POOL_H__
@@ -377,6 +377,13 @@ void UpdatesStats::Init()
 	STATS_POOL_ADD(Pool, "", PendingQueries, IF_BASICPUB);
 	STATS_POOL_ADD_VAL_PUB_RECENT(Pool, "", DroppedQueries, IF_BASICPUB);
 
+	// stats for the query thread pool.
+	STATS_POOL_ADD(Pool, "", ActiveQueryThreads, IF_BASICPUB | IF_NONZERO);
+	STATS_POOL_ADD(Pool, "", PendingThreadQueries, IF_BASICPUB | IF_NONZERO);
+	const int probe_flags = stats_entry_recent<Probe>::PubValueAndRecent | ProbeDetailMode_CAMM | IF_NONZERO | IF_BASICPUB;
+	Pool.AddProbe("ThreadQueryWaitTime", &ThreadQueryWaitTime, NULL, probe_flags);
+	Pool.AddProbe("ThreadQueryLatency", &ThreadQueryLatency, NULL, probe_flags);
+
 	ADD_EXTERN_RUNTIME(Pool, HandleQuery, IF_VERBOSEPUB);
 	ADD_EXTERN_RUNTIME(Pool, HandleLocate, IF_VERBOSEPUB);
 
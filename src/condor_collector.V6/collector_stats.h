@@ -175,6 +175,12 @@ struct UpdatesStats {
 	stats_entry_abs<int> PendingQueries;
 	stats_entry_recent<long> DroppedQueries;
 
+	// queries answered by the query thread pool
+	stats_entry_abs<int> ActiveQueryThreads;
+	stats_entry_abs<int> PendingThreadQueries;
+	stats_entry_recent<Probe> ThreadQueryWaitTime; // time spent waiting in the queue
+	stats_entry_recent<Probe> ThreadQueryLatency;  // time from arrival until the response is sent
+
 #ifdef TRACK_QUERIES_BY_SUBSYS
 	stats_entry_recent<long> InProcQueriesFrom[SUBSYSTEM_ID_COUNT]; // Track subsystems < the AUTO subsys.
 	stats_entry_recent<long> ForkQueriesFrom[SUBSYSTEM_ID_COUNT]; // Track subsystems < the AUTO subsys.
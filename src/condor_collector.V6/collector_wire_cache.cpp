@@ -0,0 +1,182 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_classad.h"
+
+#include "collector_wire_cache.h"
+
+#include <algorithm>
+#include <vector>
+
+CollectorWireCache::CollectorWireCache()
+	: m_maxProjections( 0 )
+	, m_enabled( false )
+	, m_hits( 0 )
+	, m_misses( 0 )
+{
+}
+
+CollectorWireCache::~CollectorWireCache()
+{
+}
+
+void
+CollectorWireCache::configure( bool enable, int max_projections )
+{
+	std::lock_guard<std::mutex> guard( m_mutex );
+
+	if ( max_projections < 0 ) {
+		max_projections = 0;
+	}
+	if ( ! enable ) {
+		m_entries.clear();
+		m_projectionUses.clear();
+		m_hotProjections.clear();
+	} else if ( (size_t)max_projections != m_maxProjections ) {
+		std::unordered_map<const ClassAd *, Entry>::iterator it;
+		for ( it = m_entries.begin(); it != m_entries.end(); ++it ) {
+			it->second.projected.clear();
+		}
+		m_hotProjections.clear();
+	}
+	m_maxProjections = max_projections;
+	m_enabled = enable;
+}
+
+CollectorWireCache::Encoding
+CollectorWireCache::lookup( const ClassAd *ad, const std::string &projection,
+                            const classad::References *proj )
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+
+	if ( ! m_enabled ) {
+		return Encoding();
+	}
+	if ( ! projection.empty() && ! isHotProjection( projection ) ) {
+		return Encoding();
+	}
+
+	Entry &entry = m_entries[ad];
+	Encoding &cached = projection.empty() ? entry.whole : entry.projected[projection];
+	if ( cached ) {
+		m_hits++;
+		return cached;
+	}
+	m_misses++;
+
+		// Encode without the lock, so that other threads can go on
+		// with other ads.  Nothing changes the ad meanwhile: on a query
+		// thread, it is pinned, and otherwise we are on the daemon's
+		// thread, which is the only one that changes ads.
+	lock.unlock();
+	std::string *encoded = new std::string;
+	encodeClassAd( *ad, *encoded, proj );
+	Encoding made( encoded );
+	lock.lock();
+
+		// The cache may have been turned off, or the projection dropped,
+		// while we weren't holding the lock.
+	if ( ! m_enabled ||
+	     ( ! projection.empty() && ! m_hotProjections.count( projection ) ) )
+	{
+		return made;
+	}
+	Entry &again = m_entries[ad];
+	Encoding &slot = projection.empty() ? again.whole : again.projected[projection];
+	if ( ! slot ) {
+		slot = made;
+	}
+	return slot;
+}
+
+void
+CollectorWireCache::invalidate( const ClassAd *ad )
+{
+		// Only the daemon's thread turns the cache on and off.
+	if ( ! m_enabled ) {
+		return;
+	}
+	std::lock_guard<std::mutex> guard( m_mutex );
+	m_entries.erase( ad );
+}
+
+// Called with the lock held.
+bool
+CollectorWireCache::isHotProjection( const std::string &projection )
+{
+	m_projectionUses[projection]++;
+	if ( m_hotProjections.count( projection ) ) {
+		return true;
+	}
+	if ( m_hotProjections.size() < m_maxProjections ) {
+		m_hotProjections.insert( projection );
+		return true;
+	}
+	return false;
+}
+
+void
+CollectorWireCache::rankProjections()
+{
+	std::lock_guard<std::mutex> guard( m_mutex );
+
+	if ( ! m_enabled ) {
+		return;
+	}
+
+	std::vector< std::pair<long, std::string> > ranked;
+	std::map<std::string, long>::const_iterator use;
+	for ( use = m_projectionUses.begin(); use != m_projectionUses.end(); ++use ) {
+		ranked.push_back( std::make_pair( use->second, use->first ) );
+	}
+	size_t keep = std::min( ranked.size(), m_maxProjections );
+	std::partial_sort( ranked.begin(), ranked.begin() + keep, ranked.end(),
+	                   std::greater< std::pair<long, std::string> >() );
+	std::set<std::string> hot;
+	for ( size_t i = 0; i < keep; i++ ) {
+		hot.insert( ranked[i].second );
+	}
+
+	size_t bytes = 0;
+	std::unordered_map<const ClassAd *, Entry>::iterator it;
+	for ( it = m_entries.begin(); it != m_entries.end(); ++it ) {
+		std::map<std::string, Encoding> &projected = it->second.projected;
+		std::map<std::string, Encoding>::iterator enc = projected.begin();
+		while ( enc != projected.end() ) {
+			if ( hot.count( enc->first ) ) {
+				bytes += enc->second ? enc->second->size() : 0;
+				++enc;
+			} else {
+				projected.erase( enc++ );
+			}
+		}
+		bytes += it->second.whole ? it->second.whole->size() : 0;
+	}
+
+	dprintf( D_FULLDEBUG, "Serialized ad cache: %d ads, %d projections, "
+	         "%lu bytes, %ld hits, %ld misses\n", (int)m_entries.size(),
+	         (int)hot.size(), (unsigned long)bytes, m_hits, m_misses );
+
+	m_hotProjections.swap( hot );
+	m_projectionUses.clear();
+	m_hits = 0;
+	m_misses = 0;
+}
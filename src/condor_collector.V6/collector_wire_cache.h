@@ -0,0 +1,93 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef __COLLECTOR_WIRE_CACHE_H__
+#define __COLLECTOR_WIRE_CACHE_H__
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include "condor_classad.h"
+
+/** Keeps the encodings made by encodeClassAd() of the ads the collector
+	stores, so that an ad that is queried many times between updates is
+	encoded only once.  The encoding of a whole ad is kept for any ad,
+	the encoding for a projection only for the few projections queries
+	use most.
+
+	The encodings are made when first asked for, which may be on a query
+	thread, so every method takes the cache's lock.  The collector must
+	call invalidate() before it changes an ad in place, and before it
+	deletes one.
+*/
+class CollectorWireCache
+{
+  public:
+	typedef std::shared_ptr<const std::string> Encoding;
+
+	CollectorWireCache();
+	~CollectorWireCache();
+
+		// Turn the cache on or off, and set how many projections to keep
+		// encodings for.  Turning it off forgets every encoding.
+	void configure( bool enable, int max_projections );
+	bool enabled() const { return m_enabled; }
+
+		// Get the encoding of ad for the projection (an empty string for
+		// the whole ad, with proj NULL), making it if it isn't cached.
+		// Returns NULL if the projection isn't one we keep encodings for.
+	Encoding lookup( const ClassAd *ad, const std::string &projection,
+	                 const classad::References *proj );
+
+		// Forget the encodings of an ad.
+	void invalidate( const ClassAd *ad );
+
+		// Pick the projections to keep encodings for from those used
+		// since the last call, and forget the encodings for the others.
+	void rankProjections();
+
+  private:
+	struct Entry {
+		Encoding whole;
+		std::map<std::string, Encoding> projected;
+	};
+
+	bool isHotProjection( const std::string &projection );
+
+	std::mutex m_mutex;
+	std::unordered_map<const ClassAd *, Entry> m_entries;
+	std::map<std::string, long> m_projectionUses;
+	std::set<std::string> m_hotProjections;
+	size_t m_maxProjections;
+	std::atomic<bool> m_enabled;
+
+	long m_hits;
+	long m_misses;
+
+		// not implemented
+	CollectorWireCache( const CollectorWireCache & );
+	CollectorWireCache &operator=( const CollectorWireCache & );
+};
+
+#endif // __COLLECTOR_WIRE_CACHE_H__
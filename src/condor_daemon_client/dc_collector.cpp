@@ -26,6 +26,7 @@
 #include "daemon.h"
 #include "condor_daemon_core.h"
 #include "dc_collector.h"
+#include "selector.h"
 
 #include <sstream>
 #include <algorithm>
@@ -51,6 +52,7 @@ DCCollector::init( bool needs_reconfig )
 	update_rsock = NULL;
 	use_tcp = true;
 	use_nonblocking_update = true;
+	use_delta_updates = false;
 	update_destination = NULL;
 	timerclear( &m_blacklist_monitor_query_started );
 
@@ -92,6 +94,7 @@ DCCollector::deepCopy( const DCCollector& copy )
 		delete update_rsock;
 		update_rsock = NULL;
 	}
+	delta_baselines.clear();
 		/*
 		  for now, we're not going to attempt to copy the update_rsock
 		  from the copy, since i'm not sure i trust ReliSock's copy
@@ -107,6 +110,7 @@ DCCollector::deepCopy( const DCCollector& copy )
 
 	use_tcp = copy.use_tcp;
 	use_nonblocking_update = copy.use_nonblocking_update;
+	use_delta_updates = copy.use_delta_updates;
 
 	up_type = copy.up_type;
 
@@ -226,6 +230,10 @@ void
 DCCollector::reconfig( void )
 {
 	use_nonblocking_update = param_boolean("NONBLOCKING_COLLECTOR_UPDATE",true);
+	use_delta_updates = param_boolean("UPDATE_COLLECTOR_WITH_DELTAS",false);
+	if( ! use_delta_updates ) {
+		delta_baselines.clear();
+	}
 
 	if( ! _addr ) {
 		locate();
@@ -321,6 +329,14 @@ DCCollector::sendUpdate( int cmd, ClassAd* ad1, DCCollectorAdSequences& adSeq, C
 		CopyAttribute(ATTR_MY_ADDRESS,*ad2,*ad1);
 	}
 
+		// A slot that goes away can't be the base of a delta any more.
+	if ( cmd == INVALIDATE_STARTD_ADS && ad1 && ! delta_baselines.empty() ) {
+		std::string name;
+		if ( ad1->LookupString( ATTR_NAME, name ) ) {
+			delta_baselines.erase( name );
+		}
+	}
+
 		// We never want to try sending an update to port 0.  If we're
 		// about to try that, and we're trying to talk to a local
 		// collector, we should try re-reading the address file and
@@ -586,6 +602,7 @@ public:
 					dprintf(D_ALWAYS,"Failed to send update to %s.\n",who);
 					delete dc_collector->update_rsock;
 					dc_collector->update_rsock = NULL;
+					dc_collector->delta_baselines.clear();
 					// Notice we remove the element from the list of pending updates
 					// even on failure.
 				}
@@ -685,8 +702,24 @@ DCCollector::sendTCPUpdate( int cmd, ClassAd* ad1, ClassAd* ad2, bool nonblockin
 		// since finishUpdate() assumes we've already sent the command
 		// int, and since we do *NOT* want to use startCommand() again
 		// on a cached TCP socket, just code the int ourselves...
+		// If we can, we send just what changed since the last update
+		// of this ad, but not if the collector has hung up on us: it
+		// does that when it can't apply a delta, so that we start over
+		// with the whole ad on a new connection.
+	ClassAd delta_ad;
+	bool send_delta = makeDeltaUpdate( cmd, ad1, delta_ad );
+	if ( send_delta && updateSocketClosedByPeer() ) {
+		dprintf( D_FULLDEBUG, "Collector closed the TCP socket for updates, "
+				 "starting new connection\n" );
+		delete update_rsock;
+		update_rsock = NULL;
+		return initiateTCPUpdate( cmd, ad1, ad2, nonblocking, callback_fn, miscdata );
+	}
 	update_rsock->encode();
-	if (update_rsock->put(cmd) && finishUpdate(this, update_rsock, ad1, ad2, callback_fn, miscdata)) {
+	if (update_rsock->put(send_delta ? UPDATE_STARTD_AD_DELTA : cmd) &&
+		finishUpdate(this, update_rsock, send_delta ? &delta_ad : ad1, ad2, callback_fn, miscdata))
+	{
+		saveDeltaBaseline( cmd, ad1 );
 		if (callback_fn) {
 			(*callback_fn)(true, update_rsock, nullptr, update_rsock->getTrustDomain(), update_rsock->shouldTryTokenRequest(), miscdata);
 		}
@@ -709,8 +742,11 @@ DCCollector::initiateTCPUpdate( int cmd, ClassAd* ad1, ClassAd* ad2, bool nonblo
 		delete update_rsock;
 		update_rsock = NULL;
 	}
+		// A new connection may well be to a new collector process.
+	delta_baselines.clear();
 	if(nonblocking) {
 		UpdateData *ud = new UpdateData(cmd, Sock::reli_sock, ad1, ad2, this, callback_fn, miscdata);
+		saveDeltaBaseline( cmd, ad1 );
 			// Note that UpdateData automatically adds itself to the pending_update_list.
 		if (this->pending_update_list.size() == 1)
 		{
@@ -731,7 +767,100 @@ DCCollector::initiateTCPUpdate( int cmd, ClassAd* ad1, ClassAd* ad2, bool nonblo
 		return false;
 	}
 	update_rsock = (ReliSock *)sock;
-	return finishUpdate( this, update_rsock, ad1, ad2, callback_fn, miscdata );
+	if ( ! finishUpdate( this, update_rsock, ad1, ad2, callback_fn, miscdata ) ) {
+		return false;
+	}
+	saveDeltaBaseline( cmd, ad1 );
+	return true;
+}
+
+
+// Fill in delta with the attributes of a startd ad that have changed
+// since the one we last sent over update_rsock, and the names of any
+// that have gone.  The collector applies it only if the ad it has is
+// that last one, which it checks by the base sequence number.
+bool
+DCCollector::makeDeltaUpdate( int cmd, ClassAd* ad1, ClassAd &delta )
+{
+	if ( ! use_delta_updates || cmd != UPDATE_STARTD_AD || ! ad1 || ! update_rsock ) {
+		return false;
+	}
+
+	auto *verinfo = update_rsock->get_peer_version();
+	if ( ! verinfo || ! verinfo->built_since_version(8, 9, 11) ) {
+		return false;
+	}
+
+	std::string name;
+	if ( ! ad1->LookupString( ATTR_NAME, name ) ) {
+		return false;
+	}
+	std::map<std::string, ClassAd>::iterator base = delta_baselines.find( name );
+	if ( base == delta_baselines.end() ) {
+		return false;
+	}
+	long long base_seq = 0;
+	if ( ! base->second.LookupInteger( ATTR_UPDATE_SEQUENCE_NUMBER, base_seq ) ) {
+		return false;
+	}
+
+	std::string removed;
+	for ( auto itr = base->second.begin(); itr != base->second.end(); itr++ ) {
+		if ( ! ad1->Lookup( itr->first ) ) {
+			if ( ! removed.empty() ) { removed += ','; }
+			removed += itr->first;
+		}
+	}
+	for ( auto itr = ad1->begin(); itr != ad1->end(); itr++ ) {
+		ExprTree *old_expr = base->second.Lookup( itr->first );
+		if ( ! old_expr || ! old_expr->SameAs( itr->second ) ) {
+			delta.Insert( itr->first, itr->second->Copy() );
+		}
+	}
+
+		// The collector needs these to find the ad, and to check it.
+	const char *key_attrs[] = { ATTR_MY_TYPE, ATTR_TARGET_TYPE, ATTR_NAME,
+		ATTR_MACHINE, ATTR_SLOT_ID, ATTR_MY_ADDRESS, ATTR_STARTD_IP_ADDR,
+		ATTR_DAEMON_START_TIME };
+	for ( size_t i = 0; i < sizeof(key_attrs) / sizeof(key_attrs[0]); i++ ) {
+		if ( ! delta.Lookup( key_attrs[i] ) ) {
+			CopyAttribute( key_attrs[i], delta, *ad1 );
+		}
+	}
+
+	delta.Assign( ATTR_UPDATE_DELTA_BASE_SEQUENCE, base_seq );
+	if ( ! removed.empty() ) {
+		delta.Assign( ATTR_UPDATE_DELTA_REMOVED_ATTRS, removed );
+	}
+	dprintf( D_FULLDEBUG, "Sending %d of %d attributes of %s as a delta update\n",
+			 (int)delta.size(), (int)ad1->size(), name.c_str() );
+	return true;
+}
+
+
+void
+DCCollector::saveDeltaBaseline( int cmd, ClassAd* ad1 )
+{
+	if ( ! use_delta_updates || cmd != UPDATE_STARTD_AD || ! ad1 ) {
+		return;
+	}
+	std::string name;
+	if ( ad1->LookupString( ATTR_NAME, name ) ) {
+		delta_baselines[name] = *ad1;
+	}
+}
+
+
+// The collector never writes to a socket it reads updates from, so if
+// the socket is readable, the collector has closed it.
+bool
+DCCollector::updateSocketClosedByPeer()
+{
+	Selector selector;
+	selector.add_fd( update_rsock->get_file_desc(), Selector::IO_READ );
+	selector.set_timeout( 0 );
+	selector.execute();
+	return selector.has_ready();
 }
 
 
@@ -125,8 +125,14 @@ private:
 
 	bool use_tcp;
 	bool use_nonblocking_update;
+	bool use_delta_updates;
 	UpdateType up_type;
 
+		// The last startd ad sent to the collector over update_rsock,
+		// by name.  A delta update is only made against one of these,
+		// and they are forgotten whenever the socket is.
+	std::map<std::string, ClassAd> delta_baselines;
+
 	std::deque<class UpdateData*> pending_update_list;
 	friend class UpdateData;
 
@@ -140,6 +146,10 @@ private:
 
 	bool initiateTCPUpdate( int cmd, ClassAd* ad1, ClassAd* ad2, bool nonblocking, StartCommandCallbackType callback_fn, void *miscdata );
 
+	bool makeDeltaUpdate( int cmd, ClassAd* ad1, ClassAd &delta );
+	void saveDeltaBaseline( int cmd, ClassAd* ad1 );
+	bool updateSocketClosedByPeer();
+
 	char* update_destination;
 
 	struct timeval m_blacklist_monitor_query_started;
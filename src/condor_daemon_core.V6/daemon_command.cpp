@@ -35,6 +35,7 @@
 #include "condor_version.h"
 #include "ipv6_hostname.h"
 #include "daemon_command.h"
+#include "classad/binaryCodec.h"
 
 
 static unsigned int ZZZZZ = 0;
@@ -629,6 +630,9 @@ DaemonCommandProtocol::CommandProtocolResult DaemonCommandProtocol::ReadCommand(
 			CondorVersionInfo ver_info( peer_version.c_str() );
 			m_sock->set_peer_version( &ver_info );
 		}
+		int classad_binary_version = 0;
+		m_auth_info.LookupInteger( ATTR_SEC_CLASSAD_BINARY_VERSION, classad_binary_version );
+		m_sock->set_peer_classad_binary_version( classad_binary_version );
 
 		// look at the ad.  get the command number.
 		m_real_cmd = 0;
@@ -774,6 +778,7 @@ DaemonCommandProtocol::CommandProtocolResult DaemonCommandProtocol::ReadCommand(
 				}
 
 				std::string peer_version;
+				int classad_binary_version = 0;
 
 				// grab some attributes out of the policy.
 				if (m_policy) {
@@ -801,6 +806,7 @@ DaemonCommandProtocol::CommandProtocolResult DaemonCommandProtocol::ReadCommand(
 					}
 
 					m_policy->LookupString( ATTR_SEC_REMOTE_VERSION, peer_version );
+					m_policy->LookupInteger( ATTR_SEC_CLASSAD_BINARY_VERSION, classad_binary_version );
 
 					bool tried_authentication=false;
 					m_policy->LookupBool(ATTR_SEC_TRIED_AUTHENTICATION,tried_authentication);
@@ -818,6 +824,7 @@ DaemonCommandProtocol::CommandProtocolResult DaemonCommandProtocol::ReadCommand(
 				} else {
 					m_sock->set_peer_version( NULL );
 				}
+				m_sock->set_peer_classad_binary_version( classad_binary_version );
 
 				m_new_session = false;
 
@@ -863,6 +870,7 @@ DaemonCommandProtocol::CommandProtocolResult DaemonCommandProtocol::ReadCommand(
 
 				// add our version to the policy to be sent over
 				m_policy->Assign(ATTR_SEC_REMOTE_VERSION, CondorVersion());
+				m_policy->Assign(ATTR_SEC_CLASSAD_BINARY_VERSION, classad::BINARY_CLASSAD_VERSION);
 
 				// handy policy vars
 				SecMan::sec_feat_act will_authenticate      = m_sec_man->sec_lookup_feat_act(*m_policy, ATTR_SEC_AUTHENTICATION);
@@ -1580,6 +1588,8 @@ DaemonCommandProtocol::CommandProtocolResult DaemonCommandProtocol::SendResponse
 		// it matters if the version is empty, so we must explicitly delete it
 		m_policy->Delete( ATTR_SEC_REMOTE_VERSION );
 		m_sec_man->sec_copy_attribute( *m_policy, m_auth_info, ATTR_SEC_REMOTE_VERSION );
+		m_policy->Delete( ATTR_SEC_CLASSAD_BINARY_VERSION );
+		m_sec_man->sec_copy_attribute( *m_policy, m_auth_info, ATTR_SEC_CLASSAD_BINARY_VERSION );
 		m_sec_man->sec_copy_attribute( *m_policy, pa_ad, ATTR_SEC_USER );
 		m_sec_man->sec_copy_attribute( *m_policy, pa_ad, ATTR_SEC_SID );
 		m_sec_man->sec_copy_attribute( *m_policy, pa_ad, ATTR_SEC_VALID_COMMANDS );
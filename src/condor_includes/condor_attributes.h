@@ -750,6 +750,8 @@
 #define ATTR_UID_DOMAIN  "UidDomain"
 #define ATTR_ULOG_FILE  "UserLog"
 #define ATTR_ULOG_USE_XML  "UserLogUseXML"
+#define ATTR_UPDATE_DELTA_BASE_SEQUENCE  "UpdateDeltaBaseSequence"
+#define ATTR_UPDATE_DELTA_REMOVED_ATTRS  "UpdateDeltaRemovedAttrs"
 #define ATTR_UPDATE_INTERVAL  "UpdateInterval"
 #define ATTR_CLASSAD_LIFETIME  "ClassAdLifetime"
 #define ATTR_UPDATE_PRIO  "UpdatePrio"
@@ -880,6 +882,7 @@
 #define ATTR_SEC_SUBSYSTEM  "Subsystem"
 #define ATTR_SEC_REMOTE_VERSION  "RemoteVersion"
 #define ATTR_SEC_SHORT_VERSION  "ShortVersion"
+#define ATTR_SEC_CLASSAD_BINARY_VERSION  "ClassAdBinaryVersion"
 #define ATTR_SEC_SERVER_ENDPOINT  "ServerEndpoint"
 #define ATTR_SEC_SERVER_COMMAND_SOCK  "ServerCommandSock"
 #define ATTR_SEC_SERVER_PID  "ServerPid"
@@ -354,6 +354,9 @@ const int UPDATE_OWN_SUBMITTOR_AD = 80;
 // Request a collector to retrieve an identity token from a schedd.
 const int IMPERSONATION_TOKEN_REQUEST = 81;
 
+// Only the attributes of a startd ad that changed since an earlier update
+const int UPDATE_STARTD_AD_DELTA = 82;
+
 /* these comments are used to control command_table_generator.pl
 NAMETABLE_DIRECTIVE:END_SECTION:collector
 */
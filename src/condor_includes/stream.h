@@ -44,6 +44,12 @@ const condor_mode_t NULL_FILE_PERMISSIONS = (condor_mode_t)0;
 
 #include "proc.h"
 
+namespace classad {
+class ClassAdBinaryUnParser;
+class ClassAdBinaryParser;
+class ClassAdParser;
+}
+
 /** @name Special Types
     We need to define a special code() method for certain integer arguments.
     To take advantage of overloading, we need make these arguments have a
@@ -504,6 +510,24 @@ public:
 	/// Set the peer's version.
 	void set_peer_version(CondorVersionInfo const *version);
 
+	/// The version of the binary ClassAd encoding the peer said it can
+	/// read during the security handshake, or 0 if it did not say.
+	int get_peer_classad_binary_version() const { return m_peer_classad_binary_version; }
+	void set_peer_classad_binary_version(int version) { m_peer_classad_binary_version = version; }
+
+	/// The encoder and decoder of ClassAds in binary form for this
+	/// connection, which hold the names sent so far.  See putClassAd().
+	classad::ClassAdBinaryUnParser *get_classad_binary_unparser();
+	classad::ClassAdBinaryParser *get_classad_binary_parser();
+
+	/// The parser for expressions of ClassAds received as text on this
+	/// connection, kept so a stream of ads doesn't build one per ad.
+	classad::ClassAdParser *get_classad_parser();
+
+	/// Forget the names sent and received as part of binary ClassAds.
+	/// Done when the connection is closed.
+	void reset_classad_binary_state();
+
 	/** Get this stream's type.
         @return the type of this stream
     */
@@ -587,6 +611,10 @@ protected:
 	int decrypt_buf_len;
 	char *m_peer_description_str;
 	CondorVersionInfo *m_peer_version;
+	int m_peer_classad_binary_version;
+	classad::ClassAdBinaryUnParser *m_classad_unparser;
+	classad::ClassAdBinaryParser *m_classad_parser;
+	classad::ClassAdParser *m_classad_text_parser;
 
 	time_t m_deadline_time;
 	static int timeout_multiplier;
@@ -36,6 +36,7 @@
 #include "condor_ipverify.h"
 #include "condor_secman.h"
 #include "classad_merge.h"
+#include "classad/binaryCodec.h"
 #include "daemon.h"
 #include "subsystem_info.h"
 #include "setenv.h"
@@ -1664,9 +1665,13 @@ SecManStartCommand::sendAuthInfo_inner()
 		CondorVersionInfo ver_info(m_remote_version.c_str());
 		m_sock->set_peer_version(&ver_info);
 	}
+	int classad_binary_version = 0;
+	m_auth_info.LookupInteger(ATTR_SEC_CLASSAD_BINARY_VERSION, classad_binary_version);
+	m_sock->set_peer_classad_binary_version(classad_binary_version);
 
 	// fill in our version
 	m_auth_info.Assign(ATTR_SEC_REMOTE_VERSION,CondorVersion());
+	m_auth_info.Assign(ATTR_SEC_CLASSAD_BINARY_VERSION, classad::BINARY_CLASSAD_VERSION);
 
 	// fill in return address, if we are a daemon
 	char const* dcss = global_dc_sinful();
@@ -1932,6 +1937,11 @@ SecManStartCommand::receiveAuthInfo_inner()
 				CondorVersionInfo ver_info(m_remote_version.c_str());
 				m_sock->set_peer_version(&ver_info);
 			}
+			m_auth_info.Delete(ATTR_SEC_CLASSAD_BINARY_VERSION);
+			m_sec_man.sec_copy_attribute( m_auth_info, auth_response, ATTR_SEC_CLASSAD_BINARY_VERSION );
+			int classad_binary_version = 0;
+			m_auth_info.LookupInteger(ATTR_SEC_CLASSAD_BINARY_VERSION, classad_binary_version);
+			m_sock->set_peer_classad_binary_version(classad_binary_version);
 			m_sec_man.sec_copy_attribute( m_auth_info, auth_response, ATTR_SEC_ENACT );
 			m_sec_man.sec_copy_attribute( m_auth_info, auth_response, ATTR_SEC_AUTHENTICATION_METHODS_LIST );
 			m_sec_man.sec_copy_attribute( m_auth_info, auth_response, ATTR_SEC_AUTHENTICATION_METHODS );
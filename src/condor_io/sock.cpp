@@ -1891,6 +1891,9 @@ int Sock::close()
 	setFullyQualifiedUser(NULL);
 	setTriedAuthentication(false);
 
+	// and the names sent in binary ClassAds, which are per connection
+	reset_classad_binary_state();
+
 	return TRUE;
 }
 
@@ -25,6 +25,7 @@
 #include "condor_debug.h"
 #include "MyString.h"
 #include "utilfns.h"
+#include "classad/binaryCodec.h"
 
 // initialize static data members
 int Stream::timeout_multiplier = 0;
@@ -58,6 +59,10 @@ Stream :: Stream() :
 	decrypt_buf_len(0),
 	m_peer_description_str(NULL),
 	m_peer_version(NULL),
+	m_peer_classad_binary_version(0),
+	m_classad_unparser(NULL),
+	m_classad_parser(NULL),
+	m_classad_text_parser(NULL),
 	m_deadline_time(0),
 	ignore_timeout_multiplier(false)
 {
@@ -91,6 +96,9 @@ Stream :: ~Stream()
 	if( m_peer_version ) {
 		delete m_peer_version;
 	}
+	delete m_classad_unparser;
+	delete m_classad_parser;
+	delete m_classad_text_parser;
 }
 
 int 
@@ -1534,6 +1542,44 @@ Stream::set_peer_version(CondorVersionInfo const *version)
 	}
 }
 
+classad::ClassAdBinaryUnParser *
+Stream::get_classad_binary_unparser()
+{
+	if( !m_classad_unparser ) {
+		m_classad_unparser = new classad::ClassAdBinaryUnParser();
+		m_classad_unparser->SetUseDictionary( true );
+	}
+	return m_classad_unparser;
+}
+
+classad::ClassAdBinaryParser *
+Stream::get_classad_binary_parser()
+{
+	if( !m_classad_parser ) {
+		m_classad_parser = new classad::ClassAdBinaryParser();
+	}
+	return m_classad_parser;
+}
+
+classad::ClassAdParser *
+Stream::get_classad_parser()
+{
+	if( !m_classad_text_parser ) {
+		m_classad_text_parser = new classad::ClassAdParser();
+		m_classad_text_parser->SetOldClassAd( true );
+	}
+	return m_classad_text_parser;
+}
+
+void
+Stream::reset_classad_binary_state()
+{
+	delete m_classad_unparser;
+	m_classad_unparser = NULL;
+	delete m_classad_parser;
+	m_classad_parser = NULL;
+}
+
 void
 Stream::set_deadline_timeout(int t)
 {
@@ -1436,7 +1436,7 @@ JobRouter::AcceptingMoreJobs() {
 
 bool
 CombineParentAndChildClassAd(classad::ClassAd *dest,classad::ClassAd *ad,classad::ClassAd *parent) {
-	classad::AttrList::const_iterator itr;
+	classad::ClassAd::const_iterator itr;
 	classad::ExprTree *tree;
 
 	if(parent) *dest = *parent;
@@ -3428,7 +3428,7 @@ JobRoute::ParseClassAd(std::string routing_string,int &offset,classad::ClassAd c
 
 bool
 JobRoute::ApplyRoutingJobEdits(classad::ClassAd *src_ad) {
-	classad::AttrList::const_iterator itr;
+	classad::ClassAd::const_iterator itr;
 	classad::ExprTree *tree;
 
 	src_ad->DisableDirtyTracking();
@@ -44,6 +44,7 @@
 #include "condor_classad.h"
 #include "subsystem_info.h"
 #include "authentication.h"
+#include "classad/evalProfile.h"
 
 #include <vector>
 #include <string>
@@ -67,8 +68,9 @@ extern bool user_map_do_mapping(const char * mapname, const char * input, MyStri
 
 static int jobsInSlot(ClassAd &job, ClassAd &offer);
 
-// possible outcomes of negotiating with a schedd
-enum { MM_ERROR, MM_DONE, MM_RESUME };
+// possible outcomes of negotiating with a schedd, and, from
+// negotiateStep(), that it can go on now or must wait on the schedd
+enum { MM_ERROR, MM_DONE, MM_RESUME, MM_CONTINUE, MM_WAIT };
 
 // possible outcomes of a matchmaking attempt
 enum { _MM_ERROR, MM_NO_MATCH, MM_GOOD_MATCH, MM_BAD_MATCH };
@@ -165,6 +167,11 @@ NegotiationCycleStats::NegotiationCycleStats():
 }
 
 
+// The projection of claimed machine ads when not considering preemption.
+// LastHeardFrom and UpdateSequenceNumber are for NEGOTIATOR_INCREMENTAL_ADS.
+static const char *ClaimedMachineProjection =
+	"ifThenElse(State == \"Claimed\",\"Name MyType State Activity StartdIpAddr AccountingGroup Owner RemoteUser Requirements SlotWeight ConcurrencyLimits LastHeardFrom UpdateSequenceNumber\",\"\") ";
+
 static MyString MachineAdID(ClassAd * ad)
 {
 	ASSERT(ad);
@@ -457,6 +464,13 @@ Matchmaker ()
 											 ResourcesInUseByUsersGroup_classad_func );
 	slotWeightStr = 0;
 	m_staticRanks = false;
+	m_useSlotClasses = false;
+	m_slotClassesThisCycle = false;
+	m_useSlotIndex = false;
+	m_incrementalAds = false;
+	m_incrementalAdsRefresh = 0;
+	m_lastFullAdFetch = 0;
+	m_prefetch = NULL;
 	m_dryrun = false;
 }
 
@@ -486,6 +500,7 @@ Matchmaker::
 	if (groupQuotasHash) delete groupQuotasHash;
 	if (stashedAds) delete stashedAds;
     if (strSlotConstraint) free(strSlotConstraint), strSlotConstraint = NULL;
+	clearMachineAdCache();
 
 	int i;
 	for(i=0;i<MAX_NEGOTIATION_CYCLE_STATS;i++) {
@@ -494,6 +509,10 @@ Matchmaker::
 
     if (NULL != hgq_root_group) delete hgq_root_group;
 
+	for (size_t i = 0; i < m_slotScanContexts.size(); i++) {
+		delete m_slotScanContexts[i];
+	}
+
 	matchmaker_for_classad_func = NULL;
 }
 
@@ -842,6 +861,15 @@ reinitialize ()
 	ASSERT( num_negotiation_cycle_stats <= MAX_NEGOTIATION_CYCLE_STATS );
 
 	m_staticRanks = param_boolean("NEGOTIATOR_IGNORE_JOB_RANKS", false);
+	m_useSlotClasses = param_boolean("NEGOTIATOR_SLOT_EQUIVALENCE_CLASSES", false);
+	m_useSlotIndex = param_boolean("NEGOTIATOR_SLOT_INDEX", false);
+
+		// The cached machine ads were prepared under the old config.
+	m_incrementalAds = param_boolean("NEGOTIATOR_INCREMENTAL_ADS", false);
+	m_incrementalAdsRefresh = param_integer("NEGOTIATOR_INCREMENTAL_ADS_REFRESH", 3600, 0);
+	clearMachineAdCache();
+
+	configureSlotScan();
 
 	if( first_time ) {
 		first_time = false;
@@ -1319,9 +1347,11 @@ compute_significant_attrs(ClassAdListDoesNotDeleteAds & startdAds)
 		if ( !sample_startd_ad ) {
 			sample_startd_ad = new ClassAd(*startd_ad);
 		}
+			// iterate through a const ad, so as not to thaw a frozen one
+		const ClassAd *const_ad = startd_ad;
 		classad::ClassAd::const_iterator attr_it;
-		for ( attr_it = startd_ad->begin(); attr_it != startd_ad->end(); attr_it++ ) {
-			startd_ad->GetExternalReferences( attr_it->second, external_references, true );
+		for ( attr_it = const_ad->begin(); attr_it != const_ad->end(); attr_it++ ) {
+			const_ad->GetExternalReferences( attr_it->second, external_references, true );
 		}
 	}	// while startd_ad
 
@@ -1558,6 +1588,10 @@ negotiationTime ()
 
 	time_t start_time = time(NULL);
 
+	if ( classad::EvalProfile::IsEnabled() ) {
+		classad::EvalProfile::Reset();
+	}
+
 	GotRescheduleCmd=false;  // Reset the reschedule cmd flag
 
 	// We need to nuke our MatchList from the previous negotiation cycle,
@@ -1613,6 +1647,8 @@ negotiationTime ()
 		free(job_attr_references);
 	}
 	job_attr_references = compute_significant_attrs(startdAds);
+	resetSlotClasses();
+	m_slotIndex.clear();
 
 	// ----- Recalculate priorities for schedds
 	accountant.UpdatePriorities();
@@ -2048,6 +2084,12 @@ negotiationTime ()
     // ----- Done with the negotiation cycle
     dprintf( D_ALWAYS, "---------- Finished Negotiation Cycle ----------\n" );
 
+    if ( classad::EvalProfile::IsEnabled() ) {
+        std::string profile;
+        classad::EvalProfile::Format( profile );
+        dprintf( D_ALWAYS, "ClassAd evaluation profile for this cycle:\n%s", profile.c_str() );
+    }
+
     completedLastCycleTime = time(NULL);
 
     negotiation_cycle_stats[0]->end_time = completedLastCycleTime;
@@ -2340,6 +2382,67 @@ consolidate_globaljobprio_submitter_ads(ClassAdListDoesNotDeleteAds& submitterAd
 	return true;
 }
 
+	// The state of a negotiation with one submitter, kept from one
+	// negotiateStep() to the next.
+struct Matchmaker::NegotiationSession
+{
+	NegotiationSession();
+
+		// who we negotiate for, and within what limits
+	char const *groupName;
+	std::string submitterName;
+	ClassAd *submitterAd;
+	std::string scheddAddr;
+	std::string schedd_id;	// for log messages only, as it may change
+	double priority;
+	double submitterLimit;
+	double submitterLimitUnclaimed;
+	int submitterCeiling;
+	bool ignore_schedd_limit;
+	time_t beginTime;
+	time_t deadline;
+
+		// the conversation with the schedd
+	ReliSock *sock;
+	classad_shared_ptr<ResourceRequestList> request_list;
+	int schedd_will_match;	// extra jobs the schedd will put into a partitionable slot
+	time_t waitDeadline;	// when waiting on the schedd gives up; 0 if not waiting
+
+		// how far it has got
+	int numMatched;
+	double limitUsed;
+	double limitUsedUnclaimed;
+	bool only_consider_startd_rank;
+	bool display_overlimit;
+	bool limited_by_submitterLimit;
+
+		// the reasons for the last rejection, which stand in for the
+		// Matchmaker's own while this session is stepped
+	int rejForNetwork;
+	int rejForNetworkShare;
+	int rejForConcurrencyLimit;
+	int rejPreemptForPrio;
+	int rejPreemptForPolicy;
+	int rejPreemptForRank;
+	int rejForSubmitterLimit;
+	int rejForSubmitterCeiling;
+	std::set<std::string> rejectedConcurrencyLimits;
+};
+
+Matchmaker::NegotiationSession::NegotiationSession()
+	: groupName(NULL), submitterAd(NULL), priority(0.0),
+	submitterLimit(0.0), submitterLimitUnclaimed(0.0), submitterCeiling(0),
+	ignore_schedd_limit(false), beginTime(0), deadline(0),
+	sock(NULL), schedd_will_match(1), waitDeadline(0),
+	numMatched(0), limitUsed(0.0), limitUsedUnclaimed(0.0),
+	only_consider_startd_rank(false), display_overlimit(true),
+	limited_by_submitterLimit(false),
+	rejForNetwork(0), rejForNetworkShare(0), rejForConcurrencyLimit(0),
+	rejPreemptForPrio(0), rejPreemptForPolicy(0), rejPreemptForRank(0),
+	rejForSubmitterLimit(0), rejForSubmitterCeiling(0)
+{
+}
+
 int Matchmaker::
 negotiateWithGroup ( int untrimmed_num_startds,
 					 double untrimmedSlotWeightTotal,
@@ -2377,6 +2480,8 @@ negotiateWithGroup ( int untrimmed_num_startds,
 	double start_usage_phase4 = get_rusage_utime();
 	time_t start_time_prefetch = 0;
 	double start_usage_prefetch = 0.0;
+	int maxSessions = param_integer("NEGOTIATOR_CONCURRENT_NEGOTIATIONS");
+	std::vector<NegotiationSession *> sessions;
 
 	negotiation_cycle_stats[0]->pies++;
 
@@ -2504,6 +2609,15 @@ negotiateWithGroup ( int untrimmed_num_startds,
 				continue;
 			}
 
+			// With NEGOTIATOR_CONCURRENT_NEGOTIATIONS, make room for this
+			// submitter first: one session per schedd, since its socket
+			// carries one conversation at a time, and maxSessions in all.
+			while ( !sessions.empty() &&
+					(m_busySchedds.count(scheddAddr) || (int)sessions.size() >= maxSessions) )
+			{
+				finishSession(sessions, startdAds, claimIds, submitterAds, pieLeft, scheddUsed);
+			}
+
 			num_idle_jobs = 0;
 			submitter_ad->LookupInteger(ATTR_IDLE_JOBS,num_idle_jobs);
 			if ( num_idle_jobs < 0 ) {
@@ -2683,53 +2797,42 @@ negotiateWithGroup ( int untrimmed_num_startds,
                 }
 				negotiation_cycle_stats[0]->active_submitters.insert(submitterName.c_str());
 				negotiation_cycle_stats[0]->active_schedds.insert(scheddAddr.c_str());
-				result=negotiate(groupName, submitterName.c_str(), submitter_ad, submitterPrio,
-                              submitterLimit, submitterLimitUnclaimed, submitterCeiling,
-							  startdAds, claimIds,
-							  ignore_submitter_limit,
-							  deadline, numMatched, pieLeft);
+				if (maxSessions > 1) {
+					NegotiationSession *session = new NegotiationSession();
+					session->groupName = groupName;
+					session->submitterName = submitterName;
+					session->submitterAd = submitter_ad;
+					session->priority = submitterPrio;
+					session->submitterLimit = submitterLimit;
+					session->submitterLimitUnclaimed = submitterLimitUnclaimed;
+					session->submitterCeiling = submitterCeiling;
+					session->ignore_schedd_limit = ignore_submitter_limit;
+					session->deadline = deadline;
+					if (startSession(*session)) {
+						// finishSession() sees it through from here
+						sessions.push_back(session);
+						continue;
+					}
+					delete session;
+					result = MM_ERROR;
+				} else {
+					result=negotiate(groupName, submitterName.c_str(), submitter_ad, submitterPrio,
+								  submitterLimit, submitterLimitUnclaimed, submitterCeiling,
+								  startdAds, claimIds,
+								  ignore_submitter_limit,
+								  deadline, numMatched, pieLeft);
+				}
 				updateNegCycleEndTime(startTime, submitter_ad);
 			}
 
-			switch (result)
-			{
-				case MM_RESUME:
-					// the schedd hit its resource limit.  must resume
-					// negotiations in next spin
-					scheddUsed += accountant.GetWeightedResourcesUsed(submitterName);
-                    negotiation_cycle_stats[0]->submitters_share_limit.insert(submitterName.c_str());
-					dprintf(D_FULLDEBUG, "  This submitter hit its submitterLimit.\n");
-					break;
-				case MM_DONE:
-					if (rejForNetworkShare) {
-							// We negotiated for all jobs, but some
-							// jobs were rejected because this user
-							// exceeded her fair-share of network
-							// resources.  Resume negotiations for
-							// this user in next spin.
-					} else {
-							// the schedd got all the resources it
-							// wanted. delete this schedd ad.
-						dprintf(D_FULLDEBUG,"  Submitter %s got all it wants; removing it.\n", submitterName.c_str());
-                        scheddUsed += accountant.GetWeightedResourcesUsed(submitterName);
-                        dprintf( D_FULLDEBUG, " resources used by %s are %f\n",submitterName.c_str(),
-                                 accountant.GetWeightedResourcesUsed(submitterName));
-						submitterAds.Remove( submitter_ad );
-					}
-					break;
-				case MM_ERROR:
-				default:
-					dprintf(D_ALWAYS,"  Error: Ignoring submitter for this cycle\n" );
-					sockCache->invalidateSock( scheddAddr.c_str() );
-	
-					scheddUsed += accountant.GetWeightedResourcesUsed(submitterName);
-					dprintf( D_FULLDEBUG, " resources used by %s are %f\n",submitterName.c_str(),
-						    accountant.GetWeightedResourcesUsed(submitterName));
-					submitterAds.Remove( submitter_ad );
-					negotiation_cycle_stats[0]->submitters_failed.insert(submitterName.c_str());
-			}
+			finishSubmitter(result, submitter_ad, submitterName, scheddAddr,
+							submitterAds, scheddUsed);
+		}
+		while ( !sessions.empty() ) {
+			finishSession(sessions, startdAds, claimIds, submitterAds, pieLeft, scheddUsed);
 		}
 		submitterAds.Close();
+		finishPrefetch();
 		dprintf( D_FULLDEBUG, " resources used scheddUsed= %f\n",scheddUsed);
 
 	} while ( ( pieLeft < pieLeftOrig || submitterAds.MyLength() < submitterAdsCountOrig )
@@ -3059,6 +3162,15 @@ obtainAdsFromCollector (
 
     cp_resources = false;
 
+		// With NEGOTIATOR_INCREMENTAL_ADS, fetch every machine ad only
+		// now and then, and otherwise just the ones that have changed.
+	bool incremental = m_incrementalAds && m_lastFullAdFetch &&
+		( m_incrementalAdsRefresh <= 0 ||
+		  time(NULL) < m_lastFullAdFetch + m_incrementalAdsRefresh );
+	if ( !incremental ) {
+		clearMachineAdCache();
+	}
+
     // build a query for Scheduler, Submitter and (constrained) machine ads
     //
 	CondorQuery publicQuery(ANY_AD);
@@ -3070,7 +3182,9 @@ obtainAdsFromCollector (
 	} else {
 		publicQuery.addORConstraint("(MyType == \"Submitter\")");
 	}
-    if (strSlotConstraint && strSlotConstraint[0]) {
+    if (incremental) {
+        // machine ads come from fetchChangedMachineAds() instead
+    } else if (strSlotConstraint && strSlotConstraint[0]) {
         formatstr(constraint, "((MyType == \"Machine\") && (%s))", strSlotConstraint);
         publicQuery.addORConstraint(constraint.c_str());
     } else {
@@ -3081,11 +3195,9 @@ obtainAdsFromCollector (
 	// Ask for that projection.
 
 	if (!ConsiderPreemption) {
-		const char *projectionString =
-			"ifThenElse(State == \"Claimed\",\"Name MyType State Activity StartdIpAddr AccountingGroup Owner RemoteUser Requirements SlotWeight ConcurrencyLimits\",\"\") ";
-		publicQuery.setDesiredAttrsExpr(projectionString);
+		publicQuery.setDesiredAttrsExpr(ClaimedMachineProjection);
 
-		dprintf(D_ALWAYS, "Not considering preemption, therefore constraining idle machines with %s\n", projectionString);
+		dprintf(D_ALWAYS, "Not considering preemption, therefore constraining idle machines with %s\n", ClaimedMachineProjection);
 	}
 
 	dprintf(D_ALWAYS,"  Getting startd private ads ...\n");
@@ -3106,6 +3218,11 @@ obtainAdsFromCollector (
 		return false;
 	}
 
+	std::vector<ClassAd *> unchanged;
+	if (incremental && !fetchChangedMachineAds(collects, allAds, unchanged)) {
+		return false;
+	}
+
 	dprintf(D_ALWAYS, "  Sorting %d ads ...\n",allAds.MyLength());
 
 	allAds.Open();
@@ -3125,6 +3242,8 @@ obtainAdsFromCollector (
 			ad->LookupBool(ATTR_WANT_AD_REVAULATE, reevaluate_ad);
 			newSequence = -1;	
 			ad->LookupInteger(ATTR_UPDATE_SEQUENCE_NUMBER, newSequence);
+			int lastHeardFrom = 0;
+			ad->LookupInteger(ATTR_LAST_HEARD_FROM, lastHeardFrom);
 
 			if(!ad->LookupString(ATTR_NAME, &remoteHost)) {
 				dprintf(D_FULLDEBUG,"Rejecting unnamed startd ad.\n");
@@ -3261,7 +3380,16 @@ obtainAdsFromCollector (
 
 			OptimizeMachineAdForMatchmaking( ad );
 
+				// Only the ads that get matched are modified after this
+			ad->Freeze();
+
 			startdAds.Insert(ad);
+
+				// Ads that the negotiator swaps for stashed ones aren't
+				// reused; fetchChangedMachineAds() always fetches them.
+			if (m_incrementalAds && !reevaluate_ad) {
+				cacheMachineAd(ad, MachineAdID(ad), lastHeardFrom, newSequence);
+			}
 		} else if( !strcmp(GetMyTypeName(*ad),SUBMITTER_ADTYPE) ) {
 
             std::string subname;
@@ -3339,6 +3467,21 @@ obtainAdsFromCollector (
 	}
 	allAds.Close();
 
+	for (size_t i = 0; i < unchanged.size(); i++) {
+		ad = new ClassAd(*unchanged[i]);
+		ad->Freeze();
+		if (!cp_resources && cp_supports_policy(*ad)) {
+			cp_resources = true;
+		}
+		allAds.Insert(ad);
+		startdAds.Insert(ad);
+	}
+	if (incremental) {
+		dprintf(D_ALWAYS, "  Reused %d unchanged machine ads\n", (int)unchanged.size());
+	} else if (m_incrementalAds) {
+		m_lastFullAdFetch = time(NULL);
+	}
+
 	// In the processing of allAds above, if want_globaljobprio is true,
 	// we may have created additional submitter ads and inserted them
 	// into submitterAds on the fly.
@@ -3378,6 +3521,170 @@ obtainAdsFromCollector (
 	return true;
 }
 
+// For NEGOTIATOR_INCREMENTAL_ADS: find which of the machine ads in the
+// collector are new or have changed since they were cached, by fetching
+// just the attributes that say so for every ad, then fetch the whole of
+// those, which are the ones heard from since the oldest of them was (the
+// watermark).  The changed ads go in allAds, to be prepared as usual; the
+// cached ads that are still current go in unchanged, and the rest are
+// dropped from the cache.
+bool Matchmaker::
+fetchChangedMachineAds(CollectorList *collects, ClassAdList &allAds,
+                       std::vector<ClassAd *> &unchanged)
+{
+	static const char * const keyAttrs[] = {
+		ATTR_NAME, ATTR_STARTD_IP_ADDR, ATTR_LAST_HEARD_FROM,
+		ATTR_UPDATE_SEQUENCE_NUMBER, ATTR_WANT_AD_REVAULATE, NULL
+	};
+	std::map<std::string, CachedMachineAd>::iterator it;
+	ClassAdList keyAds;
+	ClassAd *ad;
+	CondorError errstack;
+
+	CondorQuery keyQuery(STARTD_AD);
+	if (strSlotConstraint && strSlotConstraint[0]) {
+		keyQuery.addANDConstraint(strSlotConstraint);
+	}
+	keyQuery.setDesiredAttrs(keyAttrs);
+
+	dprintf(D_ALWAYS, "  Getting the update times of Machine ads ...\n");
+	QueryResult result = collects->query(keyQuery, keyAds, &errstack);
+	if (result != Q_OK) {
+		dprintf(D_ALWAYS, "Couldn't fetch ads: %s\n",
+			errstack.code() ? errstack.getFullText(false).c_str() : getStrQueryResult(result));
+		return false;
+	}
+
+	std::set<std::string> current;
+	int watermark = INT_MAX;
+	int changed = 0;
+	bool want_reevaluate = false;
+	keyAds.Open();
+	while ((ad = keyAds.Next())) {
+		if (!ad->LookupExpr(ATTR_NAME)) {
+			continue;
+		}
+		bool reevaluate_ad = false;
+		int lastHeardFrom = 0;
+		int sequence = -1;
+		ad->LookupBool(ATTR_WANT_AD_REVAULATE, reevaluate_ad);
+		ad->LookupInteger(ATTR_LAST_HEARD_FROM, lastHeardFrom);
+		ad->LookupInteger(ATTR_UPDATE_SEQUENCE_NUMBER, sequence);
+		if (reevaluate_ad) {
+			want_reevaluate = true;
+			continue;
+		}
+		std::string adID = MachineAdID(ad).Value();
+		it = m_machineAdCache.find(adID);
+		if (it != m_machineAdCache.end() &&
+			it->second.lastHeardFrom == lastHeardFrom &&
+			it->second.sequence == sequence)
+		{
+			current.insert(adID);
+		} else {
+			watermark = MIN(watermark, lastHeardFrom);
+			changed++;
+		}
+	}
+	keyAds.Close();
+
+	for (it = m_machineAdCache.begin(); it != m_machineAdCache.end(); ) {
+		if (current.count(it->first)) {
+			it++;
+		} else {
+			delete it->second.ad;
+			m_machineAdCache.erase(it++);
+		}
+	}
+
+	if (changed || want_reevaluate) {
+		std::string since;
+		if (changed) {
+			formatstr(since, "(%s >= %d)", ATTR_LAST_HEARD_FROM, watermark);
+		}
+		if (want_reevaluate) {
+			formatstr_cat(since, "%s(%s =?= true)", since.empty() ? "" : " || ",
+				ATTR_WANT_AD_REVAULATE);
+		}
+		CondorQuery adQuery(STARTD_AD);
+		if (strSlotConstraint && strSlotConstraint[0]) {
+			adQuery.addANDConstraint(strSlotConstraint);
+		}
+		adQuery.addANDConstraint(since.c_str());
+		if (!ConsiderPreemption) {
+			adQuery.setDesiredAttrsExpr(ClaimedMachineProjection);
+		}
+
+		dprintf(D_ALWAYS, "  Getting %d changed Machine ads ...\n", changed);
+		ClassAdList changedAds;
+		result = collects->query(adQuery, changedAds, &errstack);
+		if (result != Q_OK) {
+			dprintf(D_ALWAYS, "Couldn't fetch ads: %s\n",
+				errstack.code() ? errstack.getFullText(false).c_str() : getStrQueryResult(result));
+			return false;
+		}
+
+			// Ads heard from since the watermark may still be the ones
+			// cached, unless they changed after the first query.
+		std::vector<ClassAd *> fetched;
+		changedAds.Open();
+		while ((ad = changedAds.Next())) {
+			if (!ad->LookupExpr(ATTR_NAME)) {
+				continue;
+			}
+			int lastHeardFrom = 0;
+			int sequence = -1;
+			ad->LookupInteger(ATTR_LAST_HEARD_FROM, lastHeardFrom);
+			ad->LookupInteger(ATTR_UPDATE_SEQUENCE_NUMBER, sequence);
+			it = m_machineAdCache.find(MachineAdID(ad).Value());
+			if (it != m_machineAdCache.end()) {
+				if (it->second.lastHeardFrom == lastHeardFrom &&
+					it->second.sequence == sequence) {
+					continue;
+				}
+				delete it->second.ad;
+				m_machineAdCache.erase(it);
+			}
+			fetched.push_back(ad);
+		}
+		changedAds.Close();
+		for (size_t i = 0; i < fetched.size(); i++) {
+			changedAds.Remove(fetched[i]);
+			allAds.Insert(fetched[i]);
+		}
+	}
+
+	unchanged.clear();
+	for (it = m_machineAdCache.begin(); it != m_machineAdCache.end(); it++) {
+		unchanged.push_back(it->second.ad);
+	}
+	return true;
+}
+
+void Matchmaker::
+cacheMachineAd(ClassAd *ad, const MyString &adID, int lastHeardFrom, int sequence)
+{
+	CachedMachineAd &cached = m_machineAdCache[adID.Value()];
+	if (cached.ad) {
+		delete cached.ad;
+	}
+	cached.ad = new ClassAd(*ad);
+	cached.ad->Freeze();
+	cached.lastHeardFrom = lastHeardFrom;
+	cached.sequence = sequence;
+}
+
+void Matchmaker::
+clearMachineAdCache()
+{
+	std::map<std::string, CachedMachineAd>::iterator it;
+	for (it = m_machineAdCache.begin(); it != m_machineAdCache.end(); it++) {
+		delete it->second.ad;
+	}
+	m_machineAdCache.clear();
+	m_lastFullAdFetch = 0;
+}
+
 void
 Matchmaker::OptimizeMachineAdForMatchmaking(ClassAd *ad)
 {
@@ -3552,8 +3859,23 @@ typedef std::map<std::string, ScheddWorkPtr> ScheddWorkMap;
 typedef classad_shared_ptr<ResourceRequestList> RRLPtr;
 typedef std::map<std::string, std::pair<ClassAd*, RRLPtr> > CurrentWorkMap;
 
+	// The prefetch conversations of a spin of the pie: the submitters
+	// still to be prefetched for each schedd, and the conversation (at
+	// most one) in progress with each.
+struct Matchmaker::PrefetchState
+{
+	ScheddWorkMap scheddWorkQueues;
+	CurrentWorkMap currentWork;
+	unsigned attemptedPrefetches;
+	unsigned successfulPrefetches;
+	int prefetchTimeout;
+	int prefetchCycle;
+	double deadline;
+	bool concurrent;	// NEGOTIATOR_CONCURRENT_PREFETCH
+};
+
 static bool
-assignWork(const ScheddWorkMap &workMap, CurrentWorkMap &curWork, ScheddWork &negotiations)
+assignWork(const ScheddWorkMap &workMap, CurrentWorkMap &curWork, ScheddWork &negotiations, const std::set<std::string> &busySchedds)
 {
 	negotiations.clear();
 	unsigned workAssigned = 0;
@@ -3561,6 +3883,8 @@ assignWork(const ScheddWorkMap &workMap, CurrentWorkMap &curWork, ScheddWork &ne
 	{
 		if (!schedd_it->second.get()) {continue;} // null pointer.
 
+		if (busySchedds.count(schedd_it->first)) {continue;} // Negotiating with this schedd now.
+
 		CurrentWorkMap::iterator cur_it = curWork.find(schedd_it->first);
 		if (cur_it != curWork.end()) {continue;} // Already work for this schedd.
 
@@ -3587,10 +3911,11 @@ Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterA
 		return;
 	}
 
-	ReliSock *sock;
-
 	m_cachedRRLs.clear();
-	ScheddWorkMap scheddWorkQueues;
+	delete m_prefetch;
+	m_prefetch = new PrefetchState();
+	PrefetchState &state = *m_prefetch;
+	ScheddWorkMap &scheddWorkQueues = state.scheddWorkQueues;
 	submitterAds.Open();
 	ClassAd *submitterAd;
 	unsigned todoPrefetches = 0;
@@ -3618,164 +3943,275 @@ Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterA
 	{
 		sockCache->resize(scheddWorkQueues.size()+1);
 	}
-	
-	CurrentWorkMap currentWork;
-	ScheddWork negotiations;
-	typedef std::map<int, std::pair<ClassAd*, RRLPtr> > FDToRRLMap;
-	FDToRRLMap fdToRRL;
-	unsigned attemptedPrefetches = 0, successfulPrefetches = 0;
+
+	state.attemptedPrefetches = 0;
+	state.successfulPrefetches = 0;
 	double startTime = _condor_debug_get_time_double();
-	int prefetchTimeout = param_integer("NEGOTIATOR_PREFETCH_REQUESTS_TIMEOUT", NegotiatorTimeout);
-	int prefetchCycle = param_integer("NEGOTIATOR_PREFETCH_REQUESTS_MAX_TIME");
-	double deadline = (prefetchCycle > 0) ? (startTime + prefetchCycle) : -1;
+	state.prefetchTimeout = param_integer("NEGOTIATOR_PREFETCH_REQUESTS_TIMEOUT", NegotiatorTimeout);
+	state.prefetchCycle = param_integer("NEGOTIATOR_PREFETCH_REQUESTS_MAX_TIME");
+	state.deadline = (state.prefetchCycle > 0) ? (startTime + state.prefetchCycle) : -1;
+	state.concurrent = param_boolean("NEGOTIATOR_CONCURRENT_PREFETCH", false);
 
-	Selector selector;
-	while (assignWork(scheddWorkQueues, currentWork, negotiations) || !currentWork.empty())
+	if (state.concurrent)
+	{
+			// Just get the conversations going; the rest happens while
+			// we negotiate (see awaitPrefetch() and pollPrefetch()).
+		prefetchRound(0, true);
+		return;
+	}
+
+	while (prefetchRound(state.prefetchTimeout, true))
+		;
+	finishPrefetch();
+}
+
+
+bool
+Matchmaker::prefetchRound(int timeout, bool startNew)
+{
+	PrefetchState &state = *m_prefetch;
+	ScheddWorkMap &scheddWorkQueues = state.scheddWorkQueues;
+	CurrentWorkMap &currentWork = state.currentWork;
+	ReliSock *sock;
+
+	ScheddWork negotiations;
+	bool pastDeadline = (state.deadline >= 0) && (_condor_debug_get_time_double() > state.deadline);
+	if (startNew && !pastDeadline)
+	{
+		assignWork(scheddWorkQueues, currentWork, negotiations, m_busySchedds);
+	}
+	if (negotiations.empty() && currentWork.empty())
+	{
+		return false;
+	}
+
+	dprintf(D_FULLDEBUG, "Starting prefetch loop.\n");
+	// Start a bunch of negotiations
+	for (ScheddWork::const_iterator it=negotiations.begin(); it!=negotiations.end(); it++)
 	{
-		dprintf(D_FULLDEBUG, "Starting prefetch loop.\n");
-		// Start a bunch of negotiations
-		for (ScheddWork::const_iterator it=negotiations.begin(); it!=negotiations.end(); it++)
+		std::string submitter; getSubmitter(**it, submitter);
+		std::string scheddAddr; getScheddAddr(**it, scheddAddr);
+		dprintf(D_ALWAYS, "Starting prefetch negotiation for %s.\n", submitter.c_str());
+		classad_shared_ptr<ResourceRequestList> rrl;
+		state.attemptedPrefetches++;
+		bool success = false;
+		if (startNegotiateProtocol(submitter, **it, sock, rrl))
 		{
-			std::string submitter; getSubmitter(**it, submitter);
-			std::string scheddAddr; getScheddAddr(**it, scheddAddr);
-			dprintf(D_ALWAYS, "Starting prefetch negotiation for %s.\n", submitter.c_str());
-			classad_shared_ptr<ResourceRequestList> rrl;
-			attemptedPrefetches++;
-			bool success = false;
-			if (startNegotiateProtocol(submitter, **it, sock, rrl))
+			switch (rrl->tryRetrieve(sock))
 			{
-				switch (rrl->tryRetrieve(sock))
-				{
-				case ResourceRequestList::RRL_DONE:
-				case ResourceRequestList::RRL_NO_MORE_JOBS:
-				{
-					dprintf(D_FULLDEBUG, "Prefetch negotiation immediately finished.\n");
-					if (rrl->needsEndNegotiateNow()) {endNegotiate(scheddAddr);}
-					std::string hash; makeSubmitterScheddHash(**it, hash);
-					m_cachedRRLs[hash] = rrl;
-					CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
-					if (iter != currentWork.end()) {currentWork.erase(iter);}
-					else {dprintf(D_ALWAYS, "ERROR: Did prefetch work, but couldn't find it in the internal TODO list\n");}
-					success = true;
-					successfulPrefetches++;
-					break;
-				}
-				case ResourceRequestList::RRL_ERROR:
-					success = false;
-					break;
-				case ResourceRequestList::RRL_CONTINUE:
-					dprintf(D_FULLDEBUG, "Prefetch negotiation would block.\n");
-					currentWork[scheddAddr] = std::make_pair(*it, rrl);
-					success = true;
-					break;
-				}
-			}
-			if (!success)
+			case ResourceRequestList::RRL_DONE:
+			case ResourceRequestList::RRL_NO_MORE_JOBS:
 			{
-				dprintf(D_ALWAYS, "Failed to prefetch resource request lists for %s(%s).\n", submitter.c_str(), scheddAddr.c_str());
-				scheddWorkQueues[scheddAddr]->clear();
+				dprintf(D_FULLDEBUG, "Prefetch negotiation immediately finished.\n");
+				if (rrl->needsEndNegotiateNow()) {endNegotiate(scheddAddr);}
+				std::string hash; makeSubmitterScheddHash(**it, hash);
+				m_cachedRRLs[hash] = rrl;
 				CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
 				if (iter != currentWork.end()) {currentWork.erase(iter);}
+				else {dprintf(D_ALWAYS, "ERROR: Did prefetch work, but couldn't find it in the internal TODO list\n");}
+				success = true;
+				state.successfulPrefetches++;
+				break;
+			}
+			case ResourceRequestList::RRL_ERROR:
+				success = false;
+				break;
+			case ResourceRequestList::RRL_CONTINUE:
+				dprintf(D_FULLDEBUG, "Prefetch negotiation would block.\n");
+				currentWork[scheddAddr] = std::make_pair(*it, rrl);
+				success = true;
+				break;
 			}
 		}
-
-		if ((deadline >= 0) && (_condor_debug_get_time_double() > deadline))
+		if (!success)
 		{
-			dprintf(D_ALWAYS, "Prefetch cycle hit deadline of %d; skipping remaining submitters.\n", prefetchCycle);
-			break;
+			dprintf(D_ALWAYS, "Failed to prefetch resource request lists for %s(%s).\n", submitter.c_str(), scheddAddr.c_str());
+			scheddWorkQueues[scheddAddr]->clear();
+			CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
+			if (iter != currentWork.end()) {currentWork.erase(iter);}
 		}
+	}
 
-		// Non-blocking reads of RRLs
-		selector.reset();
-		selector.set_timeout(prefetchTimeout);
+	if (!state.concurrent && (state.deadline >= 0) && (_condor_debug_get_time_double() > state.deadline))
+	{
+		dprintf(D_ALWAYS, "Prefetch cycle hit deadline of %d; skipping remaining submitters.\n", state.prefetchCycle);
+		return false;
+	}
 
-			// Put together the selector.
-		unsigned workCount = 0;
-		fdToRRL.clear();
-		for (CurrentWorkMap::const_iterator it=currentWork.begin(); it!=currentWork.end(); it++)
-		{
-			ReliSock *sock = sockCache->findReliSock(it->first);
-			if (!sock) {continue;}
-			int fd = sock->get_file_desc();
-			selector.add_fd(fd, Selector::IO_READ);
-			fdToRRL[fd] = it->second;
-			workCount++;
-		}
-		if (!workCount) {continue;}
-		dprintf(D_FULLDEBUG, "Waiting on the results of %u negotiation sessions.\n", workCount);
-		selector.execute();
-		if (selector.timed_out() || selector.failed())
+	// Non-blocking reads of RRLs
+	Selector selector;
+	selector.set_timeout(timeout);
+
+		// Put together the selector.
+	typedef std::map<int, std::pair<ClassAd*, RRLPtr> > FDToRRLMap;
+	FDToRRLMap fdToRRL;
+	unsigned workCount = 0;
+	for (CurrentWorkMap::iterator it=currentWork.begin(); it!=currentWork.end(); )
+	{
+		ReliSock *sock = sockCache->findReliSock(it->first);
+		if (!sock)
 		{
-			for (FDToRRLMap::const_iterator it = fdToRRL.begin(); it != fdToRRL.end(); it++)
-			{
-				std::string scheddAddr; getScheddAddr(*(it->second.first), scheddAddr);
-				scheddWorkQueues[scheddAddr]->clear();
-				ReliSock *sock = sockCache->findReliSock(scheddAddr);
-				if (!sock) {continue;}
-				CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
-				if (iter != currentWork.end()) {currentWork.erase(iter);}
-				endNegotiate(scheddAddr);
-				sockCache->invalidateSock(scheddAddr.c_str());
-				if (selector.timed_out()) {dprintf(D_ALWAYS, "Timeout when prefetching from %s; will skip this schedd for the remainder of prefetch cycle.\n", scheddAddr.c_str());}
-				else {dprintf(D_ALWAYS, "Failure when waiting on results of negotiations sessions (%s, errno=%d).\n", strerror(selector.select_errno()), selector.select_errno());}
-			}
+				// The connection has gone; there is nothing to wait for.
+			currentWork.erase(it++);
+			continue;
 		}
-		else
-			// Try getting the RRL for all ready sockets.
+		int fd = sock->get_file_desc();
+		selector.add_fd(fd, Selector::IO_READ);
+		fdToRRL[fd] = it->second;
+		workCount++;
+		it++;
+	}
+	if (!workCount) {return true;}
+	dprintf(D_FULLDEBUG, "Waiting on the results of %u negotiation sessions.\n", workCount);
+	selector.execute();
+	if (selector.timed_out() && ((timeout == 0) || (timeout < state.prefetchTimeout)))
+	{
+		// Just polling, or waiting out what is left of one schedd's
+		// timeout (see awaitPrefetch()), and nothing is ready yet.
+	}
+	else if (selector.timed_out() || selector.failed())
+	{
 		for (FDToRRLMap::const_iterator it = fdToRRL.begin(); it != fdToRRL.end(); it++)
 		{
-			if (!selector.fd_ready(it->first, Selector::IO_READ)) {continue;}
-			ResourceRequestList &rrl = *(it->second.second);
 			std::string scheddAddr; getScheddAddr(*(it->second.first), scheddAddr);
+			scheddWorkQueues[scheddAddr]->clear();
 			ReliSock *sock = sockCache->findReliSock(scheddAddr);
 			if (!sock) {continue;}
-			switch (rrl.tryRetrieve(sock)) {
-			case ResourceRequestList::RRL_DONE:
-			case ResourceRequestList::RRL_NO_MORE_JOBS:
-			{
-					// Successfully prefetched a RRL; cache it in the negotiator.
-				if (rrl.needsEndNegotiateNow()) {endNegotiate(scheddAddr);}
-				std::string hash; makeSubmitterScheddHash(*(it->second.first), hash);
-				m_cachedRRLs[hash] = it->second.second;
-				CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
-				if (iter != currentWork.end()) {currentWork.erase(iter);}
-				successfulPrefetches++;
-				break;
-			}
-			case ResourceRequestList::RRL_ERROR:
-			{
-					// Do not attempt further prefetching with this schedd.
-				scheddWorkQueues[scheddAddr]->clear();
-				CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
-				if (iter != currentWork.end()) {currentWork.erase(iter);}
-				dprintf(D_ALWAYS, "Error when prefetching from %s; will skip this schedd for the remainder of prefetch cycle.\n", scheddAddr.c_str());
-				break;
-			}
-			case ResourceRequestList::RRL_CONTINUE:
-				// Nothing to do.
-				break;
-			}
+			CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
+			if (iter != currentWork.end()) {currentWork.erase(iter);}
+			endNegotiate(scheddAddr);
+			sockCache->invalidateSock(scheddAddr.c_str());
+			if (selector.timed_out()) {dprintf(D_ALWAYS, "Timeout when prefetching from %s; will skip this schedd for the remainder of prefetch cycle.\n", scheddAddr.c_str());}
+			else {dprintf(D_ALWAYS, "Failure when waiting on results of negotiations sessions (%s, errno=%d).\n", strerror(selector.select_errno()), selector.select_errno());}
+		}
+	}
+	else
+		// Try getting the RRL for all ready sockets.
+	for (FDToRRLMap::const_iterator it = fdToRRL.begin(); it != fdToRRL.end(); it++)
+	{
+		if (!selector.fd_ready(it->first, Selector::IO_READ)) {continue;}
+		ResourceRequestList &rrl = *(it->second.second);
+		std::string scheddAddr; getScheddAddr(*(it->second.first), scheddAddr);
+		ReliSock *sock = sockCache->findReliSock(scheddAddr);
+		if (!sock) {continue;}
+		switch (rrl.tryRetrieve(sock)) {
+		case ResourceRequestList::RRL_DONE:
+		case ResourceRequestList::RRL_NO_MORE_JOBS:
+		{
+				// Successfully prefetched a RRL; cache it in the negotiator.
+			if (rrl.needsEndNegotiateNow()) {endNegotiate(scheddAddr);}
+			std::string hash; makeSubmitterScheddHash(*(it->second.first), hash);
+			m_cachedRRLs[hash] = it->second.second;
+			CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
+			if (iter != currentWork.end()) {currentWork.erase(iter);}
+			state.successfulPrefetches++;
+			break;
+		}
+		case ResourceRequestList::RRL_ERROR:
+		{
+				// Do not attempt further prefetching with this schedd.
+			scheddWorkQueues[scheddAddr]->clear();
+			CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
+			if (iter != currentWork.end()) {currentWork.erase(iter);}
+			dprintf(D_ALWAYS, "Error when prefetching from %s; will skip this schedd for the remainder of prefetch cycle.\n", scheddAddr.c_str());
+			break;
+		}
+		case ResourceRequestList::RRL_CONTINUE:
+			// Nothing to do.
+			break;
 		}
+	}
+
+	if (!state.concurrent && (state.deadline >= 0) && (_condor_debug_get_time_double() > state.deadline))
+	{
+		dprintf(D_ALWAYS, "Prefetch cycle hit deadline of %d; skipping remaining submitters.\n", state.prefetchCycle);
+		return false;
+	}
+	return true;
+}
 
-		if ((deadline >= 0) && (_condor_debug_get_time_double() > deadline))
+
+void
+Matchmaker::awaitPrefetch(const ClassAd &submitterAd)
+{
+	if (!m_prefetch || !m_prefetch->concurrent)
+	{
+		return;
+	}
+	std::string scheddAddr;
+	if (!getScheddAddr(submitterAd, scheddAddr))
+	{
+		return;
+	}
+
+		// We are about to negotiate with this submitter ourselves, so
+		// there is no point prefetching its requests any more.
+	ScheddWorkMap::iterator iter = m_prefetch->scheddWorkQueues.find(scheddAddr);
+	if (iter != m_prefetch->scheddWorkQueues.end())
+	{
+		ScheddWork &work = *iter->second;
+		work.erase(std::remove(work.begin(), work.end(), &submitterAd), work.end());
+	}
+
+		// The schedd's socket can only carry one conversation at a time,
+		// so let a prefetch in progress with it finish first; meanwhile,
+		// carry on with the conversations with the other schedds.  Those
+		// may keep each round short, so the wait for this schedd is held
+		// to its own deadline.
+	time_t deadline = time(NULL) + m_prefetch->prefetchTimeout;
+	while (m_prefetch->currentWork.count(scheddAddr))
+	{
+		int remaining = (int)(deadline - time(NULL));
+		if (remaining <= 0)
 		{
-			dprintf(D_ALWAYS, "Prefetch cycle hit deadline of %d; skipping remaining submitters.\n", prefetchCycle);
+			dprintf(D_ALWAYS, "Timeout when prefetching from %s; will skip this schedd for the remainder of prefetch cycle.\n", scheddAddr.c_str());
+			if (iter != m_prefetch->scheddWorkQueues.end()) {iter->second->clear();}
+			m_prefetch->currentWork.erase(scheddAddr);
+			endNegotiate(scheddAddr);
+			sockCache->invalidateSock(scheddAddr);
 			break;
 		}
+		if (!prefetchRound(remaining, true)) {break;}
+	}
+
+		// Starting a conversation may block while we connect to the
+		// schedd, so new ones are only started here, between submitters.
+	prefetchRound(0, true);
+}
+
+
+void
+Matchmaker::pollPrefetch()
+{
+	if (m_prefetch && m_prefetch->concurrent)
+	{
+		prefetchRound(0, false);
+	}
+}
+
+
+void
+Matchmaker::finishPrefetch()
+{
+	if (!m_prefetch)
+	{
+		return;
 	}
 	unsigned timedOutPrefetches = 0;
-	for (CurrentWorkMap::const_iterator it=currentWork.begin(); it!=currentWork.end(); it++)
+	for (CurrentWorkMap::const_iterator it=m_prefetch->currentWork.begin(); it!=m_prefetch->currentWork.end(); it++)
 	{
 		timedOutPrefetches++;
 		dprintf(D_ALWAYS, "At end of the prefetch cycle, still waiting on response from %s; giving up and invalidating socket.\n", it->first.c_str());
 		endNegotiate(it->first);
 		sockCache->invalidateSock(it->first);
 	}
-	dprintf(D_ALWAYS, "Prefetch summary: %u attempted, %u successful.\n", attemptedPrefetches, successfulPrefetches);
+	dprintf(D_ALWAYS, "Prefetch summary: %u attempted, %u successful.\n", m_prefetch->attemptedPrefetches, m_prefetch->successfulPrefetches);
 	if (timedOutPrefetches)
 	{
 		dprintf(D_ALWAYS, "There were %u prefetches in progress when timeout limit was reached.\n", timedOutPrefetches);
 	}
+	delete m_prefetch;
+	m_prefetch = NULL;
 }
 
 
@@ -4000,368 +4436,570 @@ Matchmaker::startNegotiateProtocol(const std::string &submitter, const ClassAd &
 }
 
 int Matchmaker::
-negotiate(char const* groupName, char const *submitterName, const ClassAd *submitterAd, double priority,
+negotiate(char const* groupName, char const *submitterName, ClassAd *submitterAd, double priority,
 		   double submitterLimit, double submitterLimitUnclaimed, int submitterCeiling,
 		   ClassAdListDoesNotDeleteAds &startdAds, ClaimIdHash &claimIds,
 		   bool ignore_schedd_limit, time_t deadline,
 		   int& numMatched, double &pieLeft)
 {
-	ReliSock	*sock;
-	int			cluster, proc, autocluster;
-	int			result;
-	time_t		currentTime;
-	time_t		beginTime = time(NULL);
-	ClassAd		request;
-	ClassAd*    offer = NULL;
-	bool		only_consider_startd_rank = false;
-	bool		display_overlimit = true;
-	bool		limited_by_submitterLimit = false;
-	string remoteUser;
-	double limitUsed = 0.0;
-	double limitUsedUnclaimed = 0.0;
+	NegotiationSession session;
+	session.groupName = groupName;
+	session.submitterName = submitterName;
+	session.submitterAd = submitterAd;
+	session.priority = priority;
+	session.submitterLimit = submitterLimit;
+	session.submitterLimitUnclaimed = submitterLimitUnclaimed;
+	session.submitterCeiling = submitterCeiling;
+	session.ignore_schedd_limit = ignore_schedd_limit;
+	session.deadline = deadline;
 
 	numMatched = 0;
+	if (!startSession(session)) {return MM_ERROR;}
+
+	int result;
+	do {
+		result = negotiateStep(session, startdAds, claimIds, pieLeft, true);
+	} while (result == MM_CONTINUE);
 
-	classad_shared_ptr<ResourceRequestList> request_list = startNegotiate(submitterName, *submitterAd, sock);
-	if (!request_list.get()) {return MM_ERROR;}
+	m_busySchedds.erase(session.scheddAddr);
+	numMatched = session.numMatched;
+	return result;
+}
 
-	std::string scheddAddr;
-	if (!getScheddAddr(*submitterAd, scheddAddr))
+bool Matchmaker::
+startSession(NegotiationSession &session)
+{
+	session.beginTime = time(NULL);
+
+	if (!getScheddAddr(*session.submitterAd, session.scheddAddr))
 	{
-		dprintf (D_ALWAYS, "Matchmaker::negotiate: Internal error: Missing IP address for schedd %s.  Please contact the Condor developers.\n", submitterName);
-		return MM_ERROR;
+		dprintf (D_ALWAYS, "Matchmaker::negotiate: Internal error: Missing IP address for schedd %s.  Please contact the Condor developers.\n", session.submitterName.c_str());
+		return false;
 	}
-	// Used for log messages to identify the schedd.
-	// Not for other uses, as it may change!
-	std::string schedd_id;
-	formatstr(schedd_id, "%s (%s)", submitterName, scheddAddr.c_str());
-	
-	int schedd_will_match = 1; // number of extra jobs schedd will put into a partitionable slot
+	formatstr(session.schedd_id, "%s (%s)", session.submitterName.c_str(), session.scheddAddr.c_str());
+
+	m_busySchedds.insert(session.scheddAddr);
+	awaitPrefetch(*session.submitterAd);
 
-	// 2.  negotiation loop with schedd
-	for (numMatched=0;true;numMatched++)
+	session.request_list = startNegotiate(session.submitterName, *session.submitterAd, session.sock);
+	if (!session.request_list.get())
 	{
-		// Service any interactive commands on our command socket.
-		// This keeps condor_userprio hanging to a minimum when
-		// we are involved in a lot of schedd negotiating.
-		// It also performs the important function of draining out
-		// any reschedule requests queued up on our command socket, so
-		// we do not negotiate over & over unnecesarily.
+		m_busySchedds.erase(session.scheddAddr);
+		return false;
+	}
+	return true;
+}
 
-		daemonCore->ServiceCommandSocket();
+int Matchmaker::
+negotiateStep(NegotiationSession &session,
+		   ClassAdListDoesNotDeleteAds &startdAds, ClaimIdHash &claimIds,
+		   double &pieLeft, bool blocking)
+{
+	ReliSock	*sock = session.sock;
+	char const	*submitterName = session.submitterName.c_str();
+	std::string	&scheddAddr = session.scheddAddr;
+	double		priority = session.priority;
+	double		submitterLimit = session.submitterLimit;
+	double		&limitUsed = session.limitUsed;
+	int			&schedd_will_match = session.schedd_will_match;
+	classad_shared_ptr<ResourceRequestList> &request_list = session.request_list;
+	int			cluster, proc, autocluster;
+	int			result;
+	time_t		currentTime;
+	ClassAd		request;
+	ClassAd*    offer = NULL;
+	string remoteUser;
 
-		currentTime = time(NULL);
+	// Service any interactive commands on our command socket.
+	// This keeps condor_userprio hanging to a minimum when
+	// we are involved in a lot of schedd negotiating.
+	// It also performs the important function of draining out
+	// any reschedule requests queued up on our command socket, so
+	// we do not negotiate over & over unnecesarily.
 
-		if (currentTime >= deadline) {
-			dprintf (D_ALWAYS, 	
-			"    Reached deadline for %s after %d sec... stopping\n"
-			"       MAX_TIME_PER_SUBMITTER = %d sec, MAX_TIME_PER_SCHEDD = %d sec, MAX_TIME_PER_CYCLE = %d sec, MAX_TIME_PER_PIESPIN = %d sec\n",
-				schedd_id.c_str(), (int)(currentTime - beginTime),
-				MaxTimePerSubmitter, MaxTimePerSchedd, MaxTimePerCycle,
-				MaxTimePerSpin);
-			break;	// get out of the infinite for loop & stop negotiating
-		}
-
-
-		// Handle the case if we are over the submitterLimit
-		if( limitUsed >= submitterLimit ) {
-			if( ignore_schedd_limit ) {
-				only_consider_startd_rank = true;
-				if( display_overlimit ) {
-					display_overlimit = false;
-					dprintf(D_FULLDEBUG,
-							"    Over submitter resource limit (%f, used %f) ... "
-							"only consider startd ranks\n", submitterLimit,limitUsed);
-				}
-			} else {
-				dprintf (D_ALWAYS, 	
-						 "    Reached submitter resource limit: %f ... stopping\n", limitUsed);
-				break;	// get out of the infinite for loop & stop negotiating
+	daemonCore->ServiceCommandSocket();
+
+	// Likewise, keep the request lists of the schedds we will
+	// negotiate with later coming in.
+	pollPrefetch();
+
+	currentTime = time(NULL);
+
+	if (currentTime >= session.deadline) {
+		dprintf (D_ALWAYS, 	
+		"    Reached deadline for %s after %d sec... stopping\n"
+		"       MAX_TIME_PER_SUBMITTER = %d sec, MAX_TIME_PER_SCHEDD = %d sec, MAX_TIME_PER_CYCLE = %d sec, MAX_TIME_PER_PIESPIN = %d sec\n",
+			session.schedd_id.c_str(), (int)(currentTime - session.beginTime),
+			MaxTimePerSubmitter, MaxTimePerSchedd, MaxTimePerCycle,
+			MaxTimePerSpin);
+		// break off negotiations
+		endNegotiate(scheddAddr);
+		return MM_RESUME;
+	}
+
+
+	// Handle the case if we are over the submitterLimit
+	if( limitUsed >= submitterLimit ) {
+		if( session.ignore_schedd_limit ) {
+			session.only_consider_startd_rank = true;
+			if( session.display_overlimit ) {
+				session.display_overlimit = false;
+				dprintf(D_FULLDEBUG,
+						"    Over submitter resource limit (%f, used %f) ... "
+						"only consider startd ranks\n", submitterLimit,limitUsed);
 			}
 		} else {
-			only_consider_startd_rank = false;
+			dprintf (D_ALWAYS, 	
+					 "    Reached submitter resource limit: %f ... stopping\n", limitUsed);
+			endNegotiate(scheddAddr);
+			return MM_RESUME;
 		}
+	} else {
+		session.only_consider_startd_rank = false;
+	}
 
 
-		if (limitUsed >= submitterCeiling) {
-			dprintf(D_ALWAYS, "  This submitter has hit the ceiling (got %f new slots this cycle), stopping negotiation\n", limitUsed);
-			break; // stop negotiating
-		}
+	if (limitUsed >= session.submitterCeiling) {
+		dprintf(D_ALWAYS, "  This submitter has hit the ceiling (got %f new slots this cycle), stopping negotiation\n", limitUsed);
+		endNegotiate(scheddAddr);
+		return MM_RESUME;
+	}
 
-		// 2a.  ask for job information
-		if ( !request_list->getRequest(request,cluster,proc,autocluster,sock, schedd_will_match) ) {
-			// Failed to get a request.  Check to see if it is because
-			// of an error talking to the schedd.
-			if ( request_list->hadError() ) {
-				// note: error message already dprintf-ed
-				sockCache->invalidateSock(scheddAddr);
-				return MM_ERROR;
-			}
-			if (request_list->needsEndNegotiate())
-			{
-				endNegotiate(scheddAddr);
-				schedd_will_match = 1;
-			}
-			// Failed to get a request, and no error occured.
-			// If we have negotiated above our submitterLimit, we have only
-			// considered matching if the offer strictly prefers the request.
-			// So in this case, return MM_RESUME since there still may be
-			// jobs which the schedd wants scheduled but have not been considered
-			// as candidates for no preemption or user priority preemption.
-			// Also, if we were limited by submitterLimit, resume
-			// in the next spin of the pie, because our limit might
-			// increase.
-			if( limitUsed >= submitterLimit || limited_by_submitterLimit ) {
-				return MM_RESUME;
-			} else {
-				return MM_DONE;
-			}
+	// 2a.  ask for job information; if we must not block, only read
+	// what the schedd has sent so far, and come back when there is more.
+	if ( !blocking && request_list->needsRequests(schedd_will_match) ) {
+		switch ( request_list->retrieveMore(sock) ) {
+		case ResourceRequestList::RRL_CONTINUE:
+			return MM_WAIT;
+		case ResourceRequestList::RRL_ERROR:
+			// note: error message already dprintf-ed
+			sockCache->invalidateSock(scheddAddr);
+			return MM_ERROR;
+		default:
+			break;
 		}
-		// end of asking for job information - we now have a request
-	
-
-        negotiation_cycle_stats[0]->num_jobs_considered += 1;
-
-        // information regarding the negotiating group context:
-        string negGroupName = (groupName != NULL) ? groupName : hgq_root_group->name.c_str();
-        request.Assign(ATTR_SUBMITTER_NEGOTIATING_GROUP, negGroupName);
-        request.Assign(ATTR_SUBMITTER_AUTOREGROUP, (autoregroup && (negGroupName == hgq_root_group->name)));
-
-		// insert the submitter user priority attributes into the request ad
-		// first insert old-style ATTR_SUBMITTOR_PRIO
-		request.Assign(ATTR_SUBMITTOR_PRIO , (float)priority );
-		// next insert new-style ATTR_SUBMITTER_USER_PRIO
-		request.Assign(ATTR_SUBMITTER_USER_PRIO , (float)priority );
-		// next insert the submitter user usage attributes into the request
-		request.Assign(ATTR_SUBMITTER_USER_RESOURCES_IN_USE,
-					   accountant.GetWeightedResourcesUsed ( submitterName ));
-        string temp_groupName;
-		float temp_groupQuota, temp_groupUsage;
-		if (getGroupInfoFromUserId(submitterName, temp_groupName, temp_groupQuota, temp_groupUsage)) {
-			// this is a group, so enter group usage info
-            request.Assign(ATTR_SUBMITTER_GROUP,temp_groupName);
-			request.Assign(ATTR_SUBMITTER_GROUP_RESOURCES_IN_USE,temp_groupUsage);
-			request.Assign(ATTR_SUBMITTER_GROUP_QUOTA,temp_groupQuota);
+	}
+	if ( !request_list->getRequest(request,cluster,proc,autocluster,sock, schedd_will_match) ) {
+		// Failed to get a request.  Check to see if it is because
+		// of an error talking to the schedd.
+		if ( request_list->hadError() ) {
+			// note: error message already dprintf-ed
+			sockCache->invalidateSock(scheddAddr);
+			return MM_ERROR;
 		}
+		if (request_list->needsEndNegotiate())
+		{
+			endNegotiate(scheddAddr);
+			schedd_will_match = 1;
+		}
+		// Failed to get a request, and no error occured.
+		// If we have negotiated above our submitterLimit, we have only
+		// considered matching if the offer strictly prefers the request.
+		// So in this case, return MM_RESUME since there still may be
+		// jobs which the schedd wants scheduled but have not been considered
+		// as candidates for no preemption or user priority preemption.
+		// Also, if we were limited by submitterLimit, resume
+		// in the next spin of the pie, because our limit might
+		// increase.
+		if( limitUsed >= submitterLimit || session.limited_by_submitterLimit ) {
+			return MM_RESUME;
+		} else {
+			return MM_DONE;
+		}
+	}
+	// end of asking for job information - we now have a request
 
-        // when resource ads with consumption policies are in play, optimizing
-        // the Requirements attribute can break the augmented consumption policy logic
-        // that overrides RequestXXX attributes with corresponding values supplied by
-        // the consumption policy
-        if (!cp_resources) {
-            OptimizeJobAdForMatchmaking( &request );
-        }
 
-		if( IsDebugLevel( D_JOB ) ) {
-			dprintf(D_JOB,"Searching for a matching machine for the following job ad:\n");
-			dPrintAd(D_JOB, request);
-		}
+    negotiation_cycle_stats[0]->num_jobs_considered += 1;
+
+    // information regarding the negotiating group context:
+    string negGroupName = (session.groupName != NULL) ? session.groupName : hgq_root_group->name.c_str();
+    request.Assign(ATTR_SUBMITTER_NEGOTIATING_GROUP, negGroupName);
+    request.Assign(ATTR_SUBMITTER_AUTOREGROUP, (autoregroup && (negGroupName == hgq_root_group->name)));
+
+	// insert the submitter user priority attributes into the request ad
+	// first insert old-style ATTR_SUBMITTOR_PRIO
+	request.Assign(ATTR_SUBMITTOR_PRIO , (float)priority );
+	// next insert new-style ATTR_SUBMITTER_USER_PRIO
+	request.Assign(ATTR_SUBMITTER_USER_PRIO , (float)priority );
+	// next insert the submitter user usage attributes into the request
+	request.Assign(ATTR_SUBMITTER_USER_RESOURCES_IN_USE,
+				   accountant.GetWeightedResourcesUsed ( submitterName ));
+    string temp_groupName;
+	float temp_groupQuota, temp_groupUsage;
+	if (getGroupInfoFromUserId(submitterName, temp_groupName, temp_groupQuota, temp_groupUsage)) {
+		// this is a group, so enter group usage info
+        request.Assign(ATTR_SUBMITTER_GROUP,temp_groupName);
+		request.Assign(ATTR_SUBMITTER_GROUP_RESOURCES_IN_USE,temp_groupUsage);
+		request.Assign(ATTR_SUBMITTER_GROUP_QUOTA,temp_groupQuota);
+	}
+
+    // when resource ads with consumption policies are in play, optimizing
+    // the Requirements attribute can break the augmented consumption policy logic
+    // that overrides RequestXXX attributes with corresponding values supplied by
+    // the consumption policy
+    if (!cp_resources) {
+        OptimizeJobAdForMatchmaking( &request );
+    }
+
+	if( IsDebugLevel( D_JOB ) ) {
+		dprintf(D_JOB,"Searching for a matching machine for the following job ad:\n");
+		dPrintAd(D_JOB, request);
+	}
 
-		// 2e.  find a compatible offer for the request --- keep attempting
-		//		to find matches until we can successfully (1) find a match,
-		//		AND (2) notify the startd; so quit if we got a MM_GOOD_MATCH,
-		//		or if MM_NO_MATCH could be found
-		result = MM_BAD_MATCH;
-		while (result == MM_BAD_MATCH)
+	// 2e.  find a compatible offer for the request --- keep attempting
+	//		to find matches until we can successfully (1) find a match,
+	//		AND (2) notify the startd; so quit if we got a MM_GOOD_MATCH,
+	//		or if MM_NO_MATCH could be found
+	result = MM_BAD_MATCH;
+	while (result == MM_BAD_MATCH)
+	{
+        remoteUser = "";
+		// 2e(i).  find a compatible offer
+		offer=matchmakingAlgorithm(submitterName, scheddAddr.c_str(), request,
+                                         startdAds, priority,
+                                         limitUsed, session.limitUsedUnclaimed,
+                                         submitterLimit, session.submitterLimitUnclaimed,
+										 pieLeft,
+										 session.only_consider_startd_rank);
+
+		if( !offer )
 		{
-            remoteUser = "";
-			// 2e(i).  find a compatible offer
-			offer=matchmakingAlgorithm(submitterName, scheddAddr.c_str(), request,
-                                             startdAds, priority,
-                                             limitUsed, limitUsedUnclaimed,
-                                             submitterLimit, submitterLimitUnclaimed,
-											 pieLeft,
-											 only_consider_startd_rank);
-
-			if( !offer )
-			{
-				// lookup want_match_diagnostics in request
-				// 0 = no match diagnostics
-				// 1 = match diagnostics string
-				// 2 = match diagnostics string w/ autocluster + jobid
-				int want_match_diagnostics = 0;
-				request.LookupInteger(ATTR_WANT_MATCH_DIAGNOSTICS,want_match_diagnostics);
-				string diagnostic_message;
-				// no match found
-				dprintf(D_ALWAYS|D_MATCH, "      Rejected %d.%d %s %s: ",
-						cluster, proc, submitterName, scheddAddr.c_str());
-
-				negotiation_cycle_stats[0]->rejections++;
-
-				if( rejForSubmitterLimit ) {
-                    negotiation_cycle_stats[0]->submitters_share_limit.insert(submitterName);
-					limited_by_submitterLimit = true;
-				}
-				if (rejForNetwork) {
-					diagnostic_message = "insufficient bandwidth";
-					dprintf(D_ALWAYS|D_MATCH|D_NOHEADER, "%s\n",
-							diagnostic_message.c_str());
-				} else {
-					if (rejForNetworkShare) {
-						diagnostic_message = "network share exceeded";
-					} else if (rejForConcurrencyLimit) {
-						std::string ss;
-						std::set<std::string>::const_iterator it = rejectedConcurrencyLimits.begin();
-						while (true) {
-							ss +=  *it;
-							it++;
-							if (it == rejectedConcurrencyLimits.end()) {break;}
-							else {ss += ", ";}
-						}
-						diagnostic_message = std::string("concurrency limit ") + ss + " reached";
-					} else if (rejPreemptForPolicy) {
-						diagnostic_message =
-							"PREEMPTION_REQUIREMENTS == False";
-					} else if (rejPreemptForPrio) {
-						diagnostic_message = "insufficient priority";
-					} else if (rejForSubmitterLimit) {
-                        diagnostic_message = "submitter limit exceeded";
-					} else {
-						diagnostic_message = "no match found";
+			// lookup want_match_diagnostics in request
+			// 0 = no match diagnostics
+			// 1 = match diagnostics string
+			// 2 = match diagnostics string w/ autocluster + jobid
+			int want_match_diagnostics = 0;
+			request.LookupInteger(ATTR_WANT_MATCH_DIAGNOSTICS,want_match_diagnostics);
+			string diagnostic_message;
+			// no match found
+			dprintf(D_ALWAYS|D_MATCH, "      Rejected %d.%d %s %s: ",
+					cluster, proc, submitterName, scheddAddr.c_str());
+
+			negotiation_cycle_stats[0]->rejections++;
+
+			if( rejForSubmitterLimit ) {
+                negotiation_cycle_stats[0]->submitters_share_limit.insert(submitterName);
+				session.limited_by_submitterLimit = true;
+			}
+			if (rejForNetwork) {
+				diagnostic_message = "insufficient bandwidth";
+				dprintf(D_ALWAYS|D_MATCH|D_NOHEADER, "%s\n",
+						diagnostic_message.c_str());
+			} else {
+				if (rejForNetworkShare) {
+					diagnostic_message = "network share exceeded";
+				} else if (rejForConcurrencyLimit) {
+					std::string ss;
+					std::set<std::string>::const_iterator it = rejectedConcurrencyLimits.begin();
+					while (true) {
+						ss +=  *it;
+						it++;
+						if (it == rejectedConcurrencyLimits.end()) {break;}
+						else {ss += ", ";}
 					}
-					dprintf(D_ALWAYS|D_MATCH|D_NOHEADER, "%s\n",
-							diagnostic_message.c_str());
-				}
-				// add in autocluster and job id info if requested
-				if ( want_match_diagnostics == 2 ) {
-					string diagnostic_jobinfo;
-					formatstr(diagnostic_jobinfo," |%d|%d.%d|",autocluster,cluster,proc);
-					diagnostic_message += diagnostic_jobinfo;
+					diagnostic_message = std::string("concurrency limit ") + ss + " reached";
+				} else if (rejPreemptForPolicy) {
+					diagnostic_message =
+						"PREEMPTION_REQUIREMENTS == False";
+				} else if (rejPreemptForPrio) {
+					diagnostic_message = "insufficient priority";
+				} else if (rejForSubmitterLimit) {
+                    diagnostic_message = "submitter limit exceeded";
+				} else {
+					diagnostic_message = "no match found";
 				}
-				sock->encode();
-				if ((want_match_diagnostics) ?
-					(!sock->put(REJECTED_WITH_REASON) ||
-					 !sock->put(diagnostic_message) ||
-					 !sock->end_of_message()) :
-					(!sock->put(REJECTED) || !sock->end_of_message()))
-					{
-						dprintf (D_ALWAYS, "      Could not send rejection\n");
-						sock->end_of_message ();
-						sockCache->invalidateSock(scheddAddr.c_str());
-						
-						return MM_ERROR;
-					}
-				result = MM_NO_MATCH;
-				continue;
+				dprintf(D_ALWAYS|D_MATCH|D_NOHEADER, "%s\n",
+						diagnostic_message.c_str());
+			}
+			// add in autocluster and job id info if requested
+			if ( want_match_diagnostics == 2 ) {
+				string diagnostic_jobinfo;
+				formatstr(diagnostic_jobinfo," |%d|%d.%d|",autocluster,cluster,proc);
+				diagnostic_message += diagnostic_jobinfo;
 			}
+			sock->encode();
+			if ((want_match_diagnostics) ?
+				(!sock->put(REJECTED_WITH_REASON) ||
+				 !sock->put(diagnostic_message) ||
+				 !sock->end_of_message()) :
+				(!sock->put(REJECTED) || !sock->end_of_message()))
+				{
+					dprintf (D_ALWAYS, "      Could not send rejection\n");
+					sock->end_of_message ();
+					sockCache->invalidateSock(scheddAddr.c_str());
+					
+					return MM_ERROR;
+				}
+			result = MM_NO_MATCH;
+			continue;
+		}
 
-			if ((offer->LookupString(ATTR_PREEMPTING_ACCOUNTING_GROUP, remoteUser)==1) ||
-				(offer->LookupString(ATTR_PREEMPTING_USER, remoteUser)==1) ||
-				(offer->LookupString(ATTR_ACCOUNTING_GROUP, remoteUser)==1) ||
-			    (offer->LookupString(ATTR_REMOTE_USER, remoteUser)==1))
-			{
-                char	*remoteHost = NULL;
-                double	remotePriority;
+		if ((offer->LookupString(ATTR_PREEMPTING_ACCOUNTING_GROUP, remoteUser)==1) ||
+			(offer->LookupString(ATTR_PREEMPTING_USER, remoteUser)==1) ||
+			(offer->LookupString(ATTR_ACCOUNTING_GROUP, remoteUser)==1) ||
+		    (offer->LookupString(ATTR_REMOTE_USER, remoteUser)==1))
+		{
+            char	*remoteHost = NULL;
+            double	remotePriority;
 
-				offer->LookupString(ATTR_NAME, &remoteHost);
-				remotePriority = accountant.GetPriority (remoteUser);
+			offer->LookupString(ATTR_NAME, &remoteHost);
+			remotePriority = accountant.GetPriority (remoteUser);
 
 
-				float newStartdRank;
-				float oldStartdRank = 0.0;
-				if(! EvalFloat(ATTR_RANK, offer, &request, newStartdRank)) {
-					newStartdRank = 0.0;
-				}
-				offer->LookupFloat(ATTR_CURRENT_RANK, oldStartdRank);
-
-				// got a candidate preemption --- print a helpful message
-				dprintf( D_ALWAYS, "      Preempting %s (user prio=%.2f, startd rank=%.2f) on %s "
-						 "for %s (user prio=%.2f, startd rank=%.2f)\n", remoteUser.c_str(),
-						 remotePriority, oldStartdRank, remoteHost, submitterName,
-						 priority, newStartdRank );
-                free(remoteHost);
-                remoteHost = NULL;
+			float newStartdRank;
+			float oldStartdRank = 0.0;
+			if(! EvalFloat(ATTR_RANK, offer, &request, newStartdRank)) {
+				newStartdRank = 0.0;
 			}
+			offer->LookupFloat(ATTR_CURRENT_RANK, oldStartdRank);
 
-			// 2e(ii).  perform the matchmaking protocol
-			result = matchmakingProtocol (request, offer, claimIds, sock,
-					submitterName, scheddAddr.c_str());
+			// got a candidate preemption --- print a helpful message
+			dprintf( D_ALWAYS, "      Preempting %s (user prio=%.2f, startd rank=%.2f) on %s "
+					 "for %s (user prio=%.2f, startd rank=%.2f)\n", remoteUser.c_str(),
+					 remotePriority, oldStartdRank, remoteHost, submitterName,
+					 priority, newStartdRank );
+            free(remoteHost);
+            remoteHost = NULL;
+		}
 
-			// 2e(iii). if the matchmaking protocol failed, do not consider the
-			//			startd again for this negotiation cycle.
-			if (result == MM_BAD_MATCH)
-				startdAds.Remove (offer);
+		// 2e(ii).  perform the matchmaking protocol
+		result = matchmakingProtocol (request, offer, claimIds, sock,
+				submitterName, scheddAddr.c_str());
 
-			// 2e(iv).  if the matchmaking protocol failed to talk to the
-			//			schedd, invalidate the connection and return
-			if (result == MM_ERROR)
-			{
-				sockCache->invalidateSock (scheddAddr.c_str());
-				return MM_ERROR;
-			}
+		// 2e(iii). if the matchmaking protocol failed, do not consider the
+		//			startd again for this negotiation cycle.
+		if (result == MM_BAD_MATCH) {
+			startdAds.Remove (offer);
+			m_slotIndex.remove(offer);
 		}
 
-		// 2f.  if MM_NO_MATCH was found for the request, get another request
-		if (result == MM_NO_MATCH)
+		// 2e(iv).  if the matchmaking protocol failed to talk to the
+		//			schedd, invalidate the connection and return
+		if (result == MM_ERROR)
 		{
-			numMatched--;		// haven't used any resources this cycle
+			sockCache->invalidateSock (scheddAddr.c_str());
+			return MM_ERROR;
+		}
+	}
 
-			request_list->noMatchFound(); // do not reuse any cached requests
-			schedd_will_match = 1;
+	// 2f.  if MM_NO_MATCH was found for the request, get another request
+	if (result == MM_NO_MATCH)
+	{
+		request_list->noMatchFound(); // do not reuse any cached requests
+		schedd_will_match = 1;
+
+        if (rejForSubmitterLimit && !ConsiderPreemption && !accountant.UsingWeightedSlots()) {
+            // If we aren't considering preemption and slots are unweighted, then we can
+            // be done with this submitter when it hits its submitter limit
+            dprintf (D_ALWAYS, "    Hit submitter limit: done negotiating\n");
+            // stop negotiation and return MM_RESUME
+            // we don't want to return with MM_DONE because
+            // we didn't get NO_MORE_JOBS: there are jobs that could match
+            // in later cycles with a quota redistribution
+            endNegotiate(scheddAddr);
+            return MM_RESUME;
+        }
 
-            if (rejForSubmitterLimit && !ConsiderPreemption && !accountant.UsingWeightedSlots()) {
-                // If we aren't considering preemption and slots are unweighted, then we can
-                // be done with this submitter when it hits its submitter limit
-                dprintf (D_ALWAYS, "    Hit submitter limit: done negotiating\n");
-                // stop negotiation and return MM_RESUME
-                // we don't want to return with MM_DONE because
-                // we didn't get NO_MORE_JOBS: there are jobs that could match
-                // in later cycles with a quota redistribution
-                break;
-            }
+        // Otherwise continue trying with this submitter
+		return MM_CONTINUE;
+	}
 
-            // Otherwise continue trying with this submitter
-			continue;
-		}
+    double match_cost = 0;
+    if (offer->LookupFloat(CP_MATCH_COST, match_cost)) {
+        // If CP_MATCH_COST attribute is present, this match involved a consumption policy.
+        offer->Delete(CP_MATCH_COST);
+
+        // In this mode we don't remove offers, because the goal is to allow
+        // other jobs/requests to match against them and consume resources, if possible
+        //
+        // A potential future RFE here would be to support an option for choosing "breadth-first"
+        // or "depth-first" slot utilization.  If breadth-first was chosen, then the slot
+        // could be shuffled to the back.  It might even be possible to allow a slot-specific
+        // policy choice for this behavior.
+    } else {
+		bool reevaluate_ad = false;
+		offer->LookupBool(ATTR_WANT_AD_REVAULATE, reevaluate_ad);
+		if (reevaluate_ad) {
+			reeval(offer);
+    		// Shuffle this resource to the end of the list.  This way, if
+    		// two resources with the same RANK match, we'll hand them out
+    		// in a round-robin way
+    		startdAds.Remove(offer);
+    		startdAds.Insert(offer);
+    		m_slotIndex.moveToEnd(offer);
+		} else  {
+            // 2g.  Delete ad from list so that it will not be considered again in
+	        // this negotiation cycle
+			startdAds.Remove(offer);
+			m_slotIndex.remove(offer);
+		}
+        // traditional match cost is just slot weight expression
+        match_cost = accountant.GetSlotWeight(offer);
+    }
+    // The matched slot may have been changed, and may be offered again
+    m_slotClasses.forget(offer);
+    dprintf(D_FULLDEBUG, "Match completed, match cost= %g\n", match_cost);
 
-        double match_cost = 0;
-        if (offer->LookupFloat(CP_MATCH_COST, match_cost)) {
-            // If CP_MATCH_COST attribute is present, this match involved a consumption policy.
-            offer->Delete(CP_MATCH_COST);
+	if (param_boolean("NEGOTIATOR_DEPTH_FIRST", false)) {
+		schedd_will_match = jobsInSlot(request, *offer);
+	}
 
-            // In this mode we don't remove offers, because the goal is to allow
-            // other jobs/requests to match against them and consume resources, if possible
-            //
-            // A potential future RFE here would be to support an option for choosing "breadth-first"
-            // or "depth-first" slot utilization.  If breadth-first was chosen, then the slot
-            // could be shuffled to the back.  It might even be possible to allow a slot-specific
-            // policy choice for this behavior.
-        } else {
-    		bool reevaluate_ad = false;
-    		offer->LookupBool(ATTR_WANT_AD_REVAULATE, reevaluate_ad);
-    		if (reevaluate_ad) {
-    			reeval(offer);
-        		// Shuffle this resource to the end of the list.  This way, if
-        		// two resources with the same RANK match, we'll hand them out
-        		// in a round-robin way
-        		startdAds.Remove(offer);
-        		startdAds.Insert(offer);
-    		} else  {
-                // 2g.  Delete ad from list so that it will not be considered again in
-		        // this negotiation cycle
-    			startdAds.Remove(offer);
-    		}
-            // traditional match cost is just slot weight expression
-            match_cost = accountant.GetSlotWeight(offer);
-        }
-        dprintf(D_FULLDEBUG, "Match completed, match cost= %g\n", match_cost);
+	limitUsed += match_cost;
+    if (remoteUser == "") session.limitUsedUnclaimed += match_cost;
+	pieLeft -= match_cost;
+	negotiation_cycle_stats[0]->matches++;
+	session.numMatched++;
+	return MM_CONTINUE;
+}
+
+int Matchmaker::
+runSessions(std::vector<NegotiationSession *> &sessions,
+		   ClassAdListDoesNotDeleteAds &startdAds, ClaimIdHash &claimIds,
+		   double &pieLeft, NegotiationSession *&finished)
+{
+	ASSERT( !sessions.empty() );
+
+	for (;;)
+	{
+			// Step the highest priority session that can go on.  After
+			// each step, start again from the top: a session only gets a
+			// turn while every one ahead of it waits on its schedd.
+		bool stepped = false;
+		time_t wakeup = 0;
+		for (std::vector<NegotiationSession *>::iterator it = sessions.begin(); it != sessions.end(); it++)
+		{
+			NegotiationSession &session = **it;
+			swapRejections(session);
+			int result = negotiateStep(session, startdAds, claimIds, pieLeft, false);
+			if (result == MM_WAIT)
+			{
+				time_t now = time(NULL);
+				if (!session.waitDeadline)
+				{
+					session.waitDeadline = now + NegotiatorTimeout;
+				}
+				if (now >= session.waitDeadline)
+				{
+					dprintf(D_ALWAYS, "    Timeout waiting on requests from %s\n",
+							session.schedd_id.c_str());
+					sockCache->invalidateSock(session.scheddAddr);
+					result = MM_ERROR;
+				}
+			}
+			if (result == MM_WAIT)
+			{
+				swapRejections(session);
+				if (!wakeup || (session.waitDeadline < wakeup))
+				{
+					wakeup = session.waitDeadline;
+				}
+				continue;
+			}
+			if (result == MM_CONTINUE)
+			{
+				swapRejections(session);
+				session.waitDeadline = 0;
+				stepped = true;
+				break;
+			}
 
-		if (param_boolean("NEGOTIATOR_DEPTH_FIRST", false)) {
-			schedd_will_match = jobsInSlot(request, *offer);
+				// This one is done; its reasons for rejections are left
+				// in the Matchmaker's, as negotiate() leaves them.
+			finished = &session;
+			sessions.erase(it);
+			return result;
+		}
+		if (stepped)
+		{
+			continue;
 		}
 
-		limitUsed += match_cost;
-        if (remoteUser == "") limitUsedUnclaimed += match_cost;
-		pieLeft -= match_cost;
-		negotiation_cycle_stats[0]->matches++;
+			// Every session waits on its schedd.  Wait for one of them to
+			// have something, a second at most at a time, so that the
+			// prefetch conversations keep being read as well.
+		Selector selector;
+		int timeout = (int)(wakeup - time(NULL));
+		selector.set_timeout(MAX(0, MIN(1, timeout)));
+		for (std::vector<NegotiationSession *>::iterator it = sessions.begin(); it != sessions.end(); it++)
+		{
+			selector.add_fd((*it)->sock->get_file_desc(), Selector::IO_READ);
+		}
+		selector.execute();
 	}
+}
 
+void Matchmaker::
+swapRejections(NegotiationSession &session)
+{
+	std::swap(rejForNetwork, session.rejForNetwork);
+	std::swap(rejForNetworkShare, session.rejForNetworkShare);
+	std::swap(rejForConcurrencyLimit, session.rejForConcurrencyLimit);
+	std::swap(rejPreemptForPrio, session.rejPreemptForPrio);
+	std::swap(rejPreemptForPolicy, session.rejPreemptForPolicy);
+	std::swap(rejPreemptForRank, session.rejPreemptForRank);
+	std::swap(rejForSubmitterLimit, session.rejForSubmitterLimit);
+	std::swap(rejForSubmitterCeiling, session.rejForSubmitterCeiling);
+	rejectedConcurrencyLimits.swap(session.rejectedConcurrencyLimits);
+}
 
-	// break off negotiations
-	endNegotiate(scheddAddr);
+void Matchmaker::
+finishSession(std::vector<NegotiationSession *> &sessions,
+		   ClassAdListDoesNotDeleteAds &startdAds, ClaimIdHash &claimIds,
+		   ClassAdListDoesNotDeleteAds &submitterAds,
+		   double &pieLeft, double &scheddUsed)
+{
+	NegotiationSession *session = NULL;
+	int result = runSessions(sessions, startdAds, claimIds, pieLeft, session);
+	m_busySchedds.erase(session->scheddAddr);
+	updateNegCycleEndTime(session->beginTime, session->submitterAd);
+	finishSubmitter(result, session->submitterAd, session->submitterName,
+					session->scheddAddr, submitterAds, scheddUsed);
+	delete session;
+}
+
+void Matchmaker::
+finishSubmitter(int result, ClassAd *submitter_ad,
+		   const std::string &submitterName, const std::string &scheddAddr,
+		   ClassAdListDoesNotDeleteAds &submitterAds, double &scheddUsed)
+{
+	switch (result)
+	{
+		case MM_RESUME:
+			// the schedd hit its resource limit.  must resume
+			// negotiations in next spin
+			scheddUsed += accountant.GetWeightedResourcesUsed(submitterName);
+            negotiation_cycle_stats[0]->submitters_share_limit.insert(submitterName.c_str());
+			dprintf(D_FULLDEBUG, "  This submitter hit its submitterLimit.\n");
+			break;
+		case MM_DONE:
+			if (rejForNetworkShare) {
+					// We negotiated for all jobs, but some
+					// jobs were rejected because this user
+					// exceeded her fair-share of network
+					// resources.  Resume negotiations for
+					// this user in next spin.
+			} else {
+					// the schedd got all the resources it
+					// wanted. delete this schedd ad.
+				dprintf(D_FULLDEBUG,"  Submitter %s got all it wants; removing it.\n", submitterName.c_str());
+                scheddUsed += accountant.GetWeightedResourcesUsed(submitterName);
+                dprintf( D_FULLDEBUG, " resources used by %s are %f\n",submitterName.c_str(),
+                         accountant.GetWeightedResourcesUsed(submitterName));
+				submitterAds.Remove( submitter_ad );
+			}
+			break;
+		case MM_ERROR:
+		default:
+			dprintf(D_ALWAYS,"  Error: Ignoring submitter for this cycle\n" );
+			sockCache->invalidateSock( scheddAddr.c_str() );
 
-	// ... and continue negotiating with others
-	return MM_RESUME;
+			scheddUsed += accountant.GetWeightedResourcesUsed(submitterName);
+			dprintf( D_FULLDEBUG, " resources used by %s are %f\n",submitterName.c_str(),
+				    accountant.GetWeightedResourcesUsed(submitterName));
+			submitterAds.Remove( submitter_ad );
+			negotiation_cycle_stats[0]->submitters_failed.insert(submitterName.c_str());
+	}
 }
 
 void Matchmaker::
@@ -4534,6 +5172,9 @@ getSinfulStringProtocolBools( bool isIPv4, bool isIPv6,
 }
 
 
+// The fewest slots worth handing to a thread of the slot scan.
+static const int SLOT_SCAN_MIN_CHUNK = 512;
+
 /*
 Warning: scheddAddr may not be the actual address we'll use to contact the
 schedd, thanks to CCB.  It _is_ suitable for use as a unique identifier, for
@@ -4688,222 +5329,16 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 
 	bool allow_pslot_preemption = param_boolean("ALLOW_PSLOT_PREEMPTION", false);
 	double allocatedWeight = 0.0;
-		// Set up for parallel matchmaking, if enabled
-	std::vector<ClassAd *> par_candidates;
-	std::vector<ClassAd *> par_matches;
-
-	int num_threads =  param_integer("NEGOTIATOR_NUM_THREADS", 1);
-	if (num_threads > 1) {
-		startdAds.Open();
-		par_candidates.reserve(startdAds.Length());
-		while ((candidate = startdAds.Next())) {
-			par_candidates.push_back(candidate);
-		}
-		startdAds.Close();
-		ParallelIsAMatch(&request, par_candidates, par_matches, num_threads, false);
-	}
-
-	// scan the offer ads
-	startdAds.Open ();
-	std::string machineAddr;
-
-	bool isIPv4 = false;
-	bool isIPv6 = false;
-	getSinfulStringProtocolBools( false, false, scheddAddr, isIPv4, isIPv6 );
-
-	while ((candidate = startdAds.Next ())) {
-		bool v4 = false;
-		bool v6 = false;
-		candidate->LookupString( "MyAddress", machineAddr );
-		// This short-circuits based on the subsequent evaluation, so
-		// be sure only to change them in tandem.
-		getSinfulStringProtocolBools( isIPv4, isIPv6, machineAddr.c_str(),
-			v4, v6 );
-		if(! ((isIPv4 && v4) || (isIPv6 && v6))) { continue; }
-
-		if( IsDebugVerbose(D_MACHINE) ) {
-			dprintf(D_MACHINE,"Testing whether the job matches with the following machine ad:\n");
-			dPrintAd(D_MACHINE, *candidate);
-		}
-
-		if ( allow_pslot_preemption ) {
-			bool is_dslot = false;
-			candidate->LookupBool( ATTR_SLOT_DYNAMIC, is_dslot );
-			if ( is_dslot ) {
-				bool rollup = false;
-				candidate->LookupBool( ATTR_PSLOT_ROLLUP_INFORMATION, rollup );
-				if ( rollup ) {
-					continue;
-				}
-			}
-		}
-
-        consumption_map_t consumption;
-        bool has_cp = cp_supports_policy(*candidate);
-        bool cp_sufficient = true;
-        if (has_cp) {
-            // replace RequestXxx attributes (temporarily) with values derived from
-            // the consumption policy, so that Requirements expressions evaluate in a
-            // manner consistent with the check on CP resources
-            cp_override_requested(request, *candidate, consumption);
-            cp_sufficient = cp_sufficient_assets(*candidate, consumption);
-        }
-
-		// The candidate offer and request must match.
-        // When candidate supports a consumption policy, then resources
-        // requested via consumption policy must also be available from
-        // the resource
-		bool is_a_match = false;
-		if (num_threads > 1) {
-			is_a_match = cp_sufficient &&
-				(par_matches.end() !=
-					std::find(par_matches.begin(), par_matches.end(), candidate));
-		} else {
-			is_a_match = cp_sufficient && IsAMatch(&request, candidate);
-		}
-
-        if (has_cp) {
-            // put original values back for RequestXxx attributes
-            cp_restore_requested(request, consumption);
-        }
-
-		candidatePreemptState = NO_PREEMPTION;
-
-		candidateDslotClaims.clear();
-		if (!is_a_match && ConsiderPreemption) {
-			bool jobWantsMultiMatch = false;
-			request.LookupBool(ATTR_WANT_PSLOT_PREEMPTION, jobWantsMultiMatch);
-			if (allow_pslot_preemption && jobWantsMultiMatch) {
-				// Note: after call to pslotMultiMatch(), iff is_a_match == True,
-				// then candidatePreemptState will be updated as well as candidateDslotClaims
-				is_a_match = pslotMultiMatch(&request, candidate,submitterName,
-					only_for_startdrank, candidateDslotClaims, candidatePreemptState);
-			}
-		}
-
-		int cluster_id=-1,proc_id=-1;
-		std::string machine_name;
-		if( IsDebugLevel( D_MACHINE ) ) {
-			request.LookupInteger(ATTR_CLUSTER_ID,cluster_id);
-			request.LookupInteger(ATTR_PROC_ID,proc_id);
-			candidate->LookupString(ATTR_NAME,machine_name);
-			dprintf(D_MACHINE,"Job %d.%d %s match with %s.\n",
-					cluster_id,
-					proc_id,
-					is_a_match ? "does" : "does not",
-					machine_name.c_str());
-		}
-
-		if( !is_a_match ) {
-				// they don't match; continue
-			continue;
-		}
-
-		remoteUser.clear();
-			// If there is already a preempting user, we need to preempt that user.
-			// Otherwise, we need to preempt the user who is running the job.
-
-			// But don't bother with all these lookups if preemption is disabled.
-		if (ConsiderPreemption && (candidatePreemptState == NO_PREEMPTION)) {
-			if (!candidate->LookupString(ATTR_PREEMPTING_ACCOUNTING_GROUP, remoteUser)) {
-				if (!candidate->LookupString(ATTR_PREEMPTING_USER, remoteUser)) {
-					if (!candidate->LookupString(ATTR_ACCOUNTING_GROUP, remoteUser)) {
-						candidate->LookupString(ATTR_REMOTE_USER, remoteUser);
-					}
-				}
-			}
-		}
-
-		// if only_for_startdrank flag is true, check if the offer strictly
-		// prefers this request (if we have not already done so, such as in
-		// pslotMultimatch).  Since this is the only case we care about
-		// when the only_for_startdrank flag is set, if the offer does
-		// not prefer it, just continue with the next offer ad....  we can
-		// skip all the below logic about preempt for user-priority, etc.
-		if ( only_for_startdrank &&
-			 candidatePreemptState == NO_PREEMPTION  // have we not already considered preemption?
-		   )
-		{
-			if ( remoteUser.empty() ) {
-					// offer does not have a remote user, thus we cannot eval
-					// startd rank yet because it does not make sense (the
-					// startd has nothing to compare against).
-					// So try the next offer...
-				dprintf(D_MACHINE,
-						"Ignoring %s because it is unclaimed and we are currently "
-						"only considering startd rank preemption for job %d.%d.\n",
-						machine_name.c_str(), cluster_id, proc_id);
-				continue;
-			}
-			if ( !(EvalExprTree(rankCondStd, candidate, &request, result) &&
-				   result.IsBooleanValue(val) && val) ) {
-					// offer does not strictly prefer this request.
-					// try the next offer since only_for_statdrank flag is set
-
-				dprintf(D_MACHINE,
-						"Job %d.%d does not have higher startd rank than existing job on %s.\n",
-						cluster_id, proc_id, machine_name.c_str());
-				continue;
-			}
-			// If we made it here, we have a candidate which strictly prefers
-			// this request.  Set the candidatePreemptState properly so that
-			// we consider PREEMPTION_RANK down below as we should.
-			candidatePreemptState = RANK_PREEMPTION;
-		}
-
-		// If there is a remote user, consider preemption if we have not already
-		// done so (such as in pslotMultiMatch).
-		// Note: we skip this if only_for_startdrank is true since we already
-		//       tested above for the only condition we care about.
-		if ( (!remoteUser.empty()) &&      // is there a remote user?
-			 (!only_for_startdrank) &&
-			 (candidatePreemptState == NO_PREEMPTION) // have we not already considered preemption?
-		   )
-		{
-			if( EvalExprTree(rankCondStd, candidate, &request, result) &&
-				result.IsBooleanValue(val) && val ) {
-					// offer strictly prefers this request to the one
-					// currently being serviced; preempt for rank
-				candidatePreemptState = RANK_PREEMPTION;
-			} else if (remoteUser != submitterName) {
-					// RemoteUser is not the same as the submitting user (or is the
-					// same user, but submitting into different groups), so
-					// perhaps we can preempt this machine *but* we need to check
-					// on two things first
-				candidatePreemptState = PRIO_PREEMPTION;
-					// (1) we need to make sure that PreemptionReq's hold (i.e.,
-					// if the PreemptionReq expression isn't true, dont preempt)
-				if (PreemptionReq &&
-					!(EvalExprTree(PreemptionReq,candidate,&request,result) &&
-					  result.IsBooleanValue(val) && val) ) {
-					rejPreemptForPolicy++;
-					dprintf(D_MACHINE,
-							"PREEMPTION_REQUIREMENTS prevents job %d.%d from claiming %s.\n",
-							cluster_id, proc_id, machine_name.c_str());
-					continue;
-				}
-					// (2) we need to make sure that the machine ranks the job
-					// at least as well as the one it is currently running
-					// (i.e., rankCondPrioPreempt holds)
-				if(!(EvalExprTree(rankCondPrioPreempt,candidate,&request,result)&&
-					 result.IsBooleanValue(val) && val ) ) {
-						// machine doesn't like this job as much -- find another
-					rejPreemptForRank++;
-					dprintf(D_MACHINE,
-							"Job %d.%d has lower startd rank than existing job on %s.\n",
-							cluster_id, proc_id, machine_name.c_str());
-					continue;
-				}
-			} else {
-					// slot is being used by the same user as the job submitter *and* offer doesn't prefer
-					// request --- find another machine
-				dprintf(D_MACHINE,
-						"Job %d.%d is from the same user as the existing job on %s and is not preferred by startd rank\n",
-						cluster_id, proc_id, machine_name.c_str());
-				continue;
-			}
-		}
 
+		// Everything the scan does with a candidate once it is known to
+		// match (and that preemption, if any, is allowed), in the order
+		// the slots were scanned.  Returns false to end the scan.
+		// scanned holds the candidate's ranks when a scan thread has
+		// already computed them.
+	auto offerCandidate = [&](ClassAd *candidate, PreemptState candidatePreemptState,
+	                          const string &candidateDslotClaims,
+	                          const SlotScanResult *scanned) -> bool
+	{
 		/* Check that the submitter has suffient user priority to be matched with
 		   yet another machine. HOWEVER, do NOT perform this submitter limit
 		   check if we are negotiating only for startd rank, since startd rank
@@ -4911,20 +5346,27 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 	    */
         if ((candidatePreemptState == PRIO_PREEMPTION) && !SubmitterLimitPermits(&request, candidate, limitUsed, submitterLimit, pieLeft)) {
             rejForSubmitterLimit++;
-            continue;
+            return true;
         } else if ((candidatePreemptState == NO_PREEMPTION) && !SubmitterLimitPermits(&request, candidate, limitUsedUnclaimed, submitterLimitUnclaimed, pieLeft)) {
             rejForSubmitterLimit++;
-            continue;
+            return true;
         }
 
 		if (evaluate_limits_with_match) {
 			std::string limits;
 			if (EvalString(ATTR_CONCURRENCY_LIMITS, &request, candidate, limits) && rejectForConcurrencyLimits(limits)) {
-				continue;
+				return true;
 			}
 		}
 
-		calculateRanks(request, candidate, candidatePreemptState, candidateRankValue, candidatePreJobRankValue, candidatePostJobRankValue, candidatePreemptRankValue);
+		if (scanned && !m_staticRanks) {
+			candidateRankValue = scanned->RankValue;
+			candidatePreJobRankValue = scanned->PreJobRankValue;
+			candidatePostJobRankValue = scanned->PostJobRankValue;
+			candidatePreemptRankValue = scanned->PreemptRankValue;
+		} else {
+			calculateRanks(request, candidate, candidatePreemptState, candidateRankValue, candidatePreJobRankValue, candidatePostJobRankValue, candidatePreemptRankValue);
+		}
 
 		if ( MatchList ) {
 			MatchList->add_candidate(
@@ -4993,11 +5435,306 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 			candidate->LookupFloat(ATTR_SLOT_WEIGHT, weight);
 			allocatedWeight += weight;
 			if (allocatedWeight > submitterLimit) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	std::string machineAddr;
+
+	bool isIPv4 = false;
+	bool isIPv6 = false;
+	getSinfulStringProtocolBools( false, false, scheddAddr, isIPv4, isIPv6 );
+
+		// With NEGOTIATOR_NUM_THREADS set, the slots are split into
+		// contiguous chunks that are scanned at once, each by its own
+		// thread, as far as deciding whether a slot matches, whether it
+		// may be preempted, and its ranks.  The rest (the submitter and
+		// concurrency limits, the MatchList and the best match) is done
+		// here, visiting the chunks' results in slot order, so the outcome
+		// is the same as that of the serial scan below.  Consumption
+		// policies rewrite the request per slot, pslot preemption looks at
+		// the dslots, and D_MACHINE logs each slot, so those use the
+		// serial scan.  With NEGOTIATOR_SLOT_EQUIVALENCE_CLASSES, the same
+		// path is taken even with one thread, so that whether a request
+		// matches and may preempt is decided once per class of slots that
+		// it can't tell apart, and with NEGOTIATOR_SLOT_INDEX, so that only
+		// the slots that the simple conditions in the request's
+		// Requirements allow are scanned.
+	bool jobWantsMultiMatch = false;
+	request.LookupBool(ATTR_WANT_PSLOT_PREEMPTION, jobWantsMultiMatch);
+	int scan_chunks = std::max( 1, std::min( m_slotScanPool.threads(),
+		startdAds.Length() / SLOT_SCAN_MIN_CHUNK ) );
+	if ( ( scan_chunks > 1 || m_slotClassesThisCycle || m_useSlotIndex ) &&
+		 !cp_resources && !IsDebugLevel( D_MACHINE ) &&
+		 !( ConsiderPreemption && allow_pslot_preemption && jobWantsMultiMatch ) )
+	{
+		std::vector<ClassAd *> slots;
+		if ( m_useSlotIndex && m_slotIndex.candidates(startdAds, request, slots) ) {
+			dprintf(D_FULLDEBUG, "Slot index leaves %d of %d slots to scan\n",
+				(int)slots.size(), startdAds.Length());
+			scan_chunks = std::max( 1, std::min( m_slotScanPool.threads(),
+				(int)slots.size() / SLOT_SCAN_MIN_CHUNK ) );
+		} else {
+			slots.reserve(startdAds.Length());
+			startdAds.Open();
+			while ((candidate = startdAds.Next())) {
+				slots.push_back(candidate);
+			}
+			startdAds.Close();
+		}
+
+		std::vector<int> slot_classes;
+		int num_classes = 0;
+		classad::References request_attrs;
+		if ( m_slotClassesThisCycle &&
+			 SlotClasses::requestReferences(request, request_attrs) )
+		{
+			num_classes = m_slotClasses.classify(slots, request_attrs, slot_classes);
+			dprintf(D_FULLDEBUG, "Request falls into %d classes of %d slots\n",
+				num_classes, (int)slots.size());
+		}
+		const std::vector<int> *classes = num_classes ? &slot_classes : NULL;
+
+		m_slotScanPool.run(scan_chunks, [&](int chunk) {
+			scanSlotChunk(*m_slotScanContexts[chunk], request, submitterName, slots,
+				classes, num_classes,
+				slots.size() * chunk / scan_chunks,
+				slots.size() * (chunk + 1) / scan_chunks,
+				isIPv4, isIPv6, allow_pslot_preemption, only_for_startdrank);
+		});
+
+		bool more = true;
+		for (int chunk = 0; more && chunk < scan_chunks; chunk++) {
+			std::vector<SlotScanResult> &results = m_slotScanContexts[chunk]->results;
+			for (size_t i = 0; more && i < results.size(); i++) {
+				const SlotScanResult &scanned = results[i];
+				if (scanned.rejPreemptForPolicy) {
+					rejPreemptForPolicy++;
+				} else if (scanned.rejPreemptForRank) {
+					rejPreemptForRank++;
+				} else {
+					more = offerCandidate(scanned.candidate, scanned.preemptState,
+						string(), &scanned);
+				}
+			}
+		}
+		for (int chunk = 0; chunk < scan_chunks; chunk++) {
+			m_slotScanContexts[chunk]->results.clear();
+		}
+	} else {
+			// The request is the same for every candidate, so the parts of its
+			// Requirements that don't depend on the machine are evaluated once,
+			// here.  Consumption policies rewrite the request's RequestXxx
+			// attributes per candidate, so that case uses IsAMatch() instead.
+		classad::MatchClassAd request_match;
+		bool request_bound = false;
+		if (!cp_resources) {
+			request_bound = request_match.BindLeftAdForMatchmaking(&request);
+		}
+
+		// scan the offer ads
+		startdAds.Open ();
+
+		while ((candidate = startdAds.Next ())) {
+			bool v4 = false;
+			bool v6 = false;
+			candidate->LookupString( "MyAddress", machineAddr );
+			// This short-circuits based on the subsequent evaluation, so
+			// be sure only to change them in tandem.
+			getSinfulStringProtocolBools( isIPv4, isIPv6, machineAddr.c_str(),
+				v4, v6 );
+			if(! ((isIPv4 && v4) || (isIPv6 && v6))) { continue; }
+
+			if( IsDebugVerbose(D_MACHINE) ) {
+				dprintf(D_MACHINE,"Testing whether the job matches with the following machine ad:\n");
+				dPrintAd(D_MACHINE, *candidate);
+			}
+
+			if ( allow_pslot_preemption ) {
+				bool is_dslot = false;
+				candidate->LookupBool( ATTR_SLOT_DYNAMIC, is_dslot );
+				if ( is_dslot ) {
+					bool rollup = false;
+					candidate->LookupBool( ATTR_PSLOT_ROLLUP_INFORMATION, rollup );
+					if ( rollup ) {
+						continue;
+					}
+				}
+			}
+
+	        consumption_map_t consumption;
+	        bool has_cp = cp_supports_policy(*candidate);
+	        bool cp_sufficient = true;
+	        if (has_cp) {
+	            // replace RequestXxx attributes (temporarily) with values derived from
+	            // the consumption policy, so that Requirements expressions evaluate in a
+	            // manner consistent with the check on CP resources
+	            cp_override_requested(request, *candidate, consumption);
+	            cp_sufficient = cp_sufficient_assets(*candidate, consumption);
+	        }
+
+			// The candidate offer and request must match.
+	        // When candidate supports a consumption policy, then resources
+	        // requested via consumption policy must also be available from
+	        // the resource
+			bool is_a_match = false;
+			if (request_bound && !has_cp) {
+				is_a_match = request_match.BindRightAd(candidate) &&
+					request_match.symmetricMatch();
+			} else {
+				is_a_match = cp_sufficient && IsAMatch(&request, candidate);
+			}
+
+	        if (has_cp) {
+	            // put original values back for RequestXxx attributes
+	            cp_restore_requested(request, consumption);
+	        }
+
+			candidatePreemptState = NO_PREEMPTION;
+
+			candidateDslotClaims.clear();
+			if (!is_a_match && ConsiderPreemption) {
+				bool jobWantsMultiMatch = false;
+				request.LookupBool(ATTR_WANT_PSLOT_PREEMPTION, jobWantsMultiMatch);
+				if (allow_pslot_preemption && jobWantsMultiMatch) {
+					// Note: after call to pslotMultiMatch(), iff is_a_match == True,
+					// then candidatePreemptState will be updated as well as candidateDslotClaims
+					is_a_match = pslotMultiMatch(&request, candidate,submitterName,
+						only_for_startdrank, candidateDslotClaims, candidatePreemptState);
+				}
+			}
+
+			int cluster_id=-1,proc_id=-1;
+			std::string machine_name;
+			if( IsDebugLevel( D_MACHINE ) ) {
+				request.LookupInteger(ATTR_CLUSTER_ID,cluster_id);
+				request.LookupInteger(ATTR_PROC_ID,proc_id);
+				candidate->LookupString(ATTR_NAME,machine_name);
+				dprintf(D_MACHINE,"Job %d.%d %s match with %s.\n",
+						cluster_id,
+						proc_id,
+						is_a_match ? "does" : "does not",
+						machine_name.c_str());
+			}
+
+			if( !is_a_match ) {
+					// they don't match; continue
+				continue;
+			}
+
+			remoteUser.clear();
+				// If there is already a preempting user, we need to preempt that user.
+				// Otherwise, we need to preempt the user who is running the job.
+
+				// But don't bother with all these lookups if preemption is disabled.
+			if (ConsiderPreemption && (candidatePreemptState == NO_PREEMPTION)) {
+				if (!candidate->LookupString(ATTR_PREEMPTING_ACCOUNTING_GROUP, remoteUser)) {
+					if (!candidate->LookupString(ATTR_PREEMPTING_USER, remoteUser)) {
+						if (!candidate->LookupString(ATTR_ACCOUNTING_GROUP, remoteUser)) {
+							candidate->LookupString(ATTR_REMOTE_USER, remoteUser);
+						}
+					}
+				}
+			}
+
+			// if only_for_startdrank flag is true, check if the offer strictly
+			// prefers this request (if we have not already done so, such as in
+			// pslotMultimatch).  Since this is the only case we care about
+			// when the only_for_startdrank flag is set, if the offer does
+			// not prefer it, just continue with the next offer ad....  we can
+			// skip all the below logic about preempt for user-priority, etc.
+			if ( only_for_startdrank &&
+				 candidatePreemptState == NO_PREEMPTION  // have we not already considered preemption?
+			   )
+			{
+				if ( remoteUser.empty() ) {
+						// offer does not have a remote user, thus we cannot eval
+						// startd rank yet because it does not make sense (the
+						// startd has nothing to compare against).
+						// So try the next offer...
+					dprintf(D_MACHINE,
+							"Ignoring %s because it is unclaimed and we are currently "
+							"only considering startd rank preemption for job %d.%d.\n",
+							machine_name.c_str(), cluster_id, proc_id);
+					continue;
+				}
+				if ( !(EvalExprTree(rankCondStd, candidate, &request, result) &&
+					   result.IsBooleanValue(val) && val) ) {
+						// offer does not strictly prefer this request.
+						// try the next offer since only_for_statdrank flag is set
+
+					dprintf(D_MACHINE,
+							"Job %d.%d does not have higher startd rank than existing job on %s.\n",
+							cluster_id, proc_id, machine_name.c_str());
+					continue;
+				}
+				// If we made it here, we have a candidate which strictly prefers
+				// this request.  Set the candidatePreemptState properly so that
+				// we consider PREEMPTION_RANK down below as we should.
+				candidatePreemptState = RANK_PREEMPTION;
+			}
+
+			// If there is a remote user, consider preemption if we have not already
+			// done so (such as in pslotMultiMatch).
+			// Note: we skip this if only_for_startdrank is true since we already
+			//       tested above for the only condition we care about.
+			if ( (!remoteUser.empty()) &&      // is there a remote user?
+				 (!only_for_startdrank) &&
+				 (candidatePreemptState == NO_PREEMPTION) // have we not already considered preemption?
+			   )
+			{
+				if( EvalExprTree(rankCondStd, candidate, &request, result) &&
+					result.IsBooleanValue(val) && val ) {
+						// offer strictly prefers this request to the one
+						// currently being serviced; preempt for rank
+					candidatePreemptState = RANK_PREEMPTION;
+				} else if (remoteUser != submitterName) {
+						// RemoteUser is not the same as the submitting user (or is the
+						// same user, but submitting into different groups), so
+						// perhaps we can preempt this machine *but* we need to check
+						// on two things first
+					candidatePreemptState = PRIO_PREEMPTION;
+						// (1) we need to make sure that PreemptionReq's hold (i.e.,
+						// if the PreemptionReq expression isn't true, dont preempt)
+					if (PreemptionReq &&
+						!(EvalExprTree(PreemptionReq,candidate,&request,result) &&
+						  result.IsBooleanValue(val) && val) ) {
+						rejPreemptForPolicy++;
+						dprintf(D_MACHINE,
+								"PREEMPTION_REQUIREMENTS prevents job %d.%d from claiming %s.\n",
+								cluster_id, proc_id, machine_name.c_str());
+						continue;
+					}
+						// (2) we need to make sure that the machine ranks the job
+						// at least as well as the one it is currently running
+						// (i.e., rankCondPrioPreempt holds)
+					if(!(EvalExprTree(rankCondPrioPreempt,candidate,&request,result)&&
+						 result.IsBooleanValue(val) && val ) ) {
+							// machine doesn't like this job as much -- find another
+						rejPreemptForRank++;
+						dprintf(D_MACHINE,
+								"Job %d.%d has lower startd rank than existing job on %s.\n",
+								cluster_id, proc_id, machine_name.c_str());
+						continue;
+					}
+				} else {
+						// slot is being used by the same user as the job submitter *and* offer doesn't prefer
+						// request --- find another machine
+					dprintf(D_MACHINE,
+							"Job %d.%d is from the same user as the existing job on %s and is not preferred by startd rank\n",
+							cluster_id, proc_id, machine_name.c_str());
+					continue;
+				}
+			}
+
+			if (!offerCandidate(candidate, candidatePreemptState, candidateDslotClaims, NULL)) {
 				break;
 			}
 		}
+		startdAds.Close ();
 	}
-	startdAds.Close ();
 
 	if ( MatchList ) {
 		MatchList->set_diagnostics(
@@ -5195,6 +5932,301 @@ calculateRanks(ClassAd &request,
 	}
 }
 
+Matchmaker::SlotScanContext::
+~SlotScanContext()
+{
+	delete rankCondStd;
+	delete rankCondPrioPreempt;
+	delete PreemptionReq;
+	delete PreemptionRank;
+	delete NegotiatorPreJobRank;
+	delete NegotiatorPostJobRank;
+}
+
+static ExprTree *
+copyExpr(ExprTree *expr)
+{
+	return expr ? expr->Copy() : NULL;
+}
+
+void Matchmaker::
+configureSlotScan()
+{
+	int threads = param_integer("NEGOTIATOR_NUM_THREADS", 1, 1);
+
+		// The scan threads evaluate expressions in the same ads at once.
+	if (threads > 1) {
+		classad::ClassAdSetThreadSafeEvaluation(true);
+		dprintf_make_thread_safe();
+	}
+	m_slotScanPool.setThreads(threads);
+	if (threads <= 1) {
+		classad::ClassAdSetThreadSafeEvaluation(false);
+	}
+
+		// There is always at least one context, since the slot scan
+		// also runs on this thread alone when slot classes are in use.
+	for (size_t i = 0; i < m_slotScanContexts.size(); i++) {
+		delete m_slotScanContexts[i];
+	}
+	m_slotScanContexts.clear();
+	for (int i = 0; i < threads; i++) {
+		SlotScanContext *ctx = new SlotScanContext;
+		ctx->rankCondStd = copyExpr(rankCondStd);
+		ctx->rankCondPrioPreempt = copyExpr(rankCondPrioPreempt);
+		ctx->PreemptionReq = copyExpr(PreemptionReq);
+		ctx->PreemptionRank = copyExpr(PreemptionRank);
+		ctx->NegotiatorPreJobRank = copyExpr(NegotiatorPreJobRank);
+		ctx->NegotiatorPostJobRank = copyExpr(NegotiatorPostJobRank);
+		m_slotScanContexts.push_back(ctx);
+	}
+}
+
+// Start this cycle's slot equivalence classes.  Besides the attributes
+// each request refers to, a slot's class depends on the slot attributes
+// that decide whether it matches and may be preempted: its own
+// Requirements and Rank, who is running on it, and whatever
+// PREEMPTION_REQUIREMENTS refers to.
+void Matchmaker::
+resetSlotClasses()
+{
+	static const char * const policy[] = {
+		ATTR_REQUIREMENTS, ATTR_RANK, ATTR_CURRENT_RANK,
+		ATTR_REMOTE_USER, ATTR_ACCOUNTING_GROUP,
+		ATTR_PREEMPTING_USER, ATTR_PREEMPTING_ACCOUNTING_GROUP
+	};
+	classad::References policy_attrs;
+
+	m_slotClassesThisCycle = m_useSlotClasses;
+	if (m_slotClassesThisCycle) {
+		for (size_t i = 0; i < sizeof(policy) / sizeof(policy[0]); i++) {
+			policy_attrs.insert(policy[i]);
+		}
+		ClassAd empty;
+		if (PreemptionReq &&
+			!SlotClasses::slotReferences(empty, PreemptionReq, policy_attrs))
+		{
+			dprintf(D_ALWAYS, "Can't tell which slot attributes "
+				"PREEMPTION_REQUIREMENTS refers to; not using slot "
+				"equivalence classes this cycle\n");
+			m_slotClassesThisCycle = false;
+			policy_attrs.clear();
+		}
+	}
+	m_slotClasses.reset(policy_attrs);
+}
+
+// Is a condition on a slot (e.g. rankCondStd) true?  The slot is the
+// right ad of a scan thread's match ad, and expr is the thread's own copy.
+static bool
+EvalSlotScanCondition(ExprTree *expr, classad::ClassAd *slot)
+{
+	classad::Value result;
+	bool val = false;
+
+	expr->SetParentScope(slot);
+	return slot->EvaluateExpr(expr, result) && result.IsBooleanValue(val) && val;
+}
+
+// Like EvalNegotiatorMatchRank(), in a scan thread.
+double Matchmaker::
+EvalSlotScanRank(char const *expr_name, ExprTree *expr, SlotScanContext &ctx)
+{
+	classad::Value result;
+	float rank = -(FLT_MAX);
+
+	if (!expr) {
+		return rank;
+	}
+	classad::ClassAd *slot = ctx.match.GetRightAd();
+	expr->SetParentScope(slot);
+	if (slot->EvaluateExpr(expr, result)) {
+		double val;
+		if( result.IsNumber(val) ) {
+			rank = (float)val;
+		} else {
+			dprintf(D_ALWAYS, "Failed to evaluate %s "
+			                  "expression to a float.\n",expr_name);
+		}
+	} else {
+		dprintf(D_ALWAYS, "Failed to evaluate %s "
+		                  "expression.\n",expr_name);
+	}
+	return rank;
+}
+
+// Does the request (bound as ctx's left ad) match the candidate, and may
+// it preempt the candidate if it has to?  Returns true if the candidate
+// belongs in the scan's results, with its preemption state and any
+// rejection in scanned; the candidate is left bound as ctx's right ad.
+bool Matchmaker::
+scanSlot(SlotScanContext &ctx, const char *submitterName, ClassAd *candidate,
+         bool only_for_startdrank, SlotScanResult &scanned)
+{
+	std::string remoteUser;
+
+	ctx.match.BindRightAd(candidate);
+	if ( !ctx.match.symmetricMatch() ) {
+		return false;
+	}
+	classad::ClassAd *slot = ctx.match.GetRightAd();
+
+	scanned.candidate = candidate;
+	scanned.preemptState = NO_PREEMPTION;
+	scanned.rejPreemptForPolicy = false;
+	scanned.rejPreemptForRank = false;
+
+	if (ConsiderPreemption) {
+		if (!candidate->LookupString(ATTR_PREEMPTING_ACCOUNTING_GROUP, remoteUser)) {
+			if (!candidate->LookupString(ATTR_PREEMPTING_USER, remoteUser)) {
+				if (!candidate->LookupString(ATTR_ACCOUNTING_GROUP, remoteUser)) {
+					candidate->LookupString(ATTR_REMOTE_USER, remoteUser);
+				}
+			}
+		}
+	}
+
+	if ( only_for_startdrank ) {
+		if ( remoteUser.empty() ||
+			 !EvalSlotScanCondition(ctx.rankCondStd, slot) ) {
+			return false;
+		}
+		scanned.preemptState = RANK_PREEMPTION;
+	} else if ( !remoteUser.empty() ) {
+		if ( EvalSlotScanCondition(ctx.rankCondStd, slot) ) {
+			scanned.preemptState = RANK_PREEMPTION;
+		} else if (remoteUser != submitterName) {
+			scanned.preemptState = PRIO_PREEMPTION;
+			if ( ctx.PreemptionReq &&
+				 !EvalSlotScanCondition(ctx.PreemptionReq, slot) ) {
+				scanned.rejPreemptForPolicy = true;
+			} else if ( !EvalSlotScanCondition(ctx.rankCondPrioPreempt, slot) ) {
+				scanned.rejPreemptForRank = true;
+			}
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+// One thread's part of the slot scan in matchmakingAlgorithm(): the slots
+// [begin, end) that match the request and that it may preempt, if it has
+// to, go in ctx.results in order, with their ranks.  Slots it would
+// preempt but for PREEMPTION_REQUIREMENTS or the startd's rank go there
+// too, flagged, so that the rejections can be counted in order.  If
+// slot_classes is given, slots[i] is in class (*slot_classes)[i], and
+// scanSlot() is called for only the first slot of each class in this
+// chunk; the others share its outcome.  This must only read the request,
+// the slots and the matchmaker; the checks that change state are left to
+// the caller.
+void Matchmaker::
+scanSlotChunk(SlotScanContext &ctx, ClassAd &request, const char *submitterName,
+              const std::vector<ClassAd *> &slots,
+              const std::vector<int> *slot_classes, int num_classes,
+              size_t begin, size_t end,
+              bool isIPv4, bool isIPv6, bool allow_pslot_preemption,
+              bool only_for_startdrank)
+{
+	std::string machineAddr;
+
+	ctx.results.clear();
+	ctx.match.BindLeftAdForMatchmaking(&request);
+	if (slot_classes) {
+		ctx.class_results.resize(num_classes);
+		ctx.class_scanned.assign(num_classes, false);
+	}
+
+	for (size_t i = begin; i < end; i++) {
+		ClassAd *candidate = slots[i];
+
+		bool v4 = false;
+		bool v6 = false;
+		candidate->LookupString( "MyAddress", machineAddr );
+		getSinfulStringProtocolBools( isIPv4, isIPv6, machineAddr.c_str(),
+			v4, v6 );
+		if(! ((isIPv4 && v4) || (isIPv6 && v6))) { continue; }
+
+		if ( allow_pslot_preemption ) {
+			bool is_dslot = false;
+			candidate->LookupBool( ATTR_SLOT_DYNAMIC, is_dslot );
+			if ( is_dslot ) {
+				bool rollup = false;
+				candidate->LookupBool( ATTR_PSLOT_ROLLUP_INFORMATION, rollup );
+				if ( rollup ) {
+					continue;
+				}
+			}
+		}
+
+		SlotScanResult scanned;
+		if (slot_classes) {
+			int cls = (*slot_classes)[i];
+			SlotScanResult &outcome = ctx.class_results[cls];
+			if (!ctx.class_scanned[cls]) {
+				ctx.class_scanned[cls] = true;
+				if (!scanSlot(ctx, submitterName, candidate,
+				              only_for_startdrank, outcome)) {
+					outcome.candidate = NULL;
+				}
+			}
+			if (!outcome.candidate) {
+				continue;
+			}
+			scanned = outcome;
+			scanned.candidate = candidate;
+		} else if (!scanSlot(ctx, submitterName, candidate,
+		                     only_for_startdrank, scanned)) {
+			continue;
+		}
+
+		if ( scanned.rejPreemptForPolicy || scanned.rejPreemptForRank ) {
+			ctx.results.push_back(scanned);
+			continue;
+		}
+
+			// With NEGOTIATOR_IGNORE_JOB_RANKS, the ranks are cached per slot
+			// by calculateRanks(), which the caller calls instead.  Ranks are
+			// always per slot, since they may tell apart the slots of a class
+			// (the default NEGOTIATOR_PRE_JOB_RANK refers to SlotID, say).
+		if ( !m_staticRanks ) {
+				// the slot bound may be the one its class was decided on
+			if (slot_classes) {
+				ctx.match.BindRightAd(candidate);
+			}
+			classad::ClassAd *slot = ctx.match.GetRightAd();
+
+			scanned.PreJobRankValue = EvalSlotScanRank(
+				"NEGOTIATOR_PRE_JOB_RANK", ctx.NegotiatorPreJobRank, ctx);
+
+				// as EvalFloat() does, fall back to the slot's Rank
+			double tmp = 0.0;
+			classad::ClassAd *job = ctx.match.GetLeftAd();
+			if (job->Lookup(ATTR_RANK)) {
+				if (!job->EvaluateAttrNumber(ATTR_RANK, tmp)) {
+					tmp = 0.0;
+				}
+			} else if (slot->Lookup(ATTR_RANK)) {
+				if (!slot->EvaluateAttrNumber(ATTR_RANK, tmp)) {
+					tmp = 0.0;
+				}
+			}
+			scanned.RankValue = tmp;
+
+			scanned.PostJobRankValue = EvalSlotScanRank(
+				"NEGOTIATOR_POST_JOB_RANK", ctx.NegotiatorPostJobRank, ctx);
+
+			scanned.PreemptRankValue = -(FLT_MAX);
+			if (scanned.preemptState != NO_PREEMPTION) {
+				scanned.PreemptRankValue = EvalSlotScanRank(
+					"PREEMPTION_RANK", ctx.PreemptionRank, ctx);
+			}
+		}
+
+		ctx.results.push_back(scanned);
+	}
+}
+
 	// NOTE NOTE: this assumes that p-slots are not being preempted.
 bool Matchmaker::
 returnPslotToMatchList(ClassAd &request, ClassAd *offer)
@@ -28,6 +28,9 @@
 #include "dc_collector.h"
 #include "condor_ver_info.h"
 #include "matchmaker_negotiate.h"
+#include "matchmaker_scan.h"
+#include "matchmaker_slot_classes.h"
+#include "matchmaker_slot_index.h"
 #include "GroupEntry.h"
 
 #include <vector>
@@ -113,6 +116,11 @@ class Matchmaker : public Service
 		// auxillary functions
 		bool obtainAdsFromCollector (ClassAdList &allAds, ClassAdListDoesNotDeleteAds &startdAds, ClassAdListDoesNotDeleteAds &submitterAds, std::set<std::string> &submitterNames, ClaimIdHash &claimIds );	
 		char * compute_significant_attrs(ClassAdListDoesNotDeleteAds & startdAds);
+		bool fetchChangedMachineAds(CollectorList *collects, ClassAdList &allAds,
+			std::vector<ClassAd *> &unchanged);
+		void cacheMachineAd(ClassAd *ad, const MyString &adID,
+			int lastHeardFrom, int sequence);
+		void clearMachineAdCache();
 		bool consolidate_globaljobprio_submitter_ads(ClassAdListDoesNotDeleteAds & submitterAds) const;
 
 		void SetupMatchSecurity(ClassAdListDoesNotDeleteAds &submitterAds);
@@ -133,6 +141,26 @@ class Matchmaker : public Service
 		 * Try starting negotiations with all schedds in parallel.
 		 */
 		void prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterAds);
+
+		/**
+		 * With NEGOTIATOR_CONCURRENT_PREFETCH, the prefetch conversations
+		 * started by prefetchResourceRequestLists() carry on while we
+		 * negotiate, instead of being waited on before negotiation starts.
+		 * While we negotiate, pollPrefetch() only reads from the
+		 * conversations under way; new ones, which may block on
+		 * connecting to a schedd, are started by awaitPrefetch() between
+		 * submitters, and never with a schedd in m_busySchedds.  The
+		 * request lists are only used, and matches only made, as each
+		 * submitter's turn comes in the usual order.
+		 */
+		struct PrefetchState;
+		bool prefetchRound(int timeout, bool startNew);
+		void awaitPrefetch(const ClassAd &submitterAd);
+		void pollPrefetch();
+		void finishPrefetch();
+		PrefetchState *m_prefetch;
+			// schedds we are negotiating with ourselves right now
+		std::set<std::string> m_busySchedds;
 		typedef std::map<std::string, classad_shared_ptr<ResourceRequestList> > RRLHash;
 		RRLHash m_cachedRRLs;
 
@@ -164,13 +192,42 @@ class Matchmaker : public Service
 					MM_DONE if schedd got all the resources it wanted,
 					MM_ERROR if problem negotiating w/ this schedd.
 		**/
-		int negotiate(char const* groupName, char const *submitterName, const ClassAd *submitterAd,
+		int negotiate(char const* groupName, char const *submitterName, ClassAd *submitterAd,
 		   double priority,
            double submitterLimit, double submitterLimitUnclaimed, int submitterCeiling,
 		   ClassAdListDoesNotDeleteAds &startdAds, ClaimIdHash &claimIds, 
 		   bool ignore_schedd_limit, time_t deadline,
            int& numMatched, double &pieLeft);
 
+		/**
+		 * With NEGOTIATOR_CONCURRENT_NEGOTIATIONS above 1,
+		 * negotiateWithGroup() negotiates with the submitters of that
+		 * many schedds at once.  The state negotiate() keeps in locals is
+		 * then kept in a NegotiationSession, and negotiateStep() takes a
+		 * session one request further, returning MM_WAIT instead of
+		 * blocking on the schedd.  runSessions() is the single arbiter
+		 * that steps the sessions, one at a time and always the highest
+		 * priority one that can go on, so matches are still made one at
+		 * a time against the same slots and pie; only the waits on the
+		 * schedds overlap.
+		 */
+		struct NegotiationSession;
+		bool startSession(NegotiationSession &session);
+		int negotiateStep(NegotiationSession &session,
+		   ClassAdListDoesNotDeleteAds &startdAds, ClaimIdHash &claimIds,
+		   double &pieLeft, bool blocking);
+		int runSessions(std::vector<NegotiationSession *> &sessions,
+		   ClassAdListDoesNotDeleteAds &startdAds, ClaimIdHash &claimIds,
+		   double &pieLeft, NegotiationSession *&finished);
+		void finishSession(std::vector<NegotiationSession *> &sessions,
+		   ClassAdListDoesNotDeleteAds &startdAds, ClaimIdHash &claimIds,
+		   ClassAdListDoesNotDeleteAds &submitterAds,
+		   double &pieLeft, double &scheddUsed);
+		void swapRejections(NegotiationSession &session);
+		void finishSubmitter(int result, ClassAd *submitter_ad,
+		   const std::string &submitterName, const std::string &scheddAddr,
+		   ClassAdListDoesNotDeleteAds &submitterAds, double &scheddUsed);
+
 		int negotiateWithGroup ( int untrimmed_num_startds,
 								 double untrimmedSlotWeightTotal,
 								 double minSlotWeight,
@@ -342,6 +399,24 @@ class Matchmaker : public Service
 		std::string m_JobConstraintStr;
 
 		bool m_staticRanks;
+		bool m_useSlotClasses;	// NEGOTIATOR_SLOT_EQUIVALENCE_CLASSES
+		bool m_slotClassesThisCycle;
+		bool m_useSlotIndex;	// NEGOTIATOR_SLOT_INDEX
+
+		// With NEGOTIATOR_INCREMENTAL_ADS, the machine ads of the last
+		// cycle, as prepared for matchmaking, by MachineAdID(); each cycle
+		// only the ads that have changed in the collector since are
+		// fetched and prepared again.
+		struct CachedMachineAd
+		{
+			ClassAd *ad;
+			int lastHeardFrom;
+			int sequence;
+		};
+		bool m_incrementalAds;
+		int m_incrementalAdsRefresh;	// NEGOTIATOR_INCREMENTAL_ADS_REFRESH
+		time_t m_lastFullAdFetch;
+		std::map<std::string, CachedMachineAd> m_machineAdCache;
 
 		StringList NegotiatorMatchExprNames;
 		StringList NegotiatorMatchExprValues;
@@ -523,6 +598,62 @@ class Matchmaker : public Service
 		double cachedPrio;
 		bool cachedOnlyForStartdRank;
 
+		// What scanning one slot for a request found, for the slots that
+		// match it or that it can't preempt; see scanSlotChunk().
+		struct SlotScanResult
+		{
+			ClassAd *candidate;
+			PreemptState preemptState;
+			bool rejPreemptForPolicy;
+			bool rejPreemptForRank;
+			double RankValue;
+			double PreJobRankValue;
+			double PostJobRankValue;
+			double PreemptRankValue;
+		};
+
+		// The state each thread scanning the slots keeps: a match ad to
+		// bind the request and each slot to, copies of the negotiator's
+		// expressions (evaluating an expression sets its parent scope,
+		// so the threads can't share them), and what it found.
+		struct SlotScanContext
+		{
+			SlotScanContext() : rankCondStd(NULL), rankCondPrioPreempt(NULL),
+				PreemptionReq(NULL), PreemptionRank(NULL),
+				NegotiatorPreJobRank(NULL), NegotiatorPostJobRank(NULL) {}
+			~SlotScanContext();
+
+			classad::MatchClassAd match;
+			ExprTree *rankCondStd;
+			ExprTree *rankCondPrioPreempt;
+			ExprTree *PreemptionReq;
+			ExprTree *PreemptionRank;
+			ExprTree *NegotiatorPreJobRank;
+			ExprTree *NegotiatorPostJobRank;
+			std::vector<SlotScanResult> results;
+				// what a slot of each class came to, in this request's
+				// scan, if a slot of the class has been scanned
+			std::vector<SlotScanResult> class_results;
+			std::vector<bool> class_scanned;
+		};
+
+		void configureSlotScan();
+		void resetSlotClasses();
+		void scanSlotChunk(SlotScanContext &ctx, ClassAd &request,
+			const char *submitterName, const std::vector<ClassAd *> &slots,
+			const std::vector<int> *slot_classes, int num_classes,
+			size_t begin, size_t end, bool isIPv4, bool isIPv6,
+			bool allow_pslot_preemption, bool only_for_startdrank);
+		bool scanSlot(SlotScanContext &ctx, const char *submitterName,
+			ClassAd *candidate, bool only_for_startdrank, SlotScanResult &scanned);
+		static double EvalSlotScanRank(char const *expr_name, ExprTree *expr,
+			SlotScanContext &ctx);
+
+		SlotScanPool m_slotScanPool;
+		std::vector<SlotScanContext *> m_slotScanContexts;
+		SlotClasses m_slotClasses;
+		SlotIndex m_slotIndex;
+
         // set at startup/restart/reinit
         GroupEntry* hgq_root_group;
         vector<GroupEntry*> hgq_groups;
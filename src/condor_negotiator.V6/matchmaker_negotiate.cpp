@@ -32,6 +32,7 @@ ResourceRequestList::ResourceRequestList(int protocol_version)
 {
 	m_protocol_version = protocol_version;
 	m_clear_rejected_autoclusters = false;
+	m_no_more_requests = false;
 	m_use_resource_request_counts = param_boolean("USE_RESOURCE_REQUEST_COUNTS",true);
 	if ( protocol_version == 0 || m_use_resource_request_counts == false ) {
 		// Protocol version is 0, and schedd resource request lists were introduced
@@ -125,6 +126,10 @@ ResourceRequestList::getRequest(ClassAd &request, int &cluster, int &proc, int &
 				if ( m_send_end_negotiate ) {
 					return false;
 				}
+				// Likewise if retrieveMore() already got NO_MORE_JOBS.
+				if ( m_no_more_requests ) {
+					return false;
+				}
 				// No more requests stashed in our list, so go over the wire
 				// to the schedd and ask for more.
 				if ( m_clear_rejected_autoclusters ) {
@@ -233,6 +238,47 @@ ResourceRequestList::tryRetrieve(ReliSock *const sock)
 	return result;
 }
 
+bool
+ResourceRequestList::needsRequests(int skip_jobs)
+{
+	// A list only partly read would leave the schedd talking while we
+	// answer it, so always finish reading it first.
+	if ( m_requests_to_fetch > 0 ) {
+		return true;
+	}
+	if ( resource_request_count > resource_request_offers + skip_jobs ) {
+		return false;
+	}
+	// Throw out the requests getRequest() would skip anyway, so that
+	// it is not left to go back to the schedd for more.
+	while ( !m_ads.empty() ) {
+		int autocluster = -1;
+		m_ads.front()->LookupInteger(ATTR_AUTO_CLUSTER_ID, autocluster);
+		if ( m_rejected_auto_clusters.find(autocluster) ==
+				m_rejected_auto_clusters.end() )
+		{
+			return false;
+		}
+		delete m_ads.front();
+		m_ads.pop_front();
+	}
+	return !m_send_end_negotiate && !m_no_more_requests;
+}
+
+ResourceRequestList::TryStates
+ResourceRequestList::retrieveMore(ReliSock *const sock)
+{
+	if ( m_clear_rejected_autoclusters && !m_requests_to_fetch ) {
+		m_rejected_auto_clusters.clear();
+		m_clear_rejected_autoclusters = false;
+	}
+	TryStates result = fetchRequestsFromSchedd(sock, false);
+	if ( result == RRL_NO_MORE_JOBS && m_ads.empty() ) {
+		m_no_more_requests = true;
+	}
+	return result;
+}
+
 ResourceRequestList::TryStates
 ResourceRequestList::fetchRequestsFromSchedd(ReliSock* const sock, bool blocking)
 {
@@ -57,6 +57,12 @@ class ResourceRequestList {
 	};
 	TryStates tryRetrieve(ReliSock* const sock);
 
+		// For a negotiation that must not block: true if getRequest()
+		// would have to wait on the schedd for more requests, in which
+		// case retrieveMore() reads whatever has arrived so far.
+	bool needsRequests(int skipJobs = 1);
+	TryStates retrieveMore(ReliSock* const sock);
+
  private:
 
 	TryStates fetchRequestsFromSchedd(ReliSock* const sock, bool blocking);
@@ -66,6 +72,7 @@ class ResourceRequestList {
 	bool m_send_end_negotiate_now;
 	bool m_use_resource_request_counts;
 	bool m_clear_rejected_autoclusters;
+	bool m_no_more_requests;
 	int m_requests_to_fetch;
 	int m_num_to_fetch;
 	int errcode;
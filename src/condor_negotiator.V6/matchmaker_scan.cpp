@@ -0,0 +1,131 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+
+#include "matchmaker_scan.h"
+
+SlotScanPool::SlotScanPool()
+	: m_fn( NULL )
+	, m_chunks( 0 )
+	, m_pending( 0 )
+	, m_generation( 0 )
+	, m_stopping( false )
+{
+}
+
+SlotScanPool::~SlotScanPool()
+{
+	stop();
+}
+
+void
+SlotScanPool::setThreads( int threads )
+{
+	if ( threads < 1 ) {
+		threads = 1;
+	}
+	if ( threads == this->threads() ) {
+		return;
+	}
+
+	stop();
+	m_stopping = false;
+	for ( int chunk = 1; chunk < threads; chunk++ ) {
+		m_threads.push_back( std::thread( &SlotScanPool::worker, this, chunk, m_generation ) );
+	}
+	dprintf( D_ALWAYS, "Slot scan now uses %d threads\n", threads );
+}
+
+void
+SlotScanPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard( m_mutex );
+		m_stopping = true;
+	}
+	m_start.notify_all();
+	for ( size_t i = 0; i < m_threads.size(); i++ ) {
+		m_threads[i].join();
+	}
+	m_threads.clear();
+}
+
+void
+SlotScanPool::run( int chunks, const std::function<void(int)> &fn )
+{
+	ASSERT( chunks <= threads() );
+	if ( chunks <= 1 ) {
+		if ( chunks == 1 ) {
+			fn( 0 );
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard( m_mutex );
+		m_fn = &fn;
+		m_chunks = chunks;
+		m_pending = chunks - 1;
+		m_generation++;
+	}
+	m_start.notify_all();
+
+	fn( 0 );
+
+	std::unique_lock<std::mutex> lock( m_mutex );
+	while ( m_pending > 0 ) {
+		m_finished.wait( lock );
+	}
+	m_fn = NULL;
+}
+
+void
+SlotScanPool::worker( int chunk, unsigned seen )
+{
+	for (;;) {
+		const std::function<void(int)> *fn = NULL;
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			while ( !m_stopping && m_generation == seen ) {
+				m_start.wait( lock );
+			}
+			if ( m_stopping ) {
+				return;
+			}
+			seen = m_generation;
+			if ( chunk >= m_chunks ) {
+				continue;
+			}
+			fn = m_fn;
+		}
+
+		(*fn)( chunk );
+
+		bool last = false;
+		{
+			std::lock_guard<std::mutex> guard( m_mutex );
+			last = ( --m_pending == 0 );
+		}
+		if ( last ) {
+			m_finished.notify_one();
+		}
+	}
+}
@@ -0,0 +1,70 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _MATCHMAKER_SCAN_H
+#define _MATCHMAKER_SCAN_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A fixed set of threads that scan the slot ads for one resource request
+	at a time.  The caller splits the slots into chunks and hands run() a
+	function that scans one chunk; the calling thread scans chunk 0 itself
+	while the pool's threads scan the others, and run() returns once every
+	chunk is done.  Chunk n is always scanned with the same thread, so the
+	function may keep per-chunk state (a MatchClassAd, say) indexed by n.
+*/
+class SlotScanPool
+{
+  public:
+	SlotScanPool();
+	~SlotScanPool();
+
+		// Set the number of threads that scan, counting the caller.
+		// One (or less) means the caller scans every chunk alone.
+	void setThreads( int threads );
+	int threads() const { return (int)m_threads.size() + 1; }
+
+		// Call fn(0) .. fn(chunks-1), each on its own thread, and wait
+		// for them all.  chunks must not be more than threads().
+	void run( int chunks, const std::function<void(int)> &fn );
+
+  private:
+	void worker( int chunk, unsigned seen );
+	void stop();
+
+	std::mutex m_mutex;
+	std::condition_variable m_start;
+	std::condition_variable m_finished;
+	std::vector<std::thread> m_threads;
+	const std::function<void(int)> *m_fn;
+	int m_chunks;
+	int m_pending;
+	unsigned m_generation;
+	bool m_stopping;
+
+		// not implemented
+	SlotScanPool( const SlotScanPool & );
+	SlotScanPool &operator=( const SlotScanPool & );
+};
+
+#endif
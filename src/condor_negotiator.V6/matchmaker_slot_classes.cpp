@@ -0,0 +1,234 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_classad.h"
+#include "condor_attributes.h"
+
+#include "matchmaker_slot_classes.h"
+
+SlotClasses::SlotClasses()
+	: m_next_id( 0 )
+{
+}
+
+void
+SlotClasses::reset( const classad::References &policy_attrs )
+{
+	m_policy_attrs = policy_attrs;
+	m_base_classes.clear();
+	m_request_classes.clear();
+	m_ids.clear();
+	m_next_id = 0;
+}
+
+void
+SlotClasses::forget( const ClassAd *slot )
+{
+	m_base_classes.erase( slot );
+	std::map<std::string, ClassMap>::iterator it;
+	for ( it = m_request_classes.begin(); it != m_request_classes.end(); it++ ) {
+		it->second.erase( slot );
+	}
+}
+
+// Take the scope off a reference name from GetExternalReferences() or
+// GetInternalReferences(), leaving the name of the attribute it refers
+// to.  Returns false if it names a whole ad.
+static bool
+trimReference( const std::string &ref, std::string &attr )
+{
+	static const char * const scopes[] = {
+		"my.", "target.", "other.", ".left.", ".right.", "."
+	};
+	const char *name = ref.c_str();
+	for ( size_t i = 0; i < sizeof(scopes) / sizeof(scopes[0]); i++ ) {
+		size_t len = strlen( scopes[i] );
+		if ( strncasecmp( name, scopes[i], len ) == 0 ) {
+			name += len;
+			break;
+		}
+	}
+	attr.assign( name, strcspn( name, ".[" ) );
+	return !attr.empty() &&
+		strcasecmp( attr.c_str(), "my" ) && strcasecmp( attr.c_str(), "target" ) &&
+		strcasecmp( attr.c_str(), "other" ) && strcasecmp( attr.c_str(), "left" ) &&
+		strcasecmp( attr.c_str(), "right" );
+}
+
+bool
+SlotClasses::slotReferences( const ClassAd &slot, const classad::ExprTree *tree,
+                             classad::References &attrs )
+{
+	classad::References refs;
+	if ( !slot.GetExternalReferences( tree, refs, true ) ||
+		 !slot.GetInternalReferences( tree, refs, true ) )
+	{
+		return false;
+	}
+	std::string attr;
+	classad::References::const_iterator it;
+	for ( it = refs.begin(); it != refs.end(); it++ ) {
+		if ( !trimReference( *it, attr ) ) {
+			return false;
+		}
+		attrs.insert( attr );
+	}
+	return true;
+}
+
+bool
+SlotClasses::requestReferences( ClassAd &request, classad::References &attrs )
+{
+	const char * const exprs[] = { ATTR_REQUIREMENTS, ATTR_RANK };
+	classad::References refs;
+	for ( size_t i = 0; i < sizeof(exprs) / sizeof(exprs[0]); i++ ) {
+		classad::ExprTree *tree = request.Lookup( exprs[i] );
+		if ( tree && !request.GetExternalReferences( tree, refs, true ) ) {
+			return false;
+		}
+	}
+	std::string attr;
+	classad::References::const_iterator it;
+	for ( it = refs.begin(); it != refs.end(); it++ ) {
+		if ( !trimReference( *it, attr ) ) {
+			return false;
+		}
+		attrs.insert( attr );
+	}
+	return true;
+}
+
+// The values in a slot of the given attributes, and of every attribute
+// their expressions refer to in turn.  Two slots with the same signature
+// for a set of attributes evaluate every expression that refers only to
+// those attributes (and the other ad) the same way.
+bool
+SlotClasses::signature( const ClassAd &slot, const classad::References &attrs,
+                        std::string &sig ) const
+{
+	classad::References todo( attrs );
+	classad::References done;
+	while ( !todo.empty() ) {
+		std::string attr = *todo.begin();
+		todo.erase( todo.begin() );
+		if ( !done.insert( attr ).second ) {
+			continue;
+		}
+		classad::ExprTree *tree = slot.Lookup( attr );
+		if ( tree && tree->GetKind() != classad::ExprTree::LITERAL_NODE ) {
+			classad::References refs;
+			if ( !slotReferences( slot, tree, refs ) ) {
+				return false;
+			}
+			classad::References::const_iterator it;
+			for ( it = refs.begin(); it != refs.end(); it++ ) {
+				if ( done.find( *it ) == done.end() ) {
+					todo.insert( *it );
+				}
+			}
+		}
+	}
+
+	classad::ClassAdUnParser unparser;
+	unparser.SetOldClassAd( true, true );
+	sig.clear();
+	classad::References::const_iterator it;
+	for ( it = done.begin(); it != done.end(); it++ ) {
+		sig += *it;
+		classad::ExprTree *tree = slot.Lookup( *it );
+		if ( tree ) {
+			sig += '=';
+			unparser.Unparse( sig, tree );
+		} else {
+			sig += '!';
+		}
+		sig += '\n';
+	}
+	return true;
+}
+
+int
+SlotClasses::classOf( const std::string &sig )
+{
+	std::unordered_map<std::string, int>::iterator it = m_ids.find( sig );
+	if ( it != m_ids.end() ) {
+		return it->second;
+	}
+	m_ids[sig] = m_next_id;
+	return m_next_id++;
+}
+
+int
+SlotClasses::baseClass( const ClassAd *slot )
+{
+	ClassMap::iterator it = m_base_classes.find( slot );
+	if ( it != m_base_classes.end() ) {
+		return it->second;
+	}
+	std::string sig;
+	int id;
+	if ( signature( *slot, m_policy_attrs, sig ) ) {
+		id = classOf( "base\n" + sig );
+	} else {
+		id = m_next_id++;
+	}
+	m_base_classes[slot] = id;
+	return id;
+}
+
+int
+SlotClasses::classify( const std::vector<ClassAd *> &slots,
+                       const classad::References &request_attrs,
+                       std::vector<int> &classes )
+{
+	std::string key;
+	classad::References::const_iterator it;
+	for ( it = request_attrs.begin(); it != request_attrs.end(); it++ ) {
+		key += *it;
+		key += ',';
+	}
+	ClassMap &request_classes = m_request_classes[key];
+
+		// number the classes of these slots from 0
+	std::unordered_map<int, int> numbers;
+	classes.resize( slots.size() );
+	for ( size_t i = 0; i < slots.size(); i++ ) {
+		const ClassAd *slot = slots[i];
+		int id;
+		ClassMap::iterator found = request_classes.find( slot );
+		if ( found != request_classes.end() ) {
+			id = found->second;
+		} else {
+			std::string sig;
+			int base = baseClass( slot );
+			if ( signature( *slot, request_attrs, sig ) ) {
+				id = classOf( std::to_string( base ) + "\n" + sig );
+			} else {
+				id = m_next_id++;
+			}
+			request_classes[slot] = id;
+		}
+		std::pair<std::unordered_map<int, int>::iterator, bool> number =
+			numbers.insert( std::make_pair( id, (int)numbers.size() ) );
+		classes[i] = number.first->second;
+	}
+	return (int)numbers.size();
+}
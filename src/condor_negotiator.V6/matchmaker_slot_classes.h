@@ -0,0 +1,86 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _MATCHMAKER_SLOT_CLASSES_H
+#define _MATCHMAKER_SLOT_CLASSES_H
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Equivalence classes of slot ads ("machine autoclusters"): slots that
+	a request can't tell apart, because every slot attribute that its
+	Requirements and Rank, the slots' own Requirements and Rank, and the
+	negotiator's preemption policy refer to has the same value in each.
+	Whether a request matches a slot, and whether the slot may be
+	preempted for it, is then the same for every slot in its class.
+
+	The slot side is worked out once per negotiation cycle, the request
+	side once per distinct set of slot attributes that requests refer to,
+	which is the same for all the jobs of an autocluster and usually for
+	many autoclusters.  A slot whose references can't be found is in a
+	class of its own.
+*/
+class SlotClasses
+{
+  public:
+	SlotClasses();
+
+		// Start a new negotiation cycle.  policy_attrs are the slot
+		// attributes the negotiator's own expressions refer to.
+	void reset( const classad::References &policy_attrs );
+
+		// A slot has changed since it was put in a class.
+	void forget( const ClassAd *slot );
+
+		// The slot attributes a request's Requirements and Rank refer
+		// to.  Returns false if they can't be found, or if the request
+		// refers to the slot ad as a whole.
+	static bool requestReferences( ClassAd &request, classad::References &attrs );
+
+		// Put each of slots in a class for a request that refers to
+		// request_attrs; classes[i] is the class of slots[i].  Classes are
+		// numbered from 0; returns how many numbers there are.
+	int classify( const std::vector<ClassAd *> &slots,
+	              const classad::References &request_attrs,
+	              std::vector<int> &classes );
+
+		// The names of the attributes an expression in a slot ad refers
+		// to, in the slot or the request, with any MY., TARGET. and the
+		// like taken off.
+	static bool slotReferences( const ClassAd &slot, const classad::ExprTree *tree,
+	                            classad::References &attrs );
+
+  private:
+	typedef std::unordered_map<const ClassAd *, int> ClassMap;
+
+	bool signature( const ClassAd &slot, const classad::References &attrs,
+	                std::string &sig ) const;
+	int baseClass( const ClassAd *slot );
+	int classOf( const std::string &sig );
+
+	classad::References m_policy_attrs;
+	ClassMap m_base_classes;
+	std::map<std::string, ClassMap> m_request_classes;
+	std::unordered_map<std::string, int> m_ids;
+	int m_next_id;
+};
+
+#endif
@@ -0,0 +1,418 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_classad.h"
+#include "../classad_analysis/boolExpr.h"
+
+#include <algorithm>
+
+#include "matchmaker_slot_index.h"
+
+using classad::ExprTree;
+using classad::Operation;
+
+SlotIndex::SlotIndex()
+	: m_indexed( 0 )
+	, m_live( 0 )
+	, m_built( false )
+{
+}
+
+void
+SlotIndex::clear()
+{
+	m_slots.clear();
+	m_positions.clear();
+	m_indexed = 0;
+	m_live = 0;
+	m_changed.clear();
+	m_attrs.clear();
+	m_built = false;
+}
+
+void
+SlotIndex::build( ClassAdListDoesNotDeleteAds &startdAds )
+{
+	clear();
+	ClassAd *slot;
+	startdAds.Open();
+	while ( (slot = startdAds.Next()) ) {
+		m_positions[slot] = (int)m_slots.size();
+		m_slots.push_back( slot );
+	}
+	startdAds.Close();
+	m_indexed = m_live = m_slots.size();
+	m_built = true;
+}
+
+void
+SlotIndex::remove( const ClassAd *slot )
+{
+	std::unordered_map<const ClassAd *, int>::iterator it = m_positions.find( slot );
+	if ( it == m_positions.end() ) {
+		return;
+	}
+	m_slots[it->second] = NULL;
+	m_positions.erase( it );
+	m_live--;
+}
+
+void
+SlotIndex::moveToEnd( ClassAd *slot )
+{
+	if ( m_positions.find( slot ) == m_positions.end() ) {
+		return;
+	}
+	remove( slot );
+
+		// Past m_indexed, so it is a candidate for every request.
+	m_positions[slot] = (int)m_slots.size();
+	m_changed.push_back( (int)m_slots.size() );
+	m_slots.push_back( slot );
+	m_live++;
+}
+
+SlotIndex::AttrIndex &
+SlotIndex::attrIndex( const std::string &attr )
+{
+	std::map<std::string, AttrIndex, classad::CaseIgnLTStr>::iterator it =
+		m_attrs.find( attr );
+	if ( it != m_attrs.end() ) {
+		return it->second;
+	}
+
+	AttrIndex &index = m_attrs[attr];
+	index.num_strings = 0;
+	for ( size_t pos = 0; pos < m_indexed; pos++ ) {
+		ClassAd *slot = m_slots[pos];
+		if ( !slot ) {
+			continue;
+		}
+		const ExprTree *tree = slot->Lookup( attr );
+		if ( !tree ) {
+			index.missing.push_back( (int)pos );
+			continue;
+		}
+		tree = tree->self();
+		if ( tree->GetKind() != ExprTree::LITERAL_NODE ) {
+			index.exprs.push_back( (int)pos );
+			continue;
+		}
+
+		classad::Value val;
+		bool b;
+		double d;
+		std::string s;
+		((const classad::Literal *)tree)->GetValue( val );
+		if ( val.IsBooleanValue( b ) ) {
+				// comparisons promote booleans to integers
+			index.numbers.push_back( std::make_pair( b ? 1.0 : 0.0, (int)pos ) );
+		} else if ( val.IsNumber( d ) ) {
+			index.numbers.push_back( std::make_pair( d, (int)pos ) );
+		} else if ( val.IsStringValue( s ) ) {
+			lower_case( s );
+			index.strings[s].push_back( (int)pos );
+			index.num_strings++;
+		} else if ( val.IsUndefinedValue() || val.IsErrorValue() ) {
+				// no condition on it can be true
+		} else {
+			index.exprs.push_back( (int)pos );
+		}
+	}
+	std::sort( index.numbers.begin(), index.numbers.end() );
+	return index;
+}
+
+// Turn one conjunct of the residual Requirements into a Term, if it is a
+// simple condition on a slot attribute.
+bool
+SlotIndex::makeTerm( const ExprTree *conjunct, Term &term )
+{
+	const ExprTree *tree = conjunct->self();
+	Operation::OpKind op = Operation::__NO_OP__;
+	ExprTree *left = NULL, *right = NULL, *junk = NULL;
+	while ( tree->GetKind() == ExprTree::OP_NODE ) {
+		((const Operation *)tree)->GetComponents( op, left, right, junk );
+		if ( op != Operation::PARENTHESES_OP ) {
+			break;
+		}
+		tree = left->self();
+	}
+
+		// Find the attribute reference, and check that it is to the slot.
+	const ExprTree *ref = NULL;
+	switch ( tree->GetKind() ) {
+	case ExprTree::ATTRREF_NODE:
+		ref = tree;
+		break;
+	case ExprTree::OP_NODE:
+		if ( op != Operation::LESS_THAN_OP && op != Operation::LESS_OR_EQUAL_OP &&
+			 op != Operation::EQUAL_OP &&
+			 op != Operation::GREATER_OR_EQUAL_OP && op != Operation::GREATER_THAN_OP )
+		{
+			return false;
+		}
+		{
+			const ExprTree *lhs = left->self();
+			const ExprTree *rhs = right->self();
+			if ( lhs->GetKind() == ExprTree::ATTRREF_NODE &&
+				 rhs->GetKind() == ExprTree::LITERAL_NODE ) {
+				ref = lhs;
+			} else if ( lhs->GetKind() == ExprTree::LITERAL_NODE &&
+						rhs->GetKind() == ExprTree::ATTRREF_NODE ) {
+				ref = rhs;
+			}
+		}
+		if ( !ref ) {
+			return false;
+		}
+		break;
+	default:
+		return false;
+	}
+
+	ExprTree *base = NULL;
+	std::string name;
+	bool absolute = false;
+	((const classad::AttributeReference *)ref)->GetComponents( base, name, absolute );
+	if ( absolute ) {
+		return false;
+	}
+	term.scoped = false;
+	if ( base ) {
+		ExprTree *base_base = NULL;
+		const ExprTree *scope = base->self();
+		if ( scope->GetKind() != ExprTree::ATTRREF_NODE ) {
+			return false;
+		}
+		((const classad::AttributeReference *)scope)->GetComponents( base_base, name, absolute );
+		if ( base_base || absolute || strcasecmp( name.c_str(), "target" ) ) {
+			return false;
+		}
+		term.scoped = true;
+	}
+
+		// Let the analysis code take the condition apart.
+	Condition *condition = new Condition;
+	Condition::AttrPos pos = Condition::ATTR_POS_LEFT;
+	classad::Value val;
+	bool ok = BoolExpr::ExprToCondition( const_cast<ExprTree *>( tree ), condition ) &&
+		!condition->IsComplex() &&
+		condition->GetAttr( term.attr ) &&
+		condition->GetOp( term.op ) &&
+		condition->GetVal( val ) &&
+		condition->GetAttrPos( pos );
+	delete condition;
+	if ( !ok ) {
+		return false;
+	}
+
+	if ( ref == tree ) {
+			// just the attribute, which must be true
+		term.kind = Term::TRUTH;
+		return true;
+	}
+
+	bool b;
+	if ( val.IsBooleanValue( b ) ) {
+		term.kind = Term::NUMBER;
+		term.number = b ? 1.0 : 0.0;
+	} else if ( val.IsNumber( term.number ) ) {
+		term.kind = Term::NUMBER;
+	} else if ( term.op == Operation::EQUAL_OP && val.IsStringValue( term.string ) ) {
+			// == on strings ignores case
+		term.kind = Term::STRING;
+		lower_case( term.string );
+	} else {
+		return false;
+	}
+
+		// value op attr is attr op' value
+	if ( pos == Condition::ATTR_POS_RIGHT ) {
+		switch ( term.op ) {
+		case Operation::LESS_THAN_OP: term.op = Operation::GREATER_THAN_OP; break;
+		case Operation::LESS_OR_EQUAL_OP: term.op = Operation::GREATER_OR_EQUAL_OP; break;
+		case Operation::GREATER_OR_EQUAL_OP: term.op = Operation::LESS_OR_EQUAL_OP; break;
+		case Operation::GREATER_THAN_OP: term.op = Operation::LESS_THAN_OP; break;
+		default: break;
+		}
+	}
+	return true;
+}
+
+// How many indexed slots might satisfy a term; if slots isn't NULL, add
+// their positions to it.  A slot without the attribute never satisfies
+// TARGET.attr, but attr alone might then refer to something else.
+size_t
+SlotIndex::collect( const Term &term, std::vector<int> *slots )
+{
+	AttrIndex &index = attrIndex( term.attr );
+	typedef std::vector<std::pair<double, int> >::const_iterator NumIter;
+	std::vector<std::pair<NumIter, NumIter> > ranges;
+	size_t count = 0;
+
+	const std::pair<double, int> lo( term.number, INT_MIN );
+	const std::pair<double, int> hi( term.number, INT_MAX );
+	NumIter begin = index.numbers.begin();
+	NumIter end = index.numbers.end();
+	std::unordered_map<std::string, std::vector<int> >::const_iterator found;
+
+	switch ( term.kind ) {
+	case Term::TRUTH:
+			// anything but 0 or false, or a string, which it's simplest
+			// to leave to the match
+		ranges.push_back( std::make_pair( begin, std::lower_bound( begin, end, lo ) ) );
+		ranges.push_back( std::make_pair( std::upper_bound( begin, end, hi ), end ) );
+		count += index.num_strings;
+		if ( slots ) {
+			for ( found = index.strings.begin(); found != index.strings.end(); found++ ) {
+				slots->insert( slots->end(), found->second.begin(), found->second.end() );
+			}
+		}
+		break;
+	case Term::NUMBER:
+		switch ( term.op ) {
+		case Operation::LESS_THAN_OP:
+			ranges.push_back( std::make_pair( begin, std::lower_bound( begin, end, lo ) ) );
+			break;
+		case Operation::LESS_OR_EQUAL_OP:
+			ranges.push_back( std::make_pair( begin, std::upper_bound( begin, end, hi ) ) );
+			break;
+		case Operation::EQUAL_OP:
+			ranges.push_back( std::make_pair( std::lower_bound( begin, end, lo ),
+			                                  std::upper_bound( begin, end, hi ) ) );
+			break;
+		case Operation::GREATER_OR_EQUAL_OP:
+			ranges.push_back( std::make_pair( std::lower_bound( begin, end, lo ), end ) );
+			break;
+		case Operation::GREATER_THAN_OP:
+			ranges.push_back( std::make_pair( std::upper_bound( begin, end, hi ), end ) );
+			break;
+		default:
+			break;
+		}
+		break;
+	case Term::STRING:
+		found = index.strings.find( term.string );
+		if ( found != index.strings.end() ) {
+			count += found->second.size();
+			if ( slots ) {
+				slots->insert( slots->end(), found->second.begin(), found->second.end() );
+			}
+		}
+		break;
+	}
+
+	for ( size_t i = 0; i < ranges.size(); i++ ) {
+		count += ranges[i].second - ranges[i].first;
+		for ( NumIter it = ranges[i].first; slots && it != ranges[i].second; it++ ) {
+			slots->push_back( it->second );
+		}
+	}
+
+	count += index.exprs.size();
+	if ( slots ) {
+		slots->insert( slots->end(), index.exprs.begin(), index.exprs.end() );
+	}
+	if ( !term.scoped ) {
+		count += index.missing.size();
+		if ( slots ) {
+			slots->insert( slots->end(), index.missing.begin(), index.missing.end() );
+		}
+	}
+	return count;
+}
+
+// Split a conjunction into its conjuncts.
+static void
+conjuncts( const ExprTree *tree, std::vector<const ExprTree *> &result )
+{
+	tree = tree->self();
+	if ( tree->GetKind() == ExprTree::OP_NODE ) {
+		Operation::OpKind op;
+		ExprTree *left = NULL, *right = NULL, *junk = NULL;
+		((const Operation *)tree)->GetComponents( op, left, right, junk );
+		if ( op == Operation::PARENTHESES_OP ) {
+			conjuncts( left, result );
+			return;
+		}
+		if ( op == Operation::LOGICAL_AND_OP ) {
+			conjuncts( left, result );
+			conjuncts( right, result );
+			return;
+		}
+	}
+	result.push_back( tree );
+}
+
+bool
+SlotIndex::candidates( ClassAdListDoesNotDeleteAds &startdAds, ClassAd &request,
+                       std::vector<ClassAd *> &slots )
+{
+		// The negotiator tells us of each slot it takes out or moves; if
+		// the count is off anyway, start again rather than miss a slot.
+	if ( !m_built || m_live != (size_t)startdAds.Length() ) {
+		if ( m_built ) {
+			dprintf( D_FULLDEBUG, "Slot index is out of date; rebuilding it\n" );
+		}
+		build( startdAds );
+	}
+
+	m_match.BindLeftAdForMatchmaking( &request );
+	const ExprTree *residual = m_match.GetLeftResidual();
+	std::vector<const ExprTree *> terms;
+	if ( residual ) {
+		conjuncts( residual, terms );
+	}
+
+	Term best;
+	size_t best_count = m_indexed + 1;
+	for ( size_t i = 0; i < terms.size(); i++ ) {
+		Term term;
+		if ( !makeTerm( terms[i], term ) ) {
+			continue;
+		}
+		size_t count = collect( term, NULL );
+		if ( count < best_count ) {
+			best = term;
+			best_count = count;
+		}
+	}
+	m_match.BindLeftAd( NULL );
+	if ( best_count > m_indexed ) {
+		return false;
+	}
+
+	std::vector<int> positions;
+	positions.reserve( best_count + m_changed.size() );
+	collect( best, &positions );
+	positions.insert( positions.end(), m_changed.begin(), m_changed.end() );
+	std::sort( positions.begin(), positions.end() );
+
+	slots.clear();
+	for ( size_t i = 0; i < positions.size(); i++ ) {
+		ClassAd *slot = m_slots[positions[i]];
+		if ( slot ) {
+			slots.push_back( slot );
+		}
+	}
+	return true;
+}
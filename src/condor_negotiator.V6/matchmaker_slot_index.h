@@ -0,0 +1,114 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _MATCHMAKER_SLOT_INDEX_H
+#define _MATCHMAKER_SLOT_INDEX_H
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** Indexes over the slot ads of a negotiation cycle, for finding the
+	slots a request might match without evaluating its Requirements
+	against every one.  Most Requirements are a conjunction that includes
+	simple conditions on slot attributes, such as TARGET.OpSys == "LINUX"
+	or TARGET.Memory >= 8000; the classad_analysis code picks those
+	conditions out of what is left of the Requirements once the request's
+	own attributes are filled in.  Each slot attribute such a condition
+	names gets an index the first time it is needed in the cycle: a hash
+	of the (lower-cased) string values and a sorted array of the numeric
+	ones.  The candidates for a request are then the slots that satisfy
+	the condition with the fewest of them, plus any slot the index can't
+	say anything about (one whose value is an expression, say, or one
+	that has changed since the index was built).
+
+	The candidates are a superset of the slots that match, in the order of
+	the list of slots, so scanning them gives the same result as scanning
+	every slot.
+*/
+class SlotIndex
+{
+  public:
+	SlotIndex();
+
+		// Forget the slots of the last negotiation cycle.
+	void clear();
+
+		// The slots in startdAds, in order, that request might match, as
+		// far as the index can tell.  Returns false, leaving slots alone,
+		// if request's Requirements have no condition the index can use.
+	bool candidates( ClassAdListDoesNotDeleteAds &startdAds, ClassAd &request,
+	                 std::vector<ClassAd *> &slots );
+
+		// A slot has been taken out of the list of slots.
+	void remove( const ClassAd *slot );
+
+		// A slot may have been changed, and has been moved to the end of
+		// the list of slots.
+	void moveToEnd( ClassAd *slot );
+
+  private:
+		// The slots by the attribute's value in them; each is a list of
+		// slots' positions in m_slots.
+	struct AttrIndex
+	{
+		std::unordered_map<std::string, std::vector<int> > strings;
+		size_t num_strings;
+		std::vector<std::pair<double, int> > numbers;
+			// slots where the attribute is an expression, or a value
+			// that is neither a string nor a number
+		std::vector<int> exprs;
+			// slots that don't have the attribute
+		std::vector<int> missing;
+	};
+
+		// A condition on a slot attribute: attr op value, or just attr.
+	struct Term
+	{
+		enum Kind { TRUTH, NUMBER, STRING };
+		std::string attr;
+		bool scoped;	// TARGET.attr, rather than attr
+		Kind kind;
+		classad::Operation::OpKind op;
+		double number;
+		std::string string;
+	};
+
+	void build( ClassAdListDoesNotDeleteAds &startdAds );
+	AttrIndex &attrIndex( const std::string &attr );
+	static bool makeTerm( const classad::ExprTree *conjunct, Term &term );
+	size_t collect( const Term &term, std::vector<int> *slots );
+
+	std::vector<ClassAd *> m_slots;		// NULL once taken out
+	std::unordered_map<const ClassAd *, int> m_positions;
+	size_t m_indexed;	// slots [0, m_indexed) are in the indexes
+	size_t m_live;
+	std::vector<int> m_changed;
+	std::map<std::string, AttrIndex, classad::CaseIgnLTStr> m_attrs;
+	classad::MatchClassAd m_match;
+	bool m_built;
+
+		// not implemented
+	SlotIndex( const SlotIndex & );
+	SlotIndex &operator=( const SlotIndex & );
+};
+
+#endif
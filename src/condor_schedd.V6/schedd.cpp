@@ -2324,11 +2324,11 @@ QueryJobAdsContinuation::finish(Stream *stream) {
 				ClassAd iad;
 				cad->PopulateInfoAd(iad, 0, true);
 				retval = putClassAd(sock, iad,
-						PUT_CLASSAD_NON_BLOCKING | PUT_CLASSAD_NO_PRIVATE,
+						PUT_CLASSAD_NON_BLOCKING | PUT_CLASSAD_NO_PRIVATE | PUT_CLASSAD_NAME_DICTIONARY,
 						projection.empty() ? NULL : &projection);
 			} else {
 				retval = putClassAd(sock, *job,
-						PUT_CLASSAD_NON_BLOCKING | PUT_CLASSAD_NO_PRIVATE,
+						PUT_CLASSAD_NON_BLOCKING | PUT_CLASSAD_NO_PRIVATE | PUT_CLASSAD_NAME_DICTIONARY,
 						projection.empty() ? NULL : &projection);
 			}
 		}
@@ -2655,7 +2655,7 @@ QueryAggregatesContinuation::finish(Stream *stream) {
 			//dprintf(D_FULLDEBUG, "Writing autocluster %d,%d to wire\n", id, job_count);
 		}
 		int retval = putClassAd(sock, *curr_ad,
-					PUT_CLASSAD_NON_BLOCKING | PUT_CLASSAD_NO_PRIVATE,
+					PUT_CLASSAD_NON_BLOCKING | PUT_CLASSAD_NO_PRIVATE | PUT_CLASSAD_NAME_DICTIONARY,
 					proj.empty() ? NULL : &proj);
 		if (retval == 2) {
 			dprintf(D_FULLDEBUG, "QueryAggregatesContinuation: Detecting backlog.\n");
@@ -457,7 +457,7 @@ ScheddNegotiate::sendJobInfo(Sock *sock, bool just_sig_attrs)
 		}
 
 		// ship it!
-		putad_result = putClassAd(sock, m_current_job_ad, 0, &sig_attrs);
+		putad_result = putClassAd(sock, m_current_job_ad, PUT_CLASSAD_NAME_DICTIONARY, &sig_attrs);
 	} else {
 		// send the entire classad.  perhaps we are doing this because the
 		// ad does not have ATTR_AUTO_CLUSTER_ATTRS defined for some reason,
@@ -469,7 +469,7 @@ ScheddNegotiate::sendJobInfo(Sock *sock, bool just_sig_attrs)
 			dprintf(D_MATCH | D_VERBOSE, "resource request (all) for job %d.%d :\n%s\n", m_current_job_id.cluster, m_current_job_id.proc, tmp.c_str());
 		}
 
-		putad_result = putClassAd(sock, m_current_job_ad);
+		putad_result = putClassAd(sock, m_current_job_ad, PUT_CLASSAD_NAME_DICTIONARY);
 	}
 	if( !putad_result ) {
 		dprintf( D_ALWAYS,
@@ -46,6 +46,7 @@
 #include "classad_helpers.h" // for initStringListFromAttrs
 #include "history_utils.h"
 #include "backward_file_reader.h"
+#include "classad/exprArena.h"
 #include <fcntl.h>  // for O_BINARY
 
 void Usage(const char* name, int iExitCode=1);
@@ -149,6 +150,9 @@ static StringList projection;
 static classad::References whitelist;
 static ExprTree *sinceExpr = NULL;
 static bool want_startd_history = false;
+// the ads read from history files are parsed into this arena, so their
+// memory is reused for the next ads as they are discarded.
+static classad::ExprArena historyArena;
 
 int getInheritedSocks(Stream* socks[], size_t cMaxSocks, pid_t & ppid)
 {
@@ -1173,6 +1177,8 @@ static void readHistoryFromFileOld(const char *JobHistoryFileName, const char* c
 		exit(1);
 	}
 
+	classad::ExprArenaScope arena_scope(&historyArena);
+
 	// In case of rotated history files, check if we have already reached the number of 
 	// matches specified by the user before reading the next file
 	if ((specifiedMatch > 0 && matchCount >= specifiedMatch) || (maxAds > 0 && adCount >= maxAds)) {
@@ -1354,6 +1360,7 @@ static void printJobIfConstraint(std::vector<std::string> & exprs, const char* c
 	if ( ! exprs.size())
 		return;
 
+	classad::ExprArenaScope arena_scope(&historyArena);
 	ClassAd ad;
 	ad.rehash(521); // big enough to prevent regrowing hash table
 
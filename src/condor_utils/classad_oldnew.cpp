@@ -28,6 +28,8 @@
 using namespace std;
 
 #include "classad/classad_distribution.h"
+#include "classad/binaryCodec.h"
+#include "classad/exprArena.h"
 #include "classad_oldnew.h"
 #include "compat_classad.h"
 
@@ -45,8 +47,37 @@ void AttrList_setPublishServerTime(bool publish)
     publish_server_timeMangled = publish;
 }
 
+static bool binary_wire_format = false;
+void AttrList_setBinaryWireFormat(bool enable)
+{
+	binary_wire_format = enable;
+}
+
+static bool arena_allocation = false;
+void AttrList_setArenaAllocation(bool enable)
+{
+	arena_allocation = enable;
+}
+
+// A rough guess at the memory taken by the expression nodes of each
+// attribute of a received ad, used to size the first chunk of its arena.
+static const size_t ARENA_BYTES_PER_ATTR = 48;
+
 static const char *SECRET_MARKER = "ZKM"; // "it's a Zecret Klassad, Mon!"
 
+// Sent in place of the number of attributes of an ad to say that the ad
+// follows in the binary encoding of classad::ClassAdBinaryUnParser.
+// After it come the version of the encoding, the size and bytes of the
+// encoded attributes, then the number of attributes sent as encrypted
+// text and those attributes, each sent with put_secret().
+static const int BINARY_CLASSAD_MARKER = -0x4341;
+
+// The largest encoding of a binary ad we will accept, and the most of it
+// we read at a time, so the size the peer claims doesn't decide how much
+// we allocate before the bytes arrive.
+static const int MAX_BINARY_CLASSAD_SIZE = 64 * 1024 * 1024;
+static const int BINARY_CLASSAD_READ_SIZE = 64 * 1024;
+
 ClassAd *
 getClassAd( Stream *sock )
 {
@@ -63,67 +94,9 @@ getClassAd( Stream *sock )
 
 bool getClassAd( Stream *sock, classad::ClassAd& ad )
 {
-	int 					numExprs;
-	MyString				inputLine;
-
-	ad.Clear( );
-
-	sock->decode( );
-	if( !sock->code( numExprs ) ) {
-		dprintf(D_FULLDEBUG, "FAILED to get number of expressions.\n");
- 		return false;
-	}
-
-	// at least numExprs are coming, but we may add
-	// my, target, and a couple extra right away
-
-	ad.rehash(numExprs + 5);
-
-		// pack exprs into classad
-	for( int i = 0 ; i < numExprs ; i++ ) {
-		char const *strptr = NULL;
-		if( !sock->get_string_ptr( strptr ) || !strptr ) {
-			dprintf(D_FULLDEBUG, "FAILED to get expression string.\n");
-			return( false );
-		}
-
-		bool inserted = false;
-		if(strcmp(strptr,SECRET_MARKER) ==0 ){
-			char *secret_line = NULL;
-			if( !sock->get_secret(secret_line) ) {
-				dprintf(D_FULLDEBUG, "Failed to read encrypted ClassAd expression.\n");
-				break;
-			}
-			inserted = InsertLongFormAttrValue(ad, secret_line, true);
-			free( secret_line );
-		}
-		else {
-			inserted = InsertLongFormAttrValue(ad, strptr, true);
-		}
-
-		// inserts expression at a time
-		if ( ! inserted)
-		{
-			dprintf(D_FULLDEBUG, "FAILED to insert %s\n", strptr );
-			return false;
-		}
-		
-	}
-
-	// We fetch but ignore the special MyType and TargetType fields.
-	// These attributes, if defined, are included in the regular set
-	// of name/value pairs.
-	if (!sock->get(inputLine)) {
-		 dprintf(D_FULLDEBUG, "FAILED to get(inputLine)\n" );
-		return false;
-	}
-
-	if (!sock->get(inputLine)) {
-		 dprintf(D_FULLDEBUG, "FAILED to get(inputLine) 2\n" );
-		return false;
-	}
-
-	return true;
+	// the fast literal parsing is always safe, it produces the same
+	// values the parser would.
+	return getClassAdEx(sock, ad, GET_CLASSAD_FAST);
 }
 
 
@@ -222,11 +195,145 @@ static long long myatoll(const char *s, const char* &end) {
 }
 
 
+// Parse the right hand side of an attribute straight out of the socket
+// buffer into a Literal, when it is a simple boolean, number, string or
+// undefined value.  This is faster than letting the classad parser parse it,
+// and for the caller to skip the classad cache; literal nodes are the same
+// size as envelope nodes.  cbrhs is the size of rhs including the
+// terminating NUL.  Strings of max_string bytes or longer are left for
+// the cache.  Returns NULL if rhs isn't a simple literal, otherwise
+// sets kind to 1 for a boolean, 2 for a number and 3 for a string or undefined.
+//
+static classad::Literal * ParseWireLiteral(const char * rhs, size_t cbrhs, size_t max_string, int & kind)
+{
+	char ch = rhs[0];
+	if (cbrhs == 5 && (ch&~0x20) == 'T' && (rhs[1]&~0x20) == 'R' && (rhs[2]&~0x20) == 'U' && (rhs[3]&~0x20) == 'E') {
+		kind = 1;
+		return classad::Literal::MakeBool(true);
+	}
+	if (cbrhs == 6 && (ch&~0x20) == 'F' && (rhs[1]&~0x20) == 'A' && (rhs[2]&~0x20) == 'L' && (rhs[3]&~0x20) == 'S' && (rhs[4]&~0x20) == 'E') {
+		kind = 1;
+		return classad::Literal::MakeBool(false);
+	}
+	if (cbrhs == 10 && strcasecmp(rhs, "undefined") == 0) {
+		kind = 3;
+		return classad::Literal::MakeUndefined();
+	}
+	if (cbrhs < 30 && (ch == '-' || (ch >= '0' && ch <= '9'))) {
+		// a lone - is not a number
+		if (ch == '-' && ! (rhs[1] >= '0' && rhs[1] <= '9')) {
+			return NULL;
+		}
+		if (strchr(rhs, '.')) {
+			char *pe = NULL;
+			double d = strtod(rhs, &pe);
+			if (*pe == 0 || *pe == '\r' || *pe == '\n') {
+				kind = 2;
+				return classad::Literal::MakeReal(d);
+			}
+		} else if (cbrhs < 20) { // at most 18 digits, so that myatoll can't overflow
+			const char * pe = NULL;
+			long long ll = myatoll(rhs, pe);
+			if (*pe == 0 || *pe == '\r' || *pe == '\n') {
+				kind = 2;
+				return classad::Literal::MakeLong(ll);
+			}
+		}
+		return NULL;
+	}
+	if (cbrhs < max_string && ch == '"') {
+		size_t cch = IsSimpleString(rhs);
+		if (cch) {
+			kind = 3;
+			return classad::Literal::MakeString(rhs+1, cch-2);
+		}
+	}
+	return NULL;
+}
+
+
+// Binary ads are only sent to a peer that said during the security
+// handshake that it reads them, so one arriving on any other connection
+// is refused rather than decoded.
+static bool acceptBinaryClassAd( Stream *sock )
+{
+	if (sock->get_peer_classad_binary_version() < classad::BINARY_CLASSAD_VERSION) {
+		dprintf(D_ALWAYS, "getClassAd FAILED, peer sent a binary ClassAd it did not negotiate\n");
+		return false;
+	}
+	return true;
+}
+
+// Receives the rest of an ad sent in binary form by _putClassAdBinary(),
+// after the BINARY_CLASSAD_MARKER.
+static bool getClassAdBinary( Stream *sock, classad::ClassAd& ad, bool use_cache, bool cache_lazy )
+{
+	int version = 0;
+	int cb = 0;
+	if ( ! sock->code(version) || ! sock->code(cb) || cb < 0) {
+		dprintf(D_FULLDEBUG, "getClassAd FAILED to get binary ClassAd header\n");
+		return false;
+	}
+	if (version != classad::BINARY_CLASSAD_VERSION) {
+		dprintf(D_ALWAYS, "getClassAd FAILED, binary ClassAd version %d is not supported\n", version);
+		return false;
+	}
+
+	if (cb > MAX_BINARY_CLASSAD_SIZE) {
+		dprintf(D_ALWAYS, "getClassAd FAILED, binary ClassAd of %d bytes is too large\n", cb);
+		return false;
+	}
+
+	std::vector<char> encoded;
+	while ((int)encoded.size() < cb) {
+		int offset = (int)encoded.size();
+		int len = MIN(cb - offset, BINARY_CLASSAD_READ_SIZE);
+		encoded.resize(offset + len);
+		if (sock->get_bytes(encoded.data() + offset, len) != len) {
+			dprintf(D_FULLDEBUG, "getClassAd FAILED to get binary ClassAd\n");
+			return false;
+		}
+	}
+
+	// as in getClassAdEx(), the nodes of the ad come from an arena of their own.
+	// the encoding takes fewer bytes than the nodes, so guess twice its size.
+	classad::ExprArena arena(2 * (size_t)cb);
+	classad::ExprArenaScope arena_scope(arena_allocation ? &arena : classad::ExprArena::Current());
+	classad::ClassAdBinaryParser *parser = sock->get_classad_binary_parser();
+	const char *buf = encoded.data();
+	const char *end = buf + cb;
+	while (buf < end) {
+		if ( ! parser->ParseAttr(buf, end, ad, use_cache, cache_lazy)) {
+			dprintf(D_ALWAYS, "getClassAd FAILED to decode binary ClassAd at offset %d of %d\n",
+				(int)(buf - encoded.data()), cb);
+			return false;
+		}
+	}
+
+	int numSecrets = 0;
+	if ( ! sock->code(numSecrets)) {
+		dprintf(D_FULLDEBUG, "getClassAd FAILED to get number of secret attributes\n");
+		return false;
+	}
+	for (int ii = 0; ii < numSecrets; ++ii) {
+		const char *strptr = NULL;
+		if ( ! sock->get_secret(strptr, cb) || ! strptr) {
+			dprintf(D_FULLDEBUG, "getClassAd Failed to read encrypted ClassAd expression.\n");
+			return false;
+		}
+		if ( ! InsertLongFormAttrValue(ad, strptr, use_cache)) {
+			dprintf(D_ALWAYS, "getClassAd FAILED to insert secret %s\n", strptr);
+			return false;
+		}
+	}
+	return true;
+}
+
 bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options)
 {
 	int cb;
 	const char *strptr;
-	std::string attr;
+	std::string attr, rhs_buf;
 	bool use_cache = (options & GET_CLASSAD_NO_CACHE) == 0;
 	bool cache_lazy = (options & GET_CLASSAD_LAZY_PARSE) != 0;
 	bool fast_tricks = (options & GET_CLASSAD_FAST) != 0;
@@ -237,8 +344,7 @@ bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options)
 	double rt_last = rt.begin;
 #endif
 
-	classad::ClassAdParser parser;
-	parser.SetOldClassAd(true);
+	classad::ClassAdParser &parser = *sock->get_classad_parser();
 
 	if ( ! (options & GET_CLASSAD_NO_CLEAR)) {
 		ad.Clear( );
@@ -250,6 +356,18 @@ bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options)
 	if( !sock->code( numExprs ) ) {
 		return false;
 	}
+	if (numExprs == BINARY_CLASSAD_MARKER) {
+		if ( ! acceptBinaryClassAd(sock) ||
+			 ! getClassAdBinary(sock, ad, use_cache, cache_lazy)) {
+			return false;
+		}
+		numExprs = 0;
+	}
+
+	// the nodes of the ad come from an arena of their own, so deleting or replacing
+	// the ad frees them in a few large pieces rather than one at a time.
+	classad::ExprArena arena(numExprs * ARENA_BYTES_PER_ATTR);
+	classad::ExprArenaScope arena_scope(arena_allocation ? &arena : classad::ExprArena::Current());
 
 	// at least numExprs are coming, but we may add
 	// my, target, and a couple extra right away
@@ -292,43 +410,15 @@ bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options)
 		}
 
 		// Fast tricks pre-parses the right hand side when it is detected as a simple literal
-		// this is faster than letting the classad parser parse it (as of 8.7.0) and also
-		// uses less memory than letting the classad cache see it since literal nodes are the same
-		// size as envelope nodes.
-		//
 		bool inserted = false;
 		IF_PROFILE_GETCLASSAD(int subtype = 0);
 		size_t cbrhs = cb - (rhs - strptr);
 		if (fast_tricks) {
-			char ch = rhs[0];
-			if (cbrhs == 5 && (ch&~0x20) == 'T' && (rhs[1]&~0x20) == 'R' && (rhs[2]&~0x20) == 'U' && (rhs[3]&~0x20) == 'E') {
-				inserted = ad.InsertLiteral(attr, classad::Literal::MakeBool(true));
-				IF_PROFILE_GETCLASSAD(subtype = 1);
-			} else if (cbrhs == 6 && (ch&~0x20) == 'F' && (rhs[1]&~0x20) == 'A' && (rhs[2]&~0x20) == 'L' && (rhs[3]&~0x20) == 'S' && (rhs[4]&~0x20) == 'E') {
-				inserted = ad.InsertLiteral(attr, classad::Literal::MakeBool(false));
-				IF_PROFILE_GETCLASSAD(subtype = 1);
-			} else if (cbrhs < 30 && (ch == '-' || (ch >= '0' && ch <= '9'))) {
-				if (strchr(rhs, '.')) {
-					char *pe = NULL;
-					double d = strtod(rhs, &pe);
-					if (*pe == 0 || *pe == '\r' || *pe == '\n') {
-						inserted = ad.InsertLiteral(attr, classad::Literal::MakeReal(d));
-						IF_PROFILE_GETCLASSAD(subtype = 2);
-					}
-				} else {
-					const char * pe = NULL;
-					long long ll = myatoll(rhs, pe);
-					if (*pe == 0 || *pe == '\r' || *pe == '\n') {
-						inserted = ad.InsertLiteral(attr, classad::Literal::MakeLong(ll));
-						IF_PROFILE_GETCLASSAD(subtype = 2);
-					}
-				}
-			} else if (cbrhs < always_cache_string_size && ch == '"') { // 128 because we want long strings in the cache.
-				size_t cch = IsSimpleString(rhs);
-				if (cch) {
-					inserted = ad.InsertLiteral(attr, classad::Literal::MakeString(rhs+1, cch-2));
-					IF_PROFILE_GETCLASSAD(subtype = 3);
-				}
+			int kind = 0;
+			classad::Literal * lit = ParseWireLiteral(rhs, cbrhs, always_cache_string_size, kind);
+			if (lit) {
+				inserted = ad.InsertLiteral(attr, lit);
+				IF_PROFILE_GETCLASSAD(subtype = kind);
 			}
 		}
 
@@ -346,11 +436,13 @@ bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options)
 			// we can't cache nested classads or lists, so just parse and insert them
 			bool cache = use_cache && (*rhs != '[' && *rhs != '{');
 			if (cache) {
+				// the cache wants a std::string, reuse one buffer for all of the attributes
+				rhs_buf.assign(rhs);
 				if (cache_lazy) {
-					inserted = ad.InsertViaCache(attr, rhs, true);
+					inserted = ad.InsertViaCache(attr, rhs_buf, true);
 					IF_PROFILE_GETCLASSAD(getClassAdExCacheLazy_runtime.Add(rt.tick(rt_last)));
 				} else {
-					inserted = ad.InsertViaCache(attr, rhs, false);
+					inserted = ad.InsertViaCache(attr, rhs_buf, false);
 					IF_PROFILE_GETCLASSAD(getClassAdExCache_runtime.Add(rt.tick(rt_last)));
 				}
 			} else {
@@ -422,14 +514,12 @@ int getClassAdNonblocking( ReliSock *sock, classad::ClassAd& ad )
 bool
 getClassAdNoTypes( Stream *sock, classad::ClassAd& ad )
 {
-	classad::ClassAdParser	parser;
+	classad::ClassAdParser	&parser = *sock->get_classad_parser();
 	int 					numExprs = 0; // Initialization clears Coverity warning
 	string					buffer;
 	classad::ClassAd		*upd=NULL;
 	MyString				inputLine;
 
-	parser.SetOldClassAd( true );
-
 	ad.Clear( );
 
 	sock->decode( );
@@ -437,6 +527,27 @@ getClassAdNoTypes( Stream *sock, classad::ClassAd& ad )
  		return false;
 	}
 
+	if (numExprs == BINARY_CLASSAD_MARKER) {
+		if ( ! acceptBinaryClassAd(sock) ||
+			 ! getClassAdBinary(sock, ad, false, false)) {
+			return false;
+		}
+			// rename the concurrency limits, as below
+		const classad::ClassAd &cad = ad;
+		std::vector<std::string> limits;
+		for (classad::ClassAd::const_iterator itr = cad.begin(); itr != cad.end(); ++itr) {
+			if (strncmp(itr->first.c_str(), "ConcurrencyLimit.", 17) == 0) {
+				limits.push_back(itr->first);
+			}
+		}
+		for (std::vector<std::string>::iterator it = limits.begin(); it != limits.end(); ++it) {
+			ExprTree *tree = ad.Remove(*it);
+			(*it)[16] = '_';
+			ad.Insert(*it, tree);
+		}
+		return true;
+	}
+
 		// pack exprs into classad
 	buffer = "[";
 	for( int i = 0 ; i < numExprs ; i++ ) {
@@ -544,6 +655,27 @@ int putClassAd ( Stream *sock, const classad::ClassAd& ad )
 	return _putClassAd(sock, ad, options, nullptr);
 }
 
+// Add the attributes of the whitelist that the ad has to expanded, along
+// with the attributes of the ad that their expressions refer to.
+static void _expandWhitelist(const classad::ClassAd& ad, const classad::References &whitelist,
+	classad::References &expanded_whitelist)
+{
+	// Jaime made changes to the core classad lib that make this unneeded...
+	//ad.InsertAttr("MY","SELF");
+	for (classad::References::const_iterator attr = whitelist.begin(); attr != whitelist.end(); ++attr) {
+		ExprTree * tree = ad.Lookup(*attr);
+		if (tree) {
+			expanded_whitelist.insert(*attr); // the node exists, so add it to the final whitelist
+			if (tree->GetKind() != ExprTree::LITERAL_NODE) {
+				ad.GetInternalReferences(tree, expanded_whitelist, false);
+			}
+		}
+	}
+	//ad.Delete("MY");
+	//classad::References::iterator my = expanded_whitelist.find("MY");
+	//if (my != expanded_whitelist.end()) { expanded_whitelist.erase(my); }
+}
+
 int putClassAd (Stream *sock, const classad::ClassAd& ad, int options, const classad::References * whitelist /*=nullptr*/, const classad::References * encrypted_attrs /*=nullptr*/)
 {
 	int retval = 0;
@@ -551,20 +683,7 @@ int putClassAd (Stream *sock, const classad::ClassAd& ad, int options, const cla
 
 	bool expand_whitelist = ! (options & PUT_CLASSAD_NO_EXPAND_WHITELIST);
 	if (whitelist && expand_whitelist) {
-		// Jaime made changes to the core classad lib that make this unneeded...
-		//ad.InsertAttr("MY","SELF");
-		for (classad::References::const_iterator attr = whitelist->begin(); attr != whitelist->end(); ++attr) {
-			ExprTree * tree = ad.Lookup(*attr);
-			if (tree) {
-				expanded_whitelist.insert(*attr); // the node exists, so add it to the final whitelist
-				if (tree->GetKind() != ExprTree::LITERAL_NODE) {
-					ad.GetInternalReferences(tree, expanded_whitelist, false);
-				}
-			}
-		}
-		//ad.Delete("MY");
-		//classad::References::iterator my = expanded_whitelist.find("MY");
-		//if (my != expanded_whitelist.end()) { expanded_whitelist.erase(my); }
+		_expandWhitelist(ad, *whitelist, expanded_whitelist);
 		whitelist = &expanded_whitelist;
 	}
 
@@ -593,7 +712,66 @@ int putClassAd (Stream *sock, const classad::ClassAd& ad, int options, const cla
 }
 
 // helper function for _putClassAd
-static int _putClassAdTrailingInfo(Stream *sock, const classad::ClassAd& /* ad */, bool send_server_time, bool excludeTypes)
+// Returns the encoder to use to send an ad in binary form, or NULL if
+// the ad must be sent as text because the peer did not say during the
+// security handshake that it understands the binary encoding.  The encoder of the connection, which holds the names
+// sent so far, is used only when the caller allows it, otherwise the
+// given local one.
+static classad::ClassAdBinaryUnParser *_putClassAdBinaryUnParser(Stream *sock, int options,
+	classad::ClassAdBinaryUnParser &local_unp)
+{
+	if ( ! binary_wire_format) {
+		return NULL;
+	}
+	if (sock->get_peer_classad_binary_version() < classad::BINARY_CLASSAD_VERSION) {
+		return NULL;
+	}
+	if ((options & PUT_CLASSAD_NAME_DICTIONARY) && sock->type() == Stream::reli_sock) {
+		return sock->get_classad_binary_unparser();
+	}
+	return &local_unp;
+}
+
+// helper function for _putClassAd and putClassAdEncoded
+// Sends the attributes of an ad encoded in binary form, followed by the
+// attributes that must be sent encrypted, as text.
+static int _putClassAdBinaryBytes(Stream *sock, const std::string &encoded,
+	const std::vector<std::string> &secrets)
+{
+	int version = classad::BINARY_CLASSAD_VERSION;
+	int cb = (int)encoded.size();
+	int numSecrets = (int)secrets.size();
+	if ( ! sock->put(BINARY_CLASSAD_MARKER) || ! sock->code(version) || ! sock->code(cb)) {
+		return false;
+	}
+	if (cb && sock->put_bytes(encoded.data(), cb) != cb) {
+		return false;
+	}
+	if ( ! sock->code(numSecrets)) {
+		return false;
+	}
+	for (std::vector<std::string>::const_iterator it = secrets.begin(); it != secrets.end(); ++it) {
+		if ( ! sock->put_secret(it->c_str())) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// helper function for _putClassAd
+static int _putClassAdBinary(Stream *sock, classad::ClassAdBinaryUnParser *bin_unp,
+	std::string &encoded, const std::vector<std::string> &secrets, bool send_server_time)
+{
+	if (send_server_time) {
+		classad::Literal *now = classad::Literal::MakeLong((long long)time(NULL));
+		bin_unp->UnparseAttr(encoded, ATTR_SERVER_TIME, now);
+		delete now;
+	}
+	return _putClassAdBinaryBytes(sock, encoded, secrets);
+}
+
+// helper function for _putClassAd
+static int _putClassAdTrailingInfo(Stream *sock, bool send_server_time, bool excludeTypes)
 {
     if (send_server_time)
     {
@@ -640,8 +818,8 @@ int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options,
 
 	int numExprs=0;
 
-	classad::AttrList::const_iterator itor;
-	classad::AttrList::const_iterator itor_end;
+	classad::ClassAd::const_iterator itor;
+	classad::ClassAd::const_iterator itor_end;
 
 	bool haveChainedAd = false;
 
@@ -694,8 +872,13 @@ int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options,
 		send_server_time = true;
 	}
 
+	classad::ClassAdBinaryUnParser local_unp;
+	classad::ClassAdBinaryUnParser *bin_unp = _putClassAdBinaryUnParser(sock, options, local_unp);
+	std::string encoded;
+	std::vector<std::string> secrets;
+
 	sock->encode( );
-	if( !sock->code( numExprs ) ) {
+	if( !bin_unp && !sock->code( numExprs ) ) {
 		return false;
 	}
 
@@ -727,13 +910,23 @@ int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options,
 				continue;
 			}
 
+			bool secret = ! crypto_is_noop && private_count &&
+				(ClassAdAttributeIsPrivate(attr) ||
+				(encrypted_attrs && (encrypted_attrs->find(attr) != encrypted_attrs->end())));
+
+			if (bin_unp && ! secret) {
+				bin_unp->UnparseAttr(encoded, attr, expr);
+				continue;
+			}
+
 			buf = attr;
 			buf += " = ";
 			unp.Unparse( buf, expr );
 
-			if( ! crypto_is_noop && private_count &&
-				(ClassAdAttributeIsPrivate(attr) ||
-				(encrypted_attrs && (encrypted_attrs->find(attr) != encrypted_attrs->end()))) )
+			if (bin_unp) {
+				secrets.push_back(buf);
+			}
+			else if( secret )
 			{
 				sock->put(SECRET_MARKER);
 
@@ -745,7 +938,14 @@ int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options,
 		}
 	}
 
-	return _putClassAdTrailingInfo(sock, ad, send_server_time, excludeTypes);
+	if (bin_unp) {
+		if ( ! _putClassAdBinary(sock, bin_unp, encoded, secrets, send_server_time)) {
+			return false;
+		}
+		send_server_time = false;
+	}
+
+	return _putClassAdTrailingInfo(sock, send_server_time, excludeTypes);
 }
 
 int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options, const classad::References &whitelist, const classad::References *encrypted_attrs)
@@ -783,8 +983,13 @@ int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options, const cl
 	}
 
 
+	classad::ClassAdBinaryUnParser local_unp;
+	classad::ClassAdBinaryUnParser *bin_unp = _putClassAdBinaryUnParser(sock, options, local_unp);
+	std::string encoded;
+	std::vector<std::string> secrets;
+
 	sock->encode( );
-	if( !sock->code( numExprs ) ) {
+	if( !bin_unp && !sock->code( numExprs ) ) {
 		return false;
 	}
 
@@ -796,14 +1001,23 @@ int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options, const cl
 			continue;
 
 		classad::ExprTree const *expr = ad.Lookup(*attr);
+		bool secret = ! crypto_is_noop &&
+			(ClassAdAttributeIsPrivate(*attr) ||
+			(encrypted_attrs && (encrypted_attrs->find(*attr) != encrypted_attrs->end())));
+
+		if (bin_unp && ! secret) {
+			bin_unp->UnparseAttr(encoded, *attr, expr);
+			continue;
+		}
+
 		buf = *attr;
 		buf += " = ";
 		unp.Unparse( buf, expr );
 
-		if ( ! crypto_is_noop &&
-			(ClassAdAttributeIsPrivate(*attr) ||
-			(encrypted_attrs && (encrypted_attrs->find(*attr) != encrypted_attrs->end())))
-		) {
+		if (bin_unp) {
+			secrets.push_back(buf);
+		}
+		else if (secret) {
 			if (!sock->put(SECRET_MARKER)) {
 				return false;
 			}
@@ -816,5 +1030,67 @@ int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options, const cl
 		}
 	}
 
-	return _putClassAdTrailingInfo(sock, ad, send_server_time, excludeTypes);
+	if (bin_unp) {
+		if ( ! _putClassAdBinary(sock, bin_unp, encoded, secrets, send_server_time)) {
+			return false;
+		}
+		send_server_time = false;
+	}
+
+	return _putClassAdTrailingInfo(sock, send_server_time, excludeTypes);
+}
+
+void encodeClassAd(const classad::ClassAd& ad, std::string &encoded, const classad::References * whitelist /*=nullptr*/, int options /*=0*/)
+{
+	classad::ClassAdBinaryUnParser unp;
+
+	if (whitelist) {
+		classad::References expanded_whitelist;
+		if ( ! (options & PUT_CLASSAD_NO_EXPAND_WHITELIST)) {
+			_expandWhitelist(ad, *whitelist, expanded_whitelist);
+			whitelist = &expanded_whitelist;
+		}
+		for (classad::References::const_iterator attr = whitelist->begin(); attr != whitelist->end(); ++attr) {
+			classad::ExprTree const *expr = ad.Lookup(*attr);
+			if (expr && ! ClassAdAttributeIsPrivate(*attr)) {
+				unp.UnparseAttr(encoded, *attr, expr);
+			}
+		}
+		return;
+	}
+
+		// The chained attributes go first, so that the ad's own
+		// attributes replace them when they are decoded.
+	classad::ClassAd::const_iterator itor;
+	const classad::ClassAd *chainedAd = ad.GetChainedParentAd();
+	if (chainedAd) {
+		for (itor = chainedAd->begin(); itor != chainedAd->end(); itor++) {
+			if ( ! ClassAdAttributeIsPrivate(itor->first)) {
+				unp.UnparseAttr(encoded, itor->first, itor->second);
+			}
+		}
+	}
+	for (itor = ad.begin(); itor != ad.end(); itor++) {
+		if ( ! ClassAdAttributeIsPrivate(itor->first)) {
+			unp.UnparseAttr(encoded, itor->first, itor->second);
+		}
+	}
+}
+
+bool canPutClassAdEncoded(Stream *sock)
+{
+	classad::ClassAdBinaryUnParser local_unp;
+	return ! publish_server_timeMangled && _putClassAdBinaryUnParser(sock, 0, local_unp) != NULL;
+}
+
+int putClassAdEncoded(Stream *sock, const std::string &encoded, int options /*=0*/)
+{
+	bool excludeTypes = (options & PUT_CLASSAD_NO_TYPES) == PUT_CLASSAD_NO_TYPES;
+	std::vector<std::string> no_secrets;
+
+	sock->encode( );
+	if ( ! _putClassAdBinaryBytes(sock, encoded, no_secrets)) {
+		return false;
+	}
+	return _putClassAdTrailingInfo(sock, false, excludeTypes);
 }
@@ -32,6 +32,15 @@ class Stream;
 
 void AttrList_setPublishServerTime(bool publish);
 
+// Send ads in binary form to peers that understand it (the default), or
+// always as text.  See putClassAd().
+void AttrList_setBinaryWireFormat(bool enable);
+
+// Allocate the expression nodes of each ad received by getClassAd() and
+// getClassAdEx() from an arena owned by that ad (the default), or from the
+// heap.  See classad/exprArena.h.
+void AttrList_setArenaAllocation(bool enable);
+
 classad::ClassAd* getClassAd( Stream *sock );
 
 bool getClassAd( Stream *sock, classad::ClassAd& ad);
@@ -64,6 +73,8 @@ bool getClassAdNoTypes( Stream *sock, classad::ClassAd& ad );
 int putClassAd (Stream *sock, const classad::ClassAd& ad);
 
 /** Send the ClassAd on the CEDAR stream, this function has the functionality of all of the above
+ *  If the peer's version is known and it understands the binary encoding of classad::ClassAdBinaryUnParser,
+ *  the ad is sent in that form, otherwise as text; getClassAd() accepts either.
  * @param sock the stream
  * @param ad the ClassAd to be sent
  * @param whitelist list of attributes to send (default is to send all)
@@ -80,6 +91,33 @@ int putClassAd (Stream *sock, const classad::ClassAd& ad, int options,
 #define PUT_CLASSAD_NO_TYPES            0x02 // exclude MyType and TargetType from output.
 #define PUT_CLASSAD_NON_BLOCKING        0x04 // use non-blocking sematics. returns 2 of this would have blocked.
 #define PUT_CLASSAD_NO_EXPAND_WHITELIST 0x08 // use the whitelist argument as-is, (default is to expand internal references before using it)
+#define PUT_CLASSAD_NAME_DICTIONARY     0x10 // binary encoding may refer to attribute names sent earlier on this connection.
+                                             // only for connections whose peer reads every ad in this process, with getClassAd().
+
+/** Encode a ClassAd as putClassAd() sends it to a peer that understands the
+ *  binary encoding, but without private attributes and without referring
+ *  to a connection's name dictionary, so that the encoding can be kept and
+ *  sent any number of times, to any peer, with putClassAdEncoded().
+ * @param ad the ClassAd to be encoded
+ * @param encoded the encoding is appended to this
+ * @param whitelist list of attributes to encode (default is all of them)
+ * @param options PUT_CLASSAD_NO_EXPAND_WHITELIST, as for putClassAd()
+ */
+void encodeClassAd(const classad::ClassAd& ad, std::string &encoded,
+	const classad::References * whitelist = nullptr, int options = 0);
+
+/** Can an ad encoded by encodeClassAd() be sent on the stream?  If not,
+ *  the ad must be sent with putClassAd().
+ */
+bool canPutClassAdEncoded(Stream *sock);
+
+/** Send a ClassAd encoded by encodeClassAd() on the CEDAR stream.  The peer
+ *  gets the same as from putClassAd() with PUT_CLASSAD_NO_PRIVATE.
+ * @param sock the stream
+ * @param encoded the encoded ClassAd
+ * @param options PUT_CLASSAD_NO_TYPES, or 0
+ */
+int putClassAdEncoded(Stream *sock, const std::string &encoded, int options = 0);
 
 // fetch the given attribute from the queryAd and convert it into a set of attributes
 //   the attribute should be a string value containing a comma and/or space separated list of attributes (like StringList)
@@ -27,11 +27,14 @@
 #include "condor_config.h"
 #include "Regex.h"
 #include "classad/classadCache.h"
+#include "classad/evalProfile.h"
+#include "classad/stringListSet.h"
 #include "env.h"
 #include "condor_arglist.h"
 #define CLASSAD_USER_MAP_RETURNS_STRINGLIST 1
 
 #include <sstream>
+#include <memory>
 #include <unordered_set>
 
 class MapFile;
@@ -75,6 +78,11 @@ void ClassAdReconfig()
 	classad::SetOldClassAdSemantics( !ClassAd_strictEvaluation );
 
 	classad::ClassAdSetExpressionCaching( param_boolean( "ENABLE_CLASSAD_CACHING", false ) );
+	classad::ClassAdSetExpressionCompiling( param_boolean( "ENABLE_CLASSAD_COMPILATION", false ) );
+	AttrList_setBinaryWireFormat( param_boolean( "ENABLE_BINARY_CLASSAD_WIRE_FORMAT", false ) );
+	AttrList_setArenaAllocation( param_boolean( "ENABLE_CLASSAD_ARENA_ALLOCATION", false ) );
+	classad::EvalProfile::Enable( param_boolean( "CLASSAD_EVALUATION_PROFILE", false ),
+		param_integer( "CLASSAD_EVALUATION_PROFILE_SAMPLE_INTERVAL", 100, 1 ) );
 
 	char *new_libs = param( "CLASSAD_USER_LIBS" );
 	if ( new_libs ) {
@@ -194,8 +202,8 @@ bool stringListSize_func( const char * /*name*/,
 		return true;
 	}
 
-	StringList sl( list_str.c_str(), delim_str.c_str() );
-	result.SetIntegerValue( sl.number() );
+	classad::StringListSetPtr sl = classad::StringListSet::Find( list_str, delim_str, true );
+	result.SetIntegerValue( (long long)sl->Size() );
 
 	return true;
 }
@@ -344,14 +352,16 @@ bool stringListMember_func( const char *name,
 		return true;
 	}
 
-	StringList sl( list_str.c_str(), delim_str.c_str() );
-	int rc;
+	// Lists like a slot's software tags are tested over and over, so
+	// use the cached, already split form of the list.
+	classad::StringListSetPtr sl = classad::StringListSet::Find( list_str, delim_str, true );
+	bool rc;
 	if ( strcasecmp( name, "stringlistmember" ) == 0 ) {
-		rc = sl.contains( item_str.c_str() );
+		rc = sl->Contains( item_str );
 	} else {
-		rc = sl.contains_anycase( item_str.c_str() );
+		rc = sl->ContainsAnyCase( item_str );
 	}
-	result.SetBooleanValue( rc ? true : false );
+	result.SetBooleanValue( rc );
 
 	return true;
 }
@@ -386,6 +396,38 @@ static int regexp_str_to_options( const char *option_str )
 	return options;
 }
 
+// The patterns most recently compiled by stringListRegexpMember() in this
+// thread, indexed by a hash of the pattern.  Constraints use the same few
+// patterns over and over, against every ad.
+struct CompiledRegexp {
+	std::string pattern;
+	int options;
+	std::unique_ptr<Regex> re;
+};
+static const size_t NUM_COMPILED_REGEXPS = 16;
+static thread_local CompiledRegexp compiled_regexps[NUM_COMPILED_REGEXPS];
+
+static Regex *
+compile_regexp( const std::string &pattern, int options )
+{
+	CompiledRegexp &entry = compiled_regexps[
+		std::hash<std::string>()( pattern ) % NUM_COMPILED_REGEXPS];
+	if ( entry.re && entry.options == options && entry.pattern == pattern ) {
+		return entry.re.get();
+	}
+
+	std::unique_ptr<Regex> re( new Regex );
+	const char *errstr = 0;
+	int errpos = 0;
+	if ( !re->compile( pattern.c_str(), &errstr, &errpos, options ) ) {
+		return NULL;
+	}
+	entry.pattern = pattern;
+	entry.options = options;
+	entry.re = std::move( re );
+	return entry.re.get();
+}
+
 static
 bool stringListRegexpMember_func( const char * /*name*/,
 								  const classad::ArgumentList &arg_list,
@@ -429,15 +471,11 @@ bool stringListRegexpMember_func( const char * /*name*/,
 		return true;
 	}
 
-	Regex r;
-	const char *errstr = 0;
-	int errpos = 0;
-	bool valid;
 	int options = regexp_str_to_options(options_str.c_str());
 
 	/* can the pattern be compiled */
-	valid = r.compile(pattern_str.c_str(), &errstr, &errpos, options);
-	if (!valid) {
+	Regex *r = compile_regexp(pattern_str, options);
+	if (!r) {
 		result.SetErrorValue();
 		return true;
 	}
@@ -447,7 +485,7 @@ bool stringListRegexpMember_func( const char * /*name*/,
 	sl.rewind();
 	char *entry;
 	while( (entry = sl.next())) {
-		if (r.match(entry)) {
+		if (r->match(entry)) {
 			result.SetBooleanValue( true );
 		}
 	}
@@ -1187,7 +1225,7 @@ CondorClassAdFileParseHelper::~CondorClassAdFileParseHelper()
 			new_parser = NULL;
 		} break;
 		case Parse_json: {
-			classad::ClassAdJsonParser * parser = (classad::ClassAdJsonParser *)new_parser;
+			classad::ClassAdJsonReader * parser = (classad::ClassAdJsonReader *)new_parser;
 			delete parser;
 			new_parser = NULL;
 		} break;
@@ -1286,29 +1324,17 @@ int CondorClassAdFileParseHelper::NewParser(classad::ClassAd & ad, FILE* file, b
 		} break;
 
 		case Parse_json: {
-			classad::ClassAdJsonParser * parser = (classad::ClassAdJsonParser *)new_parser;
+			classad::ClassAdJsonReader * parser = (classad::ClassAdJsonReader *)new_parser;
 			if ( ! parser) {
-				parser = new classad::ClassAdJsonParser();
+				parser = new classad::ClassAdJsonReader();
 				new_parser = (void*)parser;
 			}
 			ASSERT(parser);
-			bool fok = parser->ParseClassAd(file, ad, false);
-			if ( ! fok) {
-				bool keep_going = false;
-				classad::Lexer::TokenType tt = parser->getLastTokenType();
-				if (inside_list) {
-					if (tt == classad::Lexer::LEX_COMMA) { keep_going = true; }
-					else if (tt == classad::Lexer::LEX_CLOSE_BOX) { keep_going = true; inside_list = false; }
-				} else {
-					if (tt == classad::Lexer::LEX_OPEN_BOX) { keep_going = true; inside_list = true; }
-				}
-				if (keep_going) {
-					fok = parser->ParseClassAd(file, ad, false); 
-				}
-			}
-			if (fok) {
+			// the reader steps over the [ , ] of the list itself
+			int rc = parser->NextClassAd(file, ad);
+			if (rc > 0) {
 				rval = ad.size();
-			} else if (feof(file)) {
+			} else if (rc == 0 || feof(file)) {
 				rval = -99;
 			} else {
 				rval = -1;
@@ -1911,13 +1937,23 @@ int EvalFloat (const char *name, classad::ClassAd *my, classad::ClassAd *target,
 	return result;
 }
 
+// Like ClassAd::EvaluateAttrBoolEquiv(), but using the compiled form
+// of the expression, since EvalBool() is typically used for policy
+// expressions that are evaluated over and over.
+static bool
+EvaluateAttrBoolEquivCompiled( classad::ClassAd *ad, const char *name, bool &value )
+{
+	classad::Value val;
+	return ad->EvaluateAttrCompiled( name, val ) && val.IsBooleanValueEquiv( value );
+}
+
 int
 EvalBool (const char *name, classad::ClassAd *my, classad::ClassAd *target, bool &value)
 {
 	int rc = 0;
 
 	if( target == my || target == NULL ) {
-		if( my->EvaluateAttrBoolEquiv( name, value ) ) {
+		if( EvaluateAttrBoolEquivCompiled( my, name, value ) ) {
 			rc = 1;
 		}
 		return rc;
@@ -1925,11 +1961,11 @@ EvalBool (const char *name, classad::ClassAd *my, classad::ClassAd *target, bool
 
 	getTheMatchAd( my, target );
 	if( my->Lookup( name ) ) {
-		if( my->EvaluateAttrBoolEquiv( name, value ) ) {
+		if( EvaluateAttrBoolEquivCompiled( my, name, value ) ) {
 			rc = 1;
 		}
 	} else if( target->Lookup( name ) ) {
-		if( target->EvaluateAttrBoolEquiv( name, value ) ) {
+		if( EvaluateAttrBoolEquivCompiled( target, name, value ) ) {
 			rc = 1;
 		}
 	}
@@ -2012,18 +2048,27 @@ dPrintAd( int level, const classad::ClassAd &ad, bool exclude_private )
 }
 
 
-int
-_sPrintAd( MyString &output, const classad::ClassAd &ad, bool exclude_private, StringList *attr_white_list )
+// Orders attributes by name, as _sPrintAd() prints them
+static bool
+attributeNameLess( const std::pair<const std::string *, const classad::ExprTree *> &a,
+				   const std::pair<const std::string *, const classad::ExprTree *> &b )
+{
+	return *a.first < *b.first;
+}
+
+static int
+_sPrintAd( std::string &output, const classad::ClassAd &ad, bool exclude_private, StringList *attr_white_list )
 {
 	classad::ClassAd::const_iterator itr;
 
 	classad::ClassAdUnParser unp;
 	unp.SetOldClassAd( true, true );
-	string value;
 
 	const classad::ClassAd *parent = ad.GetChainedParentAd();
 
-	std::map< std::string, std::string > attributes;
+		// The attributes are unparsed straight into the output once they
+		// are sorted, so only the names and expressions are collected.
+	std::vector< std::pair<const std::string *, const classad::ExprTree *> > attributes;
 	if ( parent ) {
 		for ( itr = parent->begin(); itr != parent->end(); itr++ ) {
 			if ( attr_white_list && !attr_white_list->contains_anycase(itr->first.c_str()) ) {
@@ -2034,10 +2079,7 @@ _sPrintAd( MyString &output, const classad::ClassAd &ad, bool exclude_private, S
 			}
 			if ( !exclude_private ||
 				 !ClassAdAttributeIsPrivate( itr->first ) ) {
-				value = "";
-				unp.Unparse( value, itr->second );
-				// output.formatstr_cat( "%s = %s\n", itr->first.c_str(), value.c_str() );
-				attributes[ itr->first ] = value;
+				attributes.emplace_back( &itr->first.str(), itr->second );
 			}
 		}
 	}
@@ -2048,20 +2090,16 @@ _sPrintAd( MyString &output, const classad::ClassAd &ad, bool exclude_private, S
 		}
 		if ( !exclude_private ||
 			 !ClassAdAttributeIsPrivate( itr->first ) ) {
-			value = "";
-			unp.Unparse( value, itr->second );
-			// output.formatstr_cat( "%s = %s\n", itr->first.c_str(), value.c_str() );
-			attributes[ itr->first ] = value;
+			attributes.emplace_back( &itr->first.str(), itr->second );
 		}
 	}
 
-	std::vector< std::string> keys;
+	std::sort( attributes.begin(), attributes.end(), attributeNameLess );
 	for( auto i = attributes.begin(); i != attributes.end(); ++i ) {
-		keys.push_back( i->first );
-	}
-	std::sort( keys.begin(), keys.end() );
-	for( auto i = keys.begin(); i != keys.end(); ++i ) {
-		output.formatstr_cat( "%s = %s\n", i->c_str(), attributes[ *i ].c_str() );
+		output += *i->first;
+		output += " = ";
+		unp.Unparse( output, i->second );
+		output += '\n';
 	}
 
 	return TRUE;
@@ -2069,31 +2107,31 @@ _sPrintAd( MyString &output, const classad::ClassAd &ad, bool exclude_private, S
 
 int
 sPrintAd( MyString &output, const classad::ClassAd &ad, StringList *attr_white_list ) {
-	return _sPrintAd( output, ad, true, attr_white_list );
+	std::string buffer;
+	int rc = _sPrintAd( buffer, ad, true, attr_white_list );
+	output += buffer;
+	return rc;
 }
 
 int
 sPrintAdWithSecrets( MyString &output, const classad::ClassAd &ad, StringList *attr_white_list ) {
-	return _sPrintAd( output, ad, false, attr_white_list );
+	std::string buffer;
+	int rc = _sPrintAd( buffer, ad, false, attr_white_list );
+	output += buffer;
+	return rc;
 }
 
 
 int
 sPrintAd( std::string &output, const classad::ClassAd &ad, StringList *attr_white_list )
 {
-	MyString myout;
-	int rc = sPrintAd( myout, ad, attr_white_list );
-	output += myout;
-	return rc;
+	return _sPrintAd( output, ad, true, attr_white_list );
 }
 
 int
 sPrintAdWithSecrets( std::string &output, const classad::ClassAd &ad, StringList *attr_white_list )
 {
-	MyString myout;
-	int rc = sPrintAdWithSecrets( myout, ad, attr_white_list );
-	output += myout;
-	return rc;
+	return _sPrintAd( output, ad, false, attr_white_list );
 }
 
 /** Get a sorted list of attributes that are in the given ad, and also match the given whitelist (if any)
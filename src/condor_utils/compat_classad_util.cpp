@@ -856,6 +856,12 @@ bool ParallelIsAMatch(ClassAd *ad1, std::vector<ClassAd*> &candidates, std::vect
 
 	iterations = ((candidates.size() - 1) / cpu_count) + 1;
 
+		// The threads evaluate the same ads' compiled expressions.
+	bool thread_safe = classad::ClassAdGetThreadSafeEvaluation();
+	if (cpu_count > 1) {
+		classad::ClassAdSetThreadSafeEvaluation(true);
+	}
+
 #ifdef _OPENMP
 	omp_set_num_threads(cpu_count);
 #endif
@@ -913,6 +919,8 @@ bool ParallelIsAMatch(ClassAd *ad1, std::vector<ClassAd*> &candidates, std::vect
 		}
 	}
 
+	classad::ClassAdSetThreadSafeEvaluation(thread_safe);
+
 	for(int index = 0; index < cpu_count; index++)
 	{
 		match_pool[index].RemoveLeftAd();